@@ -3,6 +3,8 @@ pofswitch_SOURCES += $(COMMON_FOLDER)/pof_basefunc.c \
 					 $(COMMON_FOLDER)/pof_byte_transfer.c \
 					 $(COMMON_FOLDER)/pof_command.c \
 					 $(COMMON_FOLDER)/pof_hmap.c \
+					 $(COMMON_FOLDER)/pof_hash.c \
+					 $(COMMON_FOLDER)/pof_rcu.c \
 					 $(COMMON_FOLDER)/pof_tree.c \
 					 $(COMMON_FOLDER)/pof_list.c \
 					 $(COMMON_FOLDER)/pof_memory.c \
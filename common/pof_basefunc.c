@@ -29,6 +29,7 @@
 #include "../include/pof_global.h"
 #include "../include/pof_local_resource.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_byte_transfer.h"
 #include <sys/time.h>
 #include <pthread.h>
 #include <string.h>
@@ -37,6 +38,17 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#define BF_SIMD
+#include <emmintrin.h>
+#endif
+
+/* Bit kernels shift 16 bytes at a time from so many bytes. */
+#define BF_SIMD_BYTES (32)
+/* Longest piece compared with the byte loops by pofbf_bit_bench. */
+#define BF_CHECK_BITS (512)
 
 /* Define pofbf_key to build queue using ftok function. */
 static key_t pofbf_key = 0;
@@ -343,6 +355,185 @@ uint32_t pofbf_timer_delete(uint32_t *timer_id_ptr){
     return POF_OK;
 }
 
+/* Load n (0 to 8) bytes into the high bytes of a word, the first byte
+ * highest. Never reads p[n] or beyond. Lengths which are not a power of
+ * two are read with two overlapped loads. */
+__attribute__((always_inline)) static inline uint64_t
+bfLoad(const uint8_t *p, uint32_t n)
+{
+    uint64_t w64;
+    uint32_t w32;
+    uint16_t w16;
+
+    if(n == 8){
+        memcpy(&w64, p, 8);
+        return POF_NTOH64(w64);
+    }
+    if(n >= 4){
+        memcpy(&w32, p, 4);
+        w64 = (uint64_t)POF_NTOHL(w32) << 32;
+        memcpy(&w32, p + n - 4, 4);
+        return w64 | (uint64_t)POF_NTOHL(w32) << (64 - 8 * n);
+    }
+    if(n >= 2){
+        memcpy(&w16, p, 2);
+        w64 = (uint64_t)POF_NTOHS(w16) << 48;
+        memcpy(&w16, p + n - 2, 2);
+        return w64 | (uint64_t)POF_NTOHS(w16) << (64 - 8 * n);
+    }
+    return n ? (uint64_t)p[0] << 56 : 0;
+}
+
+/* Store the n (0 to 8) high bytes of w, the highest first. */
+__attribute__((always_inline)) static inline void
+bfStore(uint8_t *p, uint64_t w, uint32_t n)
+{
+    uint32_t w32;
+    uint16_t w16;
+
+    if(n == 8){
+        w = POF_HTON64(w);
+        memcpy(p, &w, 8);
+    }else if(n >= 4){
+        w32 = (uint32_t)(w >> 32);
+        w32 = POF_HTONL(w32);
+        memcpy(p, &w32, 4);
+        w32 = (uint32_t)(w >> (64 - 8 * n));
+        w32 = POF_HTONL(w32);
+        memcpy(p + n - 4, &w32, 4);
+    }else if(n >= 2){
+        w16 = (uint16_t)(w >> 48);
+        w16 = POF_HTONS(w16);
+        memcpy(p, &w16, 2);
+        w16 = (uint16_t)(w >> (64 - 8 * n));
+        w16 = POF_HTONS(w16);
+        memcpy(p + n - 2, &w16, 2);
+    }else if(n){
+        p[0] = (uint8_t)(w >> 56);
+    }
+}
+
+#ifdef BF_SIMD
+/* Copy 16 result bytes at a time while 17 source bytes are left. Return
+ * the number of result bytes done. */
+static inline uint32_t
+bfCopySimd(const uint8_t *src, uint8_t *res, uint32_t shift, uint32_t srcBytes)
+{
+    const __m128i hiMask = _mm_set1_epi8((char)(0xff << shift));
+    const __m128i loMask = _mm_set1_epi8((char)(0xff >> (8 - shift)));
+    const __m128i left = _mm_cvtsi32_si128(shift);
+    const __m128i right = _mm_cvtsi32_si128(8 - shift);
+    __m128i a, b;
+    uint32_t i;
+
+    /* SSE2 has no byte shift. Shift the 16-bit lanes and mask off the
+     * bits crossing into the neighbour byte. */
+    for(i=0; i + 17 <= srcBytes; i += 16){
+        a = _mm_loadu_si128((const __m128i *)(src + i));
+        b = _mm_loadu_si128((const __m128i *)(src + i + 1));
+        a = _mm_and_si128(_mm_sll_epi16(a, left), hiMask);
+        b = _mm_and_si128(_mm_srl_epi16(b, right), loMask);
+        _mm_storeu_si128((__m128i *)(res + i), _mm_or_si128(a, b));
+    }
+    return i;
+}
+
+/* Write 16 bytes at a time while 16 value bytes are left. Return the
+ * number of value bytes done, which is at least one. */
+static inline uint32_t
+bfCoverSimd(uint8_t *dst, const uint8_t *value, uint32_t shift, uint32_t valBytes)
+{
+    const __m128i loMask = _mm_set1_epi8((char)(0xff >> shift));
+    const __m128i hiMask = _mm_set1_epi8((char)(0xff << (8 - shift)));
+    const __m128i right = _mm_cvtsi32_si128(shift);
+    const __m128i left = _mm_cvtsi32_si128(8 - shift);
+    __m128i a, b;
+    uint32_t i;
+
+    dst[0] = value[0] >> shift;
+    for(i=1; i + 16 <= valBytes; i += 16){
+        a = _mm_loadu_si128((const __m128i *)(value + i));
+        b = _mm_loadu_si128((const __m128i *)(value + i - 1));
+        a = _mm_and_si128(_mm_srl_epi16(a, right), loMask);
+        b = _mm_and_si128(_mm_sll_epi16(b, left), hiMask);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(a, b));
+    }
+    return i;
+}
+#endif // BF_SIMD
+
+/* pofbf_cover_bit of a piece over more than eight bytes of dst, which
+ * starts at the byte of the piece. Not inlined to keep the short path
+ * free of register saving. */
+__attribute__((noinline)) static void
+bfCoverLong(uint8_t *dst, const uint8_t *value, uint32_t shift, uint32_t len_b)
+{
+    uint32_t valBytes, dstBytes, i = 0;
+    uint8_t head, tail, tailKeep;
+    uint64_t w, carry = 0;
+
+    valBytes = POF_BITNUM_TO_BYTENUM_CEIL(len_b);
+    dstBytes = POF_BITNUM_TO_BYTENUM_CEIL(shift + len_b);
+
+    /* Keep the bits before and after the piece in the first and the last byte. */
+    tailKeep = (uint8_t)(0xff >> ((shift + len_b - 1) % 8 + 1));
+    head = dst[0] & (uint8_t)~(0xff >> shift);
+    tail = dst[dstBytes - 1] & tailKeep;
+
+    if(shift == 0){
+        memcpy(dst, value, valBytes);
+    }else{
+#ifdef BF_SIMD
+        if(valBytes >= BF_SIMD_BYTES){
+            i = bfCoverSimd(dst, value, shift, valBytes);
+            carry = (uint64_t)value[i - 1] << (64 - shift);
+        }
+#endif
+        /* Each word takes eight value bytes and the low bits of the one before. */
+        for(; i + 8 <= valBytes; i += 8){
+            w = bfLoad(value + i, 8);
+            bfStore(dst + i, w >> shift | carry, 8);
+            carry = w << (64 - shift);
+        }
+        w = bfLoad(value + i, valBytes - i);
+        bfStore(dst + i, w >> shift | carry, dstBytes - i);
+    }
+
+    dst[0] = head | (dst[0] & (uint8_t)(0xff >> shift));
+    dst[dstBytes - 1] = (dst[dstBytes - 1] & (uint8_t)~tailKeep) | tail;
+}
+
+/* pofbf_copy_bit of a piece over more than eight bytes of src, which
+ * starts at the byte of the piece. Not inlined as bfCoverLong. */
+__attribute__((noinline)) static void
+bfCopyLong(const uint8_t *src, uint8_t *res, uint32_t shift, uint32_t len_b)
+{
+    uint32_t srcBytes, resBytes, i = 0;
+    uint64_t w;
+
+    resBytes = POF_BITNUM_TO_BYTENUM_CEIL(len_b);
+    srcBytes = POF_BITNUM_TO_BYTENUM_CEIL(shift + len_b);
+
+    if(shift == 0){
+        memcpy(res, src, resBytes);
+    }else{
+#ifdef BF_SIMD
+        if(resBytes >= BF_SIMD_BYTES){
+            i = bfCopySimd(src, res, shift, srcBytes);
+        }
+#endif
+        /* Each word takes eight source bytes and the high bits of the next. */
+        for(; i + 9 <= srcBytes; i += 8){
+            w = bfLoad(src + i, 8) << shift | src[i + 8] >> (8 - shift);
+            bfStore(res + i, w, 8);
+        }
+        w = bfLoad(src + i, srcBytes - i) << shift;
+        bfStore(res + i, w, resBytes - i);
+    }
+
+    res[resBytes - 1] &= (uint8_t)(0xff << (resBytes * 8 - len_b));
+}
+
 /***********************************************************************
  * Cover the piece of data using the specified value.
  * Form:     uint32_t pofbf_cover_bit(uint8_t *data_ori, \
@@ -355,14 +546,150 @@ uint32_t pofbf_timer_delete(uint32_t *timer_id_ptr){
  * Discribe: This function covers the piece of data using the specified
  *           value. The value is not a number, but a data buffer. Caller
  *           should make sure that data_ori and value are not NULL.
+ *           Eight bytes are shifted at a time, sixteen with SSE2 for
+ *           long spans, and byte aligned positions are copied directly.
+ *           The value bits after len_b are neither read past their byte
+ *           nor written.
  ***********************************************************************/
 void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, uint16_t len_b){
+    uint32_t shift, dstBytes;
+    uint64_t w, mask;
+    uint8_t *dst;
+
+    if(len_b == 0){
+        return;
+    }
+
+    dst = data_ori + pos_b / 8;
+    shift = pos_b % 8;
+    dstBytes = POF_BITNUM_TO_BYTENUM_CEIL(shift + len_b);
+    if(dstBytes > 8){
+        bfCoverLong(dst, value, shift, len_b);
+        return;
+    }
+
+    /* One word read, merged and written back. */
+    mask = (~0ULL >> (64 - len_b)) << (64 - shift - len_b);
+    w = bfLoad(dst, dstBytes);
+    w = (w & ~mask) | (bfLoad(value, POF_BITNUM_TO_BYTENUM_CEIL(len_b)) >> shift & mask);
+    bfStore(dst, w, dstBytes);
+    return;
+}
+
+/***********************************************************************
+ * Copy the piece of original data to the result data buffer.
+ * Form:     uint32_t pofbf_copy_bit(uint8_t *data_ori, \
+ *                                   uint8_t *data_res, \
+ *                                   uint16_t offset_b, \
+ *                                   uint16_t len_b)
+ * Input:    original data, offset(bit unit), length(bit unit)
+ * Output:   result data
+ * Return:   POF_OK or Error code
+ * Discribe: This function copies the piece of original data to the result
+ *           data buffer. The bits after len_b in the last result byte are
+ *           zero. No byte after the piece of original data is read.
+ ***********************************************************************/
+void pofbf_copy_bit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b){
+    uint32_t shift, srcBytes;
+    const uint8_t *src;
+    uint64_t w;
+
+	if(NULL==data_ori || NULL==data_res || len_b==0){
+		return;
+	}
+
+    src = data_ori + offset_b / 8;
+    shift = offset_b % 8;
+    srcBytes = POF_BITNUM_TO_BYTENUM_CEIL(shift + len_b);
+    if(srcBytes > 8){
+        bfCopyLong(src, data_res, shift, len_b);
+        return;
+    }
+
+    /* One word read, cut and written. */
+    w = bfLoad(src, srcBytes) << shift >> (64 - len_b) << (64 - len_b);
+    bfStore(data_res, w, POF_BITNUM_TO_BYTENUM_CEIL(len_b));
+    return;
+}
+
+/***********************************************************************
+ * Get a field of at most 64 bits as a number.
+ * Form:     uint64_t pofbf_extract_bits(const uint8_t *data, \
+ *                                       uint16_t offset_b, \
+ *                                       uint16_t len_b)
+ * Input:    data, offset(bit unit), length(bit unit)
+ * Output:   NONE
+ * Return:   the field in host order, or 0 if len_b is 0 or above 64
+ * Discribe: This function reads the field with one or two loads instead
+ *           of copying it to a buffer and transforming the byte order.
+ ***********************************************************************/
+uint64_t
+pofbf_extract_bits(const uint8_t *data, uint16_t offset_b, uint16_t len_b)
+{
+    const uint8_t *src = data + offset_b / 8;
+    uint32_t shift = offset_b % 8, srcBytes;
+    uint64_t w;
+
+    if(len_b == 0 || len_b > 64){
+        return 0;
+    }
+
+    srcBytes = POF_BITNUM_TO_BYTENUM_CEIL(shift + len_b);
+    if(srcBytes <= 8){
+        w = bfLoad(src, srcBytes) << shift;
+    }else{
+        w = bfLoad(src, 8) << shift | src[8] >> (8 - shift);
+    }
+    return w >> (64 - len_b);
+}
+
+/***********************************************************************
+ * Write a number to a field of at most 64 bits.
+ * Form:     void pofbf_insert_bits(uint8_t *data, uint64_t value, \
+ *                                  uint16_t offset_b, uint16_t len_b)
+ * Input:    data, value in host order, offset(bit unit), length(bit unit)
+ * Output:   data
+ * Return:   NONE
+ * Discribe: This function is the reverse of pofbf_extract_bits. The bits
+ *           of value above len_b are ignored.
+ ***********************************************************************/
+void
+pofbf_insert_bits(uint8_t *data, uint64_t value, uint16_t offset_b, uint16_t len_b)
+{
+    uint8_t *dst = data + offset_b / 8;
+    uint32_t shift = offset_b % 8, dstBytes;
+    uint64_t w, mask;
+
+    if(len_b == 0 || len_b > 64){
+        return;
+    }
+
+    dstBytes = POF_BITNUM_TO_BYTENUM_CEIL(shift + len_b);
+    if(dstBytes > 8){
+        w = value << (64 - len_b);
+        w = POF_HTON64(w);
+        pofbf_cover_bit(data, (uint8_t *)&w, offset_b, len_b);
+        return;
+    }
+
+    mask = (~0ULL >> (64 - len_b)) << (64 - shift - len_b);
+    w = bfLoad(dst, dstBytes);
+    w = (w & ~mask) | (value << (64 - shift - len_b) & mask);
+    bfStore(dst, w, dstBytes);
+}
+
+/* The byte loops which pofbf_cover_bit and pofbf_copy_bit used before,
+ * kept as the reference of pofbf_bit_bench. They read one byte after
+ * the piece, and the cover loop also writes the value bits after len_b
+ * over the last byte, so it is compared with values whose bits after
+ * len_b are zero. */
+static void
+bfCoverBitRef(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, uint16_t len_b){
     uint32_t process_len_b = 0;
-    uint16_t pos_b_x, len_B, after_len_b_x;
+    uint16_t pos_b_x, after_len_b_x;
     uint8_t *ptr;
 
     pos_b_x = pos_b % 8;
-    len_B = (uint16_t)((len_b - 1) / 8 + 1);
     after_len_b_x = (len_b + pos_b - 1) % 8 + 1;
     ptr = data_ori + (uint16_t)(pos_b / 8);
 
@@ -377,7 +704,7 @@ void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, ui
         | POF_MOVE_BIT_RIGHT(*value, pos_b_x);
 
     process_len_b = 8 - pos_b_x;
-    while(process_len_b < (len_b-8)){
+    while(process_len_b + 8 < len_b){
         *(++ptr) = POF_MOVE_BIT_LEFT(*value, 8-pos_b_x) | POF_MOVE_BIT_RIGHT(*(++value), pos_b_x);
         process_len_b += 8;
     }
@@ -385,34 +712,15 @@ void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, ui
     *(ptr+1) = (POF_MOVE_BIT_LEFT(*value, 8-pos_b_x) | POF_MOVE_BIT_RIGHT(*(++value), pos_b_x) \
         & POF_MOVE_BIT_LEFT(0xff, 8 - (len_b - process_len_b))) \
         | (*(ptr+1) & POF_MOVE_BIT_RIGHT(0xff, len_b - process_len_b));
-
-    return;
 }
 
-/***********************************************************************
- * Copy the piece of original data to the result data buffer.
- * Form:     uint32_t pofbf_copy_bit(uint8_t *data_ori, \
- *                                   uint8_t *data_res, \
- *                                   uint16_t offset_b, \
- *                                   uint16_t len_b)
- * Input:    original data, offset(bit unit), length(bit unit)
- * Output:   result data
- * Return:   POF_OK or Error code
- * Discribe: This function copies the piece of original data to the result
- *           data buffer.
- ***********************************************************************/
-void pofbf_copy_bit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b){
+static void
+bfCopyBitRef(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b){
     uint32_t process_len_b = 0, offset_b_x;
-    uint16_t offset_B;
-    uint8_t  *ptr;
+    const uint8_t *ptr;
 
-	if(NULL==data_ori || NULL==data_res){
-		return;
-	}
-
-    offset_B = (uint16_t)(offset_b / 8);
     offset_b_x = offset_b % 8;
-    ptr = (uint8_t *)(data_ori + offset_B);
+    ptr = data_ori + offset_b / 8;
 
     while(process_len_b < len_b){
         *(data_res++) = POF_MOVE_BIT_LEFT(*ptr, offset_b_x) \
@@ -422,8 +730,123 @@ void pofbf_copy_bit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_
 
     data_res--;
     *data_res = *data_res & POF_MOVE_BIT_LEFT(0xff, process_len_b - len_b);
+}
 
-    return;
+/* Field read and write through a buffer, as the datapath did before
+ * pofbf_extract_bits and pofbf_insert_bits. */
+static uint64_t
+bfExtractRef(const uint8_t *data, uint16_t offset_b, uint16_t len_b)
+{
+    uint64_t w = 0;
+
+    bfCopyBitRef(data, (uint8_t *)&w, offset_b, len_b);
+    POF_NTOH64_FUNC(w);
+    return w >> (64 - len_b);
+}
+
+static void
+bfInsertRef(uint8_t *data, uint64_t value, uint16_t offset_b, uint16_t len_b)
+{
+    uint64_t w[2] = {0, 0};
+
+    w[0] = value << (64 - len_b);
+    POF_HTON64_FUNC(w[0]);
+    bfCoverBitRef(data, (uint8_t *)w, offset_b, len_b);
+}
+
+static uint64_t
+bfNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/***********************************************************************
+ * Check the bit kernels against the byte loops and time both
+ * Form:     uint32_t pofbf_bit_bench(uint16_t len_b, uint32_t rounds, \
+ *                                    struct pofBitBench *result)
+ * Input:    field length(bit unit) to time, rounds to time
+ * Output:   result
+ * Return:   POF_OK or Error code
+ * Discribe: Every offset below 64 and every length up to BF_CHECK_BITS
+ *           is compared with the reference on random data, 1 to 64 bits
+ *           for the number interfaces. Then each kernel is timed rounds
+ *           times at the eight bit offsets with len_b bits.
+ ***********************************************************************/
+uint32_t
+pofbf_bit_bench(uint16_t len_b, uint32_t rounds, struct pofBitBench *result)
+{
+    uint32_t bufBytes = POF_BITNUM_TO_BYTENUM_CEIL(POF_MAX(len_b, BF_CHECK_BITS) + 64) + 16;
+    uint8_t *src, *dst, *ref, *val;
+    volatile uint64_t sink = 0;
+    uint64_t start, value;
+    uint32_t i, r, off, len;
+
+    memset(result, 0, sizeof *result);
+    if(len_b == 0 || rounds == 0){
+        return POF_ERROR;
+    }
+    POF_MALLOC_SAFE_RETURN(src, bufBytes * 4, POF_ERROR);
+    dst = src + bufBytes;
+    ref = dst + bufBytes;
+    val = ref + bufBytes;
+    srand(1);
+    for(i=0; i<bufBytes; i++){
+        src[i] = (uint8_t)rand();
+    }
+
+    for(off=0; off<64; off++){
+        for(len=1; len<=BF_CHECK_BITS; len++){
+            memset(dst, 0x5a, bufBytes);
+            memset(ref, 0x5a, bufBytes);
+            pofbf_copy_bit(src, dst, off, len);
+            bfCopyBitRef(src, ref, off, len);
+            result->mismatch += (memcmp(dst, ref, bufBytes) != 0);
+
+            memset(val, 0, bufBytes);
+            pofbf_copy_bit(src + bufBytes / 2, val, off, len);
+            memcpy(dst, src, bufBytes);
+            memcpy(ref, src, bufBytes);
+            pofbf_cover_bit(dst, val, off, len);
+            bfCoverBitRef(ref, val, off, len);
+            result->mismatch += (memcmp(dst, ref, bufBytes) != 0);
+            result->checked += 2;
+
+            if(len > 64){
+                continue;
+            }
+            value = pofbf_extract_bits(src, off, len);
+            result->mismatch += (value != bfExtractRef(src, off, len));
+            pofbf_insert_bits(dst, ~value, off, len);
+            bfInsertRef(ref, ~value, off, len);
+            result->mismatch += (memcmp(dst, ref, bufBytes) != 0);
+            result->checked += 2;
+        }
+    }
+
+#define BF_TIME(ns, call)                           \
+    start = bfNow();                                \
+    for(r=0; r<rounds; r++){                        \
+        for(off=0; off<8; off++){                   \
+            call;                                   \
+            sink += dst[0];                         \
+        }                                           \
+    }                                               \
+    ns = bfNow() - start
+
+    BF_TIME(result->copyRefNs, bfCopyBitRef(src, dst, off, len_b));
+    BF_TIME(result->copyNs, pofbf_copy_bit(src, dst, off, len_b));
+    BF_TIME(result->coverRefNs, bfCoverBitRef(dst, src, off, len_b));
+    BF_TIME(result->coverNs, pofbf_cover_bit(dst, src, off, len_b));
+    if(len_b <= 64){
+        BF_TIME(result->extractRefNs, sink += bfExtractRef(src, off, len_b));
+        BF_TIME(result->extractNs, sink += pofbf_extract_bits(src, off, len_b));
+    }
+#undef BF_TIME
+
+    FREE(src);
+    return POF_OK;
 }
 
 void
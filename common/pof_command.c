@@ -29,6 +29,7 @@
 #include "../include/pof_command.h"
 #include "../include/pof_datapath.h"
 #include "../include/pof_hmap.h"
+#include "../include/pof_hash.h"
 #include "../include/pof_memory.h"
 #include <string.h>
 #include <stdio.h>
@@ -195,6 +196,192 @@ usr_cmd_test(CMD_ARG)
     return;
 }
 
+/* lpm_bench <prefix number>,<key length>,<lookup number> */
+static void
+usr_cmd_lpm_bench(CMD_ARG)
+{
+    static const char *engineStr[POFLR_LPM_ENGINE_NUM] = {"tree", "stride", "patricia"};
+    char *arg_[3] = {NULL, NULL, NULL};
+    uint32_t num, keyLen, lookupNum, mismatch, i;
+    uint64_t ns[POFLR_LPM_ENGINE_NUM] = {0};
+
+    pofbf_split_str(arg, ",", arg_, 3);
+    num = arg_[0] ? atoi(arg_[0]) : 10000;
+    keyLen = arg_[1] ? atoi(arg_[1]) : 32;
+    lookupNum = arg_[2] ? atoi(arg_[2]) : 1000000;
+	POF_COMMAND_PRINT_HEAD("lpm_bench %u,%u,%u", num, keyLen, lookupNum);
+    if(lookupNum == 0 || poflr_lpm_bench(num, keyLen, lookupNum, ns, &mismatch) != POF_OK){
+        POF_COMMAND_PRINT(1,RED,"LPM bench failed. Eg. lpm_bench 10000,32,1000000\n");
+        return;
+    }
+    for(i=0; i<POFLR_LPM_ENGINE_NUM; i++){
+        POF_COMMAND_PRINT(1,CYAN,"%-9s", engineStr[i]);
+        if(ns[i] == 0){
+            POF_COMMAND_PRINT(1,WHITE,"skipped\n");
+            continue;
+        }
+        POF_COMMAND_PRINT(1,WHITE,"%.1f ns/lookup\n", (double)ns[i] / lookupNum);
+    }
+    POF_COMMAND_PRINT(1,CYAN,"mismatch ");
+    POF_COMMAND_PRINT(1,WHITE,"%u\n", mismatch);
+}
+
+static void
+cmdPrintHashBench(const uint8_t *keys, uint32_t num, uint32_t keyBytes, uint32_t rounds)
+{
+    struct pofHashBench result[POF_HASH_FUNC_NUM];
+    uint32_t f;
+
+    if(pof_hash_bench(keys, num, keyBytes, rounds, result) != POF_OK){
+        POF_COMMAND_PRINT(1,RED,"Hash bench failed.\n");
+        return;
+    }
+    for(f=0; f<POF_HASH_FUNC_NUM; f++){
+        POF_COMMAND_PRINT(1,CYAN,"%-8s", pof_hash_func_str[f]);
+        POF_COMMAND_PRINT(1,WHITE,"%.1f ns/key, collisions %u, chain max %u, avg %.3f\n", \
+                (double)result[f].ns / ((uint64_t)num * rounds), result[f].collisions, \
+                result[f].chainMax, result[f].chainAvg);
+    }
+}
+
+/* Bench the hash functions over the keys of every EM table. Without
+ * any EM entry, num 5-tuple keys from consecutive flows are used. */
+static void
+usr_cmd_hash_bench(CMD_ARG)
+{
+    struct tableInfo *table, *next;
+    struct entryInfo *entry, *entryNext;
+    struct pof_local_resource *lr, *lrNext;
+    uint32_t num, rounds, keyBytes, i, tables = 0;
+    char *arg_[2] = {NULL, NULL};
+    uint8_t *keys;
+
+    pofbf_split_str(arg, ",", arg_, 2);
+    num = arg_[0] ? atoi(arg_[0]) : 100000;
+    rounds = arg_[1] ? atoi(arg_[1]) : 10;
+	POF_COMMAND_PRINT_HEAD("hash_bench %u,%u", num, rounds);
+    if(num == 0 || rounds == 0){
+        POF_COMMAND_PRINT(1,RED,"Hash bench failed. Eg. hash_bench 100000,10\n");
+        return;
+    }
+    POF_COMMAND_PRINT(1,CYAN,"crc32c  ");
+    POF_COMMAND_PRINT(1,WHITE,"%s\n", pof_hash_crc32c_hw() ? "sse4.2" : "table");
+
+    HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
+        HMAP_NODES_IN_STRUCT_TRAVERSE(table, next, idNode, lr->tableIdMap){
+            if(table->type != POF_EM_TABLE || table->entryNum == 0){
+                continue;
+            }
+            keyBytes = POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen);
+            if((keys = MALLOC((size_t)table->entryNum * keyBytes)) == NULL){
+                return;
+            }
+            i = 0;
+            HMAP_NODES_IN_STRUCT_TRAVERSE(entry, entryNext, node, table->entryMap){
+                memcpy(keys + (size_t)i++ * keyBytes, entry->value, keyBytes);
+            }
+            POF_COMMAND_PRINT(1,PINK,"[Slot %d][table %s] %u keys of %u bits\n", \
+                    lr->slotID, table->name, i, table->keyLen);
+            cmdPrintHashBench(keys, i, keyBytes, rounds);
+            FREE(keys);
+            tables ++;
+        }
+    }
+    if(tables){
+        return;
+    }
+
+    /* IPv4 src, dst, ports and protocol, 13 bytes. */
+    keyBytes = 13;
+    if((keys = MALLOC((size_t)num * keyBytes)) == NULL){
+        return;
+    }
+    for(i=0; i<num; i++){
+        uint8_t *key = keys + (size_t)i * keyBytes;
+        uint32_t src = 0x0A000000 + (i >> 8), dst = 0xC0A80000 + (i & 0xFF);
+        uint16_t sport = 1024 + (i % 50000), dport = 80;
+        memcpy(key, &src, 4);
+        memcpy(key + 4, &dst, 4);
+        memcpy(key + 8, &sport, 2);
+        memcpy(key + 10, &dport, 2);
+        key[12] = 6;
+    }
+    POF_COMMAND_PRINT(1,PINK,"[no EM entry] %u 5-tuple keys\n", num);
+    cmdPrintHashBench(keys, num, keyBytes, rounds);
+    FREE(keys);
+}
+
+static void
+cmdPrintBitBench(const char *name, uint64_t refNs, uint64_t ns, uint64_t calls)
+{
+    POF_COMMAND_PRINT(1,CYAN,"%-8s", name);
+    POF_COMMAND_PRINT(1,WHITE,"byte loop %.1f ns, kernel %.1f ns\n", \
+            (double)refNs / calls, (double)ns / calls);
+}
+
+/* Check the bit kernels against the byte loops, and time both on
+ * pieces of len bits. */
+static void
+usr_cmd_bit_bench(CMD_ARG)
+{
+    struct pofBitBench result;
+    char *arg_[2] = {NULL, NULL};
+    uint32_t len, rounds;
+    uint64_t calls;
+
+    pofbf_split_str(arg, ",", arg_, 2);
+    len = arg_[0] ? atoi(arg_[0]) : 32;
+    rounds = arg_[1] ? atoi(arg_[1]) : 1000000;
+	POF_COMMAND_PRINT_HEAD("bit_bench %u,%u", len, rounds);
+    if(len > POF_MTU_LENGTH * POF_BITNUM_IN_BYTE || \
+            pofbf_bit_bench(len, rounds, &result) != POF_OK){
+        POF_COMMAND_PRINT(1,RED,"Bit bench failed. Eg. bit_bench 32,1000000\n");
+        return;
+    }
+    POF_COMMAND_PRINT(1,CYAN,"checked ");
+    POF_COMMAND_PRINT(1,WHITE,"%llu, mismatch %u\n", (unsigned long long)result.checked, result.mismatch);
+    calls = (uint64_t)rounds * 8;
+    cmdPrintBitBench("copy", result.copyRefNs, result.copyNs, calls);
+    cmdPrintBitBench("cover", result.coverRefNs, result.coverNs, calls);
+    if(len <= 64){
+        cmdPrintBitBench("extract", result.extractRefNs, result.extractNs, calls);
+    }
+}
+
+static void
+cmdPrintInsBench(const char *name, uint64_t ns, uint64_t cycles, uint32_t num)
+{
+    POF_COMMAND_PRINT(1,CYAN,"%-9s", name);
+    if(cycles){
+        POF_COMMAND_PRINT(1,WHITE,"%.1f ns, %.1f cycles/packet\n", \
+                (double)ns / num, (double)cycles / num);
+    }else{
+        POF_COMMAND_PRINT(1,WHITE,"%.1f ns/packet\n", (double)ns / num);
+    }
+}
+
+/* Compare the threaded interpreter with the switch one on the same
+ * programs. */
+static void
+usr_cmd_ins_bench(CMD_ARG)
+{
+    struct pof_local_resource *lr;
+    struct pofdpInsBench result;
+    uint32_t num;
+
+    num = (arg && arg[0]) ? atoi(arg) : 1000000;
+	POF_COMMAND_PRINT_HEAD("ins_bench %u", num);
+    if((lr = pofdp_get_local_resource(POF_SLOT_ID_BASE, dp)) == NULL || \
+            pofdp_ins_bench(num, lr, &result) != POF_OK){
+        POF_COMMAND_PRINT(1,RED,"Instruction bench failed. Eg. ins_bench 1000000\n");
+        return;
+    }
+    POF_COMMAND_PRINT(1,CYAN,"programs ");
+    POF_COMMAND_PRINT(1,WHITE,"%u, mismatch %u\n", result.progNum, result.mismatch);
+    cmdPrintInsBench("switch", result.switchNs, result.switchCycles, num);
+    cmdPrintInsBench("threaded", result.threadedNs, result.threadedCycles, num);
+}
+
 static void usr_cmd_version(CMD_ARG){
     cmdPrintVersion(POFSWITCH_VERSION);
 }
@@ -330,6 +517,39 @@ void usr_cmd_tables(CMD_ARG){
     cmdPrintFlowTables(arg, dp);
 }
 
+static void
+cmdPrintHmap(const char *name, const struct hmap *map)
+{
+    struct hmapStats stats;
+    if(!map){
+        return;
+    }
+    hmap_stats(map, &stats);
+    cmdPrintHmapStats(name, &stats);
+}
+
+static void usr_cmd_hmaps(CMD_ARG){
+    struct tableInfo *table, *next;
+    struct pof_local_resource *lr, *lrNext;
+    char name[POF_STRING_MAX_LEN];
+
+    POF_COMMAND_PRINT_HEAD("hmaps");
+    cmdPrintHmap("slots", dp->slotMap);
+    HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
+        POF_COMMAND_PRINT(1,PINK,"\n[Slot %d]\n", lr->slotID);
+        cmdPrintHmap("ports", lr->portPofIndexMap);
+        cmdPrintHmap("port names", lr->portNameMap);
+        cmdPrintHmap("tables", lr->tableIdMap);
+        cmdPrintHmap("groups", lr->groupMap);
+        cmdPrintHmap("meters", lr->meterMap);
+        cmdPrintHmap("counters", lr->counterMap);
+        HMAP_NODES_IN_STRUCT_TRAVERSE(table, next, idNode, lr->tableIdMap){
+            snprintf(name, sizeof name, "table %d", table->id);
+            cmdPrintHmap(name, table->entryMap);
+        }
+    }
+}
+
 static void usr_cmd_ports(CMD_ARG){
     struct portInfo *p, *next;
     struct pof_local_resource *lr, *lrNext;
@@ -0,0 +1,307 @@
+
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_hash.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_CRC32C_HW
+#include <nmmintrin.h>
+#endif
+
+#define HASH_C1 (0x87C37B91114253D5ULL)
+#define HASH_C2 (0x4CF5AD432745937FULL)
+#define HASH_CRC32C_POLY (0x82F63B78)
+
+const char *pof_hash_func_str[POF_HASH_FUNC_NUM] = {"fold", "bytes", "crc32c"};
+
+static inline uint64_t
+hashRotl64(uint64_t x, uint32_t r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/* Both mixers are bijective, so different ids never share a hash. */
+uint32_t
+pof_hash_uint32(uint32_t value)
+{
+    value ^= value >> 16;
+    value *= 0x85EBCA6B;
+    value ^= value >> 13;
+    value *= 0xC2B2AE35;
+    return value ^ (value >> 16);
+}
+
+uint64_t
+pof_hash_uint64(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    return value ^ (value >> 33);
+}
+
+static inline uint64_t
+hashBytesMix(uint64_t hash, uint64_t word)
+{
+    word *= HASH_C1;
+    word = hashRotl64(word, 31);
+    word *= HASH_C2;
+    hash ^= word;
+    return hashRotl64(hash, 27) * 5 + 0x52DCE729;
+}
+
+/* Seeded 64-bit hash of n bytes. Every byte goes through the multiply
+ * chain in order, so permuted or equal fields do not cancel. The tail
+ * is copied, so no byte after data + n is read. */
+uint64_t
+pof_hash_bytes(const void *data, size_t n, uint64_t seed)
+{
+    const uint8_t *p = data;
+    uint64_t hash = seed ^ (n * HASH_C2), word;
+    size_t i, j;
+
+    for(i=0; i+8<=n; i+=8){
+        memcpy(&word, p + i, 8);
+        hash = hashBytesMix(hash, word);
+    }
+    if(i < n){
+        /* Byte by byte, since a memcpy of a variable size is a call. */
+        for(word = 0, j = n; j > i; j--){
+            word = (word << 8) | p[j-1];
+        }
+        hash = hashBytesMix(hash, word);
+    }
+    return pof_hash_uint64(hash ^ n);
+}
+
+static pthread_once_t hashCrc32cOnce = PTHREAD_ONCE_INIT;
+static uint32_t hashCrc32cTable[256];
+#ifdef HASH_CRC32C_HW
+static bool hashCrc32cHw;
+#endif // HASH_CRC32C_HW
+
+/* Build the table and check the CPU once, before the first CRC32C of
+ * any task. */
+static void
+crc32cInit(void)
+{
+    uint32_t i, j, c;
+
+    for(i=0; i<256; i++){
+        for(c=i, j=0; j<8; j++){
+            c = (c & 1) ? (c >> 1) ^ HASH_CRC32C_POLY : (c >> 1);
+        }
+        hashCrc32cTable[i] = c;
+    }
+#ifdef HASH_CRC32C_HW
+    __builtin_cpu_init();
+    hashCrc32cHw = __builtin_cpu_supports("sse4.2") ? TRUE : FALSE;
+#endif // HASH_CRC32C_HW
+}
+
+static uint32_t
+crc32cSoft(const uint8_t *p, size_t n, uint32_t crc)
+{
+    while(n--){
+        crc = hashCrc32cTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef HASH_CRC32C_HW
+__attribute__((target("sse4.2"))) static uint32_t
+crc32cHw(const uint8_t *p, size_t n, uint32_t crc)
+{
+#ifdef __x86_64__
+    uint64_t word, crc64 = crc;
+    for(; n >= 8; n -= 8, p += 8){
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+#endif // __x86_64__
+    uint32_t word32;
+    for(; n >= 4; n -= 4, p += 4){
+        memcpy(&word32, p, 4);
+        crc = _mm_crc32_u32(crc, word32);
+    }
+    while(n--){
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif // HASH_CRC32C_HW
+
+/* Whether the CRC32C instruction of SSE4.2 is used. */
+bool
+pof_hash_crc32c_hw(void)
+{
+#ifdef HASH_CRC32C_HW
+    pthread_once(&hashCrc32cOnce, crc32cInit);
+    return hashCrc32cHw;
+#else // HASH_CRC32C_HW
+    return FALSE;
+#endif // HASH_CRC32C_HW
+}
+
+/* CRC32C of n bytes. Uses the SSE4.2 instruction when the CPU has it,
+ * and a table otherwise. Both give the same value. */
+uint32_t
+pof_hash_crc32c(const void *data, size_t n, uint32_t seed)
+{
+    pthread_once(&hashCrc32cOnce, crc32cInit);
+#ifdef HASH_CRC32C_HW
+    if(hashCrc32cHw){
+        return ~crc32cHw(data, n, ~seed);
+    }
+#endif // HASH_CRC32C_HW
+    return ~crc32cSoft(data, n, ~seed);
+}
+
+/* The XOR fold which hmap_hashForBytes used before. Kept to compare. */
+static uint32_t
+hashFold(const uint8_t *p, size_t n)
+{
+    uint32_t word, hash = 0;
+    for(; n >= 4; n -= 4, p += 4){
+        memcpy(&word, p, 4);
+        word = word + 3 * (word >> 8) + 7 * (word >> 16) + 13 * (word >> 24);
+        hash ^= word * 0x9E3779B9;
+    }
+    if(n != 0){
+        for(word = 0; n; n--){
+            word = (word << 8) | p[n-1];
+        }
+        word = word + 3 * (word >> 8) + 7 * (word >> 16) + 13 * (word >> 24);
+        hash ^= word * 0x9E3779B9;
+    }
+    return hash;
+}
+
+uint32_t
+pof_hash(uint8_t func, const void *data, size_t n, uint32_t seed)
+{
+    uint64_t hash;
+    switch(func){
+        case POF_HASH_FOLD:
+            return hashFold(data, n) ^ seed;
+        case POF_HASH_CRC32C:
+            return pof_hash_crc32c(data, n, seed);
+        case POF_HASH_BYTES:
+        default:
+            hash = pof_hash_bytes(data, n, seed);
+            return (uint32_t)(hash ^ (hash >> 32));
+    }
+}
+
+static int
+hashCmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/***********************************************************************
+ * Benchmark the hash functions on a key set
+ * Form:     uint32_t pof_hash_bench(const uint8_t *keys, uint32_t num,
+ *                                   uint32_t keyBytes, uint32_t rounds,
+ *                                   struct pofHashBench *result)
+ * Input:    num distinct keys of keyBytes each, rounds to time
+ * Output:   result[POF_HASH_FUNC_NUM]
+ * Return:   POF_OK or Error code
+ * Discribe: For each function, this times rounds passes over the keys,
+ *           counts the keys whose 32-bit hash collides, and fills num
+ *           buckets (rounded up to 2^x) with the low bits as hmap does
+ *           to get the longest chain and the average nodes compared.
+ ***********************************************************************/
+uint32_t
+pof_hash_bench(const uint8_t *keys, uint32_t num, uint32_t keyBytes, \
+               uint32_t rounds, struct pofHashBench *result)
+{
+    struct timespec start, end;
+    volatile uint32_t sink = 0;
+    uint32_t *hashes, *chains, bktNum, f, i, r;
+    uint64_t compared;
+
+    if(num == 0){
+        return POF_ERROR;
+    }
+    for(bktNum = 1; bktNum < num; bktNum <<= 1){
+        continue;
+    }
+    POF_MALLOC_SAFE_RETURN(hashes, num, POF_ERROR);
+    chains = (uint32_t *)MALLOC(bktNum * sizeof *chains);
+    if(!chains){
+        FREE(hashes);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+
+    for(f=0; f<POF_HASH_FUNC_NUM; f++){
+        memset(&result[f], 0, sizeof result[f]);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(r=0; r<rounds; r++){
+            for(i=0; i<num; i++){
+                sink += pof_hash(f, keys + (size_t)i * keyBytes, keyBytes, 0);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        result[f].ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+        memset(chains, 0, bktNum * sizeof *chains);
+        for(i=0; i<num; i++){
+            hashes[i] = pof_hash(f, keys + (size_t)i * keyBytes, keyBytes, 0);
+            chains[hashes[i] & (bktNum - 1)] ++;
+        }
+        for(i=0, compared=0; i<bktNum; i++){
+            compared += (uint64_t)chains[i] * (chains[i] + 1) / 2;
+            if(chains[i] > result[f].chainMax){
+                result[f].chainMax = chains[i];
+            }
+        }
+        result[f].chainAvg = (double)compared / num;
+
+        qsort(hashes, num, sizeof *hashes, hashCmp);
+        for(i=1; i<num; i++){
+            if(hashes[i] == hashes[i-1]){
+                result[f].collisions ++;
+            }
+        }
+    }
+
+    FREE(chains);
+    FREE(hashes);
+    return POF_OK;
+}
@@ -29,8 +29,15 @@
 #include "../include/pof_hmap.h"
 #include "../include/pof_global.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_hash.h"
 
-#define HASH_S (0x9E3779B9)
+/* Grow when the average chain is longer than HMAP_LOAD_MAX. Shrink when
+ * less than one of HMAP_LOAD_MIN_INV buckets is used on average. */
+#define HMAP_LOAD_MAX (2)
+#define HMAP_LOAD_MIN_INV (8)
+#define HMAP_BUCKETS_MIN (16)
+/* Old buckets moved to the new buckets by each insertion. */
+#define HMAP_REHASH_STEP (16)
 
 #define BUCKETS_TRAVERSE(map,bkt,start)                         \
             for( bkt = map->buckets + start;                    \
@@ -47,9 +54,66 @@ hmapInit(struct hmap *map, hash_t bktSize)
     POF_MALLOC_SAFE_RETURN(map->buckets, bktSize, POF_ERROR);
     map->mask = bktSize - 1;
     map->n = 0;
+    map->fixed = FALSE;
+    map->oldBuckets = NULL;
     return POF_OK;
 }
 
+/* Whether the nodes with the hash are still in the old buckets. */
+static bool
+hashInOld(const struct hmap *map, hash_t hash)
+{
+    return map->oldBuckets && (map->oldMask & hash) >= map->rehashPos;
+}
+
+/* Start to rehash into bktSize buckets. The nodes are moved later by
+ * hmapRehashStep(), so the map keeps working when the malloc fails. */
+static void
+hmapRehashStart(struct hmap *map, hash_t bktSize)
+{
+    struct hnode **buckets = (struct hnode **)MALLOC(bktSize * sizeof *buckets);
+    if(!buckets){
+        return;
+    }
+    memset(buckets, 0, bktSize * sizeof *buckets);
+    map->oldBuckets = map->buckets;
+    map->oldMask = map->mask;
+    map->rehashPos = 0;
+    map->buckets = buckets;
+    map->mask = bktSize - 1;
+}
+
+/* Move at most bktNum old buckets to the new buckets. */
+static void
+hmapRehashStep(struct hmap *map, hash_t bktNum)
+{
+    struct hnode *node, *next, **bkt;
+    for(; bktNum && map->rehashPos <= map->oldMask; bktNum--, map->rehashPos++){
+        for(node = map->oldBuckets[map->rehashPos]; node; node = next){
+            next = node->next;
+            bkt = map->buckets + (map->mask & node->hash);
+            node->next = *bkt;
+            *bkt = node;
+        }
+    }
+    if(map->rehashPos > map->oldMask){
+        FREE(map->oldBuckets);
+        map->oldBuckets = NULL;
+    }
+}
+
+/* The first node in buckets[start..mask]. */
+static struct hnode *
+nodeFirstFrom(struct hnode **buckets, hash_t mask, hash_t start)
+{
+    for(; start <= mask; start++){
+        if(buckets[start]){
+            return buckets[start];
+        }
+    }
+    return NULL;
+}
+
 static hash_t
 bucketsNum(hash_t size)
 {
@@ -75,9 +139,23 @@ hmap_create(hash_t size)
     return map;
 }
 
+/* The buckets are never reallocated, so the readers always walk the
+ * chains in place. The deleted nodes should be freed by rcu_free(). */
+struct hmap *
+hmap_createFixed(hash_t size)
+{
+    struct hmap *map;
+
+    if((map = hmap_create(size)) != NULL){
+        map->fixed = TRUE;
+    }
+    return map;
+}
+
 struct hmap * 
 hmap_destroy(struct hmap *map)
 {
+    FREE(map->oldBuckets);
     FREE(map->buckets);
     FREE(map);
     return NULL;
@@ -90,6 +168,8 @@ hmap_clear(struct hmap *map)
     BUCKETS_TRAVERSE(map, bkt, 0){
         *bkt = NULL;
     }
+    FREE(map->oldBuckets);
+    map->oldBuckets = NULL;
     map->n = 0;
 }
 
@@ -108,6 +188,9 @@ hmap_nodesCountMax(const struct hmap *map)
 static struct hnode **
 bucketWithHash(const struct hmap *map, hash_t hash)
 {
+    if(hashInOld(map, hash)){
+        return map->oldBuckets + (map->oldMask & hash);
+    }
     return map->buckets + (map->mask & hash);
 }
 
@@ -135,6 +218,9 @@ hmap_nodeGetWithHashNext(const struct hnode *node, hash_t hash)
 hash_t 
 hmap_nodePosBktId(const struct hmap *map, const struct hnode *node)
 {
+    if(hashInOld(map, node->hash)){
+        return (map->oldMask & node->hash);
+    }
     return (map->mask & node->hash);
 }
 
@@ -152,27 +238,39 @@ hmap_nodePosDeep(const struct hmap *map, const struct hnode *node)
     return POF_ERROR;
 }
 
+/* While rehashing, the old buckets which are not moved yet are
+ * traversed before the new buckets. */
 struct hnode * 
 hmap_nodeNext(const struct hmap *map, const struct hnode *node)
 {
-    struct hnode **bkt;
+    struct hnode *next;
     if(node->next){
         return node->next;
     }
-    BUCKETS_TRAVERSE(map,bkt,((map->mask & node->hash) + 1)){
-        if(*bkt){
-            return *bkt;
-        }
+    if(hashInOld(map, node->hash)){
+        next = nodeFirstFrom(map->oldBuckets, map->oldMask, (map->oldMask & node->hash) + 1);
+        return next ? next : nodeFirstFrom(map->buckets, map->mask, 0);
     }
-    return NULL;
+    return nodeFirstFrom(map->buckets, map->mask, (map->mask & node->hash) + 1);
 }
 
+/* Each insertion moves HMAP_REHASH_STEP old buckets at most, so no
+ * insertion pays for the whole rehash. The node is published after its
+ * next, so a reader sees either the old chain or the whole new one. */
 void 
 hmap_nodeInsert(struct hmap *map, struct hnode *node)
 {
-    struct hnode **bkt = bucketWithHash(map, node->hash);
+    struct hnode **bkt;
+    if(map->fixed){
+        /* Never rehashed. */
+    }else if(map->oldBuckets){
+        hmapRehashStep(map, HMAP_REHASH_STEP);
+    }else if(map->n >= HMAP_LOAD_MAX * HMAP_BUCKETS_COUNT(map)){
+        hmapRehashStart(map, 2 * HMAP_BUCKETS_COUNT(map));
+    }
+    bkt = bucketWithHash(map, node->hash);
     node->next = *bkt;
-    *bkt = node;
+    __atomic_store_n(bkt, node, __ATOMIC_RELEASE);
     map->n ++;
 }
 
@@ -182,11 +280,18 @@ hmap_nodeDelete(struct hmap *map, struct hnode *node)
     struct hnode **pnode;
     for(pnode=bucketWithHash(map,node->hash); *pnode; pnode=&(*pnode)->next){
         if(*pnode == node){
-            *pnode = node->next;
+            /* node->next is kept for the readers standing on the node. */
+            __atomic_store_n(pnode, node->next, __ATOMIC_RELEASE);
             map->n --;
-            return;
+            break;
         }
     }
+    /* Only start to shrink here. No node is moved by a deletion, so
+     * deleting nodes while traversing the map stays safe. */
+    if(!map->fixed && !map->oldBuckets && HMAP_BUCKETS_COUNT(map) > HMAP_BUCKETS_MIN && \
+            map->n < HMAP_BUCKETS_COUNT(map) / HMAP_LOAD_MIN_INV){
+        hmapRehashStart(map, HMAP_BUCKETS_COUNT(map) / 4);
+    }
 }
 
 bool 
@@ -205,6 +310,14 @@ uint32_t
 hmap_nodeTrav(const struct hmap *map, uint32_t func(void *), void *arg)
 {
     struct hnode **bkt, *node;
+    hash_t i;
+    for(i = map->rehashPos; map->oldBuckets && i <= map->oldMask; i++){
+        NODES_TRAVERSE_IN_BUCKET(node,map->oldBuckets+i){
+            if(func(arg) != POF_OK){
+                return POF_ERROR;
+            }
+        }
+    }
     BUCKETS_TRAVERSE(map,bkt,0){
         NODES_TRAVERSE_IN_BUCKET(node,bkt){
             if(func(arg) != POF_OK){
@@ -218,39 +331,56 @@ hmap_nodeTrav(const struct hmap *map, uint32_t func(void *), void *arg)
 struct hnode * 
 hmap_nodeFirst(const struct hmap *map)
 {
-    struct hnode **bkt;
-    BUCKETS_TRAVERSE(map,bkt,0){
-        if(*bkt){
-            return *bkt;
+    struct hnode *node;
+    if(map->oldBuckets && \
+            (node = nodeFirstFrom(map->oldBuckets, map->oldMask, map->rehashPos)) != NULL){
+        return node;
+    }
+    return nodeFirstFrom(map->buckets, map->mask, 0);
+}
+
+/* Collect the load and the chain depth of the map. The depth of a node
+ * is the number of nodes compared to find it. */
+void
+hmap_stats(const struct hmap *map, struct hmapStats *stats)
+{
+    const struct hnode *node;
+    hash_t deep, total = 0;
+
+    memset(stats, 0, sizeof *stats);
+    stats->nodes = map->n;
+    stats->buckets = HMAP_BUCKETS_COUNT(map);
+    stats->rehashing = (map->oldBuckets != NULL);
+    for(node = hmap_nodeFirst(map); node; node = hmap_nodeNext(map, node)){
+        deep = hmap_nodePosDeep(map, node) + 1;
+        total += deep;
+        if(deep > stats->deepMax){
+            stats->deepMax = deep;
         }
     }
-    return NULL;
+    if(map->n){
+        stats->deepAvg = (double)total / map->n;
+    }
+    stats->load = (double)map->n / stats->buckets;
 }
 
+/* Identity. Only for dense ids which are known to spread over the
+ * buckets, otherwise use hmap_hashForUint32. */
 hash_t 
 hmap_hashForLinear(uint32_t value)
 {
     return value;
 }
 
+/* Bijective, so the hash is still unique to the id. */
 hash_t hmap_hashForUint32(uint32_t value)
 {
-    value = value + 3 * (value >> 8) + 7 * (value >> 16) + 13 * (value >> 24);
-    return (uint32_t)(value * HASH_S);
+    return pof_hash_uint32(value);
 }
 
 hash_t hmap_hashForBytes(const void *value, size_t n)
 {
-    uint32_t *p, left = 0;
-    hash_t hash = 0;
-    for(p = (uint32_t *)value; n >= 4; n -= 4, p ++){
-        hash ^= hmap_hashForUint32(*p);
-    }
-    if(n != 0){
-        memcpy(&left, p, n);
-        hash ^= hmap_hashForUint32(left);
-    }
-    return hash;
+    return pof_hash(POF_HASH_BYTES, value, n, 0);
 }
 
 hash_t 
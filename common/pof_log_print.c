@@ -176,6 +176,26 @@ cmdPrintMatch(const pof_match *p)
     POF_COMMAND_PRINT(1,WHITE,"%u ", p->len);
 }
 
+void
+cmdPrintHmapStats(const char *name, const struct hmapStats *stats)
+{
+    POF_COMMAND_PRINT(1,PINK,"[%s] ", name);
+    POF_COMMAND_PRINT(1,CYAN,"nodes=");
+    POF_COMMAND_PRINT(1,WHITE,"%u ", stats->nodes);
+    POF_COMMAND_PRINT(1,CYAN,"buckets=");
+    POF_COMMAND_PRINT(1,WHITE,"%u ", stats->buckets);
+    POF_COMMAND_PRINT(1,CYAN,"load=");
+    POF_COMMAND_PRINT(1,WHITE,"%.2f ", stats->load);
+    POF_COMMAND_PRINT(1,CYAN,"deep_avg=");
+    POF_COMMAND_PRINT(1,WHITE,"%.2f ", stats->deepAvg);
+    POF_COMMAND_PRINT(1,CYAN,"deep_max=");
+    POF_COMMAND_PRINT(1,WHITE,"%u ", stats->deepMax);
+    if(stats->rehashing){
+        POF_COMMAND_PRINT(1,YELLOW,"rehashing");
+    }
+    POF_COMMAND_PRINT(1,WHITE,"\n");
+}
+
 void
 cmdPrintGroup(const struct groupInfo *group)
 {
@@ -207,6 +227,12 @@ cmdPrintFlowTableBaseinfo(const struct tableInfo *table)
 {
     char ctype[POF_MAX_TABLE_TYPE][5] = {
                             "MM","LPM","EM","DT",};
+    char mmEngine[POFLR_MM_ENGINE_NUM][7] = {
+                            "linear","tss","dtree","soa",};
+    char lpmEngine[POFLR_LPM_ENGINE_NUM][9] = {
+                            "tree","stride","patricia",};
+    char emEngine[POFLR_EM_ENGINE_NUM][7] = {
+                            "hmap","cuckoo",};
     uint32_t type = table->type;
     uint32_t table_id = table->id;
     uint32_t i;
@@ -223,6 +249,20 @@ cmdPrintFlowTableBaseinfo(const struct tableInfo *table)
     POF_COMMAND_PRINT(1,WHITE,"%u ",table->match_field_num);
     POF_COMMAND_PRINT(1,CYAN,"size=");
     POF_COMMAND_PRINT(1,WHITE,"%u ", table->size);
+    if(type == POF_LPM_TABLE){
+        POF_COMMAND_PRINT(1,CYAN,"lpm_engine=");
+        POF_COMMAND_PRINT(1,WHITE,"%s ", lpmEngine[table->lpmEngine]);
+    }else if(type == POF_EM_TABLE){
+        POF_COMMAND_PRINT(1,CYAN,"em_engine=");
+        POF_COMMAND_PRINT(1,WHITE,"%s ", emEngine[table->emEngine]);
+    }else if(type == POF_MM_TABLE){
+        POF_COMMAND_PRINT(1,CYAN,"mm_engine=");
+        POF_COMMAND_PRINT(1,WHITE,"%s ", mmEngine[table->mmEngine]);
+        if(table->mmEngine == POFLR_MM_TSS){
+            POF_COMMAND_PRINT(1,CYAN,"subtable_num=");
+            POF_COMMAND_PRINT(1,WHITE,"%u ", table->tss->num);
+        }
+    }
 //    POF_COMMAND_PRINT(1,CYAN,"key_len=");
 //    POF_COMMAND_PRINT(1,WHITE,"%u ", table->key_len);
     POF_COMMAND_PRINT(1,CYAN,"table_name=");
@@ -303,17 +343,32 @@ cmdPrintFeature(const struct pof_switch_features *p)
 	POF_COMMAND_PRINT(1,WHITE,"\n");
 }
 
+/* The counter may be a copy sent to pofsctrl, so the shards are summed
+ * up here rather than by poflr_counter_read(). */
 void
 cmdPrintCounter(const struct counterInfo *counter)
 {
+    struct counterValue value = {0};
+    uint32_t i;
+
+    for(i=0; i<POFLR_COUNTER_SHARD_NUM; i++){
+        value.value += counter->shards[i].v.value;
+#ifdef POF_SD2N
+        value.byte_value += counter->shards[i].v.byte_value;
+#endif // POF_SD2N
+    }
+    value.value -= counter->base.value;
+#ifdef POF_SD2N
+    value.byte_value -= counter->base.byte_value;
+#endif // POF_SD2N
     POF_COMMAND_PRINT(1,PINK,"[counter %d] ", counter->id);
     POF_COMMAND_PRINT(1,CYAN,"counter_id=");
     POF_COMMAND_PRINT(1,WHITE,"%u ", counter->id);
     POF_COMMAND_PRINT(1,CYAN,"value=");
-    COMMAND_PRINT_U64(counter->value);
+    COMMAND_PRINT_U64(value.value);
 #ifdef POF_SD2N
     POF_COMMAND_PRINT(1,CYAN,"byte_value=");
-    COMMAND_PRINT_U64(counter->byte_value);
+    COMMAND_PRINT_U64(value.byte_value);
 #endif // POF_SD2N
     POF_COMMAND_PRINT(1,CYAN,"\n");
 }
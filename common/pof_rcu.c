@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* One object unlinked, waiting for its grace period to be freed. */
+struct rcuCallback {
+    struct rcuCallback *next;
+    void (*func)(void *);
+    void *arg;
+    uint64_t epoch;             /* rcu_retire() when it was unlinked. */
+};
+
+/* Advanced by each retirement. It is never 0, which marks the offline
+ * readers. */
+static uint64_t rcu_epoch = 1;
+
+/* The registered readers, and the pending callbacks in epoch order. */
+static pthread_mutex_t rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct rcuReader *rcu_readers = NULL;
+static struct rcuCallback *rcu_pending = NULL, **rcu_pendingTail = &rcu_pending;
+static uint32_t rcu_pendingNum = 0;
+
+/* The lowest epoch of the online readers, or UINT64_MAX if none is
+ * online. Called with the mutex held. */
+static uint64_t
+rcuReadersEpoch(void)
+{
+    const struct rcuReader *reader;
+    uint64_t epoch, min = UINT64_MAX;
+
+    for(reader = rcu_readers; reader; reader = reader->next){
+        epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+        if(epoch && epoch < min){
+            min = epoch;
+        }
+    }
+    return min;
+}
+
+static void
+rcuFree(void *ptr)
+{
+    FREE(ptr);
+}
+
+/* Register the reader, which is online from now on. */
+void
+rcu_register(struct rcuReader *reader)
+{
+    pthread_mutex_lock(&rcu_mutex);
+    reader->epoch = __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+    reader->next = rcu_readers;
+    rcu_readers = reader;
+    pthread_mutex_unlock(&rcu_mutex);
+}
+
+/* Unregister the reader if it is registered. It should hold no
+ * reference any more. */
+void
+rcu_unregister(struct rcuReader *reader)
+{
+    struct rcuReader **pp;
+
+    pthread_mutex_lock(&rcu_mutex);
+    for(pp=&rcu_readers; *pp; pp=&(*pp)->next){
+        if(*pp == reader){
+            *pp = reader->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rcu_mutex);
+}
+
+/* The reader holds no reference now. The objects unlinked before are not
+ * waiting for it any more. */
+void
+rcu_quiescent(struct rcuReader *reader)
+{
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&rcu_epoch, __ATOMIC_ACQUIRE), \
+                     __ATOMIC_RELEASE);
+}
+
+/* The reader holds no reference until rcu_online(), such as while it is
+ * blocked for the packets. */
+void
+rcu_offline(struct rcuReader *reader)
+{
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* The reader may take references again. The fence keeps its reads after
+ * the writers can see it online. */
+void
+rcu_online(struct rcuReader *reader)
+{
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&rcu_epoch, __ATOMIC_ACQUIRE), \
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* Start a new epoch after the objects have been unlinked. Return it to
+ * check by rcu_passed(). */
+uint64_t
+rcu_retire(void)
+{
+    return __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Whether every online reader has been quiescent since the epoch, so no
+ * reader can refer to the objects unlinked before it. */
+bool
+rcu_passed(uint64_t epoch)
+{
+    uint64_t min;
+
+    pthread_mutex_lock(&rcu_mutex);
+    min = rcuReadersEpoch();
+    pthread_mutex_unlock(&rcu_mutex);
+    return min >= epoch;
+}
+
+/***********************************************************************
+ * Wait for a grace period
+ * Form:     void rcu_synchronize(void)
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function returns after every reader online now has been
+ *           quiescent or offline, so the objects unlinked before can be
+ *           freed at once. The callbacks passed are run as well.
+ * NOTE:     It sleeps, so it is only for the rare modifications such as
+ *           deleting a table. It should never be called by a reader.
+ ***********************************************************************/
+void
+rcu_synchronize(void)
+{
+    uint64_t epoch = rcu_retire();
+
+    while(!rcu_passed(epoch)){
+        usleep(RCU_SYNC_US);
+    }
+    rcu_reclaim();
+}
+
+/***********************************************************************
+ * Free an object after a grace period
+ * Form:     void rcu_call(void (*func)(void *), void *arg)
+ * Input:    free function, object
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function calls func(arg) once no reader can refer to
+ *           the object any more. The object should have been unlinked
+ *           from everything the readers can reach. The callback is run
+ *           by the writer calling rcu_call() or rcu_synchronize() later,
+ *           or at once if no reader is online. The writer waits for the
+ *           readers only if RCU_PENDING_MAX callbacks are pending.
+ ***********************************************************************/
+void
+rcu_call(void (*func)(void *), void *arg)
+{
+    struct rcuCallback *cb;
+    bool full;
+
+    if((cb = MALLOC(sizeof *cb)) == NULL){
+        rcu_synchronize();
+        func(arg);
+        return;
+    }
+    cb->next = NULL;
+    cb->func = func;
+    cb->arg = arg;
+
+    pthread_mutex_lock(&rcu_mutex);
+    cb->epoch = rcu_retire();
+    *rcu_pendingTail = cb;
+    rcu_pendingTail = &cb->next;
+    full = (++ rcu_pendingNum >= RCU_PENDING_MAX);
+    pthread_mutex_unlock(&rcu_mutex);
+
+    if(full){
+        rcu_synchronize();
+    }else{
+        rcu_reclaim();
+    }
+}
+
+/* FREE the object after a grace period. */
+void
+rcu_free(void *ptr)
+{
+    if(ptr){
+        rcu_call(rcuFree, ptr);
+    }
+}
+
+/* Run the callbacks whose grace period has passed, out of the mutex. */
+void
+rcu_reclaim(void)
+{
+    struct rcuCallback *done = NULL, **tail = &done, *cb;
+    uint64_t min;
+
+    pthread_mutex_lock(&rcu_mutex);
+    min = rcuReadersEpoch();
+    while((cb = rcu_pending) != NULL && cb->epoch <= min){
+        rcu_pending = cb->next;
+        *tail = cb;
+        tail = &cb->next;
+        rcu_pendingNum --;
+    }
+    *tail = NULL;
+    if(!rcu_pending){
+        rcu_pendingTail = &rcu_pending;
+    }
+    pthread_mutex_unlock(&rcu_mutex);
+
+    while((cb = done) != NULL){
+        done = cb->next;
+        cb->func(cb->arg);
+        FREE(cb);
+    }
+}
+
+/* Allocate the pool for max indexes, with none free yet. */
+uint32_t
+rcu_poolInit(struct rcuPool *pool, uint32_t max)
+{
+    pool->freeNum = pool->retiredNum = 0;
+    pool->max = max;
+    pool->epoch = 0;
+    if(max == 0){
+        pool->indexes = NULL;
+        return POF_OK;
+    }
+    POF_MALLOC_SAFE_RETURN(pool->indexes, max, POF_ERROR);
+    return POF_OK;
+}
+
+void
+rcu_poolDestroy(struct rcuPool *pool)
+{
+    if(pool->indexes){
+        FREE(pool->indexes);
+        pool->indexes = NULL;
+    }
+}
+
+/* Add the index which no reader has seen, such as at the creation. */
+void
+rcu_poolPut(struct rcuPool *pool, uint32_t index)
+{
+    pool->indexes[pool->freeNum ++] = index;
+}
+
+/* Release the index after it has been unlinked. */
+void
+rcu_poolRetire(struct rcuPool *pool, uint32_t index)
+{
+    pool->indexes[pool->max - (++ pool->retiredNum)] = index;
+    pool->epoch = rcu_retire();
+}
+
+/* Get an index. The retired ones are taken back only when no free one is
+ * left, after waiting for their grace period if it has not passed yet.
+ * Return FALSE if the pool is empty. */
+bool
+rcu_poolGet(struct rcuPool *pool, uint32_t *index)
+{
+    if(pool->freeNum == 0){
+        if(pool->retiredNum == 0){
+            return FALSE;
+        }
+        if(!rcu_passed(pool->epoch)){
+            rcu_synchronize();
+        }
+        memmove(pool->indexes, pool->indexes + pool->max - pool->retiredNum, \
+                pool->retiredNum * sizeof *pool->indexes);
+        pool->freeNum = pool->retiredNum;
+        pool->retiredNum = 0;
+    }
+    *index = pool->indexes[-- pool->freeNum];
+    return TRUE;
+}
+
+/* Indexes free or retired, which can all be got. */
+uint32_t
+rcu_poolAvailable(const struct rcuPool *pool)
+{
+    return pool->freeNum + pool->retiredNum;
+}
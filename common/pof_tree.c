@@ -27,6 +27,7 @@
 #include "../include/pof_log_print.h"
 #include "../include/pof_global.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
 
 struct tree * 
 tree_create()
@@ -113,29 +114,38 @@ isRoot(const struct treeNode *node, const struct tree *tree)
     return ( node == tree->root );
 }
 
+/* The new nodes are published after they are filled, so the lookups walk
+ * the tree without a lock. The same value inserted later overrides the
+ * former ptr. */
 uint32_t 
 tree_nodeInsert(struct tree *tree, const void *ptr, uint8_t *value, uint32_t bitNum)
 {
-    struct treeNode ** node = &tree->root;
+    struct treeNode ** node = &tree->root, *tmp;
     while(bitNum > 0){
         node = (toLeft(value)) ? &(*node)->leftSon : &(*node)->rightSon;
         moveLeft(value, bitNum);
         bitNum --;
 
         if(!(*node)){
-            *node = tree_nodeCreate();
-            POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(*node);
+            tmp = tree_nodeCreate();
+            POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(tmp);
+            __atomic_store_n(node, tmp, __ATOMIC_RELEASE);
         }
     }
     
-    (*node)->ptr = (void *)ptr;
-    tree->count ++;
+    if(!(*node)->ptr){
+        tree->count ++;
+    }
+    __atomic_store_n(&(*node)->ptr, (void *)ptr, __ATOMIC_RELEASE);
     return POF_OK;
 }
 
+/* Nothing is deleted if the node holds another ptr, which has overridden
+ * this one. The leaf is freed after the lookups walking it. */
 uint32_t 
-tree_nodeDelete(struct tree *tree, uint8_t *value, uint32_t bitNum)
+tree_nodeDelete(struct tree *tree, const void *ptr, uint8_t *value, uint32_t bitNum)
 {
+    struct treeNode *tmp;
     struct treeNode ** node = &tree->root;
     while(bitNum > 0){
         node = (toLeft(value)) ? &(*node)->leftSon : &(*node)->rightSon;
@@ -147,10 +157,14 @@ tree_nodeDelete(struct tree *tree, uint8_t *value, uint32_t bitNum)
         }
     }
 
-    (*node)->ptr = NULL;
+    if((*node)->ptr != ptr){
+        return POF_OK;
+    }
+    __atomic_store_n(&(*node)->ptr, NULL, __ATOMIC_RELEASE);
     if(isLeaf(*node) && !isRoot(*node, tree)){
-        FREE(*node);
-        *node = NULL;
+        tmp = *node;
+        __atomic_store_n(node, NULL, __ATOMIC_RELEASE);
+        rcu_free(tmp);
     }
 
     tree->count --;
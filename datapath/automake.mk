@@ -1,4 +1,9 @@
 DATAPATH_FOLDER = datapath
 pofswitch_SOURCES += $(DATAPATH_FOLDER)/pof_action.c \
 					 $(DATAPATH_FOLDER)/pof_datapath.c \
-					 $(DATAPATH_FOLDER)/pof_instruction.c
+					 $(DATAPATH_FOLDER)/pof_instruction.c \
+					 $(DATAPATH_FOLDER)/pof_packet.c \
+					 $(DATAPATH_FOLDER)/pof_ring.c \
+					 $(DATAPATH_FOLDER)/pof_worker.c \
+					 $(DATAPATH_FOLDER)/pof_fanout.c \
+					 $(DATAPATH_FOLDER)/pof_backend.c
@@ -88,8 +88,16 @@ insertTagToPacket(uint32_t tag_pos_b, uint32_t tag_len_b, const uint8_t *value,
     /* The length behind the tag, unit is bit. */
     len_b_behindtag = dpp->left_len * 8 - tag_pos_b;
 
+    /* The packet in the RX ring has to be copied out before growing. */
+    if((dpp->offset + dpp->left_len + POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b)) > dpp->packetBufLen \
+            && dpp->packetBuf != &(dpp->mbuf->buf[POFDP_PACKET_PREBUF_LEN])){
+        if(pofdp_packet_copy_from_ring(dpp) != POF_OK){
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
+        }
+    }
+
     /* Check the length. */
-    if((dpp->offset + dpp->left_len + POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b)) > POFDP_PACKET_RAW_MAX_LEN \
+    if((dpp->offset + dpp->left_len + POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b)) > dpp->packetBufLen \
             || len_b_behindtag < 0){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
     }
@@ -207,11 +215,7 @@ static uint32_t execute_COUNTER(POFDP_ARG)
 #endif // POF_SHT_VXLAN
 
     /* Increace the Counter. */
-#ifdef POF_SD2N
-    ret = poflr_counter_increace(counterID, 0, lr);
-#else // POF_SD2N
-    ret = poflr_counter_increace(counterID, lr);
-#endif // POF_SD2N
+    ret = pofdp_counter_increace(dpp, lr, counterID, 0);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"action_counter has been done!");
@@ -495,15 +499,13 @@ static uint32_t execute_GROUP(POFDP_ARG)
 
     POF_DEBUG_CPRINT_FL(1,BLUE,"Go to Group[%u]", group_id);
 
-#ifdef POF_SD2N
-    ret = poflr_counter_increace(group->counter_id, POF_PACKET_REL_LEN_GET(dpp), lr);
-#else // POF_SD2N
-    ret = poflr_counter_increace(group->counter_id, lr);
-#endif // POF_SD2N
+    ret = pofdp_counter_increace(dpp, lr, group->counter_id, POF_PACKET_REL_LEN_GET(dpp));
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 	dpp->act = group->action;
 	dpp->act_num = group->action_number;
+    dpp->actCode = (group->action_number <= POF_MAX_ACTION_NUMBER_PER_GROUP) ? \
+                   group->actCode : NULL;
 
     ret = pofdp_action_execute(dpp, lr);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -771,7 +773,6 @@ static uint32_t execute_OUTPUT(POFDP_ARG)
     struct pof_local_resource *lrPort = NULL;
     uint32_t ret, value = 0;
 
-    struct portInfo *port, *next;//add by wenjian 2015/12/01
     if(p->packet_offset > dpp->left_len){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
     }
@@ -809,20 +810,9 @@ static uint32_t execute_OUTPUT(POFDP_ARG)
     if(dpp->output_port_id==255)
     {
      	POF_DEBUG_CPRINT(1,BLUE,"yes it is a flood port");
-       //add by jelly
-       //get all the port id execept the input port id
-     	HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lrPort->portPofIndexMap){
-        	POF_DEBUG_CPRINT(1,BLUE,"sysIndex=%d,pofIndex=%d,ori_port_id=%d\n",port->sysIndex,port->pofIndex,dpp->ori_port_id);
-        	if(port->pofIndex!=dpp->ori_port_id&&port->pofIndex!=pofsc_conn_desc.local_port_index){
-                if(port->config!=16)
-                {
-                	POF_DEBUG_CPRINT(1,BLUE,"config=%d",port->config);
-           	        dpp->output_port_id=port->pofIndex;
-                    ret = pofdp_send_raw(dpp, lrPort);
-                    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-                }
-        	}
-        }
+        /* Send to all ports in the flood port set except the input port. */
+        ret = pofdp_send_raw_flood(dpp, lrPort);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
      }
      else
      {
@@ -959,18 +949,121 @@ execute_EXPERIMENTER(POFDP_ARG)
 	POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBAC_BAD_TYPE, g_upward_xid++);
 }
 
+/* Whether the action may change the packet data. */
+static uint8_t
+actionWritesPacket(uint16_t type)
+{
+    switch(type){
+        case POFAT_OUTPUT:
+        case POFAT_GROUP:
+        case POFAT_DROP:
+        case POFAT_PACKET_IN:
+        case POFAT_COUNTER:
+            return FALSE;
+        default:
+            return TRUE;
+    }
+}
+
+#ifdef POFDP_THREADED_DISPATCH
+/* Execute the actions by the threaded interpreter. Each handler jumps to
+ * the next one directly through the label table indexed by the codes
+ * in dpp->actCode, instead of going back to one shared switch. */
+static uint32_t
+actionExecuteThreaded(POFDP_ARG)
+{
+    static const void *const handlers[POFLR_AC_BAD + 1] = {
+#define ACTION(NAME,VALUE) &&do_##NAME,
+        ACTIONS
+#undef ACTION
+        &&do_SET_FIELD_CHECKSUM_OUTPUT,
+        &&do_SET_FIELD_CHECKSUM,
+        &&do_SET_FIELD_OUTPUT,
+        &&do_BAD,
+    };
+    const uint8_t *code = dpp->actCode;
+    uint8_t num = dpp->act_num;
+    uint32_t ret = POF_OK;
+
+    /* The handlers move act and act_num on, so the code of the next
+     * action is at num - act_num. A GROUP runs the group actions with
+     * the same act_num, and finishes the list as in the switch one. */
+#define ACT_NEXT()                                                  \
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);                       \
+    if(dpp->packet_done != FALSE || dpp->act_num == 0){             \
+        return POF_OK;                                              \
+    }                                                               \
+    goto *handlers[code[num - dpp->act_num]]
+
+    ACT_NEXT();
+
+    /* The flush is decided when compiling, as the type is constant. */
+#define ACTION(NAME,VALUE)                                          \
+do_##NAME:                                                          \
+    if(actionWritesPacket(POFAT_##NAME)){                           \
+        POFDP_TX_PENDING_FLUSH(dpp);                                \
+    }                                                               \
+    ret = execute_##NAME(dpp, lr);                                  \
+    ACT_NEXT();
+    ACTIONS
+#undef ACTION
+
+    /* Superinstructions. Only the SET_FIELD changes the packet before
+     * the output, so one flush is enough. */
+do_SET_FIELD_CHECKSUM_OUTPUT:
+    POFDP_TX_PENDING_FLUSH(dpp);
+    if((ret = execute_SET_FIELD(dpp, lr)) == POF_OK && \
+            (ret = execute_CALCULATE_CHECKSUM(dpp, lr)) == POF_OK){
+        ret = execute_OUTPUT(dpp, lr);
+    }
+    ACT_NEXT();
+
+do_SET_FIELD_CHECKSUM:
+    POFDP_TX_PENDING_FLUSH(dpp);
+    if((ret = execute_SET_FIELD(dpp, lr)) == POF_OK){
+        ret = execute_CALCULATE_CHECKSUM(dpp, lr);
+    }
+    ACT_NEXT();
+
+do_SET_FIELD_OUTPUT:
+    POFDP_TX_PENDING_FLUSH(dpp);
+    if((ret = execute_SET_FIELD(dpp, lr)) == POF_OK){
+        ret = execute_OUTPUT(dpp, lr);
+    }
+    ACT_NEXT();
+
+do_BAD:
+    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBAC_BAD_TYPE, g_upward_xid++);
+#undef ACT_NEXT
+}
+#endif // POFDP_THREADED_DISPATCH
+
 /***********************************************************************
  * Execute actions
  * Form:     uint32_t pofdp_action_execute(POFDP_ARG)
  * Input:    dpp, dp
  * Return:   POF_OK or Error code
- * Discribe: This function executes the actions. 
+ * Discribe: This function executes the actions. They are executed by
+ *           the threaded interpreter if dpp->actCode is compiled and
+ *           it is on, or by the switch one.
  ***********************************************************************/
 uint32_t pofdp_action_execute(POFDP_ARG)
 {
     uint32_t ret;
 
+#ifdef POFDP_THREADED_DISPATCH
+    if(dpp->actCode && dpp->dp->threaded){
+        return actionExecuteThreaded(dpp, lr);
+    }
+#endif // POFDP_THREADED_DISPATCH
+
     while(dpp->packet_done == FALSE && dpp->act_num > 0){
+        /* The queued outputs of the packet should be sent before the
+         * packet data is changed. */
+        if(actionWritesPacket(dpp->act->type)){
+            POFDP_TX_PENDING_FLUSH(dpp);
+        }
+
 		/* Execute the actions. */
         switch(dpp->act->type){
 #define ACTION(NAME,VALUE) case POFAT_##NAME: ret = execute_##NAME(dpp, lr); break;
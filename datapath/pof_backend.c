@@ -0,0 +1,543 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_byte_transfer.h"
+#include "../include/pof_memory.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+
+/* The pcap file format. Only the Ethernet link type is supported. */
+#define PCAP_MAGIC          (0xa1b2c3d4)
+#define PCAP_MAGIC_NSEC     (0xa1b23c4d)
+#define PCAP_LINKTYPE_ETH   (1)
+#define PCAP_SNAPLEN        (65535)
+
+struct pcapFileHeader {
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    int32_t  thisZone;
+    uint32_t sigFigs;
+    uint32_t snapLen;
+    uint32_t linkType;
+};
+
+struct pcapRecordHeader {
+    uint32_t sec;
+    uint32_t usec;              /* Or nanosecond. */
+    uint32_t capLen;
+    uint32_t len;
+};
+
+/* The pcap file replayed by a pcap-replay port. */
+struct pcapReplay {
+    FILE *fp;
+    uint8_t swapped;            /* The file is in the other byte order. */
+    uint32_t repeat;            /* Times to replay the file. 0 means forever. */
+    uint32_t round;
+    uint64_t pktNum;
+};
+
+/* The pcap file written by a pcap-record port. Any task can send out
+ * through the port, so the writes are locked. */
+struct pcapRecord {
+    FILE *fp;
+    pthread_mutex_t lock;
+    uint64_t pktNum;
+};
+
+/* The packets sent out through a loopback port, waiting to be received
+ * by the port again. */
+struct loopQueue {
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t num;
+    uint64_t drop;              /* Dropped because the queue is full. */
+    uint16_t len[POFDP_BACKEND_LOOP_LEN];
+    uint8_t buf[POFDP_BACKEND_LOOP_LEN][POFDP_PACKET_RAW_MAX_LEN];
+};
+
+/* Copy the metadata and the packet of one output into buf. Return the
+ * length, or 0 if they do not fit. */
+static uint32_t
+txCopy(uint8_t *buf, uint32_t room, const struct pofdp_tx_desc *pkt)
+{
+    if(pkt->metaLen + pkt->len > room){
+        return 0;
+    }
+    memcpy(buf, pkt->meta, pkt->metaLen);
+    memcpy(buf + pkt->metaLen, pkt->packet, pkt->len);
+    return pkt->metaLen + pkt->len;
+}
+
+/* The sockets of a raw port are opened by the local resource when the
+ * port is created, so there is nothing more to open. */
+static uint32_t
+rawOpen(struct portInfo *port, const char *arg)
+{
+    return POF_OK;
+}
+
+/* Receive the packets queued in the socket bound to the port, without
+ * blocking. */
+static uint32_t
+rawRxBurst(struct portInfo *port, uint8_t **bufs, uint32_t *lens, uint32_t num)
+{
+    struct sockaddr_ll from;
+    socklen_t fromLen;
+    uint32_t i = 0;
+    ssize_t len;
+
+    while(i < num){
+        fromLen = sizeof from;
+        if((len = recvfrom(port->queue_fd[0], bufs[i], POFDP_PACKET_RAW_MAX_LEN, MSG_DONTWAIT, \
+                        (struct sockaddr *)&from, &fromLen)) <= 0){
+            break;
+        }
+        if(from.sll_pkttype == PACKET_OUTGOING){
+            continue;
+        }
+        lens[i++] = len;
+    }
+    return i;
+}
+
+/* Send the packets by sendmmsg() through the send socket of the port. */
+static uint32_t
+rawTxBurst(struct portInfo *port, const struct pofdp_tx_desc *pkts, uint32_t num)
+{
+    struct mmsghdr msg[POFDP_TX_BATCH_SIZE];
+    struct iovec iov[POFDP_TX_BATCH_SIZE][2];
+    struct sockaddr_ll sll = {0};
+    uint32_t i, n, sent = 0;
+    int ret;
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = POF_HTONS(ETH_P_ALL);
+    sll.sll_ifindex = port->sysIndex;
+
+    while(sent < num){
+        n = POF_MIN(num - sent, POFDP_TX_BATCH_SIZE);
+        memset(msg, 0, n * sizeof msg[0]);
+        for(i=0; i<n; i++){
+            iov[i][0].iov_base = (uint8_t *)pkts[sent + i].meta;
+            iov[i][0].iov_len = pkts[sent + i].metaLen;
+            iov[i][1].iov_base = (uint8_t *)pkts[sent + i].packet;
+            iov[i][1].iov_len = pkts[sent + i].len;
+            msg[i].msg_hdr.msg_name = &sll;
+            msg[i].msg_hdr.msg_namelen = sizeof sll;
+            /* Skip the metadata if there is none. */
+            msg[i].msg_hdr.msg_iov = pkts[sent + i].metaLen ? iov[i] : &iov[i][1];
+            msg[i].msg_hdr.msg_iovlen = pkts[sent + i].metaLen ? 2 : 1;
+        }
+        if((ret = sendmmsg(port->queue_fd[1], msg, n, 0)) <= 0){
+            break;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+
+/* The sockets of a raw port are left to the local resource. */
+static void
+rawClose(struct portInfo *port)
+{
+    return;
+}
+
+static uint32_t
+pcapSwap32(uint32_t x, uint8_t swapped)
+{
+    return swapped ? __builtin_bswap32(x) : x;
+}
+
+/* "file" replays the file once, "file,N" N times, and "file,0" forever. */
+static uint32_t
+pcapReplayOpen(struct portInfo *port, const char *arg)
+{
+    char path[POFDP_BACKEND_ARG_LEN], *comma;
+    struct pcapFileHeader hdr;
+    struct pcapReplay *pr;
+
+    strncpy(path, arg, sizeof path - 1);
+    path[sizeof path - 1] = '\0';
+    POF_MALLOC_SAFE_RETURN(pr, 1, POF_ERROR);
+    pr->repeat = 1;
+    if((comma = strchr(path, ',')) != NULL){
+        *comma = '\0';
+        pr->repeat = atoi(comma + 1);
+    }
+
+    if((pr->fp = fopen(path, "rb")) == NULL){
+        FREE(pr);
+        POF_ERROR_CPRINT_FL("Port %s: Can't open the pcap file %s.", port->name, path);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_OPEN_FILE_FAILURE);
+    }
+    if(fread(&hdr, sizeof hdr, 1, pr->fp) != 1 || \
+            (hdr.magic != PCAP_MAGIC && hdr.magic != PCAP_MAGIC_NSEC && \
+             __builtin_bswap32(hdr.magic) != PCAP_MAGIC && \
+             __builtin_bswap32(hdr.magic) != PCAP_MAGIC_NSEC)){
+        fclose(pr->fp);
+        FREE(pr);
+        POF_ERROR_CPRINT_FL("Port %s: %s is not a pcap file.", port->name, path);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_OPEN_FILE_FAILURE);
+    }
+    pr->swapped = (hdr.magic != PCAP_MAGIC && hdr.magic != PCAP_MAGIC_NSEC);
+    if(pcapSwap32(hdr.linkType, pr->swapped) != PCAP_LINKTYPE_ETH){
+        fclose(pr->fp);
+        FREE(pr);
+        POF_ERROR_CPRINT_FL("Port %s: The link type of %s is not Ethernet.", port->name, path);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_OPEN_FILE_FAILURE);
+    }
+
+    port->backendData = pr;
+    return POF_OK;
+}
+
+/* Read the next records of the file. The packets longer than the
+ * packet buffer are skipped. */
+static uint32_t
+pcapReplayRxBurst(struct portInfo *port, uint8_t **bufs, uint32_t *lens, uint32_t num)
+{
+    struct pcapReplay *pr = port->backendData;
+    struct pcapRecordHeader rec;
+    uint32_t i = 0, capLen;
+
+    if(!pr){
+        return 0;
+    }
+
+    while(i < num){
+        if(fread(&rec, sizeof rec, 1, pr->fp) != 1){
+            /* Rewind at the end of the file, until all rounds are done. */
+            if(pr->repeat != 0 && ++pr->round >= pr->repeat){
+                pr->round = pr->repeat;
+                break;
+            }
+            if(fseek(pr->fp, sizeof(struct pcapFileHeader), SEEK_SET) != 0 || pr->pktNum == 0){
+                break;
+            }
+            continue;
+        }
+
+        capLen = pcapSwap32(rec.capLen, pr->swapped);
+        if(capLen > POFDP_PACKET_RAW_MAX_LEN){
+            fseek(pr->fp, capLen, SEEK_CUR);
+            continue;
+        }
+        if(fread(bufs[i], 1, capLen, pr->fp) != capLen){
+            continue;
+        }
+        lens[i++] = capLen;
+        pr->pktNum ++;
+    }
+    return i;
+}
+
+/* The packets sent out through a replay port go nowhere. */
+static uint32_t
+pcapReplayTxBurst(struct portInfo *port, const struct pofdp_tx_desc *pkts, uint32_t num)
+{
+    return num;
+}
+
+static void
+pcapReplayClose(struct portInfo *port)
+{
+    struct pcapReplay *pr = port->backendData;
+
+    if(pr){
+        port->backendData = NULL;
+        fclose(pr->fp);
+        FREE(pr);
+    }
+    return;
+}
+
+static uint32_t
+pcapRecordOpen(struct portInfo *port, const char *arg)
+{
+    struct pcapFileHeader hdr = {PCAP_MAGIC, 2, 4, 0, 0, PCAP_SNAPLEN, PCAP_LINKTYPE_ETH};
+    struct pcapRecord *pr;
+
+    POF_MALLOC_SAFE_RETURN(pr, 1, POF_ERROR);
+    if((pr->fp = fopen(arg, "wb")) == NULL || fwrite(&hdr, sizeof hdr, 1, pr->fp) != 1 || \
+            fflush(pr->fp) != 0){
+        if(pr->fp){
+            fclose(pr->fp);
+        }
+        FREE(pr);
+        POF_ERROR_CPRINT_FL("Port %s: Can't write the pcap file %s.", port->name, arg);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_OPEN_FILE_FAILURE);
+    }
+    pthread_mutex_init(&pr->lock, NULL);
+
+    port->backendData = pr;
+    return POF_OK;
+}
+
+/* Nothing is received by a record port. */
+static uint32_t
+pcapRecordRxBurst(struct portInfo *port, uint8_t **bufs, uint32_t *lens, uint32_t num)
+{
+    return 0;
+}
+
+/* Append one record for each packet, the metadata in front of the packet
+ * as they go out on the wire. */
+static uint32_t
+pcapRecordTxBurst(struct portInfo *port, const struct pofdp_tx_desc *pkts, uint32_t num)
+{
+    struct pcapRecord *pr = port->backendData;
+    struct pcapRecordHeader rec;
+    struct timeval tv;
+    uint32_t i;
+
+    if(!pr){
+        return 0;
+    }
+
+    gettimeofday(&tv, NULL);
+    rec.sec = tv.tv_sec;
+    rec.usec = tv.tv_usec;
+
+    pthread_mutex_lock(&pr->lock);
+    for(i=0; i<num; i++){
+        rec.capLen = rec.len = pkts[i].metaLen + pkts[i].len;
+        if(fwrite(&rec, sizeof rec, 1, pr->fp) != 1 || \
+                fwrite(pkts[i].meta, 1, pkts[i].metaLen, pr->fp) != pkts[i].metaLen || \
+                fwrite(pkts[i].packet, 1, pkts[i].len, pr->fp) != pkts[i].len){
+            break;
+        }
+        pr->pktNum ++;
+    }
+    pthread_mutex_unlock(&pr->lock);
+    return i;
+}
+
+static void
+pcapRecordClose(struct portInfo *port)
+{
+    struct pcapRecord *pr = port->backendData;
+
+    if(pr){
+        port->backendData = NULL;
+        pthread_mutex_lock(&pr->lock);
+        fclose(pr->fp);
+        pthread_mutex_unlock(&pr->lock);
+        pthread_mutex_destroy(&pr->lock);
+        FREE(pr);
+    }
+    return;
+}
+
+static uint32_t
+loopOpen(struct portInfo *port, const char *arg)
+{
+    struct loopQueue *lq;
+
+    POF_MALLOC_SAFE_RETURN(lq, 1, POF_ERROR);
+    pthread_mutex_init(&lq->lock, NULL);
+
+    port->backendData = lq;
+    return POF_OK;
+}
+
+/* Take the packets sent out through the port. */
+static uint32_t
+loopRxBurst(struct portInfo *port, uint8_t **bufs, uint32_t *lens, uint32_t num)
+{
+    struct loopQueue *lq = port->backendData;
+    uint32_t i;
+
+    if(!lq){
+        return 0;
+    }
+
+    pthread_mutex_lock(&lq->lock);
+    for(i=0; i<num && lq->num>0; i++){
+        memcpy(bufs[i], lq->buf[lq->head], lq->len[lq->head]);
+        lens[i] = lq->len[lq->head];
+        lq->head = (lq->head + 1) % POFDP_BACKEND_LOOP_LEN;
+        lq->num --;
+    }
+    pthread_mutex_unlock(&lq->lock);
+    return i;
+}
+
+/* Queue the packets to be received by the port again. The packets are
+ * dropped if the queue is full. */
+static uint32_t
+loopTxBurst(struct portInfo *port, const struct pofdp_tx_desc *pkts, uint32_t num)
+{
+    struct loopQueue *lq = port->backendData;
+    uint32_t i, tail;
+
+    if(!lq){
+        return 0;
+    }
+
+    pthread_mutex_lock(&lq->lock);
+    for(i=0; i<num; i++){
+        tail = (lq->head + lq->num) % POFDP_BACKEND_LOOP_LEN;
+        if(lq->num == POFDP_BACKEND_LOOP_LEN || \
+                (lq->len[tail] = txCopy(lq->buf[tail], POFDP_PACKET_RAW_MAX_LEN, &pkts[i])) == 0){
+            lq->drop ++;
+            continue;
+        }
+        lq->num ++;
+    }
+    pthread_mutex_unlock(&lq->lock);
+    return num;
+}
+
+static void
+loopClose(struct portInfo *port)
+{
+    struct loopQueue *lq = port->backendData;
+
+    if(lq){
+        port->backendData = NULL;
+        pthread_mutex_destroy(&lq->lock);
+        FREE(lq);
+    }
+    return;
+}
+
+/* The raw socket of a system port. */
+const struct pofdp_backend pofdp_backend_raw = {
+    "raw", rawOpen, rawRxBurst, rawTxBurst, rawClose
+};
+
+/* Replays the packets of a pcap file as fast as the port is polled. */
+static const struct pofdp_backend pcapReplayBackend = {
+    "pcap-replay", pcapReplayOpen, pcapReplayRxBurst, pcapReplayTxBurst, pcapReplayClose
+};
+
+/* Writes the packets sent out through the port into a pcap file. */
+static const struct pofdp_backend pcapRecordBackend = {
+    "pcap-record", pcapRecordOpen, pcapRecordRxBurst, pcapRecordTxBurst, pcapRecordClose
+};
+
+/* Receives the packets sent out through the port itself. */
+static const struct pofdp_backend loopBackend = {
+    "loop", loopOpen, loopRxBurst, loopTxBurst, loopClose
+};
+
+static const struct pofdp_backend *backends[] = {
+    &pofdp_backend_raw, &pcapReplayBackend, &pcapRecordBackend, &loopBackend,
+};
+
+/* The backend with the name, or NULL if there is none. */
+const struct pofdp_backend *
+pofdp_backend_find(const char *name)
+{
+    uint32_t i;
+
+    for(i=0; i<sizeof backends / sizeof backends[0]; i++){
+        if(strcmp(backends[i]->name, name) == 0){
+            return backends[i];
+        }
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ * Open the backend of a port
+ * Form:     uint32_t pofdp_backend_open(struct portInfo *port,
+ *                                       const struct pofdp_backend *backend,
+ *                                       const char *arg)
+ * Input:    port, backend, the argument of the backend
+ * Output:   port->backend, port->backendData
+ * Return:   POF_OK or Error code
+ * Discribe: This function sets up the I/O of the port. The argument
+ *           depends on the backend:
+ *             raw          NONE. The sockets are opened by the local
+ *                          resource.
+ *             pcap-replay  "file[,N]". Replays the file N times, or
+ *                          forever if N is 0. Default is once.
+ *             pcap-record  "file".
+ *             loop         NONE.
+ ***********************************************************************/
+uint32_t
+pofdp_backend_open(struct portInfo *port, const struct pofdp_backend *backend, const char *arg)
+{
+    uint32_t ret;
+
+    ret = backend->open(port, arg ? arg : "");
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    port->backend = backend;
+    return POF_OK;
+}
+
+/* Close the backend of the port. Nothing is received or sent through
+ * the port afterwards. */
+void
+pofdp_backend_close(struct portInfo *port)
+{
+    if(port->backend){
+        port->backend->close(port);
+    }
+    return;
+}
+
+/* Close the backends of all ports, so that the recorded files are
+ * complete. It is called when the switch terminates. */
+void
+pofdp_backend_close_all(struct pof_datapath *dp)
+{
+    struct pof_local_resource *lr, *lrNext;
+    struct portInfo *port, *next;
+
+    if(!dp->slotMap){
+        return;
+    }
+    HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
+        if(!lr->portPofIndexMap){
+            continue;
+        }
+        HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
+            if(port->backend != &pofdp_backend_raw){
+                pofdp_backend_close(port);
+            }
+        }
+    }
+    return;
+}
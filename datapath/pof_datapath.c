@@ -38,11 +38,14 @@
 #include <string.h>
 #include <linux/if_packet.h>
 #include <net/ethernet.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
 
 /* Task id. */
 task_t g_pofdp_detect_port_task_id = 0;
 
-static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins);
+static uint32_t pofdp_forward(POFDP_ARG);
 static uint32_t pofdp_recv_raw_task(void *arg_ptr);
 
 static uint32_t 
@@ -85,11 +88,11 @@ pofdp_slot_init(struct pof_datapath *dp)
     uint32_t i, ret, slotID = POF_SLOT_ID_BASE;
     struct pof_local_resource *lr = NULL;
 
-    dp->slotMap = hmap_create(dp->slotMax);
+    dp->slotMap = hmap_createFixed(dp->slotMax);
     for(i=0; i<dp->slotNum; i++){
         POF_MALLOC_SAFE_RETURN(lr, 1, POF_ERROR);
         lr->slotID = slotID;
-        lr->slotNode.hash = hmap_hashForLinear(slotID);
+        lr->slotNode.hash = hmap_hashForUint32(slotID);
         hmap_nodeInsert(dp->slotMap, &lr->slotNode);
         fill_localresource_param(lr, &dp->param);
     
@@ -106,7 +109,7 @@ pofdp_get_local_resource(uint16_t slot, const struct pof_datapath *dp)
 {
     struct pof_local_resource *lr, *ptr;
     return HMAP_STRUCT_GET(lr, slotNode, \
-            hmap_hashForLinear(slot), dp->slotMap, ptr);
+            hmap_hashForUint32(slot), dp->slotMap, ptr);
 }
 
 /***********************************************************************
@@ -124,10 +127,24 @@ uint32_t pof_datapath_init(struct pof_datapath *dp){
     struct pof_local_resource *lr, *lrNext;
     uint32_t i, ret;
 
+    /* The fanout members are served by the workers, so start as many
+     * workers as the biggest fanout group if no worker is set. */
+    if(dp->workerNum == 0){
+        for(i=0; i<dp->fanoutPortNum; i++){
+            dp->workerNum = POF_MAX(dp->workerNum, dp->fanoutPorts[i].num);
+        }
+    }
+
+    /* Create the worker tasks which poll the ports, if any. */
+    if(dp->workerNum){
+        ret = pofdp_worker_pool_create(dp);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+
     /* Create task to receive raw packet. */
     HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
         HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
-            if(port->taskID == POF_INVALID_TASKID){
+            if(port->taskID == POF_INVALID_TASKID && port->workerPort == NULL){
                 if(pofdp_create_port_listen_task(port) != POF_OK){
                     POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_CREATE_FAIL);
                 }
@@ -142,12 +159,19 @@ uint32_t pof_datapath_init(struct pof_datapath *dp){
     return POF_OK;
 }
 
+/* Start receiving the packets from the port, by a new task of its own,
+ * or by one of the worker tasks if there are. The workers poll the raw
+ * ports only. */
 uint32_t 
 pofdp_create_port_listen_task(struct portInfo *port)
 {
 	uint32_t ret = POF_OK;
     task_t tid;
 
+    if(g_dp.workerNum && port->backend == &pofdp_backend_raw){
+        return pofdp_worker_port_add(port, &g_dp);
+    }
+
 	ret = pofbf_task_create(port, (void *)pofdp_recv_raw_task, &port->taskID);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Start recv_raw task!", port->name);
@@ -155,24 +179,21 @@ pofdp_create_port_listen_task(struct portInfo *port)
 	return POF_OK;
 }
 
-static void 
-set_goto_first_table_instruction(struct pof_instruction *p)
+/* Stop receiving the packets from the port. */
+uint32_t 
+pofdp_delete_port_listen_task(struct portInfo *port)
 {
-	struct pof_instruction_goto_table *pigt = \
-			(struct pof_instruction_goto_table *)p->instruction_data;
-
-	p->type = POFIT_GOTO_TABLE;
-	p->len = sizeof(pigt);
-	pigt->next_table_id = POFDP_FIRST_TABLE_ID;
-	return;
+    if(port->workerPort){
+        return pofdp_worker_port_del(port);
+    }
+    return pofbf_task_delete(&port->taskID);
 }
 
 
 /***********************************************************************
  * Forward function
- * Form:     static uint32_t pofdp_forward(POFDP_ARG, \
- *                                  struct pof_instruction *first_ins)
- * Input:    dpp, dp, first_ins
+ * Form:     static uint32_t pofdp_forward(POFDP_ARG)
+ * Input:    dpp, dp
  * Return:   POF_OK or Error code
  * Discribe: This function forwards the packet between the flow tables.
  *           The new packet will be send into the MM0 table, which is
@@ -181,9 +202,8 @@ set_goto_first_table_instruction(struct pof_instruction *p)
  *           or execute the instruction and action corresponding to the
  *           matched flow entry.
  ***********************************************************************/
-static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins)
+static uint32_t pofdp_forward(POFDP_ARG)
 {
-	uint8_t metadata[POFDP_METADATA_MAX_LEN] = {0};
 	uint32_t ret;
 
 	POF_DEBUG_CPRINT(1,BLUE,"\n");
@@ -192,18 +212,498 @@ static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins)
 	POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->packetBuf,dpp->left_len,"Input packet data is ");
 
 	/* Initialize the metadata. */
-	ret = init_packet_metadata(dpp, (struct pofdp_metadata *)metadata, sizeof(metadata));
+	ret = init_packet_metadata(dpp, (struct pofdp_metadata *)dpp->mbuf->metadata, \
+            sizeof(dpp->mbuf->metadata));
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	/* Set the first instruction to the Datapath packet. */
-	dpp->ins = first_ins;
-	dpp->ins_todo_num = 1;
+	/* Start with the program going to the first flow table. */
+	dpp->prog = &lr->firstProg;
+	dpp->op = lr->firstProg.ops;
 
 	ret = pofdp_instruction_execute(dpp, lr);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     return POF_OK;
 }
 
+/***********************************************************************
+ * Forward a burst of packets
+ * Form:     uint32_t pofdp_forward_burst(struct pofdp_packet **dpps,
+ *                                        uint32_t num,
+ *                                        struct pof_local_resource *lr)
+ * Input:    dpps, packet number, lr
+ * Return:   POF_OK or Error code
+ * Discribe: This function forwards num packets between the flow tables
+ *           together, POFDP_BURST_SIZE packets at a time. It is the
+ *           same as pofdp_forward() for each packet, except that the
+ *           packets going to the same table are looked up by one
+ *           poflr_entry_lookup_burst(), the output packets are
+ *           queued in the TX batch of the dpp if it has one, and the
+ *           counters are increased once per burst. A packet or sub-burst
+ *           which fails is skipped, and the others are still forwarded.
+ *           The last error is returned.
+ ***********************************************************************/
+uint32_t
+pofdp_forward_burst(struct pofdp_packet **dpps, uint32_t num, \
+                    struct pof_local_resource *lr)
+{
+    struct pofdp_packet *dpp;
+	uint32_t i, base, burstNum, ret, err = POF_OK;
+
+    for(base=0; base<num; base+=burstNum){
+        burstNum = POF_MIN(num - base, POFDP_BURST_SIZE);
+
+        for(i=0; i<burstNum; i++){
+            dpp = dpps[base + i];
+
+            POF_DEBUG_CPRINT(1,BLUE,"\n");
+            POF_DEBUG_CPRINT_FL(1,BLUE,"Receive a raw packet! len_B = %d, port id = %u", \
+                    dpp->ori_len, dpp->ori_port_id);
+            POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->packetBuf,dpp->left_len,"Input packet data is ");
+
+            /* Initialize the metadata. */
+            ret = init_packet_metadata(dpp, (struct pofdp_metadata *)dpp->mbuf->metadata, \
+                    sizeof(dpp->mbuf->metadata));
+
+            /* Start with the program going to the first flow table. */
+            dpp->prog = &lr->firstProg;
+            dpp->op = lr->firstProg.ops;
+            dpp->burst = TRUE;
+
+            /* Skip only this packet. */
+            if(ret != POF_OK){
+                err = ret;
+                dpp->packet_done = TRUE;
+            }
+        }
+
+        /* The counters are flushed and the next packets are forwarded
+         * even if this sub-burst fails. */
+        ret = pofdp_instruction_execute_burst(dpps + base, burstNum, lr);
+        if(dpps[base]->counterBatch){
+            pofdp_counter_batch_flush(dpps[base]->counterBatch);
+        }
+        if(ret != POF_OK){
+            err = ret;
+        }
+    }
+    return err;
+}
+
+/***********************************************************************
+ * Check one received raw packet
+ * Form:     static uint32_t recvPacketCheck(POFDP_ARG, struct portInfo *port_ptr,
+ *                                           uint32_t len_B, struct sockaddr_ll *from)
+ * Input:    dpp, lr, port, packet length, packet address
+ * Return:   POF_OK if the packet should be forwarded, otherwise POF_ERROR
+ * Discribe: This function checks and filters the packet stored in
+ *           dpp->packetBuf, and fills the input infomation of the dpp.
+ *           It is shared by both the recvfrom() and the RX ring receive
+ *           modes.
+ ***********************************************************************/
+static uint32_t
+recvPacketCheck(POFDP_ARG, struct portInfo *port_ptr, uint32_t len_B, \
+                struct sockaddr_ll *from)
+{
+    struct pof_datapath *dp = &g_dp;
+
+    /* Check whether the OpenFlow-enabled of the port is on or not. */
+    if(port_ptr->of_enable == POFE_DISABLE || from->sll_pkttype == PACKET_OUTGOING){
+        return POF_ERROR;
+    }
+
+    /* Check the packet length. */
+    if(len_B > POF_MTU_LENGTH){
+        POF_DEBUG_CPRINT_FL(1,RED,"The packet received is longer than MTU. DROP!");
+        return POF_ERROR;
+    }
+
+    /* Filter the received raw packet by some rules. */
+    if(dp->filter(dpp->packetBuf, port_ptr, *from) != POF_OK){
+        return POF_ERROR;
+    }
+
+    /* Store packet data, length, received port infomation into the message queue. */
+    dpp->ori_port_id = port_ptr->pofIndex;
+    dpp->ori_len = len_B;
+    dpp->left_len = dpp->ori_len;
+    dpp->buf_offset = dpp->packetBuf;
+
+    /* Check whether the first flow table exist. */
+    if(!(poflr_get_table_with_ID(POFDP_FIRST_TABLE_ID, lr))){
+        POF_DEBUG_CPRINT_FL(1,RED,"Received a packet, but the first flow table does NOT exist.");
+        return POF_ERROR;
+    }
+
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Handle one received raw packet
+ * Form:     static void recvPacketHandle(POFDP_ARG, struct portInfo *port_ptr,
+ *                                        uint32_t len_B, struct sockaddr_ll *from)
+ * Input:    dpp, lr, port, packet length, packet address
+ * Return:   VOID
+ * Discribe: This function checks and filters the packet stored in
+ *           dpp->packetBuf, and then forwards it. It is used by the
+ *           recvfrom() receive mode.
+ ***********************************************************************/
+static void
+recvPacketHandle(POFDP_ARG, struct portInfo *port_ptr, uint32_t len_B, \
+                 struct sockaddr_ll *from)
+{
+    struct pof_datapath *dp = &g_dp;
+    uint32_t ret;
+
+    if(recvPacketCheck(dpp, lr, port_ptr, len_B, from) != POF_OK){
+        return;
+    }
+
+    /* Forward the packet. */
+    ret = pofdp_forward(dpp, lr);
+    POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+
+    dp->pktCount ++;
+    POF_DEBUG_CPRINT_FL(1,GREEN,"one packet_raw has been processed!\n");
+    return;
+}
+
+/* Forward a burst of received packets, send the outputs of the burst
+ * out together, and free the packets. */
+static void
+recvBurstForward(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                 struct pofdp_packet **burst, uint32_t burstNum)
+{
+    struct pof_datapath *dp = &g_dp;
+    struct pofdp_tx_batch *txBatch = pool->dpps->txBatch;
+    uint32_t j, ret;
+
+    ret = pofdp_forward_burst(burst, burstNum, lr);
+    POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+
+    /* The queued outputs refer to the packet data of the burst. */
+    if(txBatch){
+        pofdp_tx_batch_flush(txBatch);
+    }
+    for(j=0; j<burstNum; j++){
+        pofdp_packet_free(pool, burst[j]);
+    }
+    dp->pktCount += burstNum;
+
+    /* No entry or table of the burst is referred to any more. */
+    rcu_quiescent(&pool->rcu);
+    return;
+}
+
+/* Whether the packet belongs to another member of the software fanout. */
+static uint8_t
+fanoutSkip(const struct pofdp_fanout *fanout, const uint8_t *packet, uint32_t len)
+{
+    return fanout && (pofdp_flow_hash(packet, len) % fanout->num) != fanout->index;
+}
+
+/* Whether the port receives packets through the RX ring. */
+uint8_t
+pofdp_rx_ring_enabled(const struct portInfo *port_ptr, const struct pof_datapath *dp)
+{
+    uint8_t i;
+
+    if(dp->rxMode == POFDP_RX_RING){
+        return TRUE;
+    }
+    for(i=0; i<dp->rxRingPortNum; i++){
+        if(strncmp(dp->rxRingPorts[i], port_ptr->name, PORT_NAME_LEN) == 0){
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/***********************************************************************
+ * Forward the packets of one RX ring block
+ * Form:     void pofdp_recv_ring_block(struct pofdp_packet_pool *pool,
+ *                                      struct pof_local_resource *lr,
+ *                                      struct pofdp_rx_ring *ring,
+ *                                      struct tpacket_block_desc *block,
+ *                                      struct portInfo *port_ptr,
+ *                                      const struct pofdp_fanout *fanout)
+ * Input:    pool, lr, ring, block, port, software fanout share
+ * Return:   VOID
+ * Discribe: This function forwards the packets of the block in place,
+ *           without any syscall or copy, by bursts of POFDP_BURST_SIZE
+ *           packets, and sends the output packets of each burst
+ *           together. Then it gives the block back to the kernel.
+ *           If fanout is not NULL, the packets of other members are
+ *           skipped.
+ * NOTE:     The pool should have POFDP_BURST_SIZE descriptors at least.
+ ***********************************************************************/
+void
+pofdp_recv_ring_block(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                      struct pofdp_rx_ring *ring, struct tpacket_block_desc *block,   \
+                      struct portInfo *port_ptr, const struct pofdp_fanout *fanout)
+{
+    struct tpacket3_hdr *frame;
+    struct pofdp_packet *burst[POFDP_BURST_SIZE], *dpp;
+    uint32_t i, pktNum, burstNum, frameOffset, room;
+
+    pktNum = block->hdr.bh1.num_pkts;
+    frameOffset = block->hdr.bh1.offset_to_first_pkt;
+    for(i=0, burstNum=0; i<pktNum; i++){
+        frame = (struct tpacket3_hdr *)((uint8_t *)block + frameOffset);
+
+        /* Initialize the dpp. */
+        dpp = pofdp_packet_alloc(pool);
+        dpp->packetBuf = (uint8_t *)frame + frame->tp_mac;
+        /* The room ends at the next frame, or at the end of the block. */
+        room = (frame->tp_next_offset ? frame->tp_next_offset : \
+                ring->blockSize - frameOffset) - frame->tp_mac;
+        dpp->packetBufLen = POF_MIN(room, POFDP_PACKET_RAW_MAX_LEN);
+
+        /* The snaplen is less than the len only if the packet is truncated. */
+        if(frame->tp_snaplen != frame->tp_len){
+            POF_DEBUG_CPRINT_FL(1,RED,"The packet received is truncated in the RX ring. DROP!");
+            pofdp_packet_free(pool, dpp);
+        }else if(fanoutSkip(fanout, dpp->packetBuf, frame->tp_snaplen)){
+            pofdp_packet_free(pool, dpp);
+        }else if(recvPacketCheck(dpp, lr, port_ptr, frame->tp_snaplen, \
+                    (struct sockaddr_ll *)((uint8_t *)frame + TPACKET_ALIGN(sizeof *frame))) == POF_OK){
+            burst[burstNum++] = dpp;
+        }else{
+            pofdp_packet_free(pool, dpp);
+        }
+
+        frameOffset += frame->tp_next_offset;
+
+        /* Forward the burst when it is full, or at the end of the block. */
+        if(burstNum == POFDP_BURST_SIZE || (i == pktNum - 1 && burstNum > 0)){
+            recvBurstForward(pool, lr, burst, burstNum);
+            burstNum = 0;
+        }
+    }
+
+    pofdp_rx_ring_release_block(ring, block);
+    return;
+}
+
+/***********************************************************************
+ * Receive packets through the RX ring
+ * Form:     static void recvRing(struct pofdp_packet_pool *pool,
+ *                                struct pof_local_resource *lr,
+ *                                struct pofdp_rx_ring *ring,
+ *                                struct portInfo *port_ptr)
+ * Input:    pool, lr, ring, port
+ * Return:   VOID
+ * Discribe: This function is the infinite loop of the receive task in
+ *           the RX ring mode. It takes the blocks from the ring one by
+ *           one, and forwards the packets of each block.
+ ***********************************************************************/
+static void
+recvRing(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+         struct pofdp_rx_ring *ring, struct portInfo *port_ptr)
+{
+    struct tpacket_block_desc *block;
+
+    while(1){
+        pthread_testcancel();
+
+        /* Not waited for by the flow mods while waiting for a block. */
+        rcu_offline(&pool->rcu);
+        block = pofdp_rx_ring_next_block(ring, POFDP_RX_RING_BLOCK_TIMEOUT);
+        rcu_online(&pool->rcu);
+        if(block == NULL){
+            continue;
+        }
+        pofdp_recv_ring_block(pool, lr, ring, block, port_ptr, NULL);
+    }
+    return;
+}
+
+/***********************************************************************
+ * Receive a burst of packets from a non-blocking socket
+ * Form:     uint32_t pofdp_recv_socket_burst(struct pofdp_packet_pool *pool,
+ *                                            struct pof_local_resource *lr,
+ *                                            int sock,
+ *                                            struct portInfo *port_ptr,
+ *                                            const struct pofdp_fanout *fanout)
+ * Input:    pool, lr, socket, port, software fanout share
+ * Return:   The number of packets received.
+ * Discribe: This function receives the packets which are already queued
+ *           in the socket, POFDP_BURST_SIZE packets at most, forwards
+ *           them together and sends the output packets of the burst
+ *           together. If fanout is not NULL, the packets of other
+ *           members are skipped.
+ * NOTE:     The socket should be non-blocking, and the pool should have
+ *           POFDP_BURST_SIZE descriptors at least.
+ ***********************************************************************/
+uint32_t
+pofdp_recv_socket_burst(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                        int sock, struct portInfo *port_ptr, const struct pofdp_fanout *fanout)
+{
+    struct sockaddr_ll from = {0};
+    socklen_t from_len;
+    struct pofdp_packet *burst[POFDP_BURST_SIZE], *dpp;
+    uint32_t i, burstNum = 0;
+    ssize_t len_B;
+
+    for(i=0; i<POFDP_BURST_SIZE; i++){
+        dpp = pofdp_packet_alloc(pool);
+
+        from_len = sizeof from;
+        if((len_B = recvfrom(sock, dpp->packetBuf, POFDP_PACKET_RAW_MAX_LEN, 0, \
+                        (struct sockaddr *)&from, &from_len)) <= 0){
+            if(len_B < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_RECEIVE_MSG_FAILURE, g_upward_xid++);
+            }
+            pofdp_packet_free(pool, dpp);
+            break;
+        }
+
+        if(!fanoutSkip(fanout, dpp->packetBuf, len_B) && \
+                recvPacketCheck(dpp, lr, port_ptr, len_B, &from) == POF_OK){
+            burst[burstNum++] = dpp;
+        }else{
+            pofdp_packet_free(pool, dpp);
+        }
+    }
+
+    if(burstNum > 0){
+        recvBurstForward(pool, lr, burst, burstNum);
+    }
+    return i;
+}
+
+/***********************************************************************
+ * Receive a burst of packets through the backend of the port
+ * Form:     uint32_t pofdp_recv_backend_burst(struct pofdp_packet_pool *pool,
+ *                                             struct pof_local_resource *lr,
+ *                                             struct portInfo *port_ptr)
+ * Input:    pool, lr, port
+ * Return:   The number of packets received.
+ * Discribe: This function receives POFDP_BURST_SIZE packets at most by
+ *           the rx_burst() of the port backend, forwards them together
+ *           and sends the output packets of the burst together, just as
+ *           the packets received from a raw socket.
+ * NOTE:     The pool should have POFDP_BURST_SIZE descriptors at least.
+ ***********************************************************************/
+uint32_t
+pofdp_recv_backend_burst(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                         struct portInfo *port_ptr)
+{
+    struct sockaddr_ll from = {0};
+    struct pofdp_packet *dpps[POFDP_BURST_SIZE], *burst[POFDP_BURST_SIZE];
+    uint8_t *bufs[POFDP_BURST_SIZE];
+    uint32_t lens[POFDP_BURST_SIZE];
+    uint32_t i, num, burstNum = 0;
+
+    /* The backend packets come as if they were sent to the host. */
+    from.sll_family = AF_PACKET;
+    from.sll_ifindex = port_ptr->sysIndex;
+    from.sll_pkttype = PACKET_HOST;
+
+    for(i=0; i<POFDP_BURST_SIZE; i++){
+        dpps[i] = pofdp_packet_alloc(pool);
+        bufs[i] = dpps[i]->packetBuf;
+    }
+    num = port_ptr->backend->rx_burst(port_ptr, bufs, lens, POFDP_BURST_SIZE);
+
+    for(i=0; i<POFDP_BURST_SIZE; i++){
+        if(i < num && recvPacketCheck(dpps[i], lr, port_ptr, lens[i], &from) == POF_OK){
+            burst[burstNum++] = dpps[i];
+        }else{
+            pofdp_packet_free(pool, dpps[i]);
+        }
+    }
+
+    if(burstNum > 0){
+        recvBurstForward(pool, lr, burst, burstNum);
+    }
+    return num;
+}
+
+/* The infinite loop of the receive task of a port driven by a backend
+ * other than the raw socket. The backends never block, so the task
+ * sleeps a while if nothing is received. */
+static void
+recvBackend(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+            struct portInfo *port_ptr)
+{
+    uint32_t n;
+    int state;
+
+    while(1){
+        pthread_testcancel();
+
+        /* fread() and fwrite() are cancellation points, and the backend
+         * may hold its lock in them. */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        n = pofdp_recv_backend_burst(pool, lr, port_ptr);
+        pthread_setcancelstate(state, NULL);
+        if(n == 0){
+            rcu_offline(&pool->rcu);
+            pofbf_task_delay(1);
+            rcu_online(&pool->rcu);
+        }
+    }
+    return;
+}
+
+/***********************************************************************
+ * Receive packets through recvfrom()
+ * Form:     static void recvFrom(struct pofdp_packet_pool *pool,
+ *                                struct pof_local_resource *lr,
+ *                                struct portInfo *port_ptr)
+ * Input:    pool, lr, port
+ * Return:   VOID
+ * Discribe: This function is the infinite loop of the receive task in
+ *           the recvfrom() mode. One packet is received and forwarded
+ *           by each loop, so the receive burst is only one packet.
+ ***********************************************************************/
+static void
+recvFrom(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+         struct portInfo *port_ptr)
+{
+    struct   sockaddr_ll from = {0};
+    uint32_t from_len = sizeof(struct sockaddr_ll), len_B;
+    int      sockRecv;
+    struct pofdp_tx_batch *txBatch = pool->dpps->txBatch;
+    struct pofdp_packet *dpp;
+
+    /* Create socket, and bind it to the specific port. */
+    if((sockRecv = pofdp_recv_socket_open(port_ptr, FALSE)) == -1){
+        /* Delay 0.1s to send error message upward to the Controller. */
+        pofbf_task_delay(100);
+        terminate_handler();
+    }
+
+    /* Receive the raw packet through the specific port. */
+    while(1){
+		pthread_testcancel();
+
+        /* Initialize the dpp. */
+        dpp = pofdp_packet_alloc(pool);
+
+        /* Receive the raw packet. Offline while blocked. */
+        rcu_offline(&pool->rcu);
+        len_B = recvfrom(sockRecv, dpp->packetBuf, POFDP_PACKET_RAW_MAX_LEN, 0, \
+                         (struct sockaddr *)&from, &from_len);
+        rcu_online(&pool->rcu);
+        if(len_B <= 0){
+            POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_RECEIVE_MSG_FAILURE, g_upward_xid++);
+            pofdp_packet_free(pool, dpp);
+            continue;
+        }
+
+        recvPacketHandle(dpp, lr, port_ptr, len_B, &from);
+
+        if(txBatch){
+            pofdp_tx_batch_flush(txBatch);
+        }
+        pofdp_packet_free(pool, dpp);
+    }
+
+    close(sockRecv);
+    return;
+}
+
 /***********************************************************************
  * The task function of receive task
  * Form:     static void pofdp_recv_raw_task(void *arg_ptr)
@@ -218,6 +718,11 @@ static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins)
  *           into the receive queue. The only parameter arg_ptr is the
  *           pointer of the local physical net port infomation which has
  *           been assembled with format of struct pof_port.
+ *           If the RX ring is enabled for the port, the packets are
+ *           received through the ring and forwarded by bursts,
+ *           otherwise through recvfrom() one by one.
+ *           If the TX batch is enabled, the output packets of one
+ *           receive burst are sent out together by sendmmsg().
  * NOTE:     This task will be terminated if any ERRORs occur.
  *           If the openflow function of this physical port is disable,
  *           it will be still loop running but nothing will be received.
@@ -226,108 +731,159 @@ static uint32_t pofdp_recv_raw_task(void *arg_ptr){
     struct portInfo *port_ptr = (struct portInfo *)arg_ptr;
     struct pof_datapath *dp = &g_dp;
     struct pof_local_resource *lr = NULL;
-    struct pofdp_packet dpp[1] = {0};
-    struct pof_instruction first_ins[1] = {0};
-    struct   sockaddr_ll sockadr = {0}, from = {0};
-    uint32_t from_len = sizeof(struct sockaddr_ll), len_B, ret;
-    int      sockRecv, sockSend;
+    struct pofdp_packet_pool *pool;
+    struct pofdp_rx_ring ring[1] = {0};
+    struct pofdp_tx_batch *txBatch = NULL;
+    struct flowCache *flowCache = NULL;
+    uint32_t i;
+    int      sockSend;
 
     if((lr = pofdp_get_local_resource(port_ptr->slotID, dp)) == NULL){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_INVALID_SLOT_ID, g_upward_xid++);
     }
 
-	/* Set GOTO_TABLE instruction to go to the first flow table. */
-	set_goto_first_table_instruction(first_ins);
-
-    /* Create socket, and bind it to the specific port. */
-    if((sockRecv = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
+    /* Create socket to send the output packets. */
+    if((sockSend = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
         POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE, g_upward_xid++);
         /* Delay 0.1s to send error message upward to the Controller. */
         pofbf_task_delay(100);
         terminate_handler();
     }
+    pofdp_send_socket_init(sockSend, dp);
 
-    /* Create socket, and bind it to the specific port. */
-    if((sockSend = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
-        POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE, g_upward_xid++);
-        /* Delay 0.1s to send error message upward to the Controller. */
-        pofbf_task_delay(100);
-        terminate_handler();
+    /* Queue the output packets, and send them once per receive burst. */
+    if(dp->txBatch){
+        txBatch = pofdp_tx_batch_create(sockSend);
     }
+    pthread_cleanup_push((void (*)(void *))pofdp_tx_batch_destroy, txBatch);
 
-    sockadr.sll_family = AF_PACKET;
-    sockadr.sll_protocol = POF_HTONS(ETH_P_ALL);
-    sockadr.sll_ifindex = port_ptr->sysIndex;
+    /* Cache the table lookups of the packets received by the task. */
+    if(dp->flowCache){
+        flowCache = poflr_flow_cache_create();
+    }
+    pthread_cleanup_push((void (*)(void *))poflr_flow_cache_destroy, flowCache);
 
-    if(bind(sockRecv, (struct sockaddr *)&sockadr, sizeof(struct sockaddr_ll)) != 0){
-       POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_BIND_SOCKET_FAILURE, g_upward_xid++);
-        /* Delay 0.1s to send error message upward to the Controller. */
+    /* The packet descriptors for one receive burst. */
+    if((pool = pofdp_packet_pool_create(POFDP_BURST_SIZE, dp)) == NULL){
         pofbf_task_delay(100);
         terminate_handler();
     }
+    for(i=0; i<pool->num; i++){
+        pool->dpps[i].sockSend = sockSend;
+        pool->dpps[i].txBatch = txBatch;
+        pool->dpps[i].flowCache = flowCache;
+    }
+    pthread_cleanup_push((void (*)(void *))pofdp_packet_pool_destroy, pool);
+
+    /* The tables are looked up without a lock. The flow mods free what
+     * they delete after this task has been quiescent. */
+    rcu_register(&pool->rcu);
+
+    /* Receive the raw packets through the RX ring. Fall back to
+     * recvfrom() if the ring can not be set up. The ports of the other
+     * backends are received through their own rx_burst(). */
+    if(port_ptr->backend != &pofdp_backend_raw){
+        recvBackend(pool, lr, port_ptr);
+    }else if(pofdp_rx_ring_enabled(port_ptr, dp) && pofdp_rx_ring_open(ring, port_ptr, dp) == POF_OK){
+        pthread_cleanup_push((void (*)(void *))pofdp_rx_ring_close, ring);
+        recvRing(pool, lr, ring, port_ptr);
+        pthread_cleanup_pop(1);
+    }else{
+        if(pofdp_rx_ring_enabled(port_ptr, dp)){
+            POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Open RX ring failed, use recvfrom instead.", port_ptr->name);
+        }
+        recvFrom(pool, lr, port_ptr);
+    }
 
-    /* Receive the raw packet through the specific port. */
-    while(1){
-		pthread_testcancel();
+    pthread_cleanup_pop(1);
+    pthread_cleanup_pop(1);
+    pthread_cleanup_pop(1);
+    close(sockSend);
+    return POF_OK;
+}
 
-        /* Initialize the dpp. */
-		memset(dpp, 0, sizeof *dpp);
-        dpp->packetBuf = &(dpp->buf[POFDP_PACKET_PREBUF_LEN]);
-		dpp->sockSend = sockSend;
+/***********************************************************************
+ * Copy the packet out of the RX ring
+ * Form:     uint32_t pofdp_packet_copy_from_ring(struct pofdp_packet *dpp)
+ * Input:    dpp
+ * Return:   POF_OK or Error code
+ * Discribe: The packet processed in place in the RX ring has only a
+ *           little room behind it. This function copies the packet,
+ *           together with the room in front of it, into dpp->mbuf, so
+ *           that the packet can grow, such as in add field action.
+ ***********************************************************************/
+uint32_t
+pofdp_packet_copy_from_ring(struct pofdp_packet *dpp)
+{
+    uint8_t *packetBuf = &(dpp->mbuf->buf[POFDP_PACKET_PREBUF_LEN]);
+    uint32_t len = POFDP_PACKET_PREBUF_LEN + dpp->offset + dpp->left_len;
 
-        /* Receive the raw packet. */
-        if((len_B = recvfrom(sockRecv, dpp->packetBuf, POFDP_PACKET_RAW_MAX_LEN, 0, \
-                        (struct sockaddr *)&from, &from_len)) <=0){
-            POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_RECEIVE_MSG_FAILURE, g_upward_xid++);
-            continue;
-        }
+    if(dpp->packetBuf == packetBuf || len > sizeof dpp->mbuf->buf){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    }
 
-        /* Check whether the OpenFlow-enabled of the port is on or not. */
-        if(port_ptr->of_enable == POFE_DISABLE || from.sll_pkttype == PACKET_OUTGOING){
-            continue;
-        }
+    memcpy(dpp->mbuf->buf, dpp->packetBuf - POFDP_PACKET_PREBUF_LEN, len);
+    if(dpp->output_packet_buf){
+        dpp->output_packet_buf = packetBuf + (dpp->output_packet_buf - dpp->packetBuf);
+    }
+    dpp->packetBuf = packetBuf;
+    dpp->buf_offset = packetBuf + dpp->offset;
+    dpp->packetBufLen = POFDP_PACKET_RAW_MAX_LEN;
+    return POF_OK;
+}
 
-        /* Check the packet length. */
-        if(len_B > POF_MTU_LENGTH){
-            POF_DEBUG_CPRINT_FL(1,RED,"The packet received is longer than MTU. DROP!");
-            continue;
-        }
+/* Send the metadata and the packet out through the port right now, as
+ * two pieces of one message. */
+static uint32_t
+sendDirect(int sock, uint32_t sysIndex, const uint8_t *meta, uint16_t metaLen, \
+           const uint8_t *packet, uint16_t len)
+{
+    struct   sockaddr_ll sll = {0};
+    struct iovec iov[2];
+    struct msghdr msg = {0};
 
-        /* Filter the received raw packet by some rules. */
-        if(dp->filter(dpp->packetBuf, port_ptr, from) != POF_OK){
-            continue;
-        }
-		
-        /* Store packet data, length, received port infomation into the message queue. */
-        dpp->ori_port_id = port_ptr->pofIndex;
-        dpp->ori_len = len_B;
-        dpp->left_len = dpp->ori_len;
-        dpp->buf_offset = dpp->packetBuf;
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = sysIndex;
+    sll.sll_protocol = POF_HTONS(ETH_P_ALL);
 
-        dpp->dp = dp;
+    iov[0].iov_base = (uint8_t *)meta;
+    iov[0].iov_len = metaLen;
+    iov[1].iov_base = (uint8_t *)packet;
+    iov[1].iov_len = len;
+    msg.msg_name = &sll;
+    msg.msg_namelen = sizeof(sll);
+    /* Skip the metadata if there is none. */
+    msg.msg_iov = metaLen ? iov : &iov[1];
+    msg.msg_iovlen = metaLen ? 2 : 1;
+
+    if(sendmsg(sock, &msg, 0) == -1){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE, g_upward_xid++);
+    }
 
-		/* Check whether the first flow table exist. */
-		if(!(poflr_get_table_with_ID(POFDP_FIRST_TABLE_ID, lr))){
-			POF_DEBUG_CPRINT_FL(1,RED,"Received a packet, but the first flow table does NOT exist.");
-			continue;
-		}
+    return POF_OK;
+}
 
-        /* Forward the packet. */
-        ret = pofdp_forward(dpp, lr, first_ins);
-        POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+/* Send one output packet through the backend of the port. */
+static uint32_t
+backendSend(struct portInfo *port, const uint8_t *meta, uint16_t metaLen, \
+            const uint8_t *packet, uint16_t len)
+{
+    struct pofdp_tx_desc pkt;
 
-		dp->pktCount ++;
-        POF_DEBUG_CPRINT_FL(1,GREEN,"one packet_raw has been processed!\n");
+    pkt.meta = meta;
+    pkt.metaLen = metaLen;
+    pkt.packet = packet;
+    pkt.len = len;
+    if(port->backend->tx_burst(port, &pkt, 1) != 1){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
     }
-
-    close(sockRecv);
-    close(sockSend);
     return POF_OK;
 }
 
 /***********************************************************************
  * The task function of send task
- * Form:     send_raw(struct pofdp_packet *dpp, struct pof_local_resource *lr)
+ * Form:     send_raw(struct pofdp_packet *dpp, struct pof_local_resource *lr,
+ *                    const uint8_t *meta)
  * Input:    NONE
  * Output:   NONE
  * Return:   VOID
@@ -336,31 +892,59 @@ static uint32_t pofdp_recv_raw_task(void *arg_ptr){
  *           and the sending port infomation. Then it sends the packet
  *           out by binding the socket to the local physical net port
  *           spicified in the port infomation.
+ *           The output metadata in meta and the packet data are sent as
+ *           two pieces of one message, so the packet is never copied.
+ *           If the receive task queues the output packets, the packet
+ *           is only queued here and will be sent out with the others
+ *           at the end of the receive burst.
  * NOTE:     This task will be terminated if any ERRORs occur.
  ***********************************************************************/
 static uint32_t 
-send_raw(const struct pofdp_packet *dpp, const struct pof_local_resource *lr)
+send_raw(struct pofdp_packet *dpp, const struct pof_local_resource *lr, const uint8_t *meta)
 {
     struct portInfo *port = NULL;
-    struct   sockaddr_ll sll = {0};
     //int      sock = dpp->sockSend;
-    uint32_t sysIndex = 0;
+    const uint8_t *packet = dpp->output_packet_buf + dpp->output_packet_offset;
 
     if((port = poflr_get_port_with_pofindex(dpp->output_port_id, lr)) == NULL){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PTR_NULL);
     }
 
+    /* The ports of the other backends are sent through right now. */
+    if(port->backend != &pofdp_backend_raw){
+        return backendSend(port, meta, dpp->output_metadata_len, packet, dpp->output_packet_len);
+    }
+
+    /* The metadata has been written into the batch. The packet data
+     * stays where it is until the batch is flushed. */
+    if(dpp->txBatch){
+        dpp->txPending = TRUE;
+        return pofdp_tx_batch_add(dpp->txBatch, port->sysIndex, dpp->output_metadata_len, \
+                packet, dpp->output_packet_len);
+    }
+
     /* Send the packet data out through the port. */
-    sll.sll_family = AF_PACKET;
-    sll.sll_ifindex = port->sysIndex;
-    sll.sll_protocol = POF_HTONS(ETH_P_ALL);
+    return sendDirect(port->queue_fd[1], port->sysIndex, meta, dpp->output_metadata_len, \
+            packet, dpp->output_packet_len);
+}
 
-    if(sendto(port->queue_fd[1], dpp->buf_out, dpp->output_whole_len, 0, (struct sockaddr *)&sll, sizeof(sll)) == -1){
-    //if(sendto(sock, dpp->buf_out, dpp->output_whole_len, 0, (struct sockaddr *)&sll, sizeof(sll)) == -1){
-    	printf("here error!!\n");
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE, g_upward_xid++);
+/* Check the output lengths and copy the output metadata to meta. */
+static uint32_t
+outputMetadataCopy(const struct pofdp_packet *dpp, uint8_t *meta)
+{
+    /* Check the packet lenght. */
+    if(dpp->output_whole_len > POF_MTU_LENGTH){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
+    }
+    if(dpp->output_metadata_len > POFDP_METADATA_MAX_LEN){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_METADATA_LEN_ERROR, g_upward_xid++);
     }
 
+	/* Copy metadata to output buffer. */
+    if(dpp->output_metadata_len){
+        pofbf_copy_bit((uint8_t *)dpp->metadata, meta, dpp->output_metadata_offset, \
+                dpp->output_metadata_len * POF_BITNUM_IN_BYTE);
+    }
     return POF_OK;
 }
 
@@ -378,30 +962,91 @@ send_raw(const struct pofdp_packet *dpp, const struct pof_local_resource *lr)
  *           output_packet_offset plus output_packet_len is less than the
  *           whole packet_len, and that output_metadata_offset plus 
  *           output_metadata_len is less than the whole metadata_len.
+ *           Only the output metadata is copied. The packet is sent from
+ *           output_packet_buf, so the flood and group outputs of one
+ *           packet all share the same packet data.
  ***********************************************************************/
 uint32_t pofdp_send_raw(struct pofdp_packet *dpp, const struct pof_local_resource *lr){
-	/* Copy metadata to output buffer. */
-    pofbf_copy_bit((uint8_t *)dpp->metadata, dpp->buf_out, dpp->output_metadata_offset, \
-			dpp->output_metadata_len * POF_BITNUM_IN_BYTE);
-	/* Copy packet to output buffer right behind metadata. */
-    memcpy(dpp->buf_out + dpp->output_metadata_len, dpp->output_packet_buf + dpp->output_packet_offset, \
-            dpp->output_packet_len);
+    uint8_t meta[POFDP_METADATA_MAX_LEN];
+    /* Write the output metadata straight into the batch if there is one. */
+    uint8_t *meta_out = dpp->txBatch ? pofdp_tx_batch_slot(dpp->txBatch) : meta;
+    uint32_t ret;
+
+    ret = outputMetadataCopy(dpp, meta_out);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"One packet is about to be sent out! port_id = %d, slot_id = %u, packet_len = %u, metadata_len = %u, total_len = %u", \
 			            dpp->output_port_id, dpp->output_slot_id, dpp->output_packet_len, \
                         dpp->output_metadata_len, dpp->output_whole_len);
     POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->output_packet_buf + dpp->output_packet_offset, dpp->output_packet_len, \
 			"The packet is ");
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_out,dpp->output_metadata_len,"The metatada is ");
-    POF_DEBUG_CPRINT_FL_0X(1,BLUE,dpp->buf_out, dpp->output_whole_len,"The whole output packet is ");
+    POF_DEBUG_CPRINT_FL_0X(1,GREEN,meta_out,dpp->output_metadata_len,"The metatada is ");
 
-    /* Check the packet lenght. */
-    if(dpp->output_whole_len > POF_MTU_LENGTH){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
+    if(send_raw(dpp, lr, meta_out) != POF_OK){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
     }
 
-    if(send_raw(dpp, lr) != POF_OK){
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Flood packet out function
+ * Form:     uint32_t pofdp_send_raw_flood(dpp, lr)
+ * Input:    dpp, local resource of the output slot
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function sends the packet out through all ports in the
+ *           flood port set of the slot except the input port. The lengths
+ *           are checked and the output metadata is copied only once.
+ *           All copies share the same packet data. If the receive task
+ *           queues the output packets, all copies go out in the batch
+ *           at the end of the receive burst.
+ ***********************************************************************/
+uint32_t pofdp_send_raw_flood(struct pofdp_packet *dpp, const struct pof_local_resource *lr){
+    const struct floodInfo *flood = __atomic_load_n(&lr->flood, __ATOMIC_ACQUIRE);
+    const struct floodPort *fp;
+    struct portInfo *port;
+    const uint8_t *packet = dpp->output_packet_buf + dpp->output_packet_offset;
+    uint8_t meta[POFDP_METADATA_MAX_LEN];
+    uint32_t i, ret;
+
+    if(!flood){
+        return POF_OK;
+    }
+
+    ret = outputMetadataCopy(dpp, meta);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    POF_DEBUG_CPRINT_FL(1,GREEN,"One packet is about to be flooded! slot_id = %u, port_num = %u, packet_len = %u, metadata_len = %u", \
+                        dpp->output_slot_id, flood->portNum, dpp->output_packet_len, dpp->output_metadata_len);
+
+    for(i=0; i<flood->portNum; i++){
+        fp = &flood->ports[i];
+        if(fp->pofIndex == dpp->ori_port_id){
+            continue;
+        }
+        dpp->output_port_id = fp->pofIndex;
+
+        if(fp->fd == -1){
+            /* The port is driven by another backend. */
+            if((port = poflr_get_port_with_pofindex(fp->pofIndex, lr)) == NULL){
+                continue;
+            }
+            ret = backendSend(port, meta, dpp->output_metadata_len, packet, dpp->output_packet_len);
+        }else if(dpp->txBatch){
+            if(dpp->output_metadata_len){
+                memcpy(pofdp_tx_batch_slot(dpp->txBatch), meta, dpp->output_metadata_len);
+            }
+            dpp->txPending = TRUE;
+            ret = pofdp_tx_batch_add(dpp->txBatch, fp->sysIndex, dpp->output_metadata_len, \
+                    packet, dpp->output_packet_len);
+        }else{
+            ret = sendDirect(fp->fd, fp->sysIndex, meta, dpp->output_metadata_len, \
+                    packet, dpp->output_packet_len);
+        }
+        if(ret != POF_OK){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+        }
     }
 
     return POF_OK;
@@ -568,4 +1213,20 @@ struct pof_datapath g_dp = {
     /* TCP listen. */
     POFDP_TCP_LISTEN_IP,
     POFDP_TCP_LISTEN_PORT,
+    0,
+    /* RX mode. */
+    POFDP_RX_RECVFROM, POFDP_RX_RING_BLOCK_SIZE, POFDP_RX_RING_BLOCK_NUM,
+    {{0}}, 0,
+    /* TX. */
+    TRUE, FALSE,
+    /* Worker pool. */
+    0, 0, {0}, 0, {{{0}}}, 0, NULL,
+    /* Fanout. */
+    POFDP_FANOUT_HASH, {{{0}}}, 0,
+    /* Port backends. */
+    {{{0}}}, 0,
+    /* Flow cache. */
+    TRUE,
+    /* Interpreter. */
+    TRUE,
 };
@@ -0,0 +1,254 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_byte_transfer.h"
+#include <sys/socket.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#ifdef PACKET_FANOUT_EBPF
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <sys/syscall.h>
+#endif // PACKET_FANOUT_EBPF
+
+/* The default RSS key of the Microsoft RSS specification, which most
+ * NICs use too. */
+static const uint8_t toeplitzKey[40] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/***********************************************************************
+ * Toeplitz hash
+ * Form:     uint32_t pofdp_toeplitz_hash(const uint8_t *data, uint32_t len)
+ * Input:    data, data length in byte
+ * Return:   The hash
+ * Discribe: This function computes the Toeplitz hash of the data with
+ *           the default RSS key, the same way as the NICs do RSS.
+ * NOTE:     The data should not be longer than 36 bytes, which is the
+ *           length of the IPv6 addresses and the TCP/UDP ports.
+ ***********************************************************************/
+uint32_t
+pofdp_toeplitz_hash(const uint8_t *data, uint32_t len)
+{
+    uint32_t hash = 0, window, i;
+    int bit;
+
+    len = POF_MIN(len, sizeof toeplitzKey - 4);
+    /* The window is the 32 bits of the key starting at the current bit. */
+    window = ((uint32_t)toeplitzKey[0] << 24) | ((uint32_t)toeplitzKey[1] << 16) | \
+             ((uint32_t)toeplitzKey[2] << 8) | toeplitzKey[3];
+    for(i=0; i<len; i++){
+        for(bit=7; bit>=0; bit--){
+            if(data[i] & (1 << bit)){
+                hash ^= window;
+            }
+            window = (window << 1) | ((toeplitzKey[i + 4] >> bit) & 1);
+        }
+    }
+    return hash;
+}
+
+/***********************************************************************
+ * Flow hash of one packet
+ * Form:     uint32_t pofdp_flow_hash(const uint8_t *packet, uint32_t len)
+ * Input:    packet, packet length in byte
+ * Return:   The hash
+ * Discribe: This function computes the Toeplitz hash of the IP addresses
+ *           and, if the packet is an unfragmented TCP or UDP one, the
+ *           ports, just like RSS. One VLAN tag is skipped. Any other
+ *           packet is hashed by its MAC addresses. So all packets of one
+ *           flow get the same hash.
+ ***********************************************************************/
+uint32_t
+pofdp_flow_hash(const uint8_t *packet, uint32_t len)
+{
+    uint8_t tuple[36];
+    uint32_t off = 2 * POF_ETH_ALEN, ihl, tupleLen;
+    uint16_t type, frag;
+    uint8_t proto;
+
+    if(len < off + 2){
+        return 0;
+    }
+    type = (packet[off] << 8) | packet[off + 1];
+    off += 2;
+    if(type == ETH_P_8021Q && len >= off + 4){
+        type = (packet[off + 2] << 8) | packet[off + 3];
+        off += 4;
+    }
+
+    if(type == ETH_P_IP && len >= off + 20){
+        ihl = (packet[off] & 0x0f) * 4;
+        proto = packet[off + 9];
+        frag = ((packet[off + 6] << 8) | packet[off + 7]) & 0x3fff;
+        memcpy(tuple, packet + off + 12, 8);
+        tupleLen = 8;
+        if(!frag && (proto == IPPROTO_TCP || proto == IPPROTO_UDP) && len >= off + ihl + 4){
+            memcpy(tuple + 8, packet + off + ihl, 4);
+            tupleLen += 4;
+        }
+    }else if(type == ETH_P_IPV6 && len >= off + 40){
+        proto = packet[off + 6];
+        memcpy(tuple, packet + off + 8, 32);
+        tupleLen = 32;
+        if((proto == IPPROTO_TCP || proto == IPPROTO_UDP) && len >= off + 44){
+            memcpy(tuple + 32, packet + off + 40, 4);
+            tupleLen += 4;
+        }
+    }else{
+        memcpy(tuple, packet, 2 * POF_ETH_ALEN);
+        tupleLen = 2 * POF_ETH_ALEN;
+    }
+
+    return pofdp_toeplitz_hash(tuple, tupleLen);
+}
+
+/* The number of fanout members set by the config for the port. 1 if none. */
+uint16_t
+pofdp_fanout_num(const struct portInfo *port, const struct pof_datapath *dp)
+{
+    uint32_t i;
+
+    for(i=0; i<dp->fanoutPortNum; i++){
+        if(strncmp(dp->fanoutPorts[i].port, port->name, PORT_NAME_LEN) == 0){
+            return POF_MAX(dp->fanoutPorts[i].num, 1);
+        }
+    }
+    return 1;
+}
+
+#ifdef PACKET_FANOUT_EBPF
+/* Load the eBPF program which spreads the packets over num members by
+ * the IPv4 addresses, or by the kernel hash of any other packet. */
+static int
+fanoutProgLoad(uint16_t num)
+{
+    struct bpf_insn prog[] = {
+        /* r6 = skb, for the LD_ABS instructions. */
+        { BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0 },
+        { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_6, offsetof(struct __sk_buff, protocol), 0 },
+        { BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 5, POF_HTONS(ETH_P_IP) },
+        /* r0 = saddr ^ daddr. */
+        { BPF_LD | BPF_ABS | BPF_W, 0, 0, 0, SKF_NET_OFF + 12 },
+        { BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_7, BPF_REG_0, 0, 0 },
+        { BPF_LD | BPF_ABS | BPF_W, 0, 0, 0, SKF_NET_OFF + 16 },
+        { BPF_ALU64 | BPF_XOR | BPF_X, BPF_REG_0, BPF_REG_7, 0, 0 },
+        { BPF_JMP | BPF_JA, 0, 0, 1, 0 },
+        { BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_6, offsetof(struct __sk_buff, hash), 0 },
+        /* Mix the bits, and take the member. */
+        { BPF_ALU | BPF_MUL | BPF_K, BPF_REG_0, 0, 0, (int32_t)0x9e3779b1 },
+        { BPF_ALU | BPF_RSH | BPF_K, BPF_REG_0, 0, 0, 16 },
+        { BPF_ALU | BPF_MOD | BPF_K, BPF_REG_0, 0, 0, num },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+    };
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = sizeof prog / sizeof prog[0];
+    attr.license = (uintptr_t)"BSD";
+    return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof attr);
+}
+#endif // PACKET_FANOUT_EBPF
+
+/***********************************************************************
+ * Join the socket to the fanout group of the port
+ * Form:     uint32_t pofdp_fanout_join(int sock, const struct portInfo *port,
+ *                                      const struct pof_datapath *dp,
+ *                                      uint16_t num)
+ * Input:    bound socket, port, dp, member number
+ * Return:   POF_OK or Error code
+ * Discribe: All sockets of one port join one PACKET_FANOUT group, whose
+ *           id is the system index of the port, and the kernel gives
+ *           each packet to only one of them. The hash mode and the eBPF
+ *           mode keep the packets of one flow in one socket. The CPU
+ *           mode does the same only if the NIC spreads the flows to the
+ *           CPUs by RSS.
+ *           If it fails, or the software mode is set, each socket gets
+ *           all packets, and the caller should take only its share by
+ *           pofdp_flow_hash().
+ ***********************************************************************/
+uint32_t
+pofdp_fanout_join(int sock, const struct portInfo *port, const struct pof_datapath *dp, \
+                  uint16_t num)
+{
+    int arg, type;
+#ifdef PACKET_FANOUT_EBPF
+    int prog;
+#endif // PACKET_FANOUT_EBPF
+
+    switch(dp->fanoutMode){
+        case POFDP_FANOUT_HASH:
+            type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+            break;
+        case POFDP_FANOUT_CPU:
+            type = PACKET_FANOUT_CPU;
+            break;
+#ifdef PACKET_FANOUT_EBPF
+        case POFDP_FANOUT_EBPF:
+            type = PACKET_FANOUT_EBPF;
+            break;
+#endif // PACKET_FANOUT_EBPF
+        default:
+            return POF_ERROR;
+    }
+
+    arg = (port->sysIndex & 0xffff) | (type << 16);
+    if(setsockopt(sock, SOL_PACKET, PACKET_FANOUT, &arg, sizeof arg) != 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SET_SOCKET_OPTION_FAILURE);
+    }
+
+#ifdef PACKET_FANOUT_EBPF
+    if(dp->fanoutMode == POFDP_FANOUT_EBPF){
+        /* The group keeps the program, so the fd is not needed any more.
+         * Each member sets the same program again, no matter. */
+        if((prog = fanoutProgLoad(num)) < 0){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SET_SOCKET_OPTION_FAILURE);
+        }
+        arg = setsockopt(sock, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof prog);
+        close(prog);
+        if(arg != 0){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SET_SOCKET_OPTION_FAILURE);
+        }
+    }
+#endif // PACKET_FANOUT_EBPF
+
+    return POF_OK;
+}
@@ -31,7 +31,9 @@
 #include "../include/pof_conn.h"
 #include "../include/pof_datapath.h"
 #include "../include/pof_byte_transfer.h"
+#include "../include/pof_memory.h"
 #include <string.h>
+#include <time.h>
 
 /* Move the packet data pointer buf_offset. 
  * buf_offset = buf_offset + offset 
@@ -50,56 +52,69 @@ movePacketBufOffset(int16_t offset, struct pofdp_packet *dpp)
     return POF_OK;
 }
 
-/* Move the instruction forward.
- * Caller needs to ensure that the forward offset is valid, less than todo number. */
-static void
-insJumpForward(uint32_t insNum, struct pofdp_packet *dpp)
+#if defined(POF_SD2N) || defined(POF_SHT_VXLAN)
+/* Go on with op i of the program. The program is done if i is its op
+ * number. */
+static uint32_t
+opGoto(uint32_t i, struct pofdp_packet *dpp)
 {
-    uint32_t i;
-    /* Forward one by one. */
-    for(i=0; i<insNum; i++){
-#ifdef POF_SHT_VXLAN
-        dpp->ins = (struct pof_instruction *)( \
-                (uint8_t *)dpp->ins + dpp->ins->len );
-#else // POF_SHT_VXLAN
-        dpp->ins ++;
-#endif // POF_SHT_VXLAN
+    if(i > dpp->prog->opNum){
+        POF_DEBUG_CPRINT_FL(1,RED,"The instruction to jump to is out of the instructions. " \
+                "ins = %u, insNum = %u", i, dpp->prog->opNum);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION,POFBIC_JUM_TO_INVALID_INST,g_upward_xid++);
     }
-    dpp->ins_todo_num -= insNum;
-    dpp->ins_done_num += insNum;
+    if(i == dpp->prog->opNum){
+        dpp->packet_done = TRUE;
+    }else{
+        dpp->op = &dpp->prog->ops[i];
+    }
+    return POF_OK;
 }
+#endif // POF_SD2N || POF_SHT_VXLAN
 
+#ifdef POF_SD2N
 /* Move the instruction forward or backword. */
 static uint32_t
 insJump(uint8_t direction, uint32_t insNum, struct pofdp_packet *dpp)
 {
+    uint32_t i = dpp->op - dpp->prog->ops;
+
 	if(direction == POFD_FORWARD){
-		if(insNum > dpp->ins_todo_num){
+		if(insNum > dpp->prog->opNum - i){
 			POF_DEBUG_CPRINT_FL(1,RED,"The number of instruction to jump forward is more than the instructions left. " \
-					"insNum = %u, insLeft=%u", insNum, dpp->ins_todo_num);
+					"insNum = %u, insLeft=%u", insNum, dpp->prog->opNum - i);
 			POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION,POFBIC_JUM_TO_INVALID_INST,g_upward_xid++);
 		}
-        insJumpForward(insNum, dpp);
+        return opGoto(i + insNum, dpp);
 	}else{
-		if(insNum > dpp->ins_done_num){
+		if(insNum > i){
 			POF_DEBUG_CPRINT_FL(1,RED,"The number of instruction to jump backward is more than the instructions reserved. " \
-					"insNum = %u, insDone = %u", insNum, dpp->ins_done_num);
+					"insNum = %u, insDone = %u", insNum, i);
 			POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION,POFBIC_JUM_TO_INVALID_INST,g_upward_xid++);
 		}
-#ifdef POF_SHT_VXLAN
-        insNum = dpp->ins_done_num - insNum;
-        dpp->ins_done_num = 0;
-        dpp->ins_todo_num = dpp->insBlock->insNum;
-        dpp->ins = (struct pof_instruction *)dpp->insBlock->insData;
-        insJumpForward(insNum, dpp);
-#else // POF_SHT_VXLAN
-        dpp->ins            -= insNum;
-        dpp->ins_done_num   -= insNum;
-        dpp->ins_todo_num   += insNum;
-#endif // POF_SHT_VXLAN
+        return opGoto(i - insNum, dpp);
 	}
-    return POF_OK;
 }
+#endif // POF_SD2N
+
+#ifdef POF_SHT_VXLAN
+/* Take the jump of the BRANCH or JMP op, which is precomputed when the
+ * instructions are installed. */
+static uint32_t
+opJump(struct pofdp_packet *dpp)
+{
+    if(dpp->op->jump == POFLR_INS_OP_BAD){
+        POF_DEBUG_CPRINT_FL(1,RED,"The instruction to jump to is out of the instructions.");
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION,POFBIC_JUM_TO_INVALID_INST,g_upward_xid++);
+    }
+    return opGoto(dpp->op->jump, dpp);
+}
+#endif // POF_SHT_VXLAN
+
+/* The pointers resolved in the op are used while the program is not
+ * stale. Otherwise the objects are found by ID. */
+#define OP_FRESH(dpp,lr)    (__atomic_load_n(&(dpp)->prog->gen, __ATOMIC_ACQUIRE) == \
+                             __atomic_load_n(&(lr)->insGen, __ATOMIC_ACQUIRE))
 
 uint8_t *
 pofdp_get_field_buf(const struct pof_match *pm, const struct pofdp_packet *dpp)
@@ -141,11 +156,11 @@ static void pofdp_find_key(uint8_t *packet, uint8_t *metadata, uint8_t **key_ptr
 static void 
 instruction_update(struct pofdp_packet *dpp)
 {
-	if(dpp->ins_todo_num == 1){
+	if(dpp->op->next == dpp->prog->opNum){
 		dpp->packet_done = TRUE;
 		return;
 	}
-    insJumpForward(1, dpp);
+    dpp->op = &dpp->prog->ops[dpp->op->next];
 	return;
 }
 
@@ -218,19 +233,23 @@ static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp, const struct
 
 static uint32_t execute_METER(POFDP_ARG)
 {
-    pof_instruction_meter *p = (pof_instruction_meter *)dpp->ins->instruction_data;
+    const struct insOp *op = dpp->op;
     struct meterInfo *meter;
-    uint32_t meterID = 0, ret;
 
 #ifdef POF_SHT_VXLAN
-	ret = pofdp_get_32value(&meterID, p->id_type, &p->meter_id, dpp);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-#else // POF_SHT_VXLAN
-    meterID = p->meter_id;
+    pof_instruction_meter *p = (pof_instruction_meter *)dpp->ins->instruction_data;
+    uint32_t meterID = 0, ret;
+
+    if(!op->meterImm){
+        ret = pofdp_get_32value(&meterID, p->id_type, &p->meter_id, dpp);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        meter = poflr_get_meter_with_ID(meterID, lr);
+    }else
 #endif // POF_SHT_VXLAN
+    meter = OP_FRESH(dpp, lr) ? op->meter : poflr_get_meter_with_ID(op->meterID, lr);
 
     /* Check the meter id. */
-    if(!(meter = poflr_get_meter_with_ID(meterID, lr))){
+    if(!meter){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_UNKNOWN_METER, g_upward_xid++);
     }
 
@@ -324,7 +343,7 @@ static uint32_t execute_BRANCH(POFDP_ARG)
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     if(value1 != value2){
-        ret = insJump(POFD_FORWARD, p->skip_instruction_num, dpp);
+        ret = opJump(dpp);
 	    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
         POF_DEBUG_CPRINT_FL(1,GREEN,\
@@ -346,13 +365,13 @@ static uint32_t execute_JMP(POFDP_ARG)
             (struct pof_instruction_jmp *)dpp->ins->instruction_data;
     uint32_t ret;
 
-    ret = insJump(p->direction, p->instruction_num, dpp);
+    /* The jump includes moving on from the op jumped to. */
+    ret = opJump(dpp);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,\
             "instruction_JMP has been DONE! direction = %u, jumpInsNum = %u", \
             p->direction, p->instruction_num);
-	instruction_update(dpp);
     return POF_OK;
 }
 #endif // POF_SHT_VXLAN
@@ -403,24 +422,83 @@ static uint32_t execute_WRITE_METADATA_FROM_PACKET(POFDP_ARG)
     return POF_OK;
 }
 
+/* Move the packet to the next table of the GOTO_TABLE or
+ * GOTO_DIRECT_TABLE op, and get the table. */
+static uint32_t
+opTableGoto(struct pofdp_packet *dpp, const struct pof_local_resource *lr, \
+            struct tableInfo **table)
+{
+    const struct insOp *op = dpp->op;
+    uint32_t ret;
+
+    /* The packet forward to the next table. */
+	ret = movePacketBufOffset(op->packetOffset, dpp);
+	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    /* The table type and id decoded from the table ID. */
+    if(op->tableType == POF_MAX_TABLE_TYPE){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_TABLE_ID, g_upward_xid++);
+    }
+    dpp->table_type = op->tableType;
+    dpp->table_id = op->tableId;
+
+    *table = OP_FRESH(dpp, lr) ? op->table : poflr_get_table_with_ID(op->tableID, lr);
+    if(!(*table)){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_BAD_TABLE_ID, g_upward_xid++);
+    }
+    return POF_OK;
+}
+
+/* Count the matched flow entry dpp->flow_entry, and go on with its
+ * instructions. */
+static uint32_t
+entryStart(POFDP_ARG)
+{
+    struct entryInfo *entry = dpp->flow_entry;
+    uint32_t ret;
+
+    /* Increace the counter value. */
+    ret = pofdp_counter_increace(dpp, lr, entry->counter_id, POF_PACKET_REL_LEN_GET(dpp));
+    POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+
+    /* Update the program to the one of the matched flow entry. */
+#ifdef POF_SHT_VXLAN
+    struct insBlockInfo *insBlock;
+
+    /* Get the insBlock. */
+    insBlock = (__atomic_load_n(&entry->insGen, __ATOMIC_ACQUIRE) == \
+                __atomic_load_n(&lr->insGen, __ATOMIC_ACQUIRE)) ? entry->insBlock : \
+               poflr_get_insBlock_with_ID(entry->insBlockID, lr);
+    if(!insBlock){
+        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_INS_BLOCK_ID);
+        dpp->packet_done = TRUE;
+        return ret;
+    }
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Execute the insBlock [%u]", insBlock->blockID);
+    dpp->insBlock = insBlock;
+    dpp->prog = &insBlock->prog;
+    dpp->paraLen = entry->paraLen;
+    dpp->para = entry->para;
+#else // POF_SHT_VXLAN
+    dpp->prog = &entry->prog;
+#endif // POF_SHT_VXLAN
+    dpp->op = dpp->prog->ops;
+    if(dpp->prog->opNum == 0){
+        dpp->packet_done = TRUE;
+    }
+
+    return ret;
+}
+
 static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
 {
     pof_instruction_goto_direct_table *p = \
 			(pof_instruction_goto_direct_table *)dpp->ins->instruction_data;
-    struct entryInfo *entry;
     struct tableInfo *table;
-    uint8_t *table_type = &dpp->table_type;
-    uint8_t *table_id = &dpp->table_id;
-    uint32_t i, ret, entry_index;
-
-    p = (pof_instruction_goto_direct_table *)dpp->ins->instruction_data;
+    uint32_t ret, entry_index;
 
     /* The packet forward to the next table. */
-	ret = movePacketBufOffset((int16_t)p->packet_offset, dpp);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-
-    /* Find the table type and id of the next direct table. */
-    ret = poflr_table_ID_to_id(p->next_table_id, table_type, table_id, lr);
+    ret = opTableGoto(dpp, lr, &table);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 #ifdef POF_SD2N
@@ -430,14 +508,10 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
 	entry_index = p->table_entry_index;
 #endif // POF_SD2N
 
-    table = poflr_get_table_with_ID(p->next_table_id, lr);
-    if(!(table)){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_BAD_TABLE_ID, g_upward_xid++);
-    }
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Go to DT table[%d][%d][%d]!", *table_type, *table_id, entry_index);
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Go to DT table[%d][%d][%d]!", dpp->table_type, dpp->table_id, entry_index);
 
     /* Check the table type. */
-    if(*table_type != POF_LINEAR_TABLE){
+    if(dpp->table_type != POF_LINEAR_TABLE){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_BAD_TABLE_TYPE, g_upward_xid++);
     }
 
@@ -446,72 +520,25 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_ENTRY_UNEXIST, g_upward_xid++);
     }
 
-    /* Increase the counter value. */
-#ifdef POF_SD2N
-    ret = poflr_counter_increace(dpp->flow_entry->counter_id, POF_PACKET_REL_LEN_GET(dpp), lr);
-#else // POF_SD2N
-    ret = poflr_counter_increace(dpp->flow_entry->counter_id, lr);
-#endif // POF_SD2N
+    ret = entryStart(dpp, lr);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    /* Update the instruction number and the instruction data corresponding to the
-     * matched flow entry in the current flow table. */
-#ifdef POF_SHT_VXLAN
-    uint16_t blockID = dpp->flow_entry->insBlockID;
-    struct insBlockInfo *insBlock = NULL;
-
-    /* Get the insBlock. */
-    if(!(insBlock = poflr_get_insBlock_with_ID(blockID, lr))){
-        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_INS_BLOCK_ID);
-        dpp->packet_done = TRUE;
-        return ret;
-    }
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Execute the insBlock [%u]", blockID);
-
-    dpp->insBlock = insBlock;
-    dpp->ins = (struct pof_instruction *)insBlock->insData;
-    dpp->ins_todo_num = insBlock->insNum;
-    dpp->paraLen = dpp->flow_entry->paraLen;
-    dpp->para = dpp->flow_entry->para;
-#else // POF_SHT_VXLAN
-    dpp->ins = dpp->flow_entry->instruction;
-    dpp->ins_todo_num = dpp->flow_entry->instruction_num;
-#endif // POF_SHT_VXLAN
-	dpp->ins_done_num = 0;
-
     POF_DEBUG_CPRINT_FL(1,GREEN,"Match entry! ");
 
     return POF_OK;
 }
 
-static uint32_t execute_GOTO_TABLE(POFDP_ARG)
+/* Go on with the flow entry dpp->flow_entry found in the GOTO_TABLE
+ * instruction, or handle the table miss if it is NULL. */
+static uint32_t
+gotoTableMatched(POFDP_ARG)
 {
-    struct pof_instruction_goto_table *p = \
-				(pof_instruction_goto_table *)dpp->ins->instruction_data;
-    struct tableInfo *table;
-    uint32_t i, j, ret = POF_OK;
-    uint8_t *table_type = &dpp->table_type;
-    uint8_t *table_id = &dpp->table_id;
-
-    p = (pof_instruction_goto_table *)dpp->ins->instruction_data;
+    uint32_t ret = POF_OK;
 
-    /* The packet forward to the next table. */
-	ret = movePacketBufOffset((int16_t)p->packet_offset, dpp);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-
-    /* The table type and id. */
-    ret = poflr_table_ID_to_id(p->next_table_id, table_type, table_id, lr);
-    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Go to table[%d][%d]!", *table_type, *table_id);
-
-    if(!(table = poflr_get_table_with_ID(p->next_table_id, lr))){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBIC_BAD_TABLE_ID, g_upward_xid++);
-    }
-
-    if(!(dpp->flow_entry = poflr_entry_lookup(dpp->buf_offset, (uint8_t *)dpp->metadata, table))){
+    if(!dpp->flow_entry){
         /* No match. */
-        POF_DEBUG_CPRINT_FL(1,RED,"Cannot find the right entry in table[%d][%d]!",*table_type,*table_id);
+        POF_DEBUG_CPRINT_FL(1,RED,"Cannot find the right entry in table[%d][%d]!", \
+                dpp->table_type, dpp->table_id);
 
         ret = pofdp_entry_nomatch(dpp, lr);
         POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
@@ -519,42 +546,35 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
         dpp->packet_done = TRUE;
     }else{
         POF_DEBUG_CPRINT_FL(1,GREEN,"Match entry[%u]", dpp->flow_entry->index);
-        /* Match. Increace the counter value. */
-#ifdef POF_SD2N
-        ret = poflr_counter_increace(dpp->flow_entry->counter_id, POF_PACKET_REL_LEN_GET(dpp), lr);
-#else // POF_SD2N
-        ret = poflr_counter_increace(dpp->flow_entry->counter_id, lr);
-#endif // POF_SD2N
-        POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
-
-        /* Update the instruction number and the instruction data corresponding to the
-         * matched flow entry in the current flow table. */
-#ifdef POF_SHT_VXLAN
-        uint16_t blockID = dpp->flow_entry->insBlockID;
-        struct insBlockInfo *insBlock = NULL;
-
-        /* Get the insBlock. */
-        if(!(insBlock = poflr_get_insBlock_with_ID(blockID, lr))){
-            POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_INS_BLOCK_ID);
-            dpp->packet_done = TRUE;
-            return ret;
-        }
-        POF_DEBUG_CPRINT_FL(1,BLUE,"Execute the insBlock [%u]", blockID);
-        dpp->insBlock = insBlock;
-        dpp->ins = (struct pof_instruction *)insBlock->insData;
-        dpp->ins_todo_num = insBlock->insNum;
-        dpp->paraLen = dpp->flow_entry->paraLen;
-        dpp->para = dpp->flow_entry->para;
-#else // POF_SHT_VXLAN
-        dpp->ins = dpp->flow_entry->instruction;
-        dpp->ins_todo_num = dpp->flow_entry->instruction_num;
-#endif // POF_SHT_VXLAN
-		dpp->ins_done_num = 0;
+        ret = entryStart(dpp, lr);
     }
 
     return ret;
 }
 
+static uint32_t execute_GOTO_TABLE(POFDP_ARG)
+{
+    struct tableInfo *table;
+    uint32_t ret = POF_OK;
+
+    /* The packet forward to the next table. */
+    ret = opTableGoto(dpp, lr, &table);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Go to table[%d][%d]!", dpp->table_type, dpp->table_id);
+
+    /* In the burst forwarding, the packet waits here, and will be looked
+     * up together with the other packets going to the same table. */
+    if(dpp->burst){
+        dpp->tableWait = table;
+        return POF_OK;
+    }
+
+    dpp->flow_entry = poflr_entry_lookup(dpp->buf_offset, (uint8_t *)dpp->metadata, \
+                                         table, dpp->flowCache);
+    return gotoTableMatched(dpp, lr);
+}
+
 static uint32_t execute_APPLY_ACTIONS(POFDP_ARG)
 {
     pof_instruction_apply_actions *p = \
@@ -563,6 +583,8 @@ static uint32_t execute_APPLY_ACTIONS(POFDP_ARG)
 
     dpp->act = (pof_action *)p->action;
     dpp->act_num = p->action_num;
+    dpp->actCode = (p->action_num <= POF_MAX_ACTION_NUMBER_PER_INSTRUCTION) ? \
+                   dpp->op->actCode : NULL;
 
     ret = pofdp_action_execute(dpp, lr);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -577,11 +599,7 @@ static void
 write_32value_to_buf(uint8_t *buf, uint32_t value, \
 						   uint16_t offset, uint16_t len)
 {
-	/* Transform the value format. */
-	value = POF_MOVE_BIT_LEFT(value, 32 - len);
-	POF_NTOHL_FUNC(value);
-
-    pofbf_cover_bit(buf, (uint8_t *)&value, offset, len);
+    pofbf_insert_bits(buf, value, offset, len);
 	return;
 }
 
@@ -601,6 +619,7 @@ pofdp_write_32value_to_field(uint32_t value, const struct pof_match *pm, \
 		if(pm->len + pm->offset > dpp->left_len * POF_BITNUM_IN_BYTE){
 			POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR, g_upward_xid++);
 		}
+        POFDP_TX_PENDING_FLUSH(dpp);
 		dst = dpp->buf_offset;
 	}else{
 		if(pm->len + pm->offset > dpp->metadata_len * POF_BITNUM_IN_BYTE){
@@ -620,12 +639,7 @@ static void
 pofdp_get_32value_from_buf(uint8_t *buf, uint32_t *value, \
 						   uint16_t offset, uint16_t len)
 {
-	pofbf_copy_bit(buf, (uint8_t *)value, offset, len);
-
-	/* Transform the value format. */
-	POF_NTOHL_FUNC(*value);
-	*value = POF_MOVE_BIT_RIGHT(*value, 32 - len);
-
+	*value = (uint32_t)pofbf_extract_bits(buf, offset, len);
 	return;
 }
 
@@ -633,12 +647,7 @@ static void
 pofdp_get_16value_from_buf(uint8_t *buf, uint16_t *value, \
 						   uint16_t offset, uint16_t len)
 {
-	pofbf_copy_bit(buf, (uint8_t *)value, offset, len);
-
-	/* Transform the value format. */
-	POF_NTOHS_FUNC(*value);
-	*value = POF_MOVE_BIT_RIGHT(*value, 16 - len);
-
+	*value = (uint16_t)pofbf_extract_bits(buf, offset, len);
 	return;
 }
 
@@ -938,21 +947,70 @@ execute_EXPERIMENTER(POFDP_ARG)
     POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNSUP_INST, g_upward_xid++);
 }
 
+#ifdef POFDP_THREADED_DISPATCH
+/* Execute the ops by the threaded interpreter. Each handler jumps to the
+ * next one directly through the label table indexed by op->code. */
+static uint32_t
+instructionExecuteThreaded(POFDP_ARG)
+{
+    static const void *const handlers[POFLR_IC_BAD + 1] = {
+#define INSTRUCTION(NAME,VALUE) &&do_##NAME,
+        INSTRUCTIONS
+#undef INSTRUCTION
+        &&do_BAD,
+    };
+    uint32_t ret = POF_OK;
+
+#define INS_NEXT()                                                  \
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);                       \
+    if(dpp->packet_done != FALSE || dpp->tableWait != NULL){        \
+        return POF_OK;                                              \
+    }                                                               \
+    dpp->ins = dpp->op->ins;                                        \
+    goto *handlers[dpp->op->code]
+
+    INS_NEXT();
+
+#define INSTRUCTION(NAME,VALUE)                                     \
+do_##NAME:                                                          \
+    ret = execute_##NAME(dpp, lr);                                  \
+    INS_NEXT();
+    INSTRUCTIONS
+#undef INSTRUCTION
+
+do_BAD:
+    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNKNOWN_INST, g_upward_xid++);
+#undef INS_NEXT
+}
+#endif // POFDP_THREADED_DISPATCH
+
 /***********************************************************************
  * Execute instructions
  * Form:     uint32_t pofdp_instruction_execute(POFDP_ARG)
  * Input:    dpp, dp
  * Return:   POF_OK or Error code
- * Discribe: This function executes the actions. 
+ * Discribe: This function executes the actions. The instructions are
+ *           executed as the ops of dpp->prog from dpp->op, which are
+ *           decoded when the instructions are installed. They are
+ *           dispatched by the threaded interpreter if it is on, or by
+ *           the switch one.
  ***********************************************************************/
 uint32_t pofdp_instruction_execute(POFDP_ARG)
 {
 	uint32_t ret = POF_OK;
+
+#ifdef POFDP_THREADED_DISPATCH
+    if(dpp->dp->threaded){
+        return instructionExecuteThreaded(dpp, lr);
+    }
+#endif // POFDP_THREADED_DISPATCH
+
     /* Forward the packet via executing the instructions until packet_over is TRUE or all
-     * instructions have been done. */
-    while(dpp->packet_done == FALSE){
+     * instructions have been done, or the packet waits for the burst table lookup. */
+    while(dpp->packet_done == FALSE && dpp->tableWait == NULL){
         /* Execute the instructions. */
-        switch(dpp->ins->type){
+        dpp->ins = dpp->op->ins;
+        switch(dpp->op->type){
 #define INSTRUCTION(NAME,VALUE) case POFIT_##NAME: ret = execute_##NAME(dpp,lr); break;
 			INSTRUCTIONS
 #undef INSTRUCTION
@@ -964,3 +1022,503 @@ uint32_t pofdp_instruction_execute(POFDP_ARG)
     }
 	return POF_OK;
 }
+
+/***********************************************************************
+ * Execute instructions for a burst of packets
+ * Form:     uint32_t pofdp_instruction_execute_burst(struct pofdp_packet **dpps,
+ *                                                    uint32_t num,
+ *                                                    struct pof_local_resource *lr)
+ * Input:    dpps, packet number, lr
+ * Return:   POF_OK or Error code
+ * Discribe: This function executes the instructions of num packets,
+ *           whose burst flag are set. Each packet runs until it is done
+ *           or waits in a GOTO_TABLE instruction. Then the waiting
+ *           packets are grouped by the next table, and each group is
+ *           looked up by one poflr_entry_lookup_burst(). These repeat
+ *           until all the packets are done.
+ * NOTE:     An error only stops the packet which meets it, the other
+ *           packets of the burst go on.
+ ***********************************************************************/
+uint32_t
+pofdp_instruction_execute_burst(struct pofdp_packet **dpps, uint32_t num, \
+                                struct pof_local_resource *lr)
+{
+    struct pofdp_packet *wait[POFDP_BURST_SIZE], *group[POFDP_BURST_SIZE], *dpp;
+    const uint8_t *packets[POFDP_BURST_SIZE], *metadatas[POFDP_BURST_SIZE];
+    struct entryInfo *entries[POFDP_BURST_SIZE];
+    struct tableInfo *table;
+    uint32_t i, j, waitNum, groupNum, ret;
+
+    if(num > POFDP_BURST_SIZE){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    }
+
+    while(1){
+        /* Run every packet until it is done or waits for the table lookup. */
+        for(i=0, waitNum=0; i<num; i++){
+            dpp = dpps[i];
+            if(dpp->packet_done == FALSE && dpp->tableWait == NULL){
+                if(pofdp_instruction_execute(dpp, lr) != POF_OK){
+                    dpp->packet_done = TRUE;
+                    continue;
+                }
+            }
+            if(dpp->packet_done == FALSE){
+                wait[waitNum++] = dpp;
+            }
+        }
+        if(waitNum == 0){
+            break;
+        }
+
+        /* Look up the waiting packets group by group. Each group goes
+         * to the same table as the first waiting packet. */
+        while(waitNum > 0){
+            table = wait[0]->tableWait;
+            for(i=0, j=0, groupNum=0; i<waitNum; i++){
+                dpp = wait[i];
+                if(dpp->tableWait == table){
+                    group[groupNum] = dpp;
+                    packets[groupNum] = dpp->buf_offset;
+                    metadatas[groupNum] = (uint8_t *)dpp->metadata;
+                    groupNum ++;
+                }else{
+                    wait[j++] = dpp;
+                }
+            }
+            waitNum = j;
+
+            if((ret = poflr_entry_lookup_burst(packets, metadatas, groupNum, table, \
+                                               group[0]->flowCache, entries)) != POF_OK){
+                memset(entries, 0, groupNum * sizeof *entries);
+            }
+
+            for(i=0; i<groupNum; i++){
+                dpp = group[i];
+                dpp->tableWait = NULL;
+                dpp->flow_entry = entries[i];
+                if(gotoTableMatched(dpp, lr) != POF_OK){
+                    dpp->packet_done = TRUE;
+                }
+            }
+        }
+    }
+
+    return POF_OK;
+}
+
+/* Programs of pofdp_ins_bench. */
+#define INS_BENCH_PROG_NUM      (5)
+#define INS_BENCH_INS_NUM       (3)
+#define INS_BENCH_PACKET_LEN    (64)
+/* Offsets of the IPv4 packet in bit unit. */
+#define INS_BENCH_TTL           (22 * POF_BITNUM_IN_BYTE)
+#define INS_BENCH_IP_CHECKSUM   (24 * POF_BITNUM_IN_BYTE)
+#define INS_BENCH_IP_HEADER     (14 * POF_BITNUM_IN_BYTE)
+#define INS_BENCH_IP_DST        (30 * POF_BITNUM_IN_BYTE)
+#define INS_BENCH_METADATA      (32 * POF_BITNUM_IN_BYTE)
+
+/* The raw instructions of one program. Under POF_SHT_VXLAN they are
+ * packed one after another as in an instruction block. */
+struct benchIns {
+#ifdef POF_SHT_VXLAN
+    uint64_t data[64];
+#else // POF_SHT_VXLAN
+    pof_instruction ins[INS_BENCH_INS_NUM];
+#endif // POF_SHT_VXLAN
+};
+
+/* Set the type of the instruction, and return its data of len bytes. */
+static void *
+benchIns(pof_instruction *ins, uint16_t type, uint16_t len)
+{
+    ins->type = type;
+#ifdef POF_SHT_VXLAN
+    ins->len = sizeof *ins + len;
+#endif // POF_SHT_VXLAN
+    return ins->instruction_data;
+}
+
+static pof_instruction *
+benchNext(pof_instruction *ins)
+{
+#ifdef POF_SHT_VXLAN
+    return (pof_instruction *)((uint8_t *)ins + ins->len);
+#else // POF_SHT_VXLAN
+    return ins + 1;
+#endif // POF_SHT_VXLAN
+}
+
+/* Append one action with len bytes of data to the APPLY_ACTIONS. */
+static pof_action *
+benchAction(pof_instruction *ins, uint16_t type, uint16_t len)
+{
+    pof_instruction_apply_actions *p = (pof_instruction_apply_actions *)ins->instruction_data;
+    pof_action *act;
+
+    if(p->action_num == 0){
+        benchIns(ins, POFIT_APPLY_ACTIONS, sizeof *p);
+    }
+#ifdef POF_SHT_VXLAN
+    act = (pof_action *)((uint8_t *)ins + ins->len);
+    act->len = sizeof *act + len;
+    ins->len += act->len;
+    p->action_num++;
+#else // POF_SHT_VXLAN
+    act = &p->action[p->action_num++];
+#endif // POF_SHT_VXLAN
+    act->type = type;
+    return act;
+}
+
+static void
+benchSetField(pof_instruction *ins, uint16_t offset, uint16_t len, uint8_t value)
+{
+    pof_action_set_field *p = \
+            (pof_action_set_field *)benchAction(ins, POFAT_SET_FIELD, sizeof *p)->action_data;
+
+#ifdef POF_SHT_VXLAN
+    p->dst_field.offset = offset;
+    p->dst_field.len = len;
+    p->src_type = POFVT_IMMEDIATE_NUM;
+    memset(p->src.value, value, POF_MAX_FIELD_LENGTH_IN_BYTE);
+#else // POF_SHT_VXLAN
+    p->field_setting.offset = offset;
+    p->field_setting.len = len;
+    memset(p->field_setting.value, value, POF_MAX_FIELD_LENGTH_IN_BYTE);
+    memset(p->field_setting.mask, 0xFF, POF_MAX_FIELD_LENGTH_IN_BYTE);
+#endif // POF_SHT_VXLAN
+}
+
+static void
+benchChecksum(pof_instruction *ins)
+{
+    pof_action_calculate_checksum *p = (pof_action_calculate_checksum *) \
+            benchAction(ins, POFAT_CALCULATE_CHECKSUM, sizeof *p)->action_data;
+
+    p->checksum_pos = INS_BENCH_IP_CHECKSUM;
+    p->checksum_len = 16;
+    p->cal_startpos = INS_BENCH_IP_HEADER;
+    p->cal_len = 20 * POF_BITNUM_IN_BYTE;
+}
+
+/* Add increment to the field. It is a CALCULATE_FIELD under
+ * POF_SHT_VXLAN, which has no MODIFY_FIELD. */
+static void
+benchModifyField(pof_instruction *ins, uint16_t offset, uint16_t len, int increment)
+{
+#ifdef POF_SHT_VXLAN
+    pof_action_calc_field *p = \
+            (pof_action_calc_field *)benchAction(ins, POFAT_CALCULATE_FIELD, sizeof *p)->action_data;
+
+    p->calc_type = (increment < 0) ? POFCT_SUBTRACT : POFCT_ADD;
+    p->src_type = POFVT_IMMEDIATE_NUM;
+    p->dst_field.offset = offset;
+    p->dst_field.len = len;
+    p->src_operand.value = (increment < 0) ? -increment : increment;
+#else // POF_SHT_VXLAN
+    pof_action_modify_field *p = \
+            (pof_action_modify_field *)benchAction(ins, POFAT_MODIFY_FIELD, sizeof *p)->action_data;
+
+    p->field.offset = offset;
+    p->field.len = len;
+    p->increment = increment;
+#endif // POF_SHT_VXLAN
+}
+
+static void
+benchFromMetadata(pof_instruction *ins)
+{
+    pof_action_set_field_from_metadata *p = (pof_action_set_field_from_metadata *) \
+            benchAction(ins, POFAT_SET_FIELD_FROM_METADATA, sizeof *p)->action_data;
+
+    p->field_setting.offset = INS_BENCH_IP_DST;
+    p->field_setting.len = 32;
+    p->metadata_offset = INS_BENCH_METADATA;
+}
+
+static void
+benchOutput(pof_instruction *ins, uint32_t portID)
+{
+    pof_action_output *p = \
+            (pof_action_output *)benchAction(ins, POFAT_OUTPUT, sizeof *p)->action_data;
+
+#ifdef POF_SD2N
+    p->portId_type = POFVT_IMMEDIATE_NUM;
+    p->outputPortId.value = portID;
+#else // POF_SD2N
+    p->outputPortId = portID;
+#endif // POF_SD2N
+}
+
+static void
+benchDrop(pof_instruction *ins)
+{
+    benchAction(ins, POFAT_DROP, sizeof(pof_action_drop));
+}
+
+static void
+benchWriteMetadata(pof_instruction *ins)
+{
+    pof_instruction_write_metadata *p = \
+            (pof_instruction_write_metadata *)benchIns(ins, POFIT_WRITE_METADATA, sizeof *p);
+
+    p->metadata_offset = INS_BENCH_METADATA;
+    p->len = 32;
+#ifndef POF_SD2N_AFTER1015
+    p->value = 0x0A000063;
+#endif // POF_SD2N_AFTER1015
+}
+
+static void
+benchFromPacket(pof_instruction *ins)
+{
+    pof_instruction_write_metadata_from_packet *p = (pof_instruction_write_metadata_from_packet *) \
+            benchIns(ins, POFIT_WRITE_METADATA_FROM_PACKET, sizeof *p);
+
+    p->metadata_offset = INS_BENCH_METADATA + 32;
+    p->packet_offset = INS_BENCH_TTL;
+    p->len = 8;
+}
+
+/* The common rewrites of routers and NATs. The programs differ in the
+ * instructions and action sequences, which is the case the shared
+ * switch mispredicts. All but the last drop the packets at the end.
+ * The last one sends them out through the loop port, if there is one.
+ * Return the number of the programs. */
+static uint32_t
+benchPrograms(struct benchIns *bi, uint8_t *insNum, const struct portInfo *loop, \
+              const struct pof_local_resource *lr)
+{
+    pof_instruction *ins;
+
+    /* Decrease TTL and rewrite the MACs. */
+    insNum[0] = 1;
+    ins = (pof_instruction *)&bi[0];
+    benchModifyField(ins, INS_BENCH_TTL, 8, -1);
+    benchChecksum(ins);
+    benchSetField(ins, 0, 48, 0x02);
+    benchSetField(ins, 48, 48, 0x04);
+    benchDrop(ins);
+
+    /* DNAT from metadata. */
+    insNum[1] = 2;
+    ins = (pof_instruction *)&bi[1];
+    benchWriteMetadata(ins);
+    ins = benchNext(ins);
+    benchFromMetadata(ins);
+    benchChecksum(ins);
+    benchDrop(ins);
+
+    /* Set TTL. The SET_FIELD and CALCULATE_CHECKSUM are fused. */
+    insNum[2] = 2;
+    ins = (pof_instruction *)&bi[2];
+    benchFromPacket(ins);
+    ins = benchNext(ins);
+    benchSetField(ins, INS_BENCH_TTL, 8, 0x40);
+    benchChecksum(ins);
+    benchDrop(ins);
+
+    /* Metadata work before a rewrite. */
+    insNum[3] = 3;
+    ins = (pof_instruction *)&bi[3];
+    benchFromPacket(ins);
+    ins = benchNext(ins);
+    benchWriteMetadata(ins);
+    ins = benchNext(ins);
+    benchSetField(ins, 0, 48, 0x06);
+    benchModifyField(ins, INS_BENCH_TTL, 8, -2);
+    benchChecksum(ins);
+    benchDrop(ins);
+
+    if(!loop){
+        return INS_BENCH_PROG_NUM - 1;
+    }
+
+    /* Set TTL and output. The three actions are fused. */
+    insNum[4] = 1;
+    ins = (pof_instruction *)&bi[4];
+    benchSetField(ins, INS_BENCH_TTL, 8, 0x3F);
+    benchChecksum(ins);
+    benchOutput(ins, ((uint32_t)lr->slotID << 16) | loop->pofIndex);
+    return INS_BENCH_PROG_NUM;
+}
+
+/* The first port of the slot driven by the loop backend, or NULL. */
+static struct portInfo *
+benchLoopPort(const struct pof_local_resource *lr)
+{
+    const struct pofdp_backend *loop = pofdp_backend_find("loop");
+    struct portInfo *port, *next;
+
+    if(!lr->portPofIndexMap){
+        return NULL;
+    }
+    HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
+        if(port->backend == loop){
+            return port;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t
+benchNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+benchCycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Run the program on one fresh packet. */
+static uint32_t
+benchRun(struct pofdp_packet *dpp, const uint8_t *packet, \
+         const struct insProgram *prog, struct pof_local_resource *lr)
+{
+    POFDP_PACKET_RESET(dpp);
+    dpp->packetBuf = &(dpp->mbuf->buf[POFDP_PACKET_PREBUF_LEN]);
+    dpp->packetBufLen = POFDP_PACKET_RAW_MAX_LEN;
+    memcpy(dpp->packetBuf, packet, INS_BENCH_PACKET_LEN);
+    dpp->buf_offset = dpp->packetBuf;
+    dpp->ori_len = dpp->left_len = INS_BENCH_PACKET_LEN;
+    dpp->metadata = (struct pofdp_metadata *)dpp->mbuf->metadata;
+    dpp->metadata_len = POFDP_METADATA_MAX_LEN;
+    memset(dpp->metadata, 0, POFDP_METADATA_MAX_LEN);
+    POF_PACKET_REL_LEN_SET(dpp, dpp->ori_len);
+    dpp->prog = prog;
+    dpp->op = prog->ops;
+    return pofdp_instruction_execute(dpp, lr);
+}
+
+/* Take the packet the program sent out through the loop port back, so
+ * that the queue of the port never fills. */
+static void
+benchTakeBack(struct portInfo *loop, uint8_t *buf)
+{
+    uint32_t len;
+
+    loop->backend->rx_burst(loop, &buf, &len, 1);
+}
+
+/***********************************************************************
+ * Benchmark the interpreters
+ * Form:     uint32_t pofdp_ins_bench(uint32_t packet_num,
+ *                                    struct pof_local_resource *lr,
+ *                                    struct pofdpInsBench *result)
+ * Input:    packet number, lr
+ * Output:   result
+ * Return:   POF_OK or Error code
+ * Discribe: This function compiles several programs, and runs them in
+ *           turn on packet_num IPv4 packets by the switch interpreter
+ *           and by the threaded one. The packets and metadata each
+ *           program leaves are compared between the two first. The
+ *           programs are not installed, and drop the packets at the
+ *           end, except one with the fused SET_FIELD, CALCULATE_CHECKSUM
+ *           and OUTPUT. That one is run only if the slot has a port of
+ *           the loop backend, and the packets it sends out through the
+ *           port are taken back at once.
+ ***********************************************************************/
+uint32_t
+pofdp_ins_bench(uint32_t packet_num, struct pof_local_resource *lr, \
+                struct pofdpInsBench *result)
+{
+    static const uint8_t packet[INS_BENCH_PACKET_LEN] = {
+        0x00,0x00,0x00,0x00,0x00,0x01, 0x00,0x00,0x00,0x00,0x00,0x02, 0x08,0x00,
+        0x45,0x00,0x00,0x32, 0x00,0x01,0x00,0x00, 0x40,0x11,0x00,0x00,
+        0x0A,0x00,0x00,0x01, 0x0A,0x00,0x00,0x02,
+        0x04,0x00,0x00,0x35,0x00,0x1E,0x00,0x00,
+    };
+    struct benchSpace {
+        struct benchIns ins[INS_BENCH_PROG_NUM];
+        struct insOp ops[INS_BENCH_PROG_NUM][INS_BENCH_INS_NUM];
+        struct insProgram progs[INS_BENCH_PROG_NUM];
+        uint8_t insNum[INS_BENCH_PROG_NUM];
+        uint8_t out[INS_BENCH_PROG_NUM][INS_BENCH_PACKET_LEN + POFDP_METADATA_MAX_LEN];
+        uint8_t back[POFDP_PACKET_RAW_MAX_LEN];
+        struct pof_datapath dp;
+    } *bs;
+    struct pofdp_packet_pool *pool = NULL;
+    struct pofdp_packet *dpp;
+    struct portInfo *loop;
+    uint64_t *ns, *cycles, startNs, startCycles;
+    uint32_t i, p, progNum, threaded, ret = POF_ERROR;
+
+    memset(result, 0, sizeof *result);
+    if(packet_num == 0){
+        return POF_ERROR;
+    }
+    POF_MALLOC_SAFE_RETURN(bs, 1, POF_ERROR);
+    /* A copy of the datapath selects the interpreter, so the running
+     * switch is not affected. */
+    bs->dp = g_dp;
+    if((pool = pofdp_packet_pool_create(1, &bs->dp)) == NULL || \
+            (dpp = pofdp_packet_alloc(pool)) == NULL){
+        goto out;
+    }
+    /* The programs look up the ports as the receive tasks do. */
+    rcu_register(&pool->rcu);
+
+    loop = benchLoopPort(lr);
+    progNum = benchPrograms(bs->ins, bs->insNum, loop, lr);
+    for(p=0; p<progNum; p++){
+        poflr_ins_program_compile(&bs->progs[p], bs->ops[p], \
+                (pof_instruction *)&bs->ins[p], bs->insNum[p], lr);
+    }
+    result->progNum = progNum;
+
+    for(threaded=FALSE; threaded<=TRUE; threaded++){
+        bs->dp.threaded = threaded;
+        for(p=0; p<progNum; p++){
+            if(benchRun(dpp, packet, &bs->progs[p], lr) != POF_OK){
+                goto out;
+            }
+            if(p == INS_BENCH_PROG_NUM - 1){
+                benchTakeBack(loop, bs->back);
+            }
+            if(!threaded){
+                memcpy(bs->out[p], dpp->buf_offset, INS_BENCH_PACKET_LEN);
+                memcpy(bs->out[p] + INS_BENCH_PACKET_LEN, dpp->metadata, POFDP_METADATA_MAX_LEN);
+            }else{
+                result->mismatch += \
+                    (memcmp(bs->out[p], dpp->buf_offset, INS_BENCH_PACKET_LEN) != 0 || \
+                     memcmp(bs->out[p] + INS_BENCH_PACKET_LEN, dpp->metadata, POFDP_METADATA_MAX_LEN) != 0);
+            }
+        }
+    }
+
+    for(threaded=FALSE; threaded<=TRUE; threaded++){
+        rcu_quiescent(&pool->rcu);
+        bs->dp.threaded = threaded;
+        ns = threaded ? &result->threadedNs : &result->switchNs;
+        cycles = threaded ? &result->threadedCycles : &result->switchCycles;
+        startNs = benchNs();
+        startCycles = benchCycles();
+        for(i=0; i<packet_num; i++){
+            p = i % progNum;
+            benchRun(dpp, packet, &bs->progs[p], lr);
+            if(p == INS_BENCH_PROG_NUM - 1){
+                benchTakeBack(loop, bs->back);
+            }
+        }
+        *cycles = benchCycles() - startCycles;
+        *ns = benchNs() - startNs;
+    }
+    ret = POF_OK;
+
+out:
+    if(pool){
+        pofdp_packet_pool_destroy(pool);
+    }
+    FREE(bs);
+    return ret;
+}
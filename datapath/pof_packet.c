@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_memory.h"
+#include <string.h>
+
+/* The counter shard of the next pool. */
+static uint32_t packet_shardNext = 0;
+
+/***********************************************************************
+ * Initialize one packet descriptor
+ * Form:     void pofdp_packet_init(struct pofdp_packet *dpp,
+ *                                  struct pofdp_mbuf *mbuf,
+ *                                  struct pof_datapath *dp)
+ * Input:    dpp, packet memory, dp
+ * Return:   VOID
+ * Discribe: This function clears the whole descriptor, and links it to
+ *           its packet memory. It is called only once for each
+ *           descriptor. Then POFDP_PACKET_RESET() is enough for each
+ *           packet.
+ ***********************************************************************/
+void
+pofdp_packet_init(struct pofdp_packet *dpp, struct pofdp_mbuf *mbuf, \
+                  struct pof_datapath *dp)
+{
+    memset(dpp, 0, sizeof *dpp);
+    dpp->mbuf = mbuf;
+    dpp->dp = dp;
+    return;
+}
+
+/***********************************************************************
+ * Create the packet descriptor pool
+ * Form:     struct pofdp_packet_pool *pofdp_packet_pool_create(uint32_t num,
+ *                                              struct pof_datapath *dp)
+ * Input:    descriptor number, dp
+ * Return:   The pool, or NULL if failed
+ * Discribe: This function allocates num cache aligned descriptors and
+ *           their packet memory at once. All the descriptors are free.
+ *           The pools take the counter shards in turn.
+ * NOTE:     The pool is owned by one task, so there is no lock.
+ ***********************************************************************/
+struct pofdp_packet_pool *
+pofdp_packet_pool_create(uint32_t num, struct pof_datapath *dp)
+{
+    struct pofdp_packet_pool *pool;
+    uint32_t i;
+
+    POF_MALLOC_SAFE_RETURN(pool, 1, NULL);
+    if(!(pool->free = MALLOC(num * sizeof *pool->free)) || \
+            posix_memalign((void **)&pool->dpps, POF_CACHE_LINE_SIZE, num * sizeof *pool->dpps) != 0 || \
+            posix_memalign((void **)&pool->mbufs, POF_CACHE_LINE_SIZE, num * sizeof *pool->mbufs) != 0){
+        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        pofdp_packet_pool_destroy(pool);
+        return NULL;
+    }
+
+    pool->num = num;
+    for(i=0; i<num; i++){
+        pofdp_packet_init(&pool->dpps[i], &pool->mbufs[i], dp);
+        pool->dpps[i].counterBatch = &pool->counterBatch;
+        pool->free[i] = &pool->dpps[i];
+    }
+    pool->freeNum = num;
+    pool->counterBatch.shard = __atomic_fetch_add(&packet_shardNext, 1, __ATOMIC_RELAXED) % \
+                               POFLR_COUNTER_SHARD_NUM;
+    return pool;
+}
+
+void
+pofdp_packet_pool_destroy(struct pofdp_packet_pool *pool)
+{
+    if(!pool){
+        return;
+    }
+    rcu_unregister(&pool->rcu);
+    free(pool->dpps);
+    free(pool->mbufs);
+    FREE(pool->free);
+    FREE(pool);
+    return;
+}
+
+/***********************************************************************
+ * Allocate one packet descriptor
+ * Form:     struct pofdp_packet *pofdp_packet_alloc(struct pofdp_packet_pool *pool)
+ * Input:    pool
+ * Return:   The descriptor, or NULL if the pool is empty
+ * Discribe: This function takes one free descriptor from the pool, and
+ *           resets only the state of one packet in it. The packet memory
+ *           is NOT cleared, and packetBuf points to the packet right
+ *           behind the headroom.
+ ***********************************************************************/
+struct pofdp_packet *
+pofdp_packet_alloc(struct pofdp_packet_pool *pool)
+{
+    struct pofdp_packet *dpp;
+
+    if(pool->freeNum == 0){
+        return NULL;
+    }
+    dpp = pool->free[--pool->freeNum];
+
+    POFDP_PACKET_RESET(dpp);
+    dpp->packetBuf = &(dpp->mbuf->buf[POFDP_PACKET_PREBUF_LEN]);
+    dpp->packetBufLen = POFDP_PACKET_RAW_MAX_LEN;
+    return dpp;
+}
+
+void
+pofdp_packet_free(struct pofdp_packet_pool *pool, struct pofdp_packet *dpp)
+{
+    pool->free[pool->freeNum++] = dpp;
+    return;
+}
+
+/***********************************************************************
+ * Increace the counter of one packet
+ * Form:     uint32_t pofdp_counter_increace(POFDP_ARG, uint32_t counter_id,
+ *                                           uint32_t byte_len)
+ * Input:    dpp, lr, counter_id, byte length
+ * Return:   POF_OK or Error code
+ * Discribe: This function increases the counter corresponding to the
+ *           counter_id by one packet, and skips it if there is no such
+ *           counter. In a burst, the increase is only gathered in the
+ *           counter batch, so a flow hitting the counter many times adds
+ *           to it once, when the batch is flushed at the end of the
+ *           burst.
+ ***********************************************************************/
+uint32_t
+pofdp_counter_increace(POFDP_ARG, uint32_t counter_id, uint32_t byte_len)
+{
+    struct pofdp_counter_batch *batch = dpp->counterBatch;
+    struct counterInfo *counter;
+    uint32_t i, ret;
+
+    if(!counter_id){
+        return POF_OK;
+    }
+    ret = poflr_counter_lookup(counter_id, &counter, lr);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    /* The datapath does not create the counter, so a missing one is
+     * skipped. */
+    if(!counter){
+        POF_DEBUG_CPRINT_FL(1,RED,"The counter %u does not exist", counter_id);
+        return POF_OK;
+    }
+
+    if(!batch || !dpp->burst){
+        poflr_counter_add(counter, batch ? batch->shard : 0, 1, byte_len);
+        POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %u has increased", counter_id);
+        return POF_OK;
+    }
+
+    /* The latest counters are the most likely ones. */
+    for(i=batch->num; i>0; i--){
+        if(batch->items[i-1].counter == counter){
+            batch->items[i-1].packets ++;
+            batch->items[i-1].bytes += byte_len;
+            return POF_OK;
+        }
+    }
+    if(batch->num == POFDP_COUNTER_BATCH_SIZE){
+        pofdp_counter_batch_flush(batch);
+    }
+    batch->items[batch->num].counter = counter;
+    batch->items[batch->num].packets = 1;
+    batch->items[batch->num].bytes = byte_len;
+    batch->num ++;
+    return POF_OK;
+}
+
+/* Add the gathered increases to the counters. It should be done before
+ * the task is quiescent, as the counters may be deleted then. */
+void
+pofdp_counter_batch_flush(struct pofdp_counter_batch *batch)
+{
+    uint32_t i;
+
+    for(i=0; i<batch->num; i++){
+        poflr_counter_add(batch->items[i].counter, batch->shard, \
+                          batch->items[i].packets, batch->items[i].bytes);
+    }
+    batch->num = 0;
+    return;
+}
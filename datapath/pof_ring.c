@@ -0,0 +1,340 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_byte_transfer.h"
+#include "../include/pof_memory.h"
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+
+#define RING_BLOCK(ring, index) \
+            ((struct tpacket_block_desc *)((ring)->map + (index) * (ring)->blockSize))
+
+/* The packets in one batch can be sent to different ports, so each
+ * message carries its own address. Only the output metadata is copied
+ * into the batch. The packet data is sent from where it is. */
+struct pofdp_tx_batch {
+    int sock;
+    uint32_t num;
+    struct mmsghdr msg[POFDP_TX_BATCH_SIZE];
+    struct iovec iov[POFDP_TX_BATCH_SIZE][2];   /* The metadata, and the packet. */
+    struct sockaddr_ll sll[POFDP_TX_BATCH_SIZE];
+    uint8_t meta[POFDP_TX_BATCH_SIZE][POFDP_METADATA_MAX_LEN];
+};
+
+/***********************************************************************
+ * Open the TPACKET_V3 RX ring of one port
+ * Form:     uint32_t pofdp_rx_ring_open(struct pofdp_rx_ring *ring,
+ *                                       const struct portInfo *port,
+ *                                       const struct pof_datapath *dp)
+ * Input:    port, dp
+ * Output:   ring
+ * Return:   POF_OK or Error code
+ * Discribe: This function creates a RAW socket bound to the port, and
+ *           maps a block-based RX ring shared with the kernel. Every
+ *           frame in the ring keeps POFDP_PACKET_PREBUF_LEN bytes in
+ *           front of the packet, so the packet can be processed in place
+ *           just like the one in pofdp_packet.buf.
+ * NOTE:     Nothing is left open if any ERRORs occur, and the caller
+ *           can fall back to recvfrom().
+ ***********************************************************************/
+uint32_t
+pofdp_rx_ring_open(struct pofdp_rx_ring *ring, const struct portInfo *port, \
+                   const struct pof_datapath *dp)
+{
+    struct tpacket_req3 req = {0};
+    struct sockaddr_ll sll = {0};
+    int version = TPACKET_V3, reserve = POFDP_PACKET_PREBUF_LEN;
+
+    memset(ring, 0, sizeof *ring);
+    ring->blockSize = dp->rxRingBlockSize;
+    ring->blockNum = dp->rxRingBlockNum;
+    if(ring->blockSize < POFDP_RX_RING_FRAME_SIZE || ring->blockNum == 0 || \
+            (ring->blockSize & (ring->blockSize - 1))){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_MMAP_RING_FAILURE);
+    }
+
+    if((ring->sock = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE);
+    }
+
+    /* The version and the reserve have to be set before the ring. */
+    if(setsockopt(ring->sock, SOL_PACKET, PACKET_VERSION, &version, sizeof version) != 0 || \
+            setsockopt(ring->sock, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof reserve) != 0){
+        close(ring->sock);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SET_SOCKET_OPTION_FAILURE);
+    }
+
+    req.tp_block_size = ring->blockSize;
+    req.tp_block_nr = ring->blockNum;
+    req.tp_frame_size = POFDP_RX_RING_FRAME_SIZE;
+    req.tp_frame_nr = (ring->blockSize / POFDP_RX_RING_FRAME_SIZE) * ring->blockNum;
+    req.tp_retire_blk_tov = POFDP_RX_RING_BLOCK_TIMEOUT;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if(setsockopt(ring->sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) != 0){
+        close(ring->sock);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SET_SOCKET_OPTION_FAILURE);
+    }
+
+    ring->mapLen = ring->blockSize * ring->blockNum;
+    ring->map = mmap(NULL, ring->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, ring->sock, 0);
+    if(ring->map == MAP_FAILED){
+        /* MAP_LOCKED fails without CAP_IPC_LOCK or enough RLIMIT_MEMLOCK. */
+        ring->map = mmap(NULL, ring->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, ring->sock, 0);
+    }
+    if(ring->map == MAP_FAILED){
+        ring->map = NULL;
+        close(ring->sock);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_MMAP_RING_FAILURE);
+    }
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = POF_HTONS(ETH_P_ALL);
+    sll.sll_ifindex = port->sysIndex;
+    if(bind(ring->sock, (struct sockaddr *)&sll, sizeof sll) != 0){
+        pofdp_rx_ring_close(ring);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BIND_SOCKET_FAILURE);
+    }
+
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: RX ring is ready! block_size = %u, block_num = %u", \
+            port->name, ring->blockSize, ring->blockNum);
+    return POF_OK;
+}
+
+void
+pofdp_rx_ring_close(struct pofdp_rx_ring *ring)
+{
+    if(ring->map){
+        munmap(ring->map, ring->mapLen);
+        ring->map = NULL;
+    }
+    close(ring->sock);
+    return;
+}
+
+/***********************************************************************
+ * Get the next RX ring block owned by user
+ * Form:     struct tpacket_block_desc *pofdp_rx_ring_next_block(ring, timeout)
+ * Input:    ring, timeout in millisecond
+ * Return:   The block, or NULL if no block is ready after the timeout.
+ * Discribe: The kernel retires a block to user when it is full or when
+ *           the block timeout expires, so the block holds a burst of
+ *           packets. The caller walks all the packets in the block and
+ *           then gives it back by pofdp_rx_ring_release_block.
+ *           If the timeout is 0, it returns at once without any syscall.
+ ***********************************************************************/
+struct tpacket_block_desc *
+pofdp_rx_ring_next_block(struct pofdp_rx_ring *ring, int timeout)
+{
+    struct tpacket_block_desc *block = RING_BLOCK(ring, ring->blockIndex);
+    struct pollfd pfd = {0};
+
+    if(!(block->hdr.bh1.block_status & TP_STATUS_USER)){
+        if(timeout == 0){
+            return NULL;
+        }
+        pfd.fd = ring->sock;
+        pfd.events = POLLIN | POLLERR;
+        /* poll() is also the cancellation point of the task. */
+        poll(&pfd, 1, timeout);
+        if(!(block->hdr.bh1.block_status & TP_STATUS_USER)){
+            return NULL;
+        }
+    }
+
+    /* Read the packets only after the status. */
+    __sync_synchronize();
+    return block;
+}
+
+void
+pofdp_rx_ring_release_block(struct pofdp_rx_ring *ring, struct tpacket_block_desc *block)
+{
+    __sync_synchronize();
+    block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    ring->blockIndex = (ring->blockIndex + 1) % ring->blockNum;
+    return;
+}
+
+/***********************************************************************
+ * Open the receive socket of one port
+ * Form:     int pofdp_recv_socket_open(const struct portInfo *port, int nonblock)
+ * Input:    port, whether recvfrom() should never block
+ * Return:   The socket, or -1 if any ERRORs occur.
+ * Discribe: This function creates a RAW socket bound to the port, for
+ *           receiving the packets by recvfrom().
+ ***********************************************************************/
+int
+pofdp_recv_socket_open(const struct portInfo *port, int nonblock)
+{
+    struct sockaddr_ll sll = {0};
+    int sock;
+
+    if((sock = socket(AF_PACKET, SOCK_RAW | (nonblock ? SOCK_NONBLOCK : 0), \
+                    POF_HTONS(ETH_P_ALL))) == -1){
+        POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE, g_upward_xid++);
+        return -1;
+    }
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = POF_HTONS(ETH_P_ALL);
+    sll.sll_ifindex = port->sysIndex;
+
+    if(bind(sock, (struct sockaddr *)&sll, sizeof(struct sockaddr_ll)) != 0){
+        POF_ERROR_HANDLE_NO_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_BIND_SOCKET_FAILURE, g_upward_xid++);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/***********************************************************************
+ * Initialize the send socket of one receive task
+ * Form:     uint32_t pofdp_send_socket_init(int sock, const struct pof_datapath *dp)
+ * Input:    sock, dp
+ * Return:   POF_OK or Error code
+ * Discribe: With PACKET_QDISC_BYPASS the packets sent by the socket skip
+ *           the qdisc layer of the kernel. The packets may be dropped by
+ *           the driver if its queue is full.
+ ***********************************************************************/
+uint32_t
+pofdp_send_socket_init(int sock, const struct pof_datapath *dp)
+{
+    int bypass = 1;
+
+    if(dp->txQdiscBypass){
+        if(setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass, sizeof bypass) != 0){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SET_SOCKET_OPTION_FAILURE);
+        }
+    }
+    return POF_OK;
+}
+
+struct pofdp_tx_batch *
+pofdp_tx_batch_create(int sock)
+{
+    struct pofdp_tx_batch *batch = NULL;
+    uint32_t i;
+
+    POF_MALLOC_SAFE_RETURN(batch, 1, NULL);
+    batch->sock = sock;
+    for(i=0; i<POFDP_TX_BATCH_SIZE; i++){
+        batch->iov[i][0].iov_base = batch->meta[i];
+        batch->sll[i].sll_family = AF_PACKET;
+        batch->sll[i].sll_protocol = POF_HTONS(ETH_P_ALL);
+        batch->msg[i].msg_hdr.msg_name = &batch->sll[i];
+        batch->msg[i].msg_hdr.msg_namelen = sizeof batch->sll[i];
+    }
+    return batch;
+}
+
+void
+pofdp_tx_batch_destroy(struct pofdp_tx_batch *batch)
+{
+    if(batch){
+        FREE(batch);
+    }
+    return;
+}
+
+/* The buffer to be filled by the output metadata of the next queued packet. */
+uint8_t *
+pofdp_tx_batch_slot(struct pofdp_tx_batch *batch)
+{
+    return batch->meta[batch->num];
+}
+
+/***********************************************************************
+ * Queue one output packet
+ * Form:     uint32_t pofdp_tx_batch_add(struct pofdp_tx_batch *batch,
+ *                                       uint32_t sysIndex, uint16_t metaLen,
+ *                                       const uint8_t *packet, uint16_t len)
+ * Input:    batch, system index of the output port, metadata length,
+ *           packet data, packet length
+ * Return:   POF_OK or Error code
+ * Discribe: The output metadata has been written into
+ *           pofdp_tx_batch_slot(batch) by the caller. The packet data is
+ *           NOT copied, so it should not be changed or freed until the
+ *           batch is flushed. The batch is flushed when it is full.
+ ***********************************************************************/
+uint32_t
+pofdp_tx_batch_add(struct pofdp_tx_batch *batch, uint32_t sysIndex, uint16_t metaLen, \
+                   const uint8_t *packet, uint16_t len)
+{
+    struct iovec *iov = batch->iov[batch->num];
+    struct msghdr *hdr = &batch->msg[batch->num].msg_hdr;
+
+    batch->sll[batch->num].sll_ifindex = sysIndex;
+    iov[0].iov_len = metaLen;
+    iov[1].iov_base = (uint8_t *)packet;
+    iov[1].iov_len = len;
+    /* Skip the metadata if there is none. */
+    hdr->msg_iov = metaLen ? iov : &iov[1];
+    hdr->msg_iovlen = metaLen ? 2 : 1;
+    batch->num ++;
+
+    if(batch->num == POFDP_TX_BATCH_SIZE){
+        return pofdp_tx_batch_flush(batch);
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Send all the queued packets
+ * Form:     uint32_t pofdp_tx_batch_flush(struct pofdp_tx_batch *batch)
+ * Input:    batch
+ * Return:   POF_OK or Error code
+ * Discribe: This function sends the queued packets by as few sendmmsg()
+ *           as possible. The packets which can not be sent are dropped,
+ *           and the batch is always empty after flushing.
+ ***********************************************************************/
+uint32_t
+pofdp_tx_batch_flush(struct pofdp_tx_batch *batch)
+{
+    uint32_t sent = 0;
+    int ret;
+
+    while(sent < batch->num){
+        if((ret = sendmmsg(batch->sock, &batch->msg[sent], batch->num - sent, 0)) <= 0){
+            batch->num = 0;
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE, g_upward_xid++);
+        }
+        sent += ret;
+    }
+
+    batch->num = 0;
+    return POF_OK;
+}
@@ -0,0 +1,544 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_byte_transfer.h"
+#include "../include/pof_memory.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+
+/* The receive state of one port, or of one fanout member of the port,
+ * polled by a worker. */
+struct pofdp_worker_port {
+    struct portInfo *port;
+    struct pof_local_resource *lr;
+    struct pofdp_worker *worker;
+    struct pofdp_worker_port *next;     /* In the port list of the worker. */
+    struct pofdp_worker_port *member;   /* The next fanout member of the port. */
+    struct pofdp_rx_ring ring;      /* Used if the ring is mapped. */
+    int sock;                       /* Non-blocking recvfrom() socket otherwise. */
+    struct pofdp_fanout fanout;     /* The share of the packets if they are
+                                       spread in software. num is 0 if not. */
+    uint8_t detached;               /* The port has been deleted. */
+};
+
+/* One worker task polling a set of ports. */
+struct pofdp_worker {
+    uint16_t id;
+    int cpu;
+    int epfd;
+    task_t taskID;
+    pthread_mutex_t lock;           /* Held while the ready ports are handled. */
+    uint16_t portNum;
+    struct pofdp_worker_port *ports;    /* The ports being polled. */
+    struct pofdp_worker_port *detached; /* Freed by the worker before the
+                                           next epoll_wait(). */
+    int sockSend;
+    struct pofdp_tx_batch *txBatch;
+    struct flowCache *flowCache;
+    struct pofdp_packet_pool *pool;
+} POF_CACHE_ALIGNED;
+
+/* Open the RX ring of the port, or a non-blocking socket if the ring
+ * is not enabled or can not be set up. */
+static int
+workerPortSocket(struct pofdp_worker_port *wp, const struct pof_datapath *dp)
+{
+    if(pofdp_rx_ring_enabled(wp->port, dp)){
+        if(pofdp_rx_ring_open(&wp->ring, wp->port, dp) == POF_OK){
+            return wp->ring.sock;
+        }
+        POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Open RX ring failed, use recvfrom instead.", wp->port->name);
+    }
+    return (wp->sock = pofdp_recv_socket_open(wp->port, TRUE));
+}
+
+static void
+workerPortSocketClose(struct pofdp_worker_port *wp)
+{
+    if(wp->ring.map){
+        pofdp_rx_ring_close(&wp->ring);
+    }else if(wp->sock != -1){
+        close(wp->sock);
+        wp->sock = -1;
+    }
+    return;
+}
+
+/* Open the socket of one fanout member of the port, and join it into
+ * the fanout group if the port has several members. If the kernel can
+ * not spread the packets, the member takes its share in software. */
+static int
+workerPortOpen(struct pofdp_worker_port *wp, const struct pof_datapath *dp, \
+               uint16_t index, uint16_t num)
+{
+    int fd;
+
+    if((fd = workerPortSocket(wp, dp)) == -1 || num == 1){
+        return fd;
+    }
+
+    if(dp->fanoutMode != POFDP_FANOUT_SOFT){
+        if(pofdp_fanout_join(fd, wp->port, dp, num) == POF_OK){
+            return fd;
+        }
+        /* The socket may be in the group already, so open a new one. */
+        POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Join the fanout group failed, spread the packets in software instead.", \
+                wp->port->name);
+        workerPortSocketClose(wp);
+        if((fd = workerPortSocket(wp, dp)) == -1){
+            return fd;
+        }
+    }
+
+    wp->fanout.index = index;
+    wp->fanout.num = num;
+    return fd;
+}
+
+static void
+workerPortClose(struct pofdp_worker_port *wp)
+{
+    workerPortSocketClose(wp);
+    FREE(wp);
+    return;
+}
+
+/* Free the ports deleted since the last epoll_wait(). None of the ready
+ * events can refer to them any more. */
+static void
+workerDetachedFree(struct pofdp_worker *worker)
+{
+    struct pofdp_worker_port *wp;
+
+    pthread_mutex_lock(&worker->lock);
+    while((wp = worker->detached) != NULL){
+        worker->detached = wp->next;
+        workerPortClose(wp);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return;
+}
+
+/* Pin the worker to its CPU, and set its real-time priority. */
+static void
+workerSchedule(const struct pofdp_worker *worker, const struct pof_datapath *dp)
+{
+    struct sched_param param = {0};
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(worker->cpu, &cpus);
+    if(pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus) != 0){
+        POF_ERROR_CPRINT_FL("Worker %u: Can not run on CPU %d.", worker->id, worker->cpu);
+    }
+
+    if(dp->workerPriority){
+        param.sched_priority = dp->workerPriority;
+        if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0){
+            POF_ERROR_CPRINT_FL("Worker %u: Can not set SCHED_FIFO priority %u.", \
+                    worker->id, dp->workerPriority);
+        }
+    }
+    return;
+}
+
+/* Receive and forward the packets which are ready in one port. */
+static void
+workerPortRecv(struct pofdp_worker *worker, struct pofdp_worker_port *wp)
+{
+    const struct pofdp_fanout *fanout = wp->fanout.num ? &wp->fanout : NULL;
+    struct tpacket_block_desc *block;
+    uint32_t i;
+
+    if(wp->ring.map){
+        /* Leave the other blocks to the next turn, so that a busy
+         * port can not starve the others of the worker. */
+        for(i=0; i<POFDP_WORKER_RING_BUDGET; i++){
+            if((block = pofdp_rx_ring_next_block(&wp->ring, 0)) == NULL){
+                break;
+            }
+            pofdp_recv_ring_block(worker->pool, wp->lr, &wp->ring, block, \
+                    wp->port, fanout);
+        }
+    }else{
+        pofdp_recv_socket_burst(worker->pool, wp->lr, wp->sock, wp->port, fanout);
+    }
+    return;
+}
+
+/***********************************************************************
+ * The task function of worker task
+ * Form:     static uint32_t pofdp_worker_task(void *arg_ptr)
+ * Input:    worker
+ * Output:   NONE
+ * Return:   POF_OK
+ * Discribe: This is the task function of worker task, which is infinite
+ *           loop running on its own CPU. It waits until some of its
+ *           ports have packets by epoll_wait(), and then receives and
+ *           forwards a burst of packets from each ready port.
+ * NOTE:     The task can only be canceled in epoll_wait(), so it never
+ *           stops with the lock held or in the middle of a burst.
+ ***********************************************************************/
+static uint32_t
+pofdp_worker_task(void *arg_ptr)
+{
+    struct pofdp_worker *worker = (struct pofdp_worker *)arg_ptr;
+    struct epoll_event events[POFDP_WORKER_EVENT_NUM];
+    struct pofdp_worker_port *wp;
+    int i, num, state;
+
+    workerSchedule(worker, &g_dp);
+
+    /* Unregistered when the pool is destroyed. */
+    rcu_register(&worker->pool->rcu);
+
+    while(1){
+        workerDetachedFree(worker);
+
+        /* Not waited for by the flow mods while waiting for the ports. */
+        rcu_offline(&worker->pool->rcu);
+        num = epoll_wait(worker->epfd, events, POFDP_WORKER_EVENT_NUM, POFDP_WORKER_TIMEOUT);
+        rcu_online(&worker->pool->rcu);
+        if(num <= 0){
+            continue;
+        }
+
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        pthread_mutex_lock(&worker->lock);
+        for(i=0; i<num; i++){
+            wp = (struct pofdp_worker_port *)events[i].data.ptr;
+            if(!wp->detached){
+                workerPortRecv(worker, wp);
+            }
+        }
+        pthread_mutex_unlock(&worker->lock);
+        pthread_setcancelstate(state, NULL);
+    }
+    return POF_OK;
+}
+
+/* Create everything one worker task needs, and start the task. */
+static uint32_t
+workerStart(struct pofdp_worker *worker, struct pof_datapath *dp)
+{
+    uint32_t i, ret;
+
+    pthread_mutex_init(&worker->lock, NULL);
+    if((worker->epfd = epoll_create1(0)) == -1){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE);
+    }
+
+    /* Create socket to send the output packets. */
+    if((worker->sockSend = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE);
+    }
+    pofdp_send_socket_init(worker->sockSend, dp);
+
+    /* Queue the output packets, and send them once per receive burst. */
+    if(dp->txBatch && (worker->txBatch = pofdp_tx_batch_create(worker->sockSend)) == NULL){
+        return POF_ERROR;
+    }
+
+    /* Cache the table lookups of the packets received by the worker. */
+    if(dp->flowCache && (worker->flowCache = poflr_flow_cache_create()) == NULL){
+        return POF_ERROR;
+    }
+
+    /* The packet descriptors for one receive burst. */
+    if((worker->pool = pofdp_packet_pool_create(POFDP_BURST_SIZE, dp)) == NULL){
+        return POF_ERROR;
+    }
+    for(i=0; i<worker->pool->num; i++){
+        worker->pool->dpps[i].sockSend = worker->sockSend;
+        worker->pool->dpps[i].txBatch = worker->txBatch;
+        worker->pool->dpps[i].flowCache = worker->flowCache;
+    }
+
+    ret = pofbf_task_create(worker, (void *)pofdp_worker_task, &worker->taskID);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Worker %u: Start on CPU %d!", worker->id, worker->cpu);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Create the worker pool
+ * Form:     uint32_t pofdp_worker_pool_create(struct pof_datapath *dp)
+ * Input:    dp
+ * Output:   dp->workers
+ * Return:   POF_OK or Error code
+ * Discribe: This function starts dp->workerNum worker tasks. Each worker
+ *           runs on the CPU set by the config, or on the CPU of its
+ *           index by default. The ports are added to the workers later
+ *           by pofdp_worker_port_add().
+ ***********************************************************************/
+uint32_t
+pofdp_worker_pool_create(struct pof_datapath *dp)
+{
+    struct pofdp_worker *workers;
+    long cpuNum = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t i;
+
+    if(dp->workerNum > POFDP_WORKER_MAX){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_CREATE_FAIL);
+    }
+    if(cpuNum <= 0){
+        cpuNum = 1;
+    }
+
+    if(posix_memalign((void **)&workers, POF_CACHE_LINE_SIZE, dp->workerNum * sizeof *workers) != 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    memset(workers, 0, dp->workerNum * sizeof *workers);
+    for(i=0; i<dp->workerNum; i++){
+        workers[i].id = i;
+        workers[i].cpu = (i < dp->workerCpuNum) ? dp->workerCpus[i] : (i % cpuNum);
+        workers[i].epfd = -1;
+        workers[i].sockSend = -1;
+    }
+    dp->workers = workers;
+
+    for(i=0; i<dp->workerNum; i++){
+        if(workerStart(&workers[i], dp) != POF_OK){
+            pofdp_worker_pool_destroy(dp);
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_CREATE_FAIL);
+        }
+    }
+    return POF_OK;
+}
+
+/* Stop all worker tasks, and close all ports polled by them. */
+void
+pofdp_worker_pool_destroy(struct pof_datapath *dp)
+{
+    struct pofdp_worker *worker;
+    struct pofdp_worker_port *wp;
+    uint32_t i;
+
+    if(!dp->workers){
+        return;
+    }
+
+    for(i=0; i<dp->workerNum; i++){
+        worker = &dp->workers[i];
+        if(worker->taskID != POF_INVALID_TASKID){
+            pthread_cancel(worker->taskID);
+            pthread_join(worker->taskID, NULL);
+        }
+
+        while((wp = worker->ports) != NULL){
+            worker->ports = wp->next;
+            wp->port->workerPort = NULL;
+            workerPortClose(wp);
+        }
+        while((wp = worker->detached) != NULL){
+            worker->detached = wp->next;
+            workerPortClose(wp);
+        }
+
+        pofdp_packet_pool_destroy(worker->pool);
+        pofdp_tx_batch_destroy(worker->txBatch);
+        poflr_flow_cache_destroy(worker->flowCache);
+        if(worker->sockSend != -1){
+            close(worker->sockSend);
+        }
+        if(worker->epfd != -1){
+            close(worker->epfd);
+        }
+        pthread_mutex_destroy(&worker->lock);
+    }
+
+    free(dp->workers);
+    dp->workers = NULL;
+    return;
+}
+
+/* The worker set by the config, or the one polling the fewest ports. */
+static struct pofdp_worker *
+workerAssign(const struct portInfo *port, const struct pof_datapath *dp)
+{
+    struct pofdp_worker *worker = &dp->workers[0];
+    uint32_t i;
+
+    for(i=0; i<dp->workerPortNum; i++){
+        if(strncmp(dp->workerPorts[i].port, port->name, PORT_NAME_LEN) == 0 && \
+                dp->workerPorts[i].worker < dp->workerNum){
+            return &dp->workers[dp->workerPorts[i].worker];
+        }
+    }
+
+    for(i=1; i<dp->workerNum; i++){
+        if(dp->workers[i].portNum < worker->portNum){
+            worker = &dp->workers[i];
+        }
+    }
+    return worker;
+}
+
+/* Add one fanout member of the port to the epoll set of the worker. */
+static uint32_t
+workerPortAdd(struct portInfo *port, struct pof_local_resource *lr, struct pofdp_worker *worker, \
+              const struct pof_datapath *dp, uint16_t index, uint16_t num)
+{
+    struct pofdp_worker_port *wp;
+    struct epoll_event event = {0};
+    int fd;
+
+    POF_MALLOC_SAFE_RETURN(wp, 1, POF_ERROR);
+    wp->port = port;
+    wp->lr = lr;
+    wp->worker = worker;
+    wp->sock = -1;
+    if((fd = workerPortOpen(wp, dp, index, num)) == -1){
+        FREE(wp);
+        return POF_ERROR;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = wp;
+
+    pthread_mutex_lock(&worker->lock);
+    if(epoll_ctl(worker->epfd, EPOLL_CTL_ADD, fd, &event) != 0){
+        pthread_mutex_unlock(&worker->lock);
+        workerPortClose(wp);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_CREATE_FAIL);
+    }
+    wp->next = worker->ports;
+    worker->ports = wp;
+    worker->portNum ++;
+    wp->member = port->workerPort;
+    port->workerPort = wp;
+    pthread_mutex_unlock(&worker->lock);
+
+    if(num == 1){
+        POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Polled by worker %u on CPU %d!", \
+                port->name, worker->id, worker->cpu);
+    }else{
+        POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Fanout member %u of %u polled by worker %u on CPU %d!%s", \
+                port->name, index, num, worker->id, worker->cpu, wp->fanout.num ? " (in software)" : "");
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Add a port to the worker pool
+ * Form:     uint32_t pofdp_worker_port_add(struct portInfo *port,
+ *                                          struct pof_datapath *dp)
+ * Input:    port, dp
+ * Output:   port->workerPort
+ * Return:   POF_OK or Error code
+ * Discribe: This function opens the RX ring of the port, or a
+ *           non-blocking socket if the ring is not enabled or can not be
+ *           set up, and adds it to the epoll set of the worker assigned
+ *           to the port.
+ *           If the config sets several fanout members for the port, one
+ *           socket is opened for each member, and the members are given
+ *           to the workers following the assigned one. So one busy port
+ *           can use several CPUs.
+ ***********************************************************************/
+uint32_t
+pofdp_worker_port_add(struct portInfo *port, struct pof_datapath *dp)
+{
+    struct pof_local_resource *lr;
+    struct pofdp_worker *worker;
+    uint16_t i, num;
+
+    if(port->workerPort){
+        return POF_OK;
+    }
+    if(!dp->workers){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_CREATE_FAIL);
+    }
+    if((lr = pofdp_get_local_resource(port->slotID, dp)) == NULL){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_INVALID_SLOT_ID);
+    }
+
+    worker = workerAssign(port, dp);
+    num = pofdp_fanout_num(port, dp);
+    for(i=0; i<num; i++){
+        if(workerPortAdd(port, lr, &dp->workers[(worker->id + i) % dp->workerNum], dp, i, num) != POF_OK){
+            if(port->workerPort){
+                pofdp_worker_port_del(port);
+            }
+            return POF_ERROR;
+        }
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Delete a port from the worker pool
+ * Form:     uint32_t pofdp_worker_port_del(struct portInfo *port)
+ * Input:    port
+ * Output:   port->workerPort
+ * Return:   POF_OK or Error code
+ * Discribe: This function removes all fanout members of the port from
+ *           the epoll sets of their workers. The receive state of each
+ *           member is freed by the worker itself, because the events it
+ *           is handling may still refer to it. The port can be freed as
+ *           soon as this returns.
+ ***********************************************************************/
+uint32_t
+pofdp_worker_port_del(struct portInfo *port)
+{
+    struct pofdp_worker_port *wp, **pp;
+    struct pofdp_worker *worker;
+
+    if(!port->workerPort){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_DELETE_FAIL);
+    }
+
+    while((wp = port->workerPort) != NULL){
+        port->workerPort = wp->member;
+        worker = wp->worker;
+
+        pthread_mutex_lock(&worker->lock);
+        epoll_ctl(worker->epfd, EPOLL_CTL_DEL, wp->ring.map ? wp->ring.sock : wp->sock, NULL);
+        for(pp=&worker->ports; *pp!=wp; pp=&(*pp)->next){
+            ;
+        }
+        *pp = wp->next;
+        wp->detached = TRUE;
+        wp->port = NULL;
+        wp->next = worker->detached;
+        worker->detached = wp;
+        worker->portNum --;
+        pthread_mutex_unlock(&worker->lock);
+    }
+    return POF_OK;
+}
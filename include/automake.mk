@@ -9,6 +9,8 @@ EXTRA_DIST += \
 	include/pof_local_resource.h \
 	include/pof_log_print.h \
 	include/pof_hmap.h \
+	include/pof_hash.h \
+	include/pof_rcu.h \
 	include/pof_tree.h \
 	include/pof_list.h \
 	include/pof_memory.h \
@@ -43,6 +43,7 @@
 	COMMAND(table_resource)		\
 	COMMAND(ports)				\
 	COMMAND(tables)				\
+	COMMAND(hmaps)				\
 	COMMAND(groups)				\
 	COMMAND(meters)				\
 	COMMAND(counters)			\
@@ -53,6 +54,10 @@
 	COMMAND(addport)	        \
 	COMMAND(delport)	        \
 	COMMAND(test)               \
+	COMMAND(lpm_bench)          \
+	COMMAND(hash_bench)         \
+	COMMAND(bit_bench)          \
+	COMMAND(ins_bench)          \
 	COMMAND(clear_resource)		\
 	COMMAND(enable_debug)		\
 	COMMAND(disable_debug)		\
@@ -71,6 +76,7 @@
 	COMMAND(table_resource)		\
 	COMMAND(ports)				\
 	COMMAND(tables)				\
+	COMMAND(hmaps)				\
 	COMMAND(groups)				\
 	COMMAND(meters)				\
 	COMMAND(counters)			\
@@ -81,6 +87,10 @@
 	COMMAND(addport)	        \
 	COMMAND(delport)	        \
 	COMMAND(test)               \
+	COMMAND(lpm_bench)          \
+	COMMAND(hash_bench)         \
+	COMMAND(bit_bench)          \
+	COMMAND(ins_bench)          \
 	COMMAND(clear_resource)		\
 	COMMAND(enable_debug)		\
 	COMMAND(disable_debug)		\
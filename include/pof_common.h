@@ -106,6 +106,14 @@
 /* Right shift. */
 #define POF_MOVE_BIT_RIGHT(x,n)             ((x) >> (n))
 
+/* Minimum and maximum. */
+#define POF_MIN(a,b)                        ((a) < (b) ? (a) : (b))
+#define POF_MAX(a,b)                        ((a) > (b) ? (a) : (b))
+
+/* Cache line. */
+#define POF_CACHE_LINE_SIZE                 (64)
+#define POF_CACHE_ALIGNED                   __attribute__((aligned(POF_CACHE_LINE_SIZE)))
+
 #define POF_STRUCT_FROM_MEMBER(obj, member, ptr) \
             ( (typeof(obj)) ((uint8_t *)ptr - offsetof(typeof(*obj), member)) )
 
@@ -172,6 +180,17 @@ struct pof_state {
     struct pof_str_pair sd2n_after1015;
     struct pof_str_pair multiSlot;
     struct pof_str_pair sht_vxlan;
+    struct pof_str_pair rxRing;
+    struct pof_str_pair txBatch;
+    struct pof_str_pair qdiscBypass;
+    struct pof_str_pair workers;
+    struct pof_str_pair schedFifo;
+    struct pof_str_pair fanout;
+    struct pof_str_pair mmEngine;
+    struct pof_str_pair lpmEngine;
+    struct pof_str_pair emEngine;
+    struct pof_str_pair flowCache;
+    struct pof_str_pair interpreter;
 };
 
 extern struct pof_state g_states;
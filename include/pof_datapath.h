@@ -29,6 +29,7 @@
 #include <linux/if_packet.h>
 #include "pof_global.h"
 #include "pof_local_resource.h"
+#include "pof_rcu.h"
 #include "pof_common.h"
 
 /* Max length of the raw packet received by local physical port. */
@@ -59,6 +60,56 @@
 #define POF_SLOT_NUM        (1)
 #define POF_SLOT_MAX        (16)
 
+/* TPACKET_V3 memory-mapped RX ring. */
+#define POFDP_RX_RING_BLOCK_SIZE    (1 << 20)   /* Byte unit. Power of 2. */
+#define POFDP_RX_RING_BLOCK_NUM     (64)
+#define POFDP_RX_RING_FRAME_SIZE    (2048)
+#define POFDP_RX_RING_BLOCK_TIMEOUT (10)        /* Millisecond unit. */
+#define POFDP_RX_RING_PORT_MAX      (16)
+
+/* Max number of packets forwarded together by pofdp_forward_burst(). */
+#define POFDP_BURST_SIZE            (32)
+
+/* The threaded interpreter dispatches by the computed goto of GCC. */
+#ifdef __GNUC__
+#define POFDP_THREADED_DISPATCH
+#endif // __GNUC__
+
+/* Max number of packets sent by one sendmmsg(). */
+#define POFDP_TX_BATCH_SIZE         (32)
+
+/* Max number of different counters increased in one burst. */
+#define POFDP_COUNTER_BATCH_SIZE    (32)
+
+/* Worker tasks polling the ports, instead of one task per port. */
+#define POFDP_WORKER_MAX            (64)
+#define POFDP_WORKER_PORT_MAX       (128)
+#define POFDP_WORKER_EVENT_NUM      (16)    /* Ready ports handled per epoll_wait(). */
+#define POFDP_WORKER_RING_BUDGET    (4)     /* Ring blocks per ready port each turn. */
+#define POFDP_WORKER_TIMEOUT        (100)   /* Millisecond unit. */
+
+/* Several sockets of one port joined into a PACKET_FANOUT group. */
+#define POFDP_FANOUT_PORT_MAX       (16)
+
+/* Ports driven by a backend other than the raw socket. */
+#define POFDP_BACKEND_PORT_MAX      (16)
+#define POFDP_BACKEND_ARG_LEN       (256)
+#define POFDP_BACKEND_LOOP_LEN      (256)   /* Packets queued in a loop port. */
+
+/* How the packets of one port are spread over its fanout members. */
+enum pofdp_fanout_mode {
+    POFDP_FANOUT_HASH   = 0,    /* Kernel flow hash. */
+    POFDP_FANOUT_CPU    = 1,    /* The CPU which receives the packet. */
+    POFDP_FANOUT_EBPF   = 2,    /* eBPF program on the addresses. */
+    POFDP_FANOUT_SOFT   = 3,    /* Toeplitz hash in software. */
+};
+
+/* How the ports receive the raw packets. */
+enum pofdp_rx_mode {
+    POFDP_RX_RECVFROM   = 0,    /* One recvfrom() per packet. */
+    POFDP_RX_RING       = 1,    /* TPACKET_V3 memory-mapped RX ring. */
+};
+
 /**
 #define POF_PACKET_REL_LEN_GET(DPP)         (0)
 #define POF_PACKET_REL_LEN_SET(DPP, LEN)    (0)
@@ -85,49 +136,52 @@
 #define POF_COMP_RES_FIELD_BITNUM     (2)
 
 
-/* Packet infomation including data, length, received port. */
+/* Packet memory of one descriptor. The headroom is in front of the
+ * packet, so the fields can be added in front of the packet without
+ * moving it. */
+struct pofdp_mbuf{
+    uint8_t metadata[POFDP_METADATA_MAX_LEN];   /* The packet metadata. */
+    uint8_t buf[PFODP_PACKET_BUF_TOTAL_LEN];    /* The memery which stores the whole packet.
+                                                 * POFDP_PACKET_PREBUF_LEN bytes headroom,
+                                                 * then POFDP_PACKET_RAW_MAX_LEN bytes for
+                                                 * the packet. */
+} POF_CACHE_ALIGNED;
+
+/* Packet infomation including data, length, received port.
+ * The fields in front of dp are the state of one packet, and the hot
+ * ones come first to share the first two cache lines. They are reset
+ * by POFDP_PACKET_RESET() for each packet. The fields from dp on are
+ * set once when the descriptor is created. */
 struct pofdp_packet{
-    struct pof_datapath *dp;
-    /* Input information. */
-    uint32_t ori_port_id;       /* The original packet input port index. */
-    uint32_t ori_len;           /* The original packet length.
-                                 * If packet length has been changed, such as
-                                 * in add field action, the ori_len will NOT
-                                 * change. The len in metadata will update
-                                 * immediatley in this situation. */
-    uint8_t buf[POFDP_PACKET_RAW_MAX_LEN];  /* The memery which stores the whole packet. */
-    uint8_t *packetBuf;         /* Points to the original packet buffer.
-                                 * packetBuf = buf + POFDP_PACKET_PREBUF_LEN */
-
-    /* Output. */
-    uint16_t output_port_id;    /* The output port index. */
-    uint16_t output_slot_id;
-	uint16_t output_packet_len;			/* Byte unit. */
-								/* The length of output packet. */
-    uint16_t output_packet_offset;		/* Byte unit. */
-								/* The start position of output. */
-	uint16_t output_metadata_len;		/* Byte unit. */
-	uint16_t output_metadata_offset;	/* Bit unit. */
-								/* The output metadata length and offset. 
-								 * Packet data output right behind the metadata. */
-	uint16_t output_whole_len;  /* = output_packet_len + output_metadata_len. */
-	uint8_t buf_out[POFDP_PACKET_RAW_MAX_LEN];	/* The memery which store the whole output data. 
-                                                 * Including the metadata and
-                                                 * the packet.*/
-    uint8_t *output_packet_buf;      /* Points to the first byte of packet to output. */
-
     /* Offset. */
-    int16_t offset;				/* Byte unit. Can be negative.*/
-								/* The base offset of table field and actions. */
-    uint8_t *buf_offset;        /* The packet pointer shift offset. 
+    uint8_t *buf_offset;        /* The packet pointer shift offset.
                                  * buf_offset = packetBuf + offset */
     int32_t left_len;           /* Length of left packet after shifting offset. */
+    int16_t offset;				/* Byte unit. Can be negative.*/
+								/* The base offset of table field and actions. */
+    uint16_t packetBufLen;      /* The room behind packetBuf in byte. */
+    uint8_t *packetBuf;         /* Points to the original packet buffer.
+                                 * packetBuf = mbuf->buf + POFDP_PACKET_PREBUF_LEN,
+                                 * or points into the RX ring frame when the
+                                 * packet is processed in place. */
 
     /* Metadata. */
     struct pofdp_metadata *metadata;
                                 /* The memery which stores the packet metadata. 
 								 * The packet WHOLE length and input port index 
 								 * has been stored in metadata. */
+
+    /* Instruction & Actions. */
+    const struct insProgram *prog;  /* The program being executed. */
+    const struct insOp *op;     /* The op of prog to be executed. */
+    struct pof_instruction *ins;/* The raw instruction of op. */
+    struct pof_action *act;     /* Memery which stores the actions need to be
+                                 * implemented. */
+    uint8_t act_num;            /* Number of actions need to be implemented. */
+    const uint8_t *actCode;     /* POFLR_AC_* of act for the threaded
+                                 * interpreter. NULL if not compiled. */
+    uint8_t packet_done;        /* Indicate whether the packet processing is */
+                                /* already done. 1 means done, 0 means not. */
     uint16_t metadata_len;      /* The length of packet metadata in byte. */
 
     /* Flow. */
@@ -135,29 +189,97 @@ struct pofdp_packet{
     uint8_t table_id;           /* Index of table which contains the packet now. */
     struct entryInfo *flow_entry; /* The flow entry which match the packet. */
 
-    /* Instruction & Actions. */
+    /* Burst. */
+    struct tableInfo *tableWait;/* The table the packet waits to look up in
+                                 * together with the other packets of the
+                                 * burst. NULL means not waiting. */
+    uint8_t burst;              /* The packet is forwarded in a burst. */
+    uint8_t txPending;          /* The TX batch refers to the packet data.
+                                 * Flush the batch before changing it. */
+
 #ifdef POF_SHT_VXLAN
     struct insBlockInfo *insBlock;  /* Points to instruction block to be execute. */
-#endif // POF_SHT_VXLAN
-    struct pof_instruction *ins;/* The memery which stores the instructions need
-                                 * to be implemented. */
-    uint8_t ins_todo_num;       /* Number of instructions need to be implemented. */
-	uint8_t ins_done_num;       /* Number of instructions have been done. */
-    struct pof_action *act;     /* Memery which stores the actions need to be
-                                 * implemented. */
-    uint8_t act_num;            /* Number of actions need to be implemented. */
-#ifdef POF_SHT_VXLAN
     uint8_t *para;              /* Parameter of the entry. */
     uint16_t paraLen;           /* The length of the parameter. */
 #endif // POF_SHT_VXLAN
-    uint8_t packet_done;        /* Indicate whether the packet processing is */
-                                /* already done. 1 means done, 0 means not. */
+
+    /* Input information. */
+    uint32_t ori_port_id;       /* The original packet input port index. */
+    uint32_t ori_len;           /* The original packet length.
+                                 * If packet length has been changed, such as
+                                 * in add field action, the ori_len will NOT
+                                 * change. The len in metadata will update
+                                 * immediatley in this situation. */
+
+    /* Output. */
+    uint16_t output_port_id;    /* The output port index. */
+    uint16_t output_slot_id;
+	uint16_t output_packet_len;			/* Byte unit. */
+								/* The length of output packet. */
+    uint16_t output_packet_offset;		/* Byte unit. */
+								/* The start position of output. */
+	uint16_t output_metadata_len;		/* Byte unit. */
+	uint16_t output_metadata_offset;	/* Bit unit. */
+								/* The output metadata length and offset. 
+								 * Packet data output right behind the metadata. */
+	uint16_t output_whole_len;  /* = output_packet_len + output_metadata_len. */
+    uint8_t *output_packet_buf;      /* Points to the first byte of packet to output. */
 
 	/* Meter. */
 	uint16_t rate;				/* Rate. 0 means no limitation. */
 
+    /* Fields below are NOT reset for each packet. */
+    struct pof_datapath *dp;
+    struct pofdp_mbuf *mbuf;    /* The packet memory of the descriptor. */
+
 	/* Socket. */
 	int sockSend;
+    struct pofdp_tx_batch *txBatch; /* The output packets are queued here
+                                     * if not NULL, and sent out once per
+                                     * receive burst. */
+    struct flowCache *flowCache;    /* The flow cache of the receive task.
+                                     * NULL if not used. */
+    struct pofdp_counter_batch *counterBatch;
+                                    /* The counter increases of the burst
+                                     * are gathered here. NULL if the
+                                     * packet is not from a pool. */
+} POF_CACHE_ALIGNED;
+
+/* Send the queued outputs which refer to the packet data, before the
+ * packet is changed. */
+#define POFDP_TX_PENDING_FLUSH(dpp)                         \
+            do{                                             \
+                if((dpp)->txPending){                       \
+                    pofdp_tx_batch_flush((dpp)->txBatch);   \
+                    (dpp)->txPending = FALSE;               \
+                }                                           \
+            }while(0)
+
+/* Reset the state of one packet in the descriptor. */
+#define POFDP_PACKET_RESET(dpp) \
+            memset((dpp), 0, offsetof(struct pofdp_packet, dp))
+
+/* Counter increases of one burst. Each counter is added to once at the
+ * end of the burst, in the counter shard of the receive task. */
+struct pofdp_counter_batch{
+    uint32_t shard;
+    uint32_t num;
+    struct {
+        struct counterInfo *counter;
+        uint32_t packets;
+        uint64_t bytes;
+    } items[POFDP_COUNTER_BATCH_SIZE];
+};
+
+/* Preallocated packet descriptors of one receive task. No lock. */
+struct pofdp_packet_pool{
+    uint32_t num;
+    uint32_t freeNum;
+    struct pofdp_packet *dpps;  /* Cache aligned descriptors. */
+    struct pofdp_mbuf *mbufs;   /* Cache aligned packet memory. */
+    struct pofdp_packet **free; /* Stack of the free descriptors. */
+    struct rcuReader rcu;       /* Reader of the task owning the pool. */
+    struct pofdp_counter_batch counterBatch;
 };
 
 /* Define Metadata structure. */
@@ -184,6 +306,56 @@ struct pof_param {
     uint32_t counterNumMax;
 };
 
+/* The worker which polls the port, set by the config. */
+struct pofdp_worker_assign {
+    char port[PORT_NAME_LEN];
+    uint16_t worker;
+};
+
+/* The number of fanout members of the port, set by the config. */
+struct pofdp_fanout_assign {
+    char port[PORT_NAME_LEN];
+    uint16_t num;
+};
+
+/* The share of the packets of a port which one fanout member takes, if
+ * the packets are spread in software. */
+struct pofdp_fanout {
+    uint16_t index;
+    uint16_t num;
+};
+
+/* One output packet given to a port backend. */
+struct pofdp_tx_desc {
+    const uint8_t *meta;        /* The output metadata, sent in front of */
+    const uint8_t *packet;      /* the packet. */
+    uint16_t metaLen;
+    uint16_t len;
+};
+
+/* The I/O of a port. The raw socket ports keep the fast paths of the
+ * datapath (RX ring, TX batch and workers), while the ports of the
+ * other backends are received and sent through these functions only.
+ * Defined in pof_backend.c. */
+struct pofdp_backend {
+    const char *name;
+    /* Set up the port, keeping the state in port->backendData. */
+    uint32_t (*open)(struct portInfo *port, const char *arg);
+    /* Receive num packets at most without blocking. Each buffer has
+     * POFDP_PACKET_RAW_MAX_LEN bytes. Return the number received. */
+    uint32_t (*rx_burst)(struct portInfo *port, uint8_t **bufs, uint32_t *lens, uint32_t num);
+    /* Send the packets. Return the number sent. */
+    uint32_t (*tx_burst)(struct portInfo *port, const struct pofdp_tx_desc *pkts, uint32_t num);
+    void (*close)(struct portInfo *port);
+};
+
+/* A port driven by a backend, set by the config. */
+struct pofdp_backend_assign {
+    char port[PORT_NAME_LEN];
+    const struct pofdp_backend *backend;
+    char arg[POFDP_BACKEND_ARG_LEN];
+};
+
 /* Define datapath struction. */
 struct pof_datapath{
     /* NONE promisc packet filter function. */
@@ -207,9 +379,77 @@ struct pof_datapath{
     uint16_t listenPort;
 
 	uint32_t pktCount;
+
+    /* RX mode. */
+    uint8_t rxMode;             /* POFDP_RX_*. Default mode of all ports. */
+    uint32_t rxRingBlockSize;
+    uint32_t rxRingBlockNum;
+    char rxRingPorts[POFDP_RX_RING_PORT_MAX][PORT_NAME_LEN];
+                                /* Ports use RX ring whatever rxMode is. */
+    uint8_t rxRingPortNum;
+
+    /* TX. */
+    uint8_t txBatch;            /* Send the packets of one burst by one sendmmsg(). */
+    uint8_t txQdiscBypass;      /* Set PACKET_QDISC_BYPASS on the send socket. */
+
+    /* Worker pool. */
+    uint16_t workerNum;         /* 0: one receive task per port. */
+    uint8_t workerPriority;     /* SCHED_FIFO priority. 0: normal scheduling. */
+    uint16_t workerCpus[POFDP_WORKER_MAX];
+                                /* CPU of each worker. The workers not
+                                   listed run on the CPU of their index. */
+    uint16_t workerCpuNum;
+    struct pofdp_worker_assign workerPorts[POFDP_WORKER_PORT_MAX];
+                                /* The ports not listed go to the worker
+                                   polling the fewest ports. */
+    uint16_t workerPortNum;
+    struct pofdp_worker *workers;   /* Defined in pof_worker.c. */
+
+    /* Fanout. */
+    uint8_t fanoutMode;         /* POFDP_FANOUT_*. */
+    struct pofdp_fanout_assign fanoutPorts[POFDP_FANOUT_PORT_MAX];
+    uint16_t fanoutPortNum;
+
+    /* Port backends. */
+    struct pofdp_backend_assign backendPorts[POFDP_BACKEND_PORT_MAX];
+                                /* Created in the first slot besides the
+                                   system ports. */
+    uint16_t backendPortNum;
+
+    /* Flow cache. */
+    uint8_t flowCache;          /* Look up the MM and LPM tables through
+                                   the flow cache of each receive task. */
+
+    /* Interpreter. */
+    uint8_t threaded;           /* Execute the instructions and actions by
+                                   the threaded interpreter. */
+};
+
+/* Result of pofdp_ins_bench. The cycles are of the TSC, and 0 if
+ * there is no TSC. */
+struct pofdpInsBench {
+    uint32_t progNum;           /* Different programs run in turn. */
+    uint32_t mismatch;          /* Programs whose results differ between
+                                 * the interpreters. */
+    uint64_t switchNs, switchCycles;
+    uint64_t threadedNs, threadedCycles;
+};
+
+/* Output packets queued by one receive task. Defined in pof_ring.c. */
+struct pofdp_tx_batch;
+
+/* TPACKET_V3 RX ring of one port. */
+struct pofdp_rx_ring {
+    int sock;
+    uint8_t *map;               /* The whole ring mapped from the kernel. */
+    uint32_t mapLen;
+    uint32_t blockSize;
+    uint32_t blockNum;
+    uint32_t blockIndex;        /* The block to be read next. */
 };
 
 extern struct pof_datapath g_dp;
+extern const struct pofdp_backend pofdp_backend_raw;
 
 #define POFDP_ARG	struct pofdp_packet *dpp, struct pof_local_resource *lr
 
@@ -218,7 +458,57 @@ extern uint32_t pofdp_slot_init(struct pof_datapath *dp);
 extern struct pof_local_resource * \
            pofdp_get_local_resource(uint16_t slot, const struct pof_datapath *dp);
 extern uint32_t pofdp_create_port_listen_task(struct portInfo *);
+extern uint32_t pofdp_delete_port_listen_task(struct portInfo *);
+extern uint8_t pofdp_rx_ring_enabled(const struct portInfo *port_ptr, const struct pof_datapath *dp);
+extern void pofdp_recv_ring_block(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                                  struct pofdp_rx_ring *ring, struct tpacket_block_desc *block,   \
+                                  struct portInfo *port_ptr, const struct pofdp_fanout *fanout);
+extern uint32_t pofdp_recv_socket_burst(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                                        int sock, struct portInfo *port_ptr,                            \
+                                        const struct pofdp_fanout *fanout);
+extern uint32_t pofdp_worker_pool_create(struct pof_datapath *dp);
+extern void pofdp_worker_pool_destroy(struct pof_datapath *dp);
+extern uint32_t pofdp_worker_port_add(struct portInfo *port, struct pof_datapath *dp);
+extern uint32_t pofdp_worker_port_del(struct portInfo *port);
+extern uint32_t pofdp_toeplitz_hash(const uint8_t *data, uint32_t len);
+extern uint32_t pofdp_flow_hash(const uint8_t *packet, uint32_t len);
+extern uint16_t pofdp_fanout_num(const struct portInfo *port, const struct pof_datapath *dp);
+extern uint32_t pofdp_fanout_join(int sock, const struct portInfo *port, const struct pof_datapath *dp, \
+                                  uint16_t num);
+extern const struct pofdp_backend *pofdp_backend_find(const char *name);
+extern uint32_t pofdp_backend_open(struct portInfo *port, const struct pofdp_backend *backend, \
+                                   const char *arg);
+extern void pofdp_backend_close(struct portInfo *port);
+extern void pofdp_backend_close_all(struct pof_datapath *dp);
+extern uint32_t pofdp_recv_backend_burst(struct pofdp_packet_pool *pool, struct pof_local_resource *lr, \
+                                         struct portInfo *port_ptr);
+extern void pofdp_packet_init(struct pofdp_packet *dpp, struct pofdp_mbuf *mbuf, \
+                              struct pof_datapath *dp);
+extern struct pofdp_packet_pool *pofdp_packet_pool_create(uint32_t num, struct pof_datapath *dp);
+extern void pofdp_packet_pool_destroy(struct pofdp_packet_pool *pool);
+extern struct pofdp_packet *pofdp_packet_alloc(struct pofdp_packet_pool *pool);
+extern void pofdp_packet_free(struct pofdp_packet_pool *pool, struct pofdp_packet *dpp);
+extern uint32_t pofdp_counter_increace(POFDP_ARG, uint32_t counter_id, uint32_t byte_len);
+extern void pofdp_counter_batch_flush(struct pofdp_counter_batch *batch);
+extern uint32_t pofdp_forward_burst(struct pofdp_packet **dpps, uint32_t num,  \
+                                    struct pof_local_resource *lr);
+extern uint32_t pofdp_packet_copy_from_ring(struct pofdp_packet *dpp);
+extern uint32_t pofdp_rx_ring_open(struct pofdp_rx_ring *ring,            \
+                                   const struct portInfo *port,           \
+                                   const struct pof_datapath *dp);
+extern void pofdp_rx_ring_close(struct pofdp_rx_ring *ring);
+extern struct tpacket_block_desc *pofdp_rx_ring_next_block(struct pofdp_rx_ring *ring, int timeout);
+extern int pofdp_recv_socket_open(const struct portInfo *port, int nonblock);
+extern void pofdp_rx_ring_release_block(struct pofdp_rx_ring *ring, struct tpacket_block_desc *block);
+extern struct pofdp_tx_batch *pofdp_tx_batch_create(int sock);
+extern void pofdp_tx_batch_destroy(struct pofdp_tx_batch *batch);
+extern uint8_t *pofdp_tx_batch_slot(struct pofdp_tx_batch *batch);
+extern uint32_t pofdp_tx_batch_add(struct pofdp_tx_batch *batch, uint32_t sysIndex, uint16_t metaLen, \
+                                   const uint8_t *packet, uint16_t len);
+extern uint32_t pofdp_tx_batch_flush(struct pofdp_tx_batch *batch);
+extern uint32_t pofdp_send_socket_init(int sock, const struct pof_datapath *dp);
 extern uint32_t pofdp_send_raw(struct pofdp_packet *dpp, const struct pof_local_resource *lr);
+extern uint32_t pofdp_send_raw_flood(struct pofdp_packet *dpp, const struct pof_local_resource *lr);
 extern uint32_t pofdp_send_packet_in_to_controller(uint16_t len,        \
                                                    uint8_t reason,      \
                                                    uint8_t table_id,    \
@@ -227,7 +517,11 @@ extern uint32_t pofdp_send_packet_in_to_controller(uint16_t len,        \
                                                    uint16_t slotID,     \
                                                    uint8_t *packet);
 extern uint32_t pofdp_instruction_execute(POFDP_ARG);
+extern uint32_t pofdp_instruction_execute_burst(struct pofdp_packet **dpps, uint32_t num, \
+                                                struct pof_local_resource *lr);
 extern uint32_t pofdp_action_execute(POFDP_ARG);
+extern uint32_t pofdp_ins_bench(uint32_t packet_num, struct pof_local_resource *lr, \
+                                struct pofdpInsBench *result);
 
 extern uint32_t pofdp_write_32value_to_field(uint32_t value, const struct pof_match *pm, \
 											 struct pofdp_packet *dpp);
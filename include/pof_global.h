@@ -1664,6 +1664,9 @@ typedef enum pof_soft_error{
     POF_TIMER_CREATE_FAIL = 0X700E,
     POF_TIMER_DELETE_FAIL = 0X700F,
     POF_PTR_NULL =0X7010,
+    POF_SET_SOCKET_OPTION_FAILURE = 0X7011,
+    POF_MMAP_RING_FAILURE = 0X7012,
+    POF_OPEN_FILE_FAILURE = 0X7013,
 
     POF_IPC_SEND_FAILURE = 0X8001,
     POF_ERROR = 0xffff
@@ -1751,6 +1754,16 @@ typedef void (*POF_TASK_FUNC)(void *arg_ptr);
 /* Timer routine. */
 typedef void (*POF_TIMER_FUNC)(uint32_t timerid, int arg);
 
+/* Result of pofbf_bit_bench. The times are of the byte loops (Ref) and
+ * of the word kernels. */
+struct pofBitBench {
+    uint64_t checked;       /* Pieces compared with the byte loops. */
+    uint32_t mismatch;      /* Pieces whose result differs. */
+    uint64_t copyRefNs, copyNs;
+    uint64_t coverRefNs, coverNs;
+    uint64_t extractRefNs, extractNs;
+};
+
 /* Basic function interface. */
 extern uint32_t pofbf_task_create(void *arg, POF_TASK_FUNC task_func, task_t *task_id_ptr0);
 extern uint32_t pofbf_task_delay(uint32_t delay);
@@ -1766,6 +1779,9 @@ extern uint32_t pofbf_timer_create(uint32_t delay, \
 extern uint32_t pofbf_timer_delete(uint32_t *task_id_ptr);
 extern void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, uint16_t len_b);
 extern void pofbf_copy_bit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b);
+extern uint64_t pofbf_extract_bits(const uint8_t *data, uint16_t offset_b, uint16_t len_b);
+extern void pofbf_insert_bits(uint8_t *data, uint64_t value, uint16_t offset_b, uint16_t len_b);
+extern uint32_t pofbf_bit_bench(uint16_t len_b, uint32_t rounds, struct pofBitBench *result);
 extern void pofbf_split_str(char *strSrc, const char *split, char *strDst[], uint32_t count);
 extern uint32_t pofsc_send_packet_upward(uint8_t *packet, uint32_t len);
 extern void terminate_handler();
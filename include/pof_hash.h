@@ -0,0 +1,61 @@
+
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _POF_HASH_H_
+#define _POF_HASH_H_
+
+#include <stddef.h>
+#include "pof_type.h"
+
+/* Hash functions which can be chosen for a map. */
+enum pof_hash_func {
+    POF_HASH_FOLD = 0,      /* XOR fold of hashed 32-bit words. The old hmap_hashForBytes. */
+    POF_HASH_BYTES = 1,     /* pof_hash_bytes. */
+    POF_HASH_CRC32C = 2,    /* pof_hash_crc32c. */
+
+    POF_HASH_FUNC_NUM
+};
+
+/* Result of one hash function in pof_hash_bench. */
+struct pofHashBench {
+    uint64_t ns;            /* Time used by all rounds. */
+    uint32_t collisions;    /* Keys whose 32-bit hash equals the one of an earlier key. */
+    uint32_t chainMax;      /* Longest chain in num buckets rounded up to 2^x. */
+    double chainAvg;        /* Average nodes compared to find a key. */
+};
+
+extern const char *pof_hash_func_str[POF_HASH_FUNC_NUM];
+
+uint64_t pof_hash_bytes(const void *data, size_t n, uint64_t seed);
+uint32_t pof_hash_crc32c(const void *data, size_t n, uint32_t seed);
+uint32_t pof_hash_uint32(uint32_t value);
+uint64_t pof_hash_uint64(uint64_t value);
+uint32_t pof_hash(uint8_t func, const void *data, size_t n, uint32_t seed);
+bool pof_hash_crc32c_hw(void);
+uint32_t pof_hash_bench(const uint8_t *keys, uint32_t num, uint32_t keyBytes, \
+                        uint32_t rounds, struct pofHashBench *result);
+
+#endif // _POF_HASH_H_
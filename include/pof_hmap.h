@@ -36,10 +36,28 @@ struct hnode {
     struct hnode *next;
 };
 
+/* The map grows and shrinks by itself. While rehashing, the nodes of
+ * oldBuckets[rehashPos..oldMask] have not been moved to buckets yet.
+ * A fixed map is never rehashed, so the datapath can look it up without
+ * a lock while one writer inserts and deletes the nodes. Any map read by
+ * the datapath should be fixed, as a rehash relinks the nodes in place. */
 struct hmap {
     struct hnode **buckets;
     hash_t mask;
     hash_t n;
+    bool fixed;
+    struct hnode **oldBuckets;  /* NULL if not rehashing. */
+    hash_t oldMask;
+    hash_t rehashPos;
+};
+
+struct hmapStats {
+    hash_t nodes;
+    hash_t buckets;
+    hash_t deepMax;
+    double deepAvg;
+    double load;        /* Nodes per bucket. */
+    bool rehashing;
 };
 
 #define HMAP_STRUCT_GET(obj, node, hash, map, ptr)              \
@@ -49,14 +67,17 @@ struct hmap {
 #define HMAP_BUCKETS_COUNT(map) (map->mask + 1)
 #define HMAP_NODES_COUNT(map) (map->n)
 
+/* The end test is done on the integer address, since the compiler may
+ * assume that &((obj)->node) is never NULL and drop the check. */
 #define HMAP_NODES_IN_STRUCT_TRAVERSE(obj, next, node, map)                     \
             for( obj = POF_STRUCT_FROM_MEMBER(obj, node, hmap_nodeFirst(map));  \
-                 &((obj)->node) &&                                              \
+                 ((uintptr_t)(obj) + offsetof(typeof(*obj), node)) &&           \
                  (next = POF_STRUCT_FROM_MEMBER(next, node,                     \
                      hmap_nodeNext(map, &((obj)->node)) ), 1);                  \
                  obj = next)
 
 struct hmap * hmap_create(hash_t size);
+struct hmap * hmap_createFixed(hash_t size);
 struct hmap * hmap_destroy(struct hmap *hmap);
 void hmap_clear(struct hmap *);
 bool hmap_empty(const struct hmap *);
@@ -72,6 +93,7 @@ void hmap_nodeInsert(struct hmap *, struct hnode *);
 void hmap_nodeDelete(struct hmap *, struct hnode *);
 bool hmap_nodeContain(const struct hmap *, const struct hnode *);
 uint32_t hmap_nodeTrav(const struct hmap *, uint32_t func(void *), void *);
+void hmap_stats(const struct hmap *, struct hmapStats *);
 
 hash_t hmap_hashForLinear(uint32_t);
 hash_t hmap_hashForUint32(uint32_t);
@@ -45,12 +45,52 @@
 #define POFLR_COUNTER_NUMBER (512)
 #define POFLR_GROUP_NUMBER (128)
 
+/* Shards of one counter. Each datapath task increases its own shard. */
+#define POFLR_COUNTER_SHARD_NUM (16)
+
 /* Max number of local physical port. */
 #define POFLR_DEVICE_PORT_NUM_MAX (100)
 
 /* Max key length. */
 #define POFLR_KEY_LEN (160)
 
+/* Max bucket number of one tuple space search subtable. */
+#define POFLR_TSS_SUBTABLE_SIZE (1024)
+
+/* Decision tree of MM table. */
+#define POFLR_DTREE_LEAF_SIZE           (8)     /* Max rules in a leaf. */
+#define POFLR_DTREE_DEPTH_MAX           (32)
+#define POFLR_DTREE_NODE_MAX            (16384)
+#define POFLR_DTREE_SPLIT_MUL           (3)     /* Children hold 3/2 rules */
+#define POFLR_DTREE_SPLIT_DIV           (2)     /* of the parent at most. */
+#define POFLR_DTREE_REBUILD_DELAY_US    (1000)  /* Gather the flow modifications. */
+
+/* Row alignment of the compact layout of MM table. */
+#define POFLR_SOA_ALIGN                 (16)
+
+/* Keys looked up together by the cuckoo hash of EM table. */
+#define POFLR_CUCKOO_BURST              (32)
+
+/* The lookup key is extracted to the stack, so it has a fixed max size. */
+#define POFLR_KEY_BYTES_MAX             (POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM)
+
+/* Flow cache of each receive task. The microflow tier is direct mapped,
+ * and the megaflow tier is 2-way set associative. The tables with wider
+ * keys are not cached. */
+#define POFLR_FLOW_CACHE_MICRO          (1024)
+#define POFLR_FLOW_CACHE_MEGA           (2048)
+#define POFLR_FLOW_CACHE_KEY_BYTES      (64)
+
+/* The LPM tables with wider keys use the Patricia trie instead of the
+ * stride engine. */
+#define POFLR_STRIDE_KEY_LEN_MAX        (64)
+
+/* Max table id of each type. */
+#define POFLR_TABLE_ID_MAX      (0xFF)
+
+/* Apply the MM engine to all the MM tables. */
+#define POFLR_MM_ENGINE_ALL     (0xFFFF)
+
 /* Max instruction block number. */
 #define POFLR_INS_BLOCK_NUM     (64)
 
@@ -62,6 +102,64 @@
 #define PORT_NAME_LEN   POF_NAME_MAX_LENGTH
 #define TABLE_NAME_LEN  POF_NAME_MAX_LENGTH
 
+/* Op index out of the program, for the bad jumps. */
+#define POFLR_INS_OP_BAD        (0xFFFF)
+
+struct tableInfo;
+struct meterInfo;
+
+/* Dense codes of the instructions, which index the handler table of the
+ * threaded interpreter. */
+enum poflr_ins_code {
+#define INSTRUCTION(NAME,VALUE) POFLR_IC_##NAME,
+    INSTRUCTIONS
+#undef INSTRUCTION
+    POFLR_IC_BAD,               /* Unknown instruction type. */
+};
+
+/* Dense codes of the actions. The superinstructions run several actions
+ * in a row, and are put at the first of them. */
+enum poflr_act_code {
+#define ACTION(NAME,VALUE) POFLR_AC_##NAME,
+    ACTIONS
+#undef ACTION
+    POFLR_AC_SET_FIELD_CHECKSUM_OUTPUT, /* SET_FIELD, CALCULATE_CHECKSUM,
+                                         * OUTPUT. */
+    POFLR_AC_SET_FIELD_CHECKSUM,        /* SET_FIELD, CALCULATE_CHECKSUM. */
+    POFLR_AC_SET_FIELD_OUTPUT,          /* SET_FIELD, OUTPUT. */
+    POFLR_AC_BAD,                       /* Unknown action type. */
+};
+
+/* One instruction decoded when it is installed. The immediate IDs are
+ * resolved to pointers, which are valid only while the generation of
+ * the program is lr->insGen. */
+struct insOp{
+    struct pof_instruction *ins;    /* The raw instruction. NULL for the
+                                     * first GOTO_TABLE of the datapath. */
+    struct tableInfo *table;        /* GOTO_TABLE, GOTO_DIRECT_TABLE. */
+    struct meterInfo *meter;        /* METER with the immediate ID. */
+    uint32_t meterID;
+    uint16_t type;                  /* POFIT_*. */
+    uint16_t next;                  /* Op to go on with. opNum means done. */
+    uint16_t jump;                  /* Op jumped to by BRANCH or JMP, or
+                                     * POFLR_INS_OP_BAD. */
+    int16_t packetOffset;           /* GOTO_TABLE, GOTO_DIRECT_TABLE. */
+    uint8_t tableID;                /* Global table ID. */
+    uint8_t tableType;              /* POF_MAX_TABLE_TYPE if tableID is bad. */
+    uint8_t tableId;                /* Table id of the type. */
+    uint8_t meterImm;               /* The meter ID is immediate. */
+    uint8_t code;                   /* POFLR_IC_*. */
+    uint8_t actCode[POF_MAX_ACTION_NUMBER_PER_INSTRUCTION];
+                                    /* POFLR_AC_* of APPLY_ACTIONS. */
+};
+
+/* The instructions of one flow entry or instruction block. */
+struct insProgram{
+    uint32_t gen;                   /* lr->insGen when resolved. */
+    uint16_t opNum;
+    struct insOp *ops;
+};
+
 #ifdef POF_SHT_VXLAN
 struct insBlockInfo{
     uint16_t blockID;
@@ -70,6 +168,7 @@ struct insBlockInfo{
     uint8_t insNum;
     uint8_t tableID;
     struct pof_local_resource *lr;
+    struct insProgram prog;         /* Decoded insData. */
     struct pof_instruction insData[0];
 };
 #endif 
@@ -77,12 +176,22 @@ struct insBlockInfo{
 struct entryInfo{
     uint32_t  index;
     struct hnode node;
+    struct hnode tssNode;   /* Only for MM table with POFLR_MM_TSS engine. */
+    struct listNode dtNode; /* Only for MM table with POFLR_MM_DTREE engine. */
+    uint32_t dtInsGen;
+    uint32_t dtDelGen;      /* Zero if the entry is live. */
+    uint32_t lpmRule;       /* Only for LPM table with POFLR_LPM_STRIDE engine. */
+    struct entryInfo *lpmNext;  /* Only for LPM table with POFLR_LPM_PATRICIA engine. */
     uint32_t counter_id;
 #ifdef POF_SHT_VXLAN
     uint16_t insBlockID;
+    struct insBlockInfo *insBlock;  /* Valid while insGen is lr->insGen. */
+    uint32_t insGen;
 #else // POF_SHT_VXLAN
     uint8_t instruction_num;
     pof_instruction instruction[POF_MAX_INSTRUCTION_NUM]; /*The instructions*/
+    struct insProgram prog;         /* Decoded instruction. */
+    struct insOp ops[POF_MAX_INSTRUCTION_NUM];
 #endif // POF_SHT_VXLAN
 
     uint16_t priority;
@@ -98,23 +207,97 @@ struct entryInfo{
 #endif // POF_SHT_VXLAN
 };
 
+/* The engine to lookup the MM table. */
+enum poflr_mm_engine {
+    POFLR_MM_LINEAR     = 0,    /* Traverse all entries. */
+    POFLR_MM_TSS        = 1,    /* Tuple space search. */
+    POFLR_MM_DTREE      = 2,    /* Decision tree rebuilt in background. */
+    POFLR_MM_SOA        = 3,    /* Vectorized scan of the compact layout. */
+    POFLR_MM_ENGINE_NUM,
+};
+
+/* Tuple space search subtable. All the entries in it have the same mask,
+ * and are hashed by the masked value. */
+struct tssSubtable{
+    uint8_t mask[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint16_t maxPriority;
+    uint32_t entryNum;
+    struct hmap *entryMap;      /* Hash map with entryInfo.tssNode. */
+};
+
+/* The subtables in descending maxPriority order, with the maxPriority of
+ * each when the order was built. It is never changed after published, so
+ * the lookups walk it without a lock. */
+struct tssOrder{
+    uint32_t num;
+    struct {
+        uint16_t maxPriority;
+        struct tssSubtable *sub;
+    } subs[0];
+};
+
+/* The engine to lookup the LPM table. */
+enum poflr_lpm_engine {
+    POFLR_LPM_TREE      = 0,    /* Binary tree. */
+    POFLR_LPM_STRIDE    = 1,    /* Multibit trie, DIR-24-8 or 16-8-8-... */
+    POFLR_LPM_PATRICIA  = 2,    /* Path-compressed trie for the wide keys. */
+    POFLR_LPM_ENGINE_NUM,
+};
+
+/* The engine to lookup the EM table. */
+enum poflr_em_engine {
+    POFLR_EM_HMAP       = 0,    /* Hash map of the entries. */
+    POFLR_EM_CUCKOO     = 1,    /* Bucketized cuckoo hash. */
+    POFLR_EM_ENGINE_NUM,
+};
+
+struct mmDtree;
+struct mmSoa;
+struct lpmStride;
+struct lpmPatricia;
+struct emCuckoo;
+struct keyPlan;
+struct flowCache;
+
 struct tableInfo{
     uint8_t id;         /* Global value. */
     struct hnode idNode;
     uint8_t type;
+    struct pof_local_resource *lr;
 //    struct hnode typeNode;
     char name[TABLE_NAME_LEN];
 
     struct hmap *entryMap;
+    struct entryInfo **entries;         /* Entry of each index. size slots. */
     uint32_t entryNum;
     uint32_t size;
     uint16_t keyLen;
 
     /* Only For LPM. */
+    uint8_t lpmEngine;                  /* POFLR_LPM_*. */
     struct tree *tree;
+    struct lpmStride *stride;
+    struct lpmPatricia *patricia;
+
+    /* Only For EM. */
+    uint8_t emEngine;                   /* POFLR_EM_*. */
+    struct emCuckoo *cuckoo;
+
+    /* Only For MM. */
+    uint8_t mmEngine;                   /* POFLR_MM_*. */
+    struct tssOrder *tss;               /* Replaced by each change. */
+    struct mmDtree *dtree;
+    struct mmSoa *soa;
 
     uint8_t match_field_num;
     pof_match match[POF_MAX_MATCH_FIELD_NUM];
+    struct keyPlan *keyPlan;            /* Compiled from match. */
+
+    /* Flow cache. */
+    uint64_t gen;                       /* Renewed by each flow mod. */
+    uint8_t maskUnion[POFLR_KEY_BYTES_MAX];
+                                        /* OR of the masks of all the
+                                         * entries. Cleared when empty. */
 };
 
 struct groupInfo{
@@ -125,6 +308,7 @@ struct groupInfo{
 
     uint32_t counter_id;
     pof_action action[POF_MAX_ACTION_NUMBER_PER_GROUP];
+    uint8_t actCode[POF_MAX_ACTION_NUMBER_PER_GROUP];   /* POFLR_AC_*. */
 };
 
 struct meterInfo{
@@ -133,14 +317,30 @@ struct meterInfo{
     struct hnode idNode;
 };
 
-struct counterInfo{
-    uint32_t id;
-    struct hnode idNode;
+/* Packet and byte number of a counter. */
+struct counterValue{
     uint64_t value;
 #ifdef POF_SD2N
     uint64_t byte_value;
 #endif // POF_SD2N
 };
+
+/* The part of a counter increased by one datapath task, in its own
+ * cache line. */
+struct counterShard{
+    struct counterValue v;
+} POF_CACHE_ALIGNED;
+
+/* The counter value is the sum of the shards minus the base, which is
+ * the sum when the counter was cleared last time. The shards are only
+ * added to by the datapath, and the base is only written by the
+ * control task. Read it by poflr_counter_read(). */
+struct counterInfo{
+    uint32_t id;
+    struct hnode idNode;
+    struct counterValue base;
+    struct counterShard shards[POFLR_COUNTER_SHARD_NUM];
+} POF_CACHE_ALIGNED;
 //add by wenjian 2015/12/02
 enum portFlags {
     NETDEV_UP = 0x0001,         /* Device enabled? */
@@ -163,6 +363,14 @@ struct portInfo {
     uint16_t    slotID;
     uint8_t     of_enable;
     task_t      taskID;
+    struct pofdp_worker_port *workerPort;
+                                /* Receive state in the worker polling
+                                   the port. NULL if the port has its own
+                                   task. Defined in pof_worker.c. */
+    const struct pofdp_backend *backend;
+                                /* The I/O of the port. Defined in
+                                   pof_datapath.h. */
+    void *backendData;          /* The state of the backend. */
 
     //add by wenjian 2015/12/02
     int queue_fd[PORT_MAX_QUEUES+1];
@@ -175,6 +383,18 @@ enum portFlag {
     POFLRPF_FROM_CUSTOM = 1 << 0,
 };
 
+/* The ports which a flood output is replicated to. The set is rebuilt
+ * whenever a port is added, deleted or modified, so the datapath need
+ * not walk the port map for each flooded packet. */
+struct floodInfo {
+    uint16_t portNum;
+    struct floodPort {
+        uint8_t  pofIndex;
+        int      fd;            /* Socket sending through the port. */
+        uint32_t sysIndex;
+    } ports[];
+};
+
 struct pof_local_resource {
     uint16_t slotID;
     struct hnode slotNode;
@@ -185,9 +405,12 @@ struct pof_local_resource {
     uint16_t portNumMax;
     uint16_t portNum;
     uint32_t portFlag;   /* POFLRPF_*. */
+    struct floodInfo *flood;        /* Flood port set, NULL if none. */
 
     /* Table. */
     struct hmap *tableIdMap;        /* Hash map with tableInfo.idNode. */
+    struct tableInfo *tables[POFLR_TABLE_ID_MAX + 1];
+                                    /* Table of each global ID. */
 //    struct hmap *tableTypeMap;      /* Hash map with tableInfo.typeNode. */
     uint16_t tableNumMax;
     uint16_t tableNumMaxEachType[POF_MAX_TABLE_TYPE];
@@ -209,6 +432,7 @@ struct pof_local_resource {
 
     /* Counter. */
     struct hmap *counterMap;        /* Hash map with counterInfo.idNode. */
+    struct counterInfo **counters;  /* Counter of each ID. counterNumMax slots. */
     uint32_t counterNumMax;
     uint32_t counterNum;
 //    uint32_t counterFlag;
@@ -219,6 +443,13 @@ struct pof_local_resource {
     uint32_t insBlockNumMax;
     uint32_t insBlockNum;
 #endif // POF_SHT_VXLAN
+
+    /* Instruction program. */
+    uint32_t insGen;                /* Renewed when a table, meter or
+                                     * instruction block is added or
+                                     * deleted. */
+    struct insProgram firstProg;    /* Go to the first table. */
+    struct insOp firstOp;
 };
 
 /* Switch ID. */
@@ -247,6 +478,7 @@ extern uint32_t poflr_reset_dev_id();
 /* Port. */
 extern uint32_t poflr_init_port(struct pof_local_resource *);
 extern uint32_t poflr_port_detect_task();
+extern uint32_t poflr_flood_rebuild(struct pof_local_resource *);
 extern uint32_t poflr_port_report(uint8_t reason, const struct portInfo *port);
 extern uint32_t poflr_get_hwaddr_by_ipaddr(uint8_t *hwaddr, char *ipaddr_stri, struct pof_local_resource *);
 extern uint32_t poflr_port_openflow_enable(uint32_t port_id, uint8_t ulFlowEnableFlg, \
@@ -282,6 +514,11 @@ extern uint32_t poflr_table_id_to_ID(uint8_t type,                 \
                                      const struct pof_local_resource *);
 extern struct tableInfo *poflr_get_table_with_ID(uint8_t, const struct pof_local_resource *);
 extern uint32_t poflr_set_key_len(uint32_t key_len);
+extern uint32_t poflr_set_mm_engine(uint16_t id, uint8_t engine);
+extern uint32_t poflr_set_lpm_engine(uint8_t engine);
+extern uint32_t poflr_set_em_engine(uint8_t engine);
+extern uint32_t poflr_lpm_bench(uint32_t num, uint16_t key_len, uint32_t lookup_num, \
+                                uint64_t *ns, uint32_t *mismatch);
 
 extern uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_resource *);
 extern uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_resource *);
@@ -290,7 +527,74 @@ extern struct entryInfo *poflr_entry_get_with_index(uint32_t index, const struct
 extern struct entryInfo *poflr_entry_lookup_Linear(uint32_t index, const struct tableInfo *table);
 extern struct entryInfo *poflr_entry_lookup(const uint8_t *packet,          \
                                             const uint8_t *metadata,        \
-                                            const struct tableInfo *table);
+                                            const struct tableInfo *table,  \
+                                            struct flowCache *cache);
+extern struct entryInfo *poflr_entry_lookup_key(const uint8_t *key,         \
+                                                const struct tableInfo *table);
+extern uint32_t poflr_entry_lookup_burst(const uint8_t **packets,           \
+                                         const uint8_t **metadatas,         \
+                                         uint32_t num,                      \
+                                         const struct tableInfo *table,     \
+                                         struct flowCache *cache,           \
+                                         struct entryInfo **entries);
+
+/* Flow cache of the receive task. */
+extern struct flowCache *poflr_flow_cache_create();
+extern void poflr_flow_cache_destroy(struct flowCache *cache);
+extern struct entryInfo *poflr_flow_cache_lookup(struct flowCache *cache,    \
+                                                 const uint8_t *key,         \
+                                                 uint16_t key_bytes,         \
+                                                 const struct tableInfo *table);
+
+/* Decision tree of MM table. */
+extern uint32_t poflr_dtree_create(struct tableInfo *table);
+extern void poflr_dtree_destroy(struct tableInfo *table);
+extern uint32_t poflr_dtree_insert(struct entryInfo *entry, struct tableInfo *table);
+extern void poflr_dtree_delete(struct entryInfo *entry, struct tableInfo *table);
+extern struct entryInfo *poflr_dtree_lookup(const uint8_t *key, const struct tableInfo *table);
+
+/* Compact layout of MM table. */
+extern uint32_t poflr_soa_create(struct tableInfo *table);
+extern void poflr_soa_destroy(struct tableInfo *table);
+extern uint32_t poflr_soa_insert(struct entryInfo *entry, struct entryInfo *old, struct tableInfo *table);
+extern void poflr_soa_delete(struct entryInfo *entry, struct tableInfo *table);
+extern struct entryInfo *poflr_soa_lookup(const uint8_t *key, const struct tableInfo *table);
+
+/* Multibit trie of LPM table. */
+extern uint32_t poflr_stride_create(struct tableInfo *table);
+extern void poflr_stride_destroy(struct tableInfo *table);
+extern uint32_t poflr_stride_insert(struct entryInfo *entry, uint32_t depth, struct tableInfo *table);
+extern uint32_t poflr_stride_delete(struct entryInfo *entry, uint32_t depth, struct tableInfo *table);
+extern struct entryInfo *poflr_stride_lookup(const uint8_t *key, const struct tableInfo *table);
+
+/* Patricia trie of LPM table. */
+extern uint32_t poflr_patricia_create(struct tableInfo *table);
+extern void poflr_patricia_destroy(struct tableInfo *table);
+extern uint32_t poflr_patricia_insert(struct entryInfo *entry, uint32_t depth, struct tableInfo *table);
+extern uint32_t poflr_patricia_delete(struct entryInfo *entry, uint32_t depth, struct tableInfo *table);
+extern struct entryInfo *poflr_patricia_lookup(const uint8_t *key, const struct tableInfo *table);
+
+/* Cuckoo hash of EM table. */
+extern uint32_t poflr_cuckoo_create(struct tableInfo *table);
+extern void poflr_cuckoo_destroy(struct tableInfo *table);
+extern uint32_t poflr_cuckoo_insert(struct entryInfo *entry, struct tableInfo *table);
+extern void poflr_cuckoo_delete(struct entryInfo *entry, struct tableInfo *table);
+extern struct entryInfo *poflr_cuckoo_lookup(const uint8_t *key, const struct tableInfo *table);
+extern struct entryInfo *poflr_cuckoo_lookup_hash(const uint8_t *key, uint64_t hash,  \
+                                                  const struct tableInfo *table);
+extern void poflr_cuckoo_lookup_burst(const uint8_t *keys, const uint64_t *hashes,  \
+                                      uint32_t num, const struct tableInfo *table,  \
+                                      struct entryInfo **entries);
+
+/* Instruction program. */
+extern uint32_t poflr_init_ins_program(struct pof_local_resource *lr);
+extern void poflr_ins_program_compile(struct insProgram *prog, struct insOp *ops, \
+                                      struct pof_instruction *ins, uint8_t insNum, \
+                                      const struct pof_local_resource *lr);
+extern void poflr_ins_program_entry(struct entryInfo *entry, const struct pof_local_resource *lr);
+extern void poflr_ins_program_renew(struct pof_local_resource *lr);
+extern void poflr_act_code_compile(uint8_t *codes, const struct pof_action *act, \
+                                   uint8_t actNum);
 
 /* Meter. */
 extern uint32_t poflr_add_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_resource *);
@@ -315,11 +619,11 @@ extern uint32_t poflr_counter_init(uint32_t counter_id, struct pof_local_resourc
 extern uint32_t poflr_counter_delete(uint32_t counter_id, struct pof_local_resource *);
 extern uint32_t poflr_counter_clear(uint32_t counter_id, struct pof_local_resource *);
 extern uint32_t poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *);
-#ifdef POF_SD2N
-extern uint32_t poflr_counter_increace(uint32_t counter_id, uint16_t byte_len, struct pof_local_resource *);
-#else // POF_SD2N
-extern uint32_t poflr_counter_increace(uint32_t counter_id, struct pof_local_resource *);
-#endif // POF_SD2N
+extern uint32_t poflr_counter_lookup(uint32_t counter_id, struct counterInfo **counter, \
+                                     const struct pof_local_resource *lr);
+extern void poflr_counter_add(struct counterInfo *counter, uint32_t shard, \
+                              uint32_t packets, uint64_t bytes);
+extern void poflr_counter_read(const struct counterInfo *counter, struct counterValue *value);
 extern uint32_t poflr_init_counter(struct pof_local_resource *);
 extern uint32_t poflr_empty_counter(struct pof_local_resource *);
 extern struct counterInfo *poflr_get_counter_with_ID(uint32_t id, \
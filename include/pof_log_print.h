@@ -88,6 +88,7 @@ extern void cmdPrintSwitchConfig(const struct pof_switch_config *pofsc_ptr);
 extern void cmdPrintPort(const struct portInfo *p);
 extern void cmdPrintMeter(const struct meterInfo *meter);
 extern void cmdPrintGroup(const struct groupInfo *group);
+extern void cmdPrintHmapStats(const char *name, const struct hmapStats *stats);
 extern void cmdPrintFlowTableBaseinfo(const struct tableInfo *table);
 extern void cmdPrintFlowEntryBaseinfo(const struct entryInfo *entry);
 extern void cmdPrintFeature(const struct pof_switch_features *p);
@@ -0,0 +1,88 @@
+
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _POF_RCU_H_
+#define _POF_RCU_H_
+
+#include "pof_type.h"
+#include "pof_global.h"
+
+/* Poll the readers not passed the grace period yet. */
+#define RCU_SYNC_US         (100)
+
+/* Callbacks waiting for their grace period at most. Beyond it, the
+ * writer synchronizes once to run them all. */
+#define RCU_PENDING_MAX     (4096)
+
+/* Quiescent state based reclamation. Each task reading the objects
+ * published to the datapath registers a reader, and reports a quiescent
+ * state whenever it holds no reference to them, such as between two
+ * receive bursts. While it is blocked, it is offline and is not waited
+ * for. The writer unlinks an object first, and frees it only after every
+ * online reader has been quiescent since then, so the readers take no
+ * lock and never see a freed object. */
+struct rcuReader {
+    uint64_t epoch;             /* rcu_epoch seen by the last quiescent
+                                 * state, or 0 while offline. */
+    struct rcuReader *next;     /* In the registered readers. */
+};
+
+/* Readers. */
+void rcu_register(struct rcuReader *reader);
+void rcu_unregister(struct rcuReader *reader);
+void rcu_quiescent(struct rcuReader *reader);
+void rcu_offline(struct rcuReader *reader);
+void rcu_online(struct rcuReader *reader);
+
+/* Writers. */
+uint64_t rcu_retire(void);
+bool rcu_passed(uint64_t epoch);
+void rcu_synchronize(void);
+void rcu_call(void (*func)(void *), void *arg);
+void rcu_free(void *ptr);
+void rcu_reclaim(void);
+
+/* Pool of the indexes which the readers follow into an array, such as the
+ * records of the cuckoo hash. A released index is retired first, and is
+ * only given again after a grace period, so a reader never sees its slot
+ * reused under it. The free indexes are at the front of the array, and
+ * the retired ones at the back. */
+struct rcuPool {
+    uint32_t *indexes;
+    uint32_t max;
+    uint32_t freeNum;
+    uint32_t retiredNum;
+    uint64_t epoch;             /* rcu_retire() of the last retired one. */
+};
+
+uint32_t rcu_poolInit(struct rcuPool *pool, uint32_t max);
+void rcu_poolDestroy(struct rcuPool *pool);
+void rcu_poolPut(struct rcuPool *pool, uint32_t index);
+void rcu_poolRetire(struct rcuPool *pool, uint32_t index);
+bool rcu_poolGet(struct rcuPool *pool, uint32_t *index);
+uint32_t rcu_poolAvailable(const struct rcuPool *pool);
+
+#endif // _POF_RCU_H_
@@ -46,7 +46,7 @@ uint32_t tree_clear(struct tree *tree);
 struct treeNode * tree_nodeCreate();
 void tree_nodeDestroy(struct treeNode **);
 uint32_t tree_nodeInsert(struct tree *, const void *ptr, uint8_t *value, uint32_t bitNum);
-uint32_t tree_nodeDelete(struct tree *, uint8_t *value, uint32_t bitNum);
+uint32_t tree_nodeDelete(struct tree *, const void *ptr, uint8_t *value, uint32_t bitNum);
 void * tree_nodeLookup(const struct tree *, uint8_t *value, uint32_t bitNum);
 uint32_t tree_nodeTrav(const struct tree *, uint32_t func(void *), void *);
 
@@ -4,5 +4,12 @@ pofswitch_SOURCES += $(LOCAL_RESOURCE_FOLDER)/pof_counter.c \
 					 $(LOCAL_RESOURCE_FOLDER)/pof_group.c \
 					 $(LOCAL_RESOURCE_FOLDER)/pof_local_resource.c \
 					 $(LOCAL_RESOURCE_FOLDER)/pof_meter.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_mm_dtree.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_mm_soa.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_em_cuckoo.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_flow_cache.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_lpm_patricia.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_lpm_stride.c \
 					 $(LOCAL_RESOURCE_FOLDER)/pof_ins_block.c \
+					 $(LOCAL_RESOURCE_FOLDER)/pof_ins_program.c \
 					 $(LOCAL_RESOURCE_FOLDER)/pof_port.c
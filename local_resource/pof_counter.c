@@ -31,6 +31,7 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -39,34 +40,57 @@
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
 
-/* Malloc memory for counter information. Should be free by map_counterDelete(). */
+/* Malloc memory for counter information. Should be free by map_counterDelete().
+ * Cache aligned, so no two shards share a cache line. */
 static struct counterInfo *
 map_counterCreate()
 {
     struct counterInfo *counter;
-    POF_MALLOC_SAFE_RETURN(counter, 1, NULL);
+    if(posix_memalign((void **)&counter, POF_CACHE_LINE_SIZE, sizeof *counter) != 0){
+        return NULL;
+    }
+    memset(counter, 0, sizeof *counter);
     return counter;
 }
 
+/* The counter is freed after the datapath tasks which may still count in
+ * it. */
 static void
 map_counterDelete(struct counterInfo *counter, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->counterMap, &counter->idNode);
+    __atomic_store_n(&lr->counters[counter->id], NULL, __ATOMIC_RELEASE);
     lr->counterNum --;
-    FREE(counter);
+    rcu_free(counter);
 }
 
 static void
 map_counterInsert(struct counterInfo *counter, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->counterMap, &counter->idNode);
+    __atomic_store_n(&lr->counters[counter->id], counter, __ATOMIC_RELEASE);
     lr->counterNum ++;
 }
 
 static hash_t
 map_counterHashByID(uint32_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
+}
+
+/* Sum up the shards. The datapath may be adding to them meanwhile. */
+static void
+counterSum(const struct counterInfo *counter, struct counterValue *sum)
+{
+    uint32_t i;
+
+    memset(sum, 0, sizeof *sum);
+    for(i=0; i<POFLR_COUNTER_SHARD_NUM; i++){
+        sum->value += __atomic_load_n(&counter->shards[i].v.value, __ATOMIC_RELAXED);
+#ifdef POF_SD2N
+        sum->byte_value += __atomic_load_n(&counter->shards[i].v.byte_value, __ATOMIC_RELAXED);
+#endif // POF_SD2N
+    }
 }
 
 /***********************************************************************
@@ -145,7 +169,9 @@ poflr_counter_delete(uint32_t counter_id, struct pof_local_resource *lr)
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will make the counter value corresponding to
- *           counter_id to be zero.
+ *           counter_id to be zero. The shards are not touched, as the
+ *           datapath adds to them without a lock. The current sum of
+ *           them becomes the base instead.
  ***********************************************************************/
 uint32_t 
 poflr_counter_clear(uint32_t counter_id, struct pof_local_resource *lr)
@@ -164,10 +190,7 @@ poflr_counter_clear(uint32_t counter_id, struct pof_local_resource *lr)
     }
 
     /* Initialize the counter value. */
-    counter->value = 0;
-#ifdef POF_SD2N
-    counter->byte_value = 0;
-#endif // POF_SD2N
+    counterSum(counter, &counter->base);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Clear counter[%u] value SUC!", counter_id);
     return POF_OK;
@@ -188,6 +211,7 @@ uint32_t
 poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr)
 {
     struct counterInfo *counter;
+    struct counterValue value;
     pof_counter pofCounter = {0};
 
     /* Check counter_id. */
@@ -205,9 +229,10 @@ poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr)
     pofCounter.command = POFCC_QUERY;
 #endif // POF_MULTIPLE_SLOTS
     pofCounter.counter_id = counter_id;
-    pofCounter.value = counter->value;
+    poflr_counter_read(counter, &value);
+    pofCounter.value = value.value;
 #ifdef POF_SD2N
-    pofCounter.byte_value = counter->byte_value;
+    pofCounter.byte_value = value.byte_value;
 #endif // POF_SD2N
     pof_NtoH_transfer_counter(&pofCounter);
 
@@ -221,10 +246,10 @@ poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr)
 #ifdef POF_SD2N
     POF_DEBUG_CPRINT_FL(1,GREEN,"Get counter value SUC! counter id = %u, counter value = %" \
             POF_PRINT_FORMAT_U64", byte_value = %"POF_PRINT_FORMAT_U64, \
-                        counter_id, counter->value, counter->byte_value);
+                        counter_id, value.value, value.byte_value);
 #else // POF_SD2N
     POF_DEBUG_CPRINT_FL(1,GREEN,"Get counter value SUC! counter id = %u, counter value = %"POF_PRINT_FORMAT_U64, \
-                        counter_id, counter->value);
+                        counter_id, value.value);
 #endif // POF_SD2N
     return POF_OK;
 }
@@ -234,6 +259,7 @@ poflr_reply_counter_all(const struct pof_local_resource *lr)
 {
     struct pof_counter pofCounter = {0};
     struct counterInfo *counter, *next;
+    struct counterValue value;
 
     HMAP_NODES_IN_STRUCT_TRAVERSE(counter, next, idNode, lr->counterMap){
         pofCounter.command = POFCC_QUERY_RESULT;
@@ -241,9 +267,10 @@ poflr_reply_counter_all(const struct pof_local_resource *lr)
         pofCounter.slotID = lr->slotID;
 #endif // POF_MULTIPLE_SLOTS
         pofCounter.counter_id = counter->id;
-        pofCounter.value = counter->value;
+        poflr_counter_read(counter, &value);
+        pofCounter.value = value.value;
 #ifdef POF_SD2N
-        pofCounter.byte_value = counter->byte_value;
+        pofCounter.byte_value = value.byte_value;
 #endif // POF_SD2N
         pof_NtoH_transfer_counter(&pofCounter);
 
@@ -251,63 +278,70 @@ poflr_reply_counter_all(const struct pof_local_resource *lr)
             POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid);
         }
     }
+    return POF_OK;
 }
 
 /***********************************************************************
- * Increace the counter
- * Form:     uint32_t poflr_counter_increace(uint32_t counter_id, \)
- *                      uint16_t byte_len, struct pof_local_resource *lr)
+ * Look up the counter to increace
+ * Form:     uint32_t poflr_counter_lookup(uint32_t counter_id,           \
+ *                                         struct counterInfo **counter, \
+ *                                         const struct pof_local_resource *lr)
  * Input:    counter_id
- * Output:   NONE
+ * Output:   counter
  * Return:   POF_OK or Error code
- * Discribe: This function increase the counter value corresponding to
- *           the counter_id by one.
+ * Discribe: This function gets the counter corresponding to the
+ *           counter_id, or NULL if it does not exist. The counters are
+ *           created only by the counter, flow and group mods, which are
+ *           the only writers of the counter map. The counter stays
+ *           valid until the datapath task is quiescent.
  ***********************************************************************/
-#ifdef POF_SD2N
-uint32_t 
-poflr_counter_increace(uint32_t counter_id, uint16_t byte_len, struct pof_local_resource *lr)
-{
-#else // POF_SD2N
-uint32_t 
-poflr_counter_increace(uint32_t counter_id, struct pof_local_resource *lr)
+uint32_t
+poflr_counter_lookup(uint32_t counter_id, struct counterInfo **counter, \
+                     const struct pof_local_resource *lr)
 {
-#endif // POF_SD2N
-    struct counterInfo *counter;
-
-    if(!counter_id){
-        return POF_OK;
-    }
-
     /* Check the counter id. */
     if(counter_id >= lr->counterNumMax){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_BAD_COUNTER_ID, g_upward_xid++);
     }
-    if(!(counter = poflr_get_counter_with_ID(counter_id, lr))){
-		poflr_counter_init(counter_id, lr);
-    }
+    *counter = poflr_get_counter_with_ID(counter_id, lr);
+    return POF_OK;
+}
 
-    counter->value ++;
+/* Add to the shard of the datapath task. A shard is shared when there
+ * are more tasks than shards, so the adds are still atomic. But they
+ * do not bounce the cache line between the tasks. */
+void
+poflr_counter_add(struct counterInfo *counter, uint32_t shard, \
+                  uint32_t packets, uint64_t bytes)
+{
+    struct counterValue *v = &counter->shards[shard % POFLR_COUNTER_SHARD_NUM].v;
+
+    __atomic_fetch_add(&v->value, packets, __ATOMIC_RELAXED);
 #ifdef POF_SD2N
-    counter->byte_value += byte_len;
+    __atomic_fetch_add(&v->byte_value, bytes, __ATOMIC_RELAXED);
 #endif // POF_SD2N
+    return;
+}
 
+/* The counter value since it was cleared last time. */
+void
+poflr_counter_read(const struct counterInfo *counter, struct counterValue *value)
+{
+    counterSum(counter, value);
+    value->value -= counter->base.value;
 #ifdef POF_SD2N
-    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased, value = %" \
-            POF_PRINT_FORMAT_U64", byte_value = %"POF_PRINT_FORMAT_U64, \
-            counter_id, counter->value, counter->byte_value);
-#else // POF_SD2N
-    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased, value = %"POF_PRINT_FORMAT_U64, \
-            counter_id, counter->value);
+    value->byte_value -= counter->base.byte_value;
 #endif // POF_SD2N
-    return POF_OK;
+    return;
 }
 
 /* Initialize counter resource. */
 uint32_t poflr_init_counter(struct pof_local_resource *lr){
 
     /* Initialize counter table. */
-    lr->counterMap = hmap_create(lr->counterNumMax);
+    lr->counterMap = hmap_createFixed(lr->counterNumMax);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->counterMap);
+    POF_MALLOC_SAFE_RETURN(lr->counters, lr->counterNumMax, POF_ERROR);
 
 	return POF_OK;
 }
@@ -324,11 +358,10 @@ uint32_t poflr_empty_counter(struct pof_local_resource *lr){
 	return POF_OK;
 }
 
-/* Get counter table. */
+/* The counter is got from lr->counters directly, as it is done for
+ * each matched packet. */
 struct counterInfo *
 poflr_get_counter_with_ID(uint32_t id, const struct pof_local_resource *lr)
 {
-    struct counterInfo *counter, *ptr;
-    return HMAP_STRUCT_GET(counter, idNode, \
-            map_counterHashByID(id), lr->counterMap, ptr);
+    return (id < lr->counterNumMax) ? lr->counters[id] : NULL;
 }
@@ -0,0 +1,481 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_hash.h"
+#include "../include/pof_rcu.h"
+#include <string.h>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+#define CUCKOO_SLOTS        (8)     /* Slots of a bucket. */
+#define CUCKOO_PATH_MAX     (64)    /* Max moves to make room. */
+
+/* One cache line. The tag of the empty slot is 0. */
+struct cuckooBucket {
+    uint16_t tags[CUCKOO_SLOTS];
+    uint32_t records[CUCKOO_SLOTS];
+} POF_CACHE_ALIGNED;
+
+/* Record of the key. The key is stored inline after the entry, so a hit
+ * reads the bucket and the record only. */
+struct cuckooRecord {
+    struct entryInfo *entry;
+    uint8_t key[0];
+};
+
+/* Bucketized cuckoo hash. Every key lives in one of its two buckets. The
+ * alternative bucket is computed from the bucket and the tag, so a key
+ * can be moved without hashing it again. A lookup may look at a bucket
+ * just before a key moves into it, and at the other one just after the
+ * key moves out, so the lookups which miss while seq changes retry. */
+struct emCuckoo {
+    struct cuckooBucket *buckets;
+    uint32_t mask;
+    uint32_t seq;                   /* Odd while the keys are being moved. */
+    uint8_t *records;               /* The record 0 is not used. */
+    uint32_t recordSize;
+    uint32_t keyBytes;
+    struct rcuPool recordPool;      /* The records to reuse. */
+};
+
+#define CUCKOO_RECORD(ck,r) ((struct cuckooRecord *)((ck)->records + (size_t)(r) * (ck)->recordSize))
+
+static inline uint64_t
+cuckooHash(const uint8_t *key, uint32_t bytes)
+{
+    return pof_hash_bytes(key, bytes, 0);
+}
+
+static inline uint16_t
+cuckooTag(uint64_t hash)
+{
+    uint16_t tag = hash >> 48;
+    return tag ? tag : 1;
+}
+
+static inline uint32_t
+cuckooAltBucket(const struct emCuckoo *ck, uint32_t bucket, uint16_t tag)
+{
+    return (bucket ^ (tag * 0x5BD1E995U)) & ck->mask;
+}
+
+/* Bitmap of the slots of the bucket with the tag. */
+static inline uint32_t
+cuckooTagMatch(const struct cuckooBucket *bkt, uint16_t tag)
+{
+#ifdef __SSE2__
+    __m128i tags = _mm_load_si128((const __m128i *)bkt->tags);
+    __m128i cmp = _mm_cmpeq_epi16(tags, _mm_set1_epi16(tag));
+    /* Two bits of each 16-bit lane. Keep the odd ones. */
+    return _mm_movemask_epi8(cmp) & 0xAAAA;
+#else // __SSE2__
+    uint32_t i, bits = 0;
+    for(i=0; i<CUCKOO_SLOTS; i++){
+        bits |= (uint32_t)(bkt->tags[i] == tag) << (2 * i + 1);
+    }
+    return bits;
+#endif // __SSE2__
+}
+
+#define CUCKOO_SLOT_OF_BIT(bits)    (__builtin_ctz(bits) / 2)
+
+static inline uint32_t
+cuckooReadBegin(const struct emCuckoo *ck)
+{
+    return __atomic_load_n(&ck->seq, __ATOMIC_ACQUIRE);
+}
+
+/* Whether a miss since cuckooReadBegin() should be looked up again. */
+static inline bool
+cuckooReadRetry(const struct emCuckoo *ck, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || __atomic_load_n(&ck->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static struct entryInfo *
+cuckooBucketSearch(const struct emCuckoo *ck, const struct cuckooBucket *bkt, \
+                   uint16_t tag, const uint8_t *key)
+{
+    const struct cuckooRecord *rec;
+    uint32_t bits = cuckooTagMatch(bkt, tag), slot;
+
+    for(; bits; bits &= bits - 1){
+        slot = CUCKOO_SLOT_OF_BIT(bits);
+        rec = CUCKOO_RECORD(ck, bkt->records[slot]);
+        if(memcmp(rec->key, key, ck->keyBytes) == 0){
+            return rec->entry;
+        }
+    }
+    return NULL;
+}
+
+/* Find the slot of the key. Return FALSE if none. */
+static bool
+cuckooFind(const struct emCuckoo *ck, const uint8_t *key, uint32_t *bucket, uint32_t *slot)
+{
+    uint64_t hash = cuckooHash(key, ck->keyBytes);
+    uint16_t tag = cuckooTag(hash);
+    uint32_t b[2], i, bits;
+
+    b[0] = hash & ck->mask;
+    b[1] = cuckooAltBucket(ck, b[0], tag);
+    for(i=0; i<2; i++){
+        for(bits = cuckooTagMatch(&ck->buckets[b[i]], tag); bits; bits &= bits - 1){
+            *slot = CUCKOO_SLOT_OF_BIT(bits);
+            if(memcmp(CUCKOO_RECORD(ck, ck->buckets[b[i]].records[*slot])->key, \
+                      key, ck->keyBytes) == 0){
+                *bucket = b[i];
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+static bool
+cuckooEmptySlot(const struct cuckooBucket *bkt, uint32_t *slot)
+{
+    uint32_t bits = cuckooTagMatch(bkt, 0);
+    if(!bits){
+        return FALSE;
+    }
+    *slot = CUCKOO_SLOT_OF_BIT(bits);
+    return TRUE;
+}
+
+static void
+cuckooSlotSet(struct cuckooBucket *bkt, uint32_t slot, uint16_t tag, uint32_t record)
+{
+    __atomic_store_n(&bkt->records[slot], record, __ATOMIC_RELAXED);
+    __atomic_store_n(&bkt->tags[slot], tag, __ATOMIC_RELEASE);
+}
+
+/* Make room in the bucket by moving the keys to their alternative
+ * buckets. The path is searched first, and then moved from the end, so
+ * every key stays in one of its buckets during the moves. */
+static bool
+cuckooPathHas(const uint32_t *pathBucket, const uint32_t *pathSlot, uint32_t depth, \
+              uint32_t bucket, uint32_t slot)
+{
+    uint32_t i;
+    for(i=0; i<depth; i++){
+        if(pathBucket[i] == bucket && pathSlot[i] == slot){
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static bool
+cuckooMakeRoom(struct emCuckoo *ck, uint32_t bucket, uint32_t *slot)
+{
+    uint32_t pathBucket[CUCKOO_PATH_MAX + 1], pathSlot[CUCKOO_PATH_MAX + 1];
+    uint32_t depth, i, s, b = bucket, empty;
+    struct cuckooBucket *from, *to;
+
+    for(depth=0; depth<CUCKOO_PATH_MAX; depth++){
+        /* Do not move the key of a slot twice. */
+        for(i=0, s=rand() % CUCKOO_SLOTS; i<CUCKOO_SLOTS; i++, s=(s + 1) % CUCKOO_SLOTS){
+            if(!cuckooPathHas(pathBucket, pathSlot, depth, b, s)){
+                break;
+            }
+        }
+        if(i == CUCKOO_SLOTS){
+            return FALSE;
+        }
+        pathBucket[depth] = b;
+        pathSlot[depth] = s;
+        b = cuckooAltBucket(ck, b, ck->buckets[b].tags[s]);
+        if(cuckooEmptySlot(&ck->buckets[b], &empty)){
+            break;
+        }
+    }
+    if(depth == CUCKOO_PATH_MAX){
+        return FALSE;
+    }
+
+    pathBucket[depth + 1] = b;
+    pathSlot[depth + 1] = empty;
+    __atomic_store_n(&ck->seq, ck->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for(i=depth+1; i>0; i--){
+        from = &ck->buckets[pathBucket[i-1]];
+        to = &ck->buckets[pathBucket[i]];
+        cuckooSlotSet(to, pathSlot[i], from->tags[pathSlot[i-1]], from->records[pathSlot[i-1]]);
+    }
+    __atomic_store_n(&ck->seq, ck->seq + 1, __ATOMIC_RELEASE);
+    *slot = pathSlot[0];
+    return TRUE;
+}
+
+/***********************************************************************
+ * Create the cuckoo hash of the EM table
+ * Form:     uint32_t poflr_cuckoo_create(struct tableInfo *table)
+ * Input:    table
+ * Output:   table->cuckoo
+ * Return:   POF_OK or Error code
+ * Discribe: This function allocates the buckets for table->size keys at
+ *           the load of 1/2 at most, and the records of the keys. One
+ *           more record is kept for the new key of a modified entry,
+ *           which is inserted before the old key is deleted.
+ ***********************************************************************/
+uint32_t
+poflr_cuckoo_create(struct tableInfo *table)
+{
+    struct emCuckoo *ck;
+    uint32_t bucketNum = 2, i;
+
+    POF_MALLOC_SAFE_RETURN(ck, 1, POF_ERROR);
+    table->cuckoo = ck;
+    while(bucketNum * CUCKOO_SLOTS < table->size * 2){
+        bucketNum <<= 1;
+    }
+    ck->mask = bucketNum - 1;
+    ck->keyBytes = POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen);
+    ck->recordSize = (sizeof(struct cuckooRecord) + ck->keyBytes + 7) / 8 * 8;
+
+    if(posix_memalign((void **)&ck->buckets, POF_CACHE_LINE_SIZE, \
+                      bucketNum * sizeof *ck->buckets) != 0){
+        ck->buckets = NULL;
+    }
+    if(ck->buckets == NULL || \
+            (ck->records = calloc(table->size + 2, ck->recordSize)) == NULL || \
+            rcu_poolInit(&ck->recordPool, table->size + 1) != POF_OK){
+        poflr_cuckoo_destroy(table);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    memset(ck->buckets, 0, bucketNum * sizeof *ck->buckets);
+    for(i=0; i<=table->size; i++){
+        rcu_poolPut(&ck->recordPool, table->size + 1 - i);
+    }
+    return POF_OK;
+}
+
+void
+poflr_cuckoo_destroy(struct tableInfo *table)
+{
+    struct emCuckoo *ck = table->cuckoo;
+
+    if(!ck){
+        return;
+    }
+    free(ck->buckets);
+    free(ck->records);
+    rcu_poolDestroy(&ck->recordPool);
+    FREE(ck);
+    table->cuckoo = NULL;
+}
+
+/* Insert the key of the entry. The same key inserted later overrides the
+ * former one. */
+uint32_t
+poflr_cuckoo_insert(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct emCuckoo *ck = table->cuckoo;
+    struct cuckooRecord *rec;
+    uint64_t hash;
+    uint32_t bucket, slot, record;
+    uint16_t tag;
+
+    if(cuckooFind(ck, entry->value, &bucket, &slot)){
+        rec = CUCKOO_RECORD(ck, ck->buckets[bucket].records[slot]);
+        __atomic_store_n(&rec->entry, entry, __ATOMIC_RELEASE);
+        return POF_OK;
+    }
+    if(rcu_poolAvailable(&ck->recordPool) == 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+
+    hash = cuckooHash(entry->value, ck->keyBytes);
+    tag = cuckooTag(hash);
+    bucket = hash & ck->mask;
+    if(!cuckooEmptySlot(&ck->buckets[bucket], &slot)){
+        bucket = cuckooAltBucket(ck, bucket, tag);
+        if(!cuckooEmptySlot(&ck->buckets[bucket], &slot) && \
+                !cuckooMakeRoom(ck, bucket, &slot)){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        }
+    }
+
+    rcu_poolGet(&ck->recordPool, &record);
+    rec = CUCKOO_RECORD(ck, record);
+    rec->entry = entry;
+    memcpy(rec->key, entry->value, ck->keyBytes);
+    cuckooSlotSet(&ck->buckets[bucket], slot, tag, record);
+    return POF_OK;
+}
+
+/* Delete the key of the entry. If another entry of the same key is left
+ * in table->entryMap, the key refers to it instead. It is found in the
+ * chain of the value hash. The record may still be compared by the
+ * lookups, so it is retired instead of freed. */
+void
+poflr_cuckoo_delete(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct emCuckoo *ck = table->cuckoo;
+    struct entryInfo *tmp;
+    struct hnode *node;
+    struct cuckooRecord *rec;
+    uint32_t bucket, slot, record;
+
+    if(!cuckooFind(ck, entry->value, &bucket, &slot)){
+        return;
+    }
+    record = ck->buckets[bucket].records[slot];
+    rec = CUCKOO_RECORD(ck, record);
+    if(rec->entry != entry){
+        return;
+    }
+    for(node = hmap_nodeGetWithHash(table->entryMap, entry->node.hash); node; node = node->next){
+        if(node->hash != entry->node.hash){
+            continue;
+        }
+        tmp = POF_STRUCT_FROM_MEMBER(tmp, node, node);
+        if(tmp != entry && memcmp(tmp->value, entry->value, ck->keyBytes) == 0){
+            __atomic_store_n(&rec->entry, tmp, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+    cuckooSlotSet(&ck->buckets[bucket], slot, 0, 0);
+    rcu_poolRetire(&ck->recordPool, record);
+}
+
+/* Lookup with the hash already computed by pof_hash_bytes(key, keyBytes, 0). */
+struct entryInfo *
+poflr_cuckoo_lookup_hash(const uint8_t *key, uint64_t hash, const struct tableInfo *table)
+{
+    const struct emCuckoo *ck = table->cuckoo;
+    uint16_t tag = cuckooTag(hash);
+    uint32_t bucket = hash & ck->mask, seq;
+    struct entryInfo *entry;
+
+    do{
+        seq = cuckooReadBegin(ck);
+        if((entry = cuckooBucketSearch(ck, &ck->buckets[bucket], tag, key)) != NULL || \
+                (entry = cuckooBucketSearch(ck, &ck->buckets[cuckooAltBucket(ck, bucket, tag)], \
+                                            tag, key)) != NULL){
+            return entry;
+        }
+    }while(cuckooReadRetry(ck, seq));
+    return NULL;
+}
+
+struct entryInfo *
+poflr_cuckoo_lookup(const uint8_t *key, const struct tableInfo *table)
+{
+    return poflr_cuckoo_lookup_hash(key, cuckooHash(key, table->cuckoo->keyBytes), table);
+}
+
+/***********************************************************************
+ * Lookup a burst of keys in the cuckoo hash
+ * Form:     void poflr_cuckoo_lookup_burst(const uint8_t *keys,
+ *                                          const uint64_t *hashes,
+ *                                          uint32_t num,
+ *                                          const struct tableInfo *table,
+ *                                          struct entryInfo **entries)
+ * Input:    keys, hashes of the keys or NULL, key number, table
+ * Output:   entries
+ * Return:   NONE
+ * Discribe: This function looks up the keys stored one after another in
+ *           POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen) bytes each. The
+ *           keys are hashed here if hashes is NULL. The
+ *           buckets of all the keys are hashed and prefetched first, then
+ *           the records of the matched tags are prefetched, and the keys
+ *           are compared at last. So the cache misses of the keys overlap
+ *           each other. The misses are looked up again one by one if
+ *           the keys were moved meanwhile.
+ ***********************************************************************/
+void
+poflr_cuckoo_lookup_burst(const uint8_t *keys, const uint64_t *hashes, uint32_t num, \
+                          const struct tableInfo *table, struct entryInfo **entries)
+{
+    const struct emCuckoo *ck = table->cuckoo;
+    uint32_t bucket[POFLR_CUCKOO_BURST][2], bits[POFLR_CUCKOO_BURST][2];
+    uint16_t tag[POFLR_CUCKOO_BURST];
+    const struct cuckooBucket *bkt;
+    const struct cuckooRecord *rec;
+    const uint8_t *key;
+    uint64_t hash[POFLR_CUCKOO_BURST];
+    uint32_t base, n, i, j, b, seq, miss;
+
+    for(base=0; base<num; base+=POFLR_CUCKOO_BURST){
+        n = POF_MIN(num - base, POFLR_CUCKOO_BURST);
+        seq = cuckooReadBegin(ck);
+
+        for(i=0; i<n; i++){
+            hash[i] = hashes ? hashes[base + i] : \
+                      cuckooHash(keys + (base + i) * ck->keyBytes, ck->keyBytes);
+            tag[i] = cuckooTag(hash[i]);
+            bucket[i][0] = hash[i] & ck->mask;
+            bucket[i][1] = cuckooAltBucket(ck, bucket[i][0], tag[i]);
+            __builtin_prefetch(&ck->buckets[bucket[i][0]]);
+            __builtin_prefetch(&ck->buckets[bucket[i][1]]);
+        }
+
+        for(i=0; i<n; i++){
+            for(j=0; j<2; j++){
+                bkt = &ck->buckets[bucket[i][j]];
+                bits[i][j] = cuckooTagMatch(bkt, tag[i]);
+                if(bits[i][j]){
+                    __builtin_prefetch(CUCKOO_RECORD(ck, bkt->records[CUCKOO_SLOT_OF_BIT(bits[i][j])]));
+                }
+            }
+        }
+
+        for(i=0, miss=0; i<n; i++){
+            key = keys + (base + i) * ck->keyBytes;
+            entries[base + i] = NULL;
+            for(j=0; j<2 && !entries[base + i]; j++){
+                bkt = &ck->buckets[bucket[i][j]];
+                for(b=bits[i][j]; b; b &= b - 1){
+                    rec = CUCKOO_RECORD(ck, bkt->records[CUCKOO_SLOT_OF_BIT(b)]);
+                    if(memcmp(rec->key, key, ck->keyBytes) == 0){
+                        entries[base + i] = rec->entry;
+                        break;
+                    }
+                }
+            }
+            miss += !entries[base + i];
+        }
+
+        if(miss && cuckooReadRetry(ck, seq)){
+            for(i=0; i<n; i++){
+                if(!entries[base + i]){
+                    entries[base + i] = poflr_cuckoo_lookup_hash(keys + (base + i) * ck->keyBytes, \
+                                                                 hash[i], table);
+                }
+            }
+        }
+    }
+}
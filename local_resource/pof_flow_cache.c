@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_hash.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* Ways of a megaflow set. */
+#define FLOW_CACHE_WAYS     (2)
+
+/* One cached lookup of a table. The slot is valid only while the table
+ * is the same and has the same generation. A NULL entry caches a miss. */
+struct flowCacheSlot {
+    const struct tableInfo *table;
+    uint64_t gen;
+    uint64_t hash;
+    struct entryInfo *entry;
+    uint8_t key[POFLR_FLOW_CACHE_KEY_BYTES];
+};
+
+/* Flow cache of one receive task. No lock. */
+struct flowCache {
+    struct flowCacheSlot micro[POFLR_FLOW_CACHE_MICRO];
+    struct flowCacheSlot mega[POFLR_FLOW_CACHE_MEGA];
+};
+
+/* gen is the table->gen loaded once by the lookup. */
+static inline bool
+slotMatch(const struct flowCacheSlot *slot, const struct tableInfo *table, uint64_t gen, \
+          uint64_t hash, const uint8_t *key, uint16_t key_bytes)
+{
+    return slot->table == table && slot->gen == gen && slot->hash == hash && \
+           memcmp(slot->key, key, key_bytes) == 0;
+}
+
+static inline void
+slotSet(struct flowCacheSlot *slot, const struct tableInfo *table, uint64_t gen, \
+        uint64_t hash, const uint8_t *key, uint16_t key_bytes, struct entryInfo *entry)
+{
+    slot->table = table;
+    slot->gen = gen;
+    slot->hash = hash;
+    slot->entry = entry;
+    memcpy(slot->key, key, key_bytes);
+}
+
+/***********************************************************************
+ * Create the flow cache of a receive task
+ * Form:     struct flowCache *poflr_flow_cache_create()
+ * Input:    NONE
+ * Return:   The flow cache, or NULL if failed
+ * Discribe: This function allocates an empty flow cache. The cache is
+ *           used by one task only.
+ ***********************************************************************/
+struct flowCache *
+poflr_flow_cache_create()
+{
+    struct flowCache *cache;
+
+    if(posix_memalign((void **)&cache, POF_CACHE_LINE_SIZE, sizeof *cache) != 0){
+        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        return NULL;
+    }
+    memset(cache, 0, sizeof *cache);
+    return cache;
+}
+
+void
+poflr_flow_cache_destroy(struct flowCache *cache)
+{
+    free(cache);
+}
+
+/***********************************************************************
+ * Look up the key of the table through the flow cache
+ * Form:     struct entryInfo *poflr_flow_cache_lookup(struct flowCache *cache,
+ *                                                     const uint8_t *key,
+ *                                                     uint16_t key_bytes,
+ *                                                     const struct tableInfo *table)
+ * Input:    cache, key extracted from the packet, key length, table
+ * Return:   The matched entry, or NULL if none
+ * Discribe: The microflow tier is looked up first by the whole key.
+ *           The megaflow tier is looked up then by the key masked with
+ *           table->maskUnion, as the keys equal in all the bits masked
+ *           by any entry match the same entry. A megaflow hit is copied
+ *           to the microflow tier. At last the table is looked up, and
+ *           the result is put into both tiers. Any flow mod changes
+ *           table->gen, which invalidates all the slots of the table.
+ *           The gen is loaded before the mask union and the table, and
+ *           the slots are stamped with it, so a slot filled by a stale
+ *           mask union or result never matches the newer gen.
+ * NOTE:     key_bytes should be POFLR_FLOW_CACHE_KEY_BYTES at most.
+ ***********************************************************************/
+struct entryInfo *
+poflr_flow_cache_lookup(struct flowCache *cache, const uint8_t *key, \
+                        uint16_t key_bytes, const struct tableInfo *table)
+{
+    struct flowCacheSlot *micro, *set;
+    struct entryInfo *entry;
+    uint8_t masked[POFLR_FLOW_CACHE_KEY_BYTES];
+    uint64_t hash, megaHash, gen;
+    uint32_t i;
+
+    /* Pairs with the release store of the flow mods. */
+    gen = __atomic_load_n(&table->gen, __ATOMIC_ACQUIRE);
+
+    hash = pof_hash_bytes(key, key_bytes, table->id);
+    micro = &cache->micro[hash & (POFLR_FLOW_CACHE_MICRO - 1)];
+    if(slotMatch(micro, table, gen, hash, key, key_bytes)){
+        return micro->entry;
+    }
+
+    for(i=0; i<key_bytes; i++){
+        masked[i] = key[i] & table->maskUnion[i];
+    }
+    megaHash = pof_hash_bytes(masked, key_bytes, table->id);
+    set = &cache->mega[(megaHash & (POFLR_FLOW_CACHE_MEGA / FLOW_CACHE_WAYS - 1)) * FLOW_CACHE_WAYS];
+    for(i=0; i<FLOW_CACHE_WAYS; i++){
+        if(slotMatch(&set[i], table, gen, megaHash, masked, key_bytes)){
+            entry = set[i].entry;
+            slotSet(micro, table, gen, hash, key, key_bytes, entry);
+            return entry;
+        }
+    }
+
+    /* Miss. The newest megaflow takes the first way of the set. The
+     * slots are filled before the lookup, as the LPM tree shifts the
+     * key. */
+    for(i=FLOW_CACHE_WAYS-1; i>0; i--){
+        set[i] = set[i-1];
+    }
+    slotSet(&set[0], table, gen, megaHash, masked, key_bytes, NULL);
+    slotSet(micro, table, gen, hash, key, key_bytes, NULL);
+    entry = poflr_entry_lookup_key(key, table);
+    set[0].entry = micro->entry = entry;
+    return entry;
+}
@@ -29,6 +29,8 @@
 #include "../include/pof_local_resource.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_hash.h"
+#include "../include/pof_rcu.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -36,6 +38,7 @@
 #include "net/if.h"
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
+#include "time.h"
 
 #define LPM_TREE (1)
 
@@ -45,6 +48,20 @@ uint16_t poflr_key_len_each_type[POF_MAX_TABLE_TYPE];
 /* Key length. */
 uint32_t poflr_key_len = POFLR_KEY_LEN;
 
+/* MM engine of each MM table id. */
+static uint8_t poflr_mm_engine[POFLR_TABLE_ID_MAX + 1];
+
+/* LPM engine of the LPM tables. */
+static uint8_t poflr_lpm_engine = POFLR_LPM_STRIDE;
+
+/* EM engine of the EM tables. */
+static uint8_t poflr_em_engine = POFLR_EM_CUCKOO;
+
+/* The last generation given to a table by a flow mod. Never reused, so a
+ * flow cache slot never matches a table created later at the same
+ * address. */
+static uint64_t poflr_flow_gen = 0;
+
 #define TABLE_TYPES         \
         TABLE_TYPE(MM)      \
         TABLE_TYPE(LPM)     \
@@ -53,13 +70,13 @@ uint32_t poflr_key_len = POFLR_KEY_LEN;
 static hash_t
 map_tableHashByID(uint8_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
 }
 
 static hash_t
 map_tableHashByType(uint8_t type)
 {
-    return hmap_hashForLinear(type);
+    return hmap_hashForUint32(type);
 }
 
 static void
@@ -68,10 +85,12 @@ map_tableInsert(struct tableInfo *table, struct pof_local_resource *lr)
 
     hmap_nodeInsert(lr->tableIdMap, &table->idNode);
 //    hmap_nodeInsert(lr->tableTypeMap, &table->typeNode);
+    __atomic_store_n(&lr->tables[table->id], table, __ATOMIC_RELEASE);
     lr->tableNum ++;
+    poflr_ins_program_renew(lr);
 }
 
-/* Malloc memory for table information. Should be FREE by map_tableDelete(). */
+/* Malloc memory for table information. Should be FREE by tableFree(). */
 static struct tableInfo *
 map_tableCreate()
 {
@@ -80,27 +99,30 @@ map_tableCreate()
     return table;
 }
 
+/* Unlink the table from the local resource. The datapath may still use
+ * it until a grace period has passed. */
 static void
 map_tableDelete(struct tableInfo *table, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->tableIdMap, &table->idNode);
 //    hmap_nodeDelete(lr->tableTypeMap, &table->typeNode);
+    __atomic_store_n(&lr->tables[table->id], NULL, __ATOMIC_RELEASE);
     lr->tableNum --;
-    FREE(table);
+    poflr_ins_program_renew(lr);
 }
 
+/* The table is got from lr->tables directly, as it is done for each
+ * GOTO_TABLE instruction. */
 struct tableInfo *
 poflr_get_table_with_ID(uint8_t id, const struct pof_local_resource *lr)
 {
-    struct tableInfo *table, *ptr;
-    return HMAP_STRUCT_GET(table, idNode, \
-            map_tableHashByID(id),  lr->tableIdMap, ptr);
+    return lr->tables[id];
 }
 
 static hash_t
 entryHashByID(uint32_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
 }
 
 static hash_t
@@ -155,12 +177,17 @@ get1sCountInBytes(uint8_t *value, uint32_t n)
 }
 
 static uint32_t
-lpmInsert(const struct entryInfo *entry, struct tableInfo *table)
+lpmInsert(struct entryInfo *entry, struct tableInfo *table)
 {
     uint32_t ret, bitNum;
     uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
 
     bitNum = get1sCountInBytes((uint8_t *)entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+    if(table->lpmEngine == POFLR_LPM_STRIDE){
+        return poflr_stride_insert(entry, bitNum, table);
+    }else if(table->lpmEngine == POFLR_LPM_PATRICIA){
+        return poflr_patricia_insert(entry, bitNum, table);
+    }
     memcpy(value, entry->value, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
     ret = tree_nodeInsert(table->tree, entry, value, bitNum);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -175,8 +202,13 @@ lpmDelete(struct entryInfo *entry, struct tableInfo *table)
     uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
 
     bitNum = get1sCountInBytes(entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+    if(table->lpmEngine == POFLR_LPM_STRIDE){
+        return poflr_stride_delete(entry, bitNum, table);
+    }else if(table->lpmEngine == POFLR_LPM_PATRICIA){
+        return poflr_patricia_delete(entry, bitNum, table);
+    }
     memcpy(value, entry->value, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
-    ret = tree_nodeDelete(table->tree, value, bitNum);
+    ret = tree_nodeDelete(table->tree, entry, value, bitNum);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     return POF_OK;
@@ -185,9 +217,196 @@ lpmDelete(struct entryInfo *entry, struct tableInfo *table)
 static struct entryInfo *
 lpmLookup(uint8_t *key, const struct tableInfo *table)
 {
+    if(table->lpmEngine == POFLR_LPM_STRIDE){
+        return poflr_stride_lookup(key, table);
+    }else if(table->lpmEngine == POFLR_LPM_PATRICIA){
+        return poflr_patricia_lookup(key, table);
+    }
     return tree_nodeLookup(table->tree, key, table->keyLen);
 }
 
+static uint32_t
+lpmEngineCreate(struct tableInfo *table)
+{
+    if(table->lpmEngine == POFLR_LPM_STRIDE){
+        return poflr_stride_create(table);
+    }else if(table->lpmEngine == POFLR_LPM_PATRICIA){
+        return poflr_patricia_create(table);
+    }
+    table->tree = tree_create();
+    return POF_OK;
+}
+
+static void
+lpmEngineDestroy(struct tableInfo *table)
+{
+    if(table->tree){
+        tree_destroy(table->tree);
+        table->tree = NULL;
+    }
+    poflr_stride_destroy(table);
+    poflr_patricia_destroy(table);
+}
+
+static void
+tssMaskedValue(uint8_t *dst, const uint8_t *value, const uint8_t *mask, uint16_t len_b)
+{
+    uint32_t i;
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(len_b); i++){
+        dst[i] = value[i] & mask[i];
+    }
+}
+
+static struct tssSubtable *
+tssSubtableGet(const uint8_t *mask, const struct tableInfo *table)
+{
+    const struct tssOrder *order = table->tss;
+    uint32_t i;
+    for(i=0; i<order->num; i++){
+        if(memcmp(order->subs[i].sub->mask, mask, \
+                  POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen)) == 0){
+            return order->subs[i].sub;
+        }
+    }
+    return NULL;
+}
+
+static void
+tssSubtableFree(void *arg)
+{
+    struct tssSubtable *sub = arg;
+    hmap_destroy(sub->entryMap);
+    FREE(sub);
+}
+
+/* Build the new order of the subtables with add and without del, sorted
+ * by their current maxPriority. The sort is stable, so the subtables of
+ * the same maxPriority keep their order. Return NULL if the malloc
+ * fails. */
+static struct tssOrder *
+tssOrderCreate(const struct tssOrder *old, struct tssSubtable *add, \
+               const struct tssSubtable *del)
+{
+    struct tssOrder *order;
+    struct tssSubtable *sub;
+    uint32_t i, j, num = 0;
+
+    order = (struct tssOrder *)MALLOC(sizeof *order + (old->num + 1) * sizeof order->subs[0]);
+    if(!order){
+        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        return NULL;
+    }
+    for(i=0; i<old->num; i++){
+        if(old->subs[i].sub != del){
+            order->subs[num ++].sub = old->subs[i].sub;
+        }
+    }
+    if(add){
+        order->subs[num ++].sub = add;
+    }
+    for(i=0; i<num; i++){
+        sub = order->subs[i].sub;
+        for(j=i; j>0 && order->subs[j-1].maxPriority < sub->maxPriority; j--){
+            order->subs[j] = order->subs[j-1];
+        }
+        order->subs[j].sub = sub;
+        order->subs[j].maxPriority = sub->maxPriority;
+    }
+    order->num = num;
+    return order;
+}
+
+/* Publish the new order, and free the old one after the lookups. */
+static void
+tssOrderPublish(struct tableInfo *table, struct tssOrder *order)
+{
+    struct tssOrder *old = table->tss;
+    __atomic_store_n(&table->tss, order, __ATOMIC_RELEASE);
+    rcu_free(old);
+}
+
+/* Insert the MM entry to the subtable with the same mask. Create the
+ * subtable if it is the first entry with this mask. The new order is
+ * built before the entry can be found, so nothing is undone if the
+ * malloc fails. */
+static uint32_t
+tssInsert(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct tssSubtable *sub;
+    struct tssOrder *order = NULL;
+    uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] = {0};
+    uint16_t maxPriority;
+
+    if((sub = tssSubtableGet(entry->mask, table)) == NULL){
+        POF_MALLOC_SAFE_RETURN(sub, 1, POF_ERROR);
+        if((sub->entryMap = hmap_createFixed(POF_MIN(table->size, POFLR_TSS_SUBTABLE_SIZE))) == NULL){
+            FREE(sub);
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        }
+        memcpy(sub->mask, entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+        sub->maxPriority = entry->priority;
+        if((order = tssOrderCreate(table->tss, sub, NULL)) == NULL){
+            tssSubtableFree(sub);
+            return POF_ERROR;
+        }
+    }else if(sub->maxPriority < entry->priority || sub->entryNum == 0){
+        maxPriority = sub->maxPriority;
+        sub->maxPriority = entry->priority;
+        if((order = tssOrderCreate(table->tss, NULL, NULL)) == NULL){
+            sub->maxPriority = maxPriority;
+            return POF_ERROR;
+        }
+    }
+
+    tssMaskedValue(value, entry->value, entry->mask, table->keyLen);
+    entry->tssNode.hash = entryHashByValue(value, table->keyLen);
+    hmap_nodeInsert(sub->entryMap, &entry->tssNode);
+    sub->entryNum ++;
+
+    if(order){
+        tssOrderPublish(table, order);
+    }
+    return POF_OK;
+}
+
+/* Delete the MM entry from its subtable. Destroy the subtable if it
+ * becomes empty. If the new order cannot be allocated, the old one is
+ * kept, as its maxPriority is still a bound of the entries left, and an
+ * empty subtable is reused by the next entry with its mask. */
+static void
+tssDelete(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct tssSubtable *sub;
+    struct tssOrder *order;
+    struct entryInfo *tmp, *next;
+
+    if((sub = tssSubtableGet(entry->mask, table)) == NULL){
+        return;
+    }
+    hmap_nodeDelete(sub->entryMap, &entry->tssNode);
+    sub->entryNum --;
+
+    if(sub->entryNum == 0){
+        if((order = tssOrderCreate(table->tss, NULL, sub)) != NULL){
+            tssOrderPublish(table, order);
+            rcu_call(tssSubtableFree, sub);
+        }
+        return;
+    }
+
+    if(entry->priority == sub->maxPriority){
+        sub->maxPriority = 0;
+        HMAP_NODES_IN_STRUCT_TRAVERSE(tmp, next, tssNode, sub->entryMap){
+            if(tmp->priority > sub->maxPriority){
+                sub->maxPriority = tmp->priority;
+            }
+        }
+        if((order = tssOrderCreate(table->tss, NULL, NULL)) != NULL){
+            tssOrderPublish(table, order);
+        }
+    }
+}
+
 /* Fill the struct entryInfo *entry. 
  * Calculate the hash value.
  * Assemble the value and mask.*/
@@ -242,11 +461,13 @@ entryFill(const struct pof_flow_entry *pofEntry,    \
 
 /* Malloc memory for entryInfo. Free at entryDelete. */
 /* Transfer the struct pof_flow_entry *pofEntry to the struct entryInfo *entry.
- * Insert the entry into the table.*/
+ * Insert the entry into the table. old is the entry to be replaced by a
+ * modify, or NULL. */
 static uint32_t
-entryInsert(const struct pof_flow_entry *pofEntry, struct tableInfo *table)
+entryInsert(const struct pof_flow_entry *pofEntry, struct tableInfo *table, \
+            struct entryInfo *old)
 {
-    uint32_t ret;
+    uint32_t ret, i;
     /* Create entry node. */
     struct entryInfo *entry;
 #ifdef POF_SHT_VXLAN
@@ -266,55 +487,213 @@ entryInsert(const struct pof_flow_entry *pofEntry, struct tableInfo *table)
         return POF_ERROR;
     }
 
+    /* Decode the instructions before the entry can be found. */
+    poflr_ins_program_entry(entry, table->lr);
+
+    if(table->type == POF_LPM_TABLE){
+        ret = lpmInsert(entry, table);
+    }else if(table->type == POF_EM_TABLE && table->emEngine == POFLR_EM_CUCKOO){
+        ret = poflr_cuckoo_insert(entry, table);
+    }else if(table->type == POF_MM_TABLE && table->mmEngine == POFLR_MM_TSS){
+        ret = tssInsert(entry, table);
+    }else if(table->type == POF_MM_TABLE && table->mmEngine == POFLR_MM_DTREE){
+        ret = poflr_dtree_insert(entry, table);
+    }else if(table->type == POF_MM_TABLE && table->mmEngine == POFLR_MM_SOA){
+        ret = poflr_soa_insert(entry, old, table);
+    }else{
+        ret = POF_OK;
+    }
+    if(ret != POF_OK){
+        FREE(entry);
+        return ret;
+    }
+
     hmap_nodeInsert(table->entryMap, &entry->node);
+    __atomic_store_n(&table->entries[entry->index], entry, __ATOMIC_RELEASE);
     table->entryNum ++;
 
-    if(table->type == POF_LPM_TABLE){
-        lpmInsert(entry, table);
+    /* The megaflows of the flow caches are masked by the union of the
+     * entry masks. Renew the generation after the entry can be found
+     * and the union covers it. */
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen); i++){
+        table->maskUnion[i] |= entry->mask[i];
     }
+    __atomic_store_n(&table->gen, ++ poflr_flow_gen, __ATOMIC_RELEASE);
 
     return POF_OK;
 }
 
+/* Unlink the entry, and free it after the datapath tasks which may still
+ * execute it. The index refers to the new entry already if the entry is
+ * being modified. */
 static void
 entryDelete(struct entryInfo *entry, struct tableInfo *table)
 {
+    bool dtree = FALSE;
+
     hmap_nodeDelete(table->entryMap, &entry->node);
+    if(table->entries[entry->index] == entry){
+        __atomic_store_n(&table->entries[entry->index], NULL, __ATOMIC_RELEASE);
+    }
     table->entryNum --;
 
     if(table->type == POF_LPM_TABLE){
         lpmDelete(entry, table);
+    }else if(table->type == POF_EM_TABLE && table->emEngine == POFLR_EM_CUCKOO){
+        poflr_cuckoo_delete(entry, table);
+    }else if(table->type == POF_MM_TABLE && table->mmEngine == POFLR_MM_TSS){
+        tssDelete(entry, table);
+    }else if(table->type == POF_MM_TABLE && table->mmEngine == POFLR_MM_SOA){
+        poflr_soa_delete(entry, table);
+    }else if(table->type == POF_MM_TABLE && table->mmEngine == POFLR_MM_DTREE){
+        /* The decision tree frees the entry after no lookup uses it. */
+        poflr_dtree_delete(entry, table);
+        dtree = TRUE;
     }
 
-    FREE(entry);
+    /* Renew the generation before the entry is freed, so that no flow
+     * cache returns it any more. The mask union only grows, until the
+     * table is empty. */
+    if(table->entryNum == 0){
+        memset(table->maskUnion, 0, sizeof table->maskUnion);
+    }
+    __atomic_store_n(&table->gen, ++ poflr_flow_gen, __ATOMIC_RELEASE);
+
+    if(!dtree){
+        rcu_free(entry);
+    }
 }
 
+/* Key extraction plan. Each match field is compiled to a byte copy of
+ * its aligned whole bytes, and shift/mask operations of 32 bits at most
+ * for the rest. Adjacent copies are merged into one run. */
+#define KEY_PLAN_COPY   (0)
+#define KEY_PLAN_BITS   (1)
+#define KEY_PLAN_OP_MAX (POF_MAX_MATCH_FIELD_NUM * (POF_MAX_FIELD_LENGTH_IN_BYTE / 4 + 2))
+
+struct keyPlanOp {
+    uint8_t type;           /* KEY_PLAN_*. */
+    uint8_t metadata;       /* From the metadata instead of the packet. */
+    uint8_t srcShift;       /* BITS: bit offset in the first source byte. */
+    uint8_t dstShift;       /* BITS: bit offset in the first key byte. */
+    uint8_t dstBytes;       /* BITS: bytes written. */
+    uint16_t srcByte;
+    uint16_t dstByte;
+    uint16_t len;           /* COPY: bytes. BITS: bits. */
+};
+
+struct keyPlan {
+    uint16_t zeroBytes;     /* Key bytes cleared before the extraction. */
+    uint16_t keyBytes;
+    bool hash;              /* Hash the key for EM tables. */
+    uint8_t opNum;
+    struct keyPlanOp ops[KEY_PLAN_OP_MAX];
+};
+
 static void
-keyAssemble(uint8_t *key, const uint8_t *packet, const uint8_t *metadata, \
-        uint8_t match_field_num, const struct pof_match *match)
+keyPlanAddBits(struct keyPlan *plan, uint8_t metadata, uint32_t src_b, uint32_t dst_b, uint32_t len_b)
 {
-    uint16_t i, offset_b = 0;
-    struct pof_match *matchTmp;
-    for(i=0; i<match_field_num; i++){
-        uint8_t tmp[POF_MAX_FIELD_LENGTH_IN_BYTE] = {0};
-        matchTmp = (struct pof_match *)(match + i);
-        if(matchTmp->field_id == 0xFFFF){
-            pofbf_copy_bit(metadata, tmp, matchTmp->offset, matchTmp->len);
-        }else{
-            pofbf_copy_bit(packet, tmp, matchTmp->offset, matchTmp->len);
+    struct keyPlanOp *op;
+    uint32_t len;
+    for(; len_b; src_b += len, dst_b += len, len_b -= len){
+        len = POF_MIN(len_b, 32);
+        op = &plan->ops[plan->opNum ++];
+        op->type = KEY_PLAN_BITS;
+        op->metadata = metadata;
+        op->srcByte = src_b / 8;
+        op->srcShift = src_b % 8;
+        op->dstByte = dst_b / 8;
+        op->dstShift = dst_b % 8;
+        op->dstBytes = (op->dstShift + len + 7) / 8;
+        op->len = len;
+    }
+}
+
+static void
+keyPlanAddCopy(struct keyPlan *plan, uint8_t metadata, uint32_t src_B, uint32_t dst_B, uint32_t len_B)
+{
+    struct keyPlanOp *op = plan->opNum ? &plan->ops[plan->opNum - 1] : NULL;
+    if(op && op->type == KEY_PLAN_COPY && op->metadata == metadata && \
+            op->srcByte + op->len == src_B && op->dstByte + op->len == dst_B){
+        op->len += len_B;
+        return;
+    }
+    op = &plan->ops[plan->opNum ++];
+    op->type = KEY_PLAN_COPY;
+    op->metadata = metadata;
+    op->srcByte = src_B;
+    op->dstByte = dst_B;
+    op->len = len_B;
+}
+
+/* Compile table->match into table->keyPlan. */
+static uint32_t
+keyPlanCompile(struct tableInfo *table)
+{
+    struct keyPlan *plan;
+    const struct pof_match *match;
+    uint32_t i, dst_b = 0, whole_b;
+    uint8_t metadata;
+
+    POF_MALLOC_SAFE_RETURN(plan, 1, POF_ERROR);
+    for(i=0; i<table->match_field_num; i++){
+        match = &table->match[i];
+        metadata = (match->field_id == 0xFFFF);
+        if(match->len > POF_MAX_FIELD_LENGTH_IN_BYTE * 8 || \
+                dst_b + match->len > POFLR_KEY_BYTES_MAX * 8){
+            FREE(plan);
+            return POF_ERROR;
         }
-        pofbf_cover_bit(key, tmp, offset_b, matchTmp->len);
-        offset_b += matchTmp->len;
+        whole_b = 0;
+        if(match->offset % 8 == 0 && dst_b % 8 == 0 && match->len >= 8){
+            whole_b = match->len / 8 * 8;
+            keyPlanAddCopy(plan, metadata, match->offset / 8, dst_b / 8, whole_b / 8);
+        }
+        keyPlanAddBits(plan, metadata, match->offset + whole_b, dst_b + whole_b, match->len - whole_b);
+        dst_b += match->len;
     }
+    plan->keyBytes = POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen);
+    plan->zeroBytes = POF_MIN((POF_MAX(plan->keyBytes, POF_BITNUM_TO_BYTENUM_CEIL(dst_b)) + 7) & ~7, \
+                              POFLR_KEY_BYTES_MAX);
+    plan->hash = (table->type == POF_EM_TABLE);
+    table->keyPlan = plan;
+    return POF_OK;
 }
 
-/* Entry lookup for Linear. */
+/* Extract the key of the packet into key, which has POFLR_KEY_BYTES_MAX
+ * bytes. For EM tables, the hash of the key is computed while it is
+ * still in registers and L1, and returned. */
+static uint64_t
+keyPlanExtract(const struct keyPlan *plan, const uint8_t *packet, const uint8_t *metadata, uint8_t *key)
+{
+    const struct keyPlanOp *op;
+    const uint8_t *src;
+    uint64_t v;
+    uint32_t i, j;
+
+    memset(key, 0, plan->zeroBytes);
+    for(i=0; i<plan->opNum; i++){
+        op = &plan->ops[i];
+        src = (op->metadata ? metadata : packet) + op->srcByte;
+        if(op->type == KEY_PLAN_COPY){
+            memcpy(key + op->dstByte, src, op->len);
+            continue;
+        }
+        v = pofbf_extract_bits(src, op->srcShift, op->len) << (64 - op->len);
+        v >>= op->dstShift;
+        for(j=0; j<op->dstBytes; j++){
+            key[op->dstByte + j] |= (uint8_t)(v >> (56 - 8 * j));
+        }
+    }
+    return plan->hash ? pof_hash_bytes(key, plan->keyBytes, 0) : 0;
+}
+
+/* Entry lookup for Linear. The index is a direct subscript of
+ * table->entries. */
 struct entryInfo *
 poflr_entry_lookup_Linear(uint32_t index, const struct tableInfo *table)
 {
-    struct entryInfo *entry, *ptr;
-    return HMAP_STRUCT_GET(entry, node, \
-            entryHashByID(index), table->entryMap, ptr);
+    return (index < table->size) ? table->entries[index] : NULL;
 }
 
 static bool
@@ -330,9 +709,9 @@ maskMatch(const uint8_t *mask, const uint8_t *value, const uint8_t *key, uint16_
     return TRUE;
 }
 
-/* Entry lookup for MM. */
+/* Traverse all entries of the MM table to lookup. */
 static struct entryInfo *
-entryLookup_MM(const void *key, const struct tableInfo *table)
+mmLookupLinear(const void *key, const struct tableInfo *table)
 {
     struct entryInfo *entry, *next, *ret = NULL;
 
@@ -354,14 +733,120 @@ entryLookup_MM(const void *key, const struct tableInfo *table)
     return ret;
 }
 
-/* Entry lookup for EM. */
+/* Search the subtables in descending maxPriority order. Stop once the
+ * matched entry has a priority not lower than the maxPriority of the
+ * next subtable, as no entry left can beat it. */
+static struct entryInfo *
+mmLookupTss(const uint8_t *key, const struct tableInfo *table)
+{
+    struct entryInfo *entry, *ret = NULL;
+    const struct tssOrder *order = __atomic_load_n(&table->tss, __ATOMIC_ACQUIRE);
+    const struct tssSubtable *sub;
+    struct hnode *node;
+    uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint32_t i;
+    hash_t hash;
+
+    for(i=0; i<order->num; i++){
+        sub = order->subs[i].sub;
+        if(ret && ret->priority >= order->subs[i].maxPriority){
+            break;
+        }
+
+        tssMaskedValue(value, key, sub->mask, table->keyLen);
+        hash = entryHashByValue(value, table->keyLen);
+        for(node = hmap_nodeGetWithHash(sub->entryMap, hash); node; node = node->next){
+            if(node->hash != hash){
+                continue;
+            }
+            entry = POF_STRUCT_FROM_MEMBER(entry, tssNode, node);
+            if(maskMatch(sub->mask, entry->value, key, table->keyLen) && \
+               (!ret || ret->priority < entry->priority)){
+                ret = entry;
+            }
+        }
+    }
+    return ret;
+}
+
+/* Entry lookup for MM. */
+static struct entryInfo *
+entryLookup_MM(const void *key, const struct tableInfo *table)
+{
+    if(table->mmEngine == POFLR_MM_TSS){
+        return mmLookupTss((const uint8_t *)key, table);
+    }else if(table->mmEngine == POFLR_MM_DTREE){
+        return poflr_dtree_lookup((const uint8_t *)key, table);
+    }else if(table->mmEngine == POFLR_MM_SOA){
+        return poflr_soa_lookup((const uint8_t *)key, table);
+    }
+    return mmLookupLinear(key, table);
+}
+
+/* Create the engine to lookup the MM table. */
+static uint32_t
+mmEngineCreate(struct tableInfo *table)
+{
+    if(table->mmEngine == POFLR_MM_TSS){
+        /* No subtable yet. */
+        POF_MALLOC_SAFE_RETURN(table->tss, 1, POF_ERROR);
+    }else if(table->mmEngine == POFLR_MM_DTREE){
+        return poflr_dtree_create(table);
+    }else if(table->mmEngine == POFLR_MM_SOA){
+        return poflr_soa_create(table);
+    }
+    return POF_OK;
+}
+
+/* Destroy the engine of the empty MM table. */
+static void
+mmEngineDestroy(struct tableInfo *table)
+{
+    uint32_t i;
+
+    if(table->tss){
+        /* Only the subtables kept empty are left. */
+        for(i=0; i<table->tss->num; i++){
+            tssSubtableFree(table->tss->subs[i].sub);
+        }
+        FREE(table->tss);
+        table->tss = NULL;
+    }
+    poflr_dtree_destroy(table);
+    poflr_soa_destroy(table);
+}
+
+/* Entry lookup for EM with the hash of keyPlanExtract. The hash map
+ * compares the keys of the nodes with the same hash. */
+static struct entryInfo *
+entryLookupHash_EM(const void *key, uint64_t hash64, const struct tableInfo *table)
+{
+    struct entryInfo *entry;
+    struct hnode *node;
+    hash_t hash;
+
+    if(table->emEngine == POFLR_EM_CUCKOO){
+        return poflr_cuckoo_lookup_hash((const uint8_t *)key, hash64, table);
+    }
+
+    /* The same as entryHashByValue. */
+    hash = (hash_t)(hash64 ^ (hash64 >> 32));
+    for(node = hmap_nodeGetWithHash(table->entryMap, hash); node; node = node->next){
+        if(node->hash != hash){
+            continue;
+        }
+        entry = POF_STRUCT_FROM_MEMBER(entry, node, node);
+        if(memcmp(entry->value, key, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen)) == 0){
+            return entry;
+        }
+    }
+    return NULL;
+}
+
 static struct entryInfo *
 entryLookup_EM(const void *key, const struct tableInfo *table)
 {
-    struct entryInfo *entry, *ptr;
-    return HMAP_STRUCT_GET(entry, node,                                         \
-            entryHashByValue(key, table->keyLen),   \
-            table->entryMap, ptr);
+    return entryLookupHash_EM(key, pof_hash_bytes(key, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen), 0), table);
 }
 
 /* Entry lookup for LPM. */
@@ -401,16 +886,11 @@ entryLookup_Linear(const void *key, const struct tableInfo *table)
 }
 */
 
-/* Entry lookup for EM, MM, LPM type. */
+/* Entry lookup for EM, MM, LPM type with the extracted key. */
 struct entryInfo *
-poflr_entry_lookup(const uint8_t *packet, const uint8_t *metadata, const struct tableInfo *table)
+poflr_entry_lookup_key(const uint8_t *key, const struct tableInfo *table)
 {
-    struct entryInfo *entry;
-    uint8_t *key;
-    POF_MALLOC_SAFE_RETURN(key, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen), NULL);
-
-    /* Assemble the find key. */
-    keyAssemble(key, packet, metadata, table->match_field_num, table->match);
+    struct entryInfo *entry = NULL;
 
     /* Find the matched entry using different ways according to the table type. */
 #define TABLE_TYPE(TYPE) \
@@ -418,21 +898,110 @@ poflr_entry_lookup(const uint8_t *packet, const uint8_t *metadata, const struct
     TABLE_TYPES
 #undef TABLE_TYPE
 
-    FREE(key);
     return entry;
 }
 
-/* Traverse to find the entry with the index. */
+/* Only the MM and LPM tables with short keys are looked up through the
+ * flow cache. The EM tables are one hash probe already. */
+static inline bool
+flowCacheUsed(const struct flowCache *cache, const struct tableInfo *table)
+{
+    return cache && table->type != POF_EM_TABLE && \
+           table->keyPlan->keyBytes <= POFLR_FLOW_CACHE_KEY_BYTES;
+}
+
+/* Entry lookup for EM, MM, LPM type. cache is the flow cache of the
+ * receive task, or NULL if not used. */
 struct entryInfo *
-poflr_entry_get_with_index(uint32_t index, const struct tableInfo *table)
+poflr_entry_lookup(const uint8_t *packet, const uint8_t *metadata, \
+                   const struct tableInfo *table, struct flowCache *cache)
 {
-    struct entryInfo *entry, *next;
-    HMAP_NODES_IN_STRUCT_TRAVERSE(entry, next, node, table->entryMap){
-        if(entry->index == index){
-            return entry;
+    uint8_t key[POFLR_KEY_BYTES_MAX] POF_CACHE_ALIGNED;
+    uint64_t hash;
+
+    /* Extract the find key, and hash it for EM. */
+    hash = keyPlanExtract(table->keyPlan, packet, metadata, key);
+    if(table->type == POF_EM_TABLE){
+        return entryLookupHash_EM(key, hash, table);
+    }
+    if(flowCacheUsed(cache, table)){
+        return poflr_flow_cache_lookup(cache, key, table->keyPlan->keyBytes, table);
+    }
+    return poflr_entry_lookup_key(key, table);
+}
+
+/***********************************************************************
+ * Entry lookup for a burst of packets
+ * Form:     uint32_t poflr_entry_lookup_burst(const uint8_t **packets,
+ *                                             const uint8_t **metadatas,
+ *                                             uint32_t num,
+ *                                             const struct tableInfo *table,
+ *                                             struct flowCache *cache,
+ *                                             struct entryInfo **entries)
+ * Input:    packets, metadatas, packet number, table, flow cache
+ * Output:   entries
+ * Return:   POF_OK or Error code
+ * Discribe: This function looks up num packets in the same EM, MM or LPM
+ *           type table. All the keys are assembled into one memory
+ *           first, and then looked up with only one table type
+ *           dispatch. entries[i] is NULL if packets[i] matches nothing.
+ *           The MM and LPM tables are looked up through the flow cache
+ *           of the receive task, if cache is not NULL.
+ ***********************************************************************/
+uint32_t
+poflr_entry_lookup_burst(const uint8_t **packets, const uint8_t **metadatas, \
+                         uint32_t num, const struct tableInfo *table,       \
+                         struct flowCache *cache, struct entryInfo **entries)
+{
+    uint8_t keys[POFLR_CUCKOO_BURST][POFLR_KEY_BYTES_MAX] POF_CACHE_ALIGNED;
+    uint64_t hashes[POFLR_CUCKOO_BURST];
+    uint32_t base, n, i;
+    /* The cuckoo hash takes the keys packed one after another. */
+    bool packed = (table->type == POF_EM_TABLE && table->emEngine == POFLR_EM_CUCKOO);
+
+    for(base=0; base<num; base+=POFLR_CUCKOO_BURST){
+        n = POF_MIN(num - base, POFLR_CUCKOO_BURST);
+
+        /* Extract the find keys, and hash them for EM. */
+        for(i=0; i<n; i++){
+            hashes[i] = keyPlanExtract(table->keyPlan, packets[base + i], metadatas[base + i], \
+                    packed ? keys[0] + i * table->keyPlan->keyBytes : keys[i]);
+        }
+
+        /* Find the matched entries using different ways according to the table type. */
+        if(packed){
+            poflr_cuckoo_lookup_burst(keys[0], hashes, n, table, entries + base);
+            continue;
+        }
+        if(flowCacheUsed(cache, table)){
+            for(i=0; i<n; i++){
+                entries[base + i] = poflr_flow_cache_lookup(cache, keys[i], \
+                        table->keyPlan->keyBytes, table);
+            }
+            continue;
+        }
+        for(i=0; i<n; i++){
+            if(table->type == POF_EM_TABLE){
+                entries[base + i] = entryLookupHash_EM(keys[i], hashes[i], table);
+                continue;
+            }
+            entries[base + i] = NULL;
+#define TABLE_TYPE(TYPE)                                                        \
+            if(table->type == POF_##TYPE##_TABLE) {                             \
+                entries[base + i] = entryLookup_##TYPE(keys[i], table);         \
+            }
+            TABLE_TYPES
+#undef TABLE_TYPE
         }
     }
-    return NULL;
+    return POF_OK;
+}
+
+/* Get the entry with the index from table->entries. */
+struct entryInfo *
+poflr_entry_get_with_index(uint32_t index, const struct tableInfo *table)
+{
+    return (index < table->size) ? table->entries[index] : NULL;
 }
 
 uint32_t 
@@ -482,16 +1051,62 @@ poflr_create_flow_table(uint8_t id,              \
     table->id = ID;
     table->idNode.hash = map_tableHashByID(ID);
     table->type = type;
+    table->lr = lr;
 //    table->typeNode.hash = map_tableHashByType(type);
     strncpy(table->name, name, TABLE_NAME_LEN);
-    table->entryMap = hmap_create(size);
+    table->entryMap = hmap_createFixed(size);
+    table->entries = (struct entryInfo **)MALLOC((size + 1) * sizeof *table->entries);
+    if(!table->entryMap || !table->entries){
+        if(table->entryMap){
+            hmap_destroy(table->entryMap);
+        }
+        FREE(table->entries);
+        FREE(table);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_upward_xid++);
+    }
+    memset(table->entries, 0, (size + 1) * sizeof *table->entries);
     table->entryNum = 0;
     table->size = size;
     table->keyLen = key_len;
+    table->gen = ++ poflr_flow_gen;
     table->match_field_num = match_field_num;
     memcpy(table->match, match, match_field_num * sizeof(pof_match));
+    if(keyPlanCompile(table) != POF_OK){
+        hmap_destroy(table->entryMap);
+        FREE(table->entries);
+        FREE(table);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_BAD_KEY_LEN, g_recv_xid);
+    }
     if(table->type == POF_LPM_TABLE){
-        table->tree = tree_create();
+        table->lpmEngine = poflr_lpm_engine;
+        if(table->lpmEngine == POFLR_LPM_STRIDE && key_len > POFLR_STRIDE_KEY_LEN_MAX){
+            table->lpmEngine = POFLR_LPM_PATRICIA;
+        }
+        if(lpmEngineCreate(table) != POF_OK){
+            hmap_destroy(table->entryMap);
+            FREE(table->entries);
+            FREE(table->keyPlan);
+            FREE(table);
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_upward_xid++);
+        }
+    }else if(table->type == POF_EM_TABLE){
+        table->emEngine = poflr_em_engine;
+        if(table->emEngine == POFLR_EM_CUCKOO && poflr_cuckoo_create(table) != POF_OK){
+            hmap_destroy(table->entryMap);
+            FREE(table->entries);
+            FREE(table->keyPlan);
+            FREE(table);
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_upward_xid++);
+        }
+    }else if(table->type == POF_MM_TABLE){
+        table->mmEngine = poflr_mm_engine[id];
+        if(mmEngineCreate(table) != POF_OK){
+            hmap_destroy(table->entryMap);
+            FREE(table->entries);
+            FREE(table->keyPlan);
+            FREE(table);
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_upward_xid++);
+        }
     }
     
     /* Insert the table to the local resource. */
@@ -501,6 +1116,28 @@ poflr_create_flow_table(uint8_t id,              \
     return POF_OK;
 }
 
+/* FREE the table unlinked by map_tableDelete(), with the hash map, the
+ * index array and the engine of the entries. No datapath task should use
+ * it any more. */
+static void
+tableFree(struct tableInfo *table)
+{
+    hmap_destroy(table->entryMap);
+    FREE(table->entries);
+    FREE(table->keyPlan);
+    if(table->type == POF_LPM_TABLE){
+        /* FREE the LPM engine. */
+        lpmEngineDestroy(table);
+    }else if(table->type == POF_EM_TABLE){
+        /* FREE the cuckoo hash. */
+        poflr_cuckoo_destroy(table);
+    }else if(table->type == POF_MM_TABLE){
+        /* FREE the MM engine. */
+        mmEngineDestroy(table);
+    }
+    FREE(table);
+}
+
 uint32_t
 poflr_delete_flow_table(uint8_t id, uint8_t type, struct pof_local_resource *lr)
 {
@@ -529,15 +1166,11 @@ poflr_delete_flow_table(uint8_t id, uint8_t type, struct pof_local_resource *lr)
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_TABLE_UNEMPTY, g_recv_xid);
     }
 
-    /* FREE the hash map of the entry in the table. */
-    hmap_destroy(table->entryMap);
-    if(table->type == POF_LPM_TABLE){
-        /* FREE the tree of LPM entry. */
-        tree_destroy(table->tree);
-    }
-
-    /* Delete the table from local resource and FREE the memory of table. */
+    /* Delete the table from local resource, and FREE it after the
+     * datapath tasks which may still look it up. */
     map_tableDelete(table, lr);
+    rcu_synchronize();
+    tableFree(table);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Delete flow table SUC!");
     return POF_OK;
@@ -585,15 +1218,21 @@ uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_resourc
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_ENTRY_ID, g_recv_xid);
     }
 
-    /* Create the entry, and insert to the table. */
-    if(entryInsert(flow_ptr, table) != POF_OK){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_UNKNOWN, g_recv_xid);
+    /* Check whether the index have already existed. */
+    if(poflr_entry_get_with_index(index, table)){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_EXIST, g_recv_xid);
     }
 
-    /* Initialize the counter_id. */
+    /* Initialize the counter_id before the datapath can find the
+     * entry, as the datapath skips the counters it can not find. */
 	ret = poflr_counter_init(flow_ptr->counter_id, lr);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
+    /* Create the entry, and insert to the table. */
+    if(entryInsert(flow_ptr, table, NULL) != POF_OK){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_UNKNOWN, g_recv_xid);
+    }
+
     POF_DEBUG_CPRINT_FL(1,GREEN,"Add flow entry SUC! Totally %d entries in this table.",
             table->entryNum);
     return POF_OK;
@@ -653,11 +1292,14 @@ uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_reso
         POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
 
-    /* Delete the original entry, then insert a new one. */
-    entryDelete(entry, table);
-    if(entryInsert(flow_ptr, table) != POF_OK){
+    /* Insert the new entry before deleting the original one, so the
+     * original is kept if the insertion fails, and the datapath finds
+     * either of them meanwhile. The engines let the entry inserted later
+     * override the one of the same key. */
+    if(entryInsert(flow_ptr, table, entry) != POF_OK){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_UNKNOWN, g_recv_xid);
     }
+    entryDelete(entry, table);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify flow entry SUC!");
     return POF_OK;
@@ -737,7 +1379,7 @@ uint32_t poflr_init_flow_table(struct pof_local_resource *lr){
     }
 
     /* Table map initialization. */
-    lr->tableIdMap = hmap_create(lr->tableNumMax);
+    lr->tableIdMap = hmap_createFixed(lr->tableNumMax);
 //    lr->tableTypeMap = hmap_create(lr->tableNumMax);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->tableIdMap);
 //    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->tableTypeMap);
@@ -747,21 +1389,24 @@ uint32_t poflr_init_flow_table(struct pof_local_resource *lr){
 
 /* Empty flow table. */
 uint32_t poflr_empty_flow_table(struct pof_local_resource *lr){
-    struct tableInfo *table, *nextTable;
+    struct tableInfo *table, *nextTable, *dead[POFLR_TABLE_ID_MAX + 1];
     struct entryInfo *entry, *nextEntry;
+    uint32_t deadNum = 0, i;
     HMAP_NODES_IN_STRUCT_TRAVERSE(table, nextTable, idNode, lr->tableIdMap){
         /* Delete all entries. */
         HMAP_NODES_IN_STRUCT_TRAVERSE(entry, nextEntry, node, table->entryMap){
             entryDelete(entry, table);
         }
-        /* FREE the hash map of entry in table. */
-        hmap_destroy(table->entryMap);
-        if(table->type == POF_LPM_TABLE){
-            /* FREE the tree of LPM entry in table. */
-            tree_destroy(table->tree);
-        }
-        /* Delete the table from local resource, and FREE the memory. */
+        /* Delete the table from local resource, and FREE all of them
+         * after one grace period. */
         map_tableDelete(table, lr);
+        dead[deadNum ++] = table;
+    }
+    if(deadNum){
+        rcu_synchronize();
+    }
+    for(i=0; i<deadNum; i++){
+        tableFree(dead[i]);
     }
 	return POF_OK;
 }
@@ -833,6 +1478,191 @@ uint32_t poflr_set_key_len(uint32_t key_len){
 	return POF_OK;
 }
 
+/***********************************************************************
+ * Set the MM engine.
+ * Form:     uint32_t poflr_set_mm_engine(uint16_t id, uint8_t engine)
+ * Input:    MM table id or POFLR_MM_ENGINE_ALL, engine
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function sets the engine to lookup the MM table with
+ *           the table id, or all the MM tables. It takes effect on the
+ *           tables created after.
+ ***********************************************************************/
+uint32_t
+poflr_set_mm_engine(uint16_t id, uint8_t engine)
+{
+    uint32_t i;
+
+    if(engine >= POFLR_MM_ENGINE_NUM || \
+            (id > POFLR_TABLE_ID_MAX && id != POFLR_MM_ENGINE_ALL)){
+        return POF_ERROR;
+    }
+    if(id != POFLR_MM_ENGINE_ALL){
+        poflr_mm_engine[id] = engine;
+        return POF_OK;
+    }
+    for(i=0; i<=POFLR_TABLE_ID_MAX; i++){
+        poflr_mm_engine[i] = engine;
+    }
+    return POF_OK;
+}
+
+/* Set the engine of the LPM tables created after. */
+uint32_t
+poflr_set_lpm_engine(uint8_t engine)
+{
+    if(engine >= POFLR_LPM_ENGINE_NUM){
+        return POF_ERROR;
+    }
+    poflr_lpm_engine = engine;
+    return POF_OK;
+}
+
+/* Set the engine of the EM tables created after. */
+uint32_t
+poflr_set_em_engine(uint8_t engine)
+{
+    if(engine >= POFLR_EM_ENGINE_NUM){
+        return POF_ERROR;
+    }
+    poflr_em_engine = engine;
+    return POF_OK;
+}
+
+#define LPM_BENCH_KEY_NUM   (4096)
+
+/* The stride engine is too large for the wide keys. */
+#define LPM_BENCH_SKIP(engine,key_len) \
+    ((engine) == POFLR_LPM_STRIDE && (key_len) > POFLR_STRIDE_KEY_LEN_MAX)
+
+static uint64_t
+lpmBenchRun(const uint8_t *keys, uint32_t keyBytes, uint32_t lookup_num, \
+            const struct tableInfo *table, struct entryInfo **ret)
+{
+    uint8_t key[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    struct timespec start, end;
+    uint32_t i, k;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i=0; i<lookup_num; i++){
+        k = i % LPM_BENCH_KEY_NUM;
+        /* The tree shifts the key, so every lookup works on a copy. */
+        memcpy(key, keys + k * keyBytes, keyBytes);
+        ret[k] = lpmLookup(key, table);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+}
+
+/***********************************************************************
+ * Benchmark the LPM engines
+ * Form:     uint32_t poflr_lpm_bench(uint32_t num, uint16_t key_len, uint32_t lookup_num,
+ *                                    uint64_t *ns, uint32_t *mismatch)
+ * Input:    prefix number, key length, lookup number
+ * Output:   nanoseconds of the lookups of each engine, mismatch number
+ * Return:   POF_OK or Error code
+ * Discribe: This function inserts the same random prefixes into one table
+ *           of each LPM engine, and times lookup_num lookups of the
+ *           random keys in each. Half of the keys are taken from the
+ *           prefixes. The results of the engines are compared with the
+ *           tree. The stride engine is skipped with ns of 0 if the keys
+ *           are wider than POFLR_STRIDE_KEY_LEN_MAX.
+ ***********************************************************************/
+uint32_t
+poflr_lpm_bench(uint32_t num, uint16_t key_len, uint32_t lookup_num, \
+                uint64_t *ns, uint32_t *mismatch)
+{
+    struct tableInfo tables[POFLR_LPM_ENGINE_NUM];
+    struct entryInfo *entries = NULL, **ret[POFLR_LPM_ENGINE_NUM] = {NULL};
+    uint8_t *keys = NULL, *key;
+    uint32_t keyBytes = POF_BITNUM_TO_BYTENUM_CEIL(key_len), i, j, depth, e;
+    uint32_t result = POF_ERROR;
+
+    if(num == 0 || key_len == 0 || \
+            keyBytes > POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM){
+        return POF_ERROR;
+    }
+    memset(tables, 0, sizeof tables);
+    for(e=0; e<POFLR_LPM_ENGINE_NUM; e++){
+        tables[e].type = POF_LPM_TABLE;
+        tables[e].size = num;
+        tables[e].keyLen = key_len;
+        tables[e].lpmEngine = e;
+        ns[e] = 0;
+        if(LPM_BENCH_SKIP(e, key_len)){
+            continue;
+        }
+        if(lpmEngineCreate(&tables[e]) != POF_OK || \
+                (ret[e] = MALLOC(LPM_BENCH_KEY_NUM * sizeof *ret[e])) == NULL){
+            goto out;
+        }
+    }
+    if((entries = MALLOC(num * sizeof *entries)) == NULL || \
+            (keys = MALLOC(LPM_BENCH_KEY_NUM * keyBytes)) == NULL){
+        goto out;
+    }
+
+    /* The random prefixes of 1 to key_len bits. */
+    srand(key_len + num);
+    for(i=0; i<num; i++){
+        memset(entries[i].mask, 0, keyBytes);
+        depth = 1 + rand() % key_len;
+        for(j=0; j<keyBytes; j++){
+            entries[i].value[j] = rand();
+            entries[i].mask[j] = (depth >= (j+1) * 8) ? 0xFF : \
+                (depth > j * 8) ? (uint8_t)(0xFF << ((j+1) * 8 - depth)) : 0;
+            entries[i].value[j] &= entries[i].mask[j];
+        }
+        for(e=0; e<POFLR_LPM_ENGINE_NUM; e++){
+            if(!LPM_BENCH_SKIP(e, key_len) && lpmInsert(&entries[i], &tables[e]) != POF_OK){
+                goto out;
+            }
+        }
+    }
+
+    for(i=0; i<LPM_BENCH_KEY_NUM; i++){
+        key = keys + i * keyBytes;
+        for(j=0; j<keyBytes; j++){
+            key[j] = rand();
+        }
+        if(i % 2){
+            continue;
+        }
+        e = rand() % num;
+        for(j=0; j<keyBytes; j++){
+            key[j] = (key[j] & ~entries[e].mask[j]) | entries[e].value[j];
+        }
+    }
+
+    *mismatch = 0;
+    for(e=0; e<POFLR_LPM_ENGINE_NUM; e++){
+        if(!LPM_BENCH_SKIP(e, key_len)){
+            ns[e] = lpmBenchRun(keys, keyBytes, lookup_num, &tables[e], ret[e]);
+        }
+    }
+    for(e=1; e<POFLR_LPM_ENGINE_NUM; e++){
+        for(i=0; i<POF_MIN(lookup_num, LPM_BENCH_KEY_NUM) && ret[e]; i++){
+            *mismatch += (ret[e][i] != ret[POFLR_LPM_TREE][i]);
+        }
+    }
+    result = POF_OK;
+
+out:
+    for(e=0; e<POFLR_LPM_ENGINE_NUM; e++){
+        lpmEngineDestroy(&tables[e]);
+        if(ret[e]){
+            FREE(ret[e]);
+        }
+    }
+    if(entries){
+        FREE(entries);
+    }
+    if(keys){
+        FREE(keys);
+    }
+    return result;
+}
+
 static uint32_t
 reply_table(const struct tableInfo *table, const struct pof_local_resource *lr)
 {
@@ -31,6 +31,7 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -48,12 +49,13 @@ map_groupCreate()
     return group;
 }
 
+/* The group is freed after the datapath tasks which may still apply it. */
 static void
 map_groupDelete(struct groupInfo *group, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->groupMap, &group->idNode);
     lr->groupNum --;
-    FREE(group);
+    rcu_free(group);
 }
 
 static void
@@ -66,7 +68,7 @@ map_groupInsert(struct groupInfo *group, struct pof_local_resource *lr)
 static hash_t
 map_groupHashByID(uint32_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
 }
 
 /* Fill the group information, including the hash value. */
@@ -79,6 +81,8 @@ groupFill(const struct pof_group *pofGroup, struct groupInfo *group)
     group->counter_id = pofGroup->counter_id;
     memcpy(group->action, pofGroup->action, \
             group->action_number * sizeof(struct pof_action));
+    poflr_act_code_compile(group->actCode, group->action, \
+            POF_MIN(group->action_number, POF_MAX_ACTION_NUMBER_PER_GROUP));
     group->idNode.hash = map_groupHashByID(group->id);
 }
 
@@ -127,11 +131,14 @@ poflr_add_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will modify the group entry in the group table.
+ *           The group is replaced by a new one instead of changed in
+ *           place, so the datapath applies either the old actions or
+ *           the new ones.
  ***********************************************************************/
 uint32_t 
 poflr_modify_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
 {
-    struct groupInfo *group;
+    struct groupInfo *group, *newGroup;
 
     /* Check group_id. */
     if(group_ptr->group_id >= lr->groupNumMax){
@@ -147,8 +154,13 @@ poflr_modify_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_COUNTER_ID, g_recv_xid);
     }
 
-    /* Modify the information of group. */
-    groupFill(group_ptr, group);
+    /* Insert the new group before the old one in the same bucket, and
+     * then delete the old one. */
+    newGroup = map_groupCreate();
+    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(newGroup, g_upward_xid++);
+    groupFill(group_ptr, newGroup);
+    map_groupInsert(newGroup, lr);
+    map_groupDelete(group, lr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify group entry SUC!");
     return POF_OK;
@@ -193,7 +205,7 @@ poflr_delete_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
 uint32_t poflr_init_group(struct pof_local_resource *lr){
 
     /* Initialize group map. */
-    lr->groupMap = hmap_create(lr->groupNumMax);
+    lr->groupMap = hmap_createFixed(lr->groupNumMax);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->groupMap);
 
 	return POF_OK;
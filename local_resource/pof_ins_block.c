@@ -31,6 +31,7 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
 
 #ifdef POF_SHT_VXLAN
 
@@ -45,12 +46,23 @@ map_insBlockCreate(uint16_t insSize)
     return insBlock;
 }
 
+static void
+map_insBlockFree(void *arg)
+{
+    struct insBlockInfo *insBlock = arg;
+    FREE(insBlock->prog.ops);
+    FREE(insBlock);
+}
+
+/* The block is freed after the datapath tasks which may still execute
+ * its program. */
 static void
 map_insBlockDelete(struct insBlockInfo *insBlock, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->insBlockMap, &insBlock->idNode);
     lr->insBlockNum --;
-    FREE(insBlock);
+    poflr_ins_program_renew(lr);
+    rcu_call(map_insBlockFree, insBlock);
 }
 
 static void
@@ -58,12 +70,13 @@ map_insBlockInsert(struct insBlockInfo *insBlock, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->insBlockMap, &insBlock->idNode);
     lr->insBlockNum ++;
+    poflr_ins_program_renew(lr);
 }
 
 static hash_t
 map_insBlockHashByID(uint32_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
 }
 
 /* Initialize instruction block resource. */
@@ -71,9 +84,9 @@ uint32_t
 poflr_init_insBlock(struct pof_local_resource *lr)
 {
     lr->insBlockNumMax = POFLR_INS_BLOCK_NUM;
-    /* Initialize meter table. */
-    lr->meterMap = hmap_create(lr->meterNumMax);
-    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->meterMap);
+    /* Initialize instruction block table. */
+    lr->insBlockMap = hmap_createFixed(lr->insBlockNumMax);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->insBlockMap);
 
 	return POF_OK;
 }
@@ -97,14 +110,22 @@ poflr_add_insBlock(struct pof_instruction_block *pof_insBlock, struct pof_local_
 
     insBlock = map_insBlockCreate(insSize);
     POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(insBlock, g_upward_xid++);
+    insBlock->prog.ops = (struct insOp *)MALLOC((insNum + 1) * sizeof(struct insOp));
+    if(!insBlock->prog.ops){
+        FREE(insBlock);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE, g_upward_xid++);
+    }
     insBlock->blockID = pof_insBlock->instruction_block_id;
     insBlock->idNode.hash = map_insBlockHashByID(insBlock->blockID);
-    map_insBlockInsert(insBlock, lr);
     insBlock->insNum = insNum;
     insBlock->tableID = pof_insBlock->related_table_id;
     insBlock->lr = lr;
     memcpy(insBlock->insData, pof_insBlock->instruction, insSize);
 
+    /* Decode the instructions before the block can be found. */
+    poflr_ins_program_compile(&insBlock->prog, insBlock->prog.ops, insBlock->insData, insNum, lr);
+    map_insBlockInsert(insBlock, lr);
+
     POF_DEBUG_CPRINT_FL(1,GREEN,"Add instruction block SUC!");
     return POF_OK;
 }
@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_datapath.h"
+#include <string.h>
+
+/* The next instruction of the raw instruction list. */
+static struct pof_instruction *
+insNext(struct pof_instruction *ins)
+{
+#ifdef POF_SHT_VXLAN
+    return (struct pof_instruction *)((uint8_t *)ins + ins->len);
+#else // POF_SHT_VXLAN
+    return ins + 1;
+#endif // POF_SHT_VXLAN
+}
+
+#ifdef POF_SHT_VXLAN
+/* The op jumped to from op i of n ops. Jumping forward to n means the
+ * program is done. */
+static uint16_t
+opJumpTarget(uint32_t i, uint8_t direction, uint32_t insNum, uint32_t n)
+{
+    if(direction == POFD_FORWARD){
+        return (insNum <= n - i) ? (i + insNum) : POFLR_INS_OP_BAD;
+    }else{
+        return (insNum <= i) ? (i - insNum) : POFLR_INS_OP_BAD;
+    }
+}
+#endif // POF_SHT_VXLAN
+
+/* The dense code of the instruction type. */
+static uint8_t
+insCode(uint16_t type)
+{
+    switch(type){
+#define INSTRUCTION(NAME,VALUE) case POFIT_##NAME: return POFLR_IC_##NAME;
+        INSTRUCTIONS
+#undef INSTRUCTION
+        default:
+            return POFLR_IC_BAD;
+    }
+}
+
+/* The dense code of the action type. */
+static uint8_t
+actCode(uint16_t type)
+{
+    switch(type){
+#define ACTION(NAME,VALUE) case POFAT_##NAME: return POFLR_AC_##NAME;
+        ACTIONS
+#undef ACTION
+        default:
+            return POFLR_AC_BAD;
+    }
+}
+
+/***********************************************************************
+ * Compile the actions to the codes of the threaded interpreter
+ * Form:     void poflr_act_code_compile(uint8_t *codes,
+ *                                       const struct pof_action *act,
+ *                                       uint8_t actNum)
+ * Input:    actions, action number
+ * Output:   codes with actNum slots
+ * Return:   VOID
+ * Discribe: This function gives each action its POFLR_AC_* code. The
+ *           first action of a common sequence gets the code of the
+ *           superinstruction running the whole sequence, while the
+ *           others keep their own codes.
+ ***********************************************************************/
+void
+poflr_act_code_compile(uint8_t *codes, const struct pof_action *act, uint8_t actNum)
+{
+    uint32_t i;
+
+    for(i=0; i<actNum; i++){
+        codes[i] = actCode(act->type);
+#ifdef POF_SHT_VXLAN
+        act = (const struct pof_action *)((const uint8_t *)act + act->len);
+#else // POF_SHT_VXLAN
+        act++;
+#endif // POF_SHT_VXLAN
+    }
+
+    for(i=0; i+1<actNum; i++){
+        if(codes[i] != POFLR_AC_SET_FIELD){
+            continue;
+        }
+        if(codes[i+1] == POFLR_AC_OUTPUT){
+            codes[i] = POFLR_AC_SET_FIELD_OUTPUT;
+        }else if(codes[i+1] == POFLR_AC_CALCULATE_CHECKSUM){
+            codes[i] = (i+2 < actNum && codes[i+2] == POFLR_AC_OUTPUT) ? \
+                       POFLR_AC_SET_FIELD_CHECKSUM_OUTPUT : POFLR_AC_SET_FIELD_CHECKSUM;
+        }
+    }
+}
+
+static void
+opTableSet(struct insOp *op, uint8_t tableID, uint16_t packetOffset, \
+           const struct pof_local_resource *lr)
+{
+    op->tableID = tableID;
+    op->packetOffset = (int16_t)packetOffset;
+    /* Check the ID first, so that a bad one is not reported upward
+     * until the op is executed. */
+    if(tableID >= lr->tableNumMax || \
+            poflr_table_ID_to_id(tableID, &op->tableType, &op->tableId, lr) != POF_OK){
+        op->tableType = POF_MAX_TABLE_TYPE;
+    }
+}
+
+/* Decode op i of n ops from the raw instruction. */
+static void
+opDecode(struct insOp *op, struct pof_instruction *ins, uint32_t i, uint32_t n, \
+         const struct pof_local_resource *lr)
+{
+    memset(op, 0, sizeof *op);
+    op->ins = ins;
+    op->type = ins->type;
+    op->code = insCode(ins->type);
+    op->next = i + 1;
+    op->jump = POFLR_INS_OP_BAD;
+
+    switch(ins->type){
+        case POFIT_GOTO_TABLE:
+        {
+            pof_instruction_goto_table *p = (pof_instruction_goto_table *)ins->instruction_data;
+            opTableSet(op, p->next_table_id, p->packet_offset, lr);
+            break;
+        }
+        case POFIT_GOTO_DIRECT_TABLE:
+        {
+            pof_instruction_goto_direct_table *p = (pof_instruction_goto_direct_table *)ins->instruction_data;
+            opTableSet(op, p->next_table_id, p->packet_offset, lr);
+            break;
+        }
+        case POFIT_APPLY_ACTIONS:
+        {
+            pof_instruction_apply_actions *p = (pof_instruction_apply_actions *)ins->instruction_data;
+            if(p->action_num <= POF_MAX_ACTION_NUMBER_PER_INSTRUCTION){
+                poflr_act_code_compile(op->actCode, p->action, p->action_num);
+            }
+            break;
+        }
+        case POFIT_METER:
+        {
+            pof_instruction_meter *p = (pof_instruction_meter *)ins->instruction_data;
+#ifdef POF_SHT_VXLAN
+            op->meterImm = (p->id_type == POFVT_IMMEDIATE_NUM);
+            op->meterID = p->meter_id.value;
+#else // POF_SHT_VXLAN
+            op->meterImm = TRUE;
+            op->meterID = p->meter_id;
+#endif // POF_SHT_VXLAN
+            break;
+        }
+#ifdef POF_SHT_VXLAN
+        case POFIT_BRANCH:
+        {
+            struct pof_instruction_branch *p = (struct pof_instruction_branch *)ins->instruction_data;
+            op->jump = opJumpTarget(i, POFD_FORWARD, p->skip_instruction_num, n);
+            break;
+        }
+        case POFIT_JMP:
+        {
+            /* The op after the one jumped to, as the JMP also moves on. */
+            struct pof_instruction_jmp *p = (struct pof_instruction_jmp *)ins->instruction_data;
+            op->jump = opJumpTarget(i, p->direction, p->instruction_num, n);
+            if(op->jump != POFLR_INS_OP_BAD){
+                op->jump = POF_MIN(op->jump + 1, n);
+            }
+            break;
+        }
+#endif // POF_SHT_VXLAN
+        default:
+            break;
+    }
+}
+
+/* Resolve the pointers of the ops with the current objects. */
+static void
+programResolve(struct insProgram *prog, const struct pof_local_resource *lr)
+{
+    struct insOp *op;
+    uint32_t i;
+
+    for(i=0; i<prog->opNum; i++){
+        op = &prog->ops[i];
+        switch(op->type){
+            case POFIT_GOTO_TABLE:
+            case POFIT_GOTO_DIRECT_TABLE:
+                __atomic_store_n(&op->table, (op->tableType == POF_MAX_TABLE_TYPE) ? NULL : \
+                                 poflr_get_table_with_ID(op->tableID, lr), __ATOMIC_RELEASE);
+                break;
+            case POFIT_METER:
+                __atomic_store_n(&op->meter, op->meterImm ? \
+                                 poflr_get_meter_with_ID(op->meterID, lr) : NULL, __ATOMIC_RELEASE);
+                break;
+            default:
+                break;
+        }
+    }
+    /* The datapath loads the gen with acquire before the pointers. */
+    __atomic_store_n(&prog->gen, lr->insGen, __ATOMIC_RELEASE);
+}
+
+/***********************************************************************
+ * Compile the instructions to a program
+ * Form:     void poflr_ins_program_compile(struct insProgram *prog,
+ *                                          struct insOp *ops,
+ *                                          struct pof_instruction *ins,
+ *                                          uint8_t insNum,
+ *                                          const struct pof_local_resource *lr)
+ * Input:    ops with insNum slots, instructions, instruction number, lr
+ * Output:   prog
+ * Return:   VOID
+ * Discribe: This function decodes the insNum instructions to ops, and
+ *           resolves the tables and meters of the immediate IDs. The
+ *           ops refer to the instructions, which should live as long
+ *           as the program. A bad table ID or jump is not refused
+ *           here, but fails when the op is executed as before.
+ ***********************************************************************/
+void
+poflr_ins_program_compile(struct insProgram *prog, struct insOp *ops, \
+                          struct pof_instruction *ins, uint8_t insNum, \
+                          const struct pof_local_resource *lr)
+{
+    uint32_t i;
+
+    for(i=0; i<insNum; i++){
+        opDecode(&ops[i], ins, i, insNum, lr);
+        ins = insNext(ins);
+    }
+    prog->ops = ops;
+    prog->opNum = insNum;
+    programResolve(prog, lr);
+}
+
+/* Compile the instructions of the entry, or resolve its instruction
+ * block. */
+void
+poflr_ins_program_entry(struct entryInfo *entry, const struct pof_local_resource *lr)
+{
+#ifdef POF_SHT_VXLAN
+    __atomic_store_n(&entry->insBlock, poflr_get_insBlock_with_ID(entry->insBlockID, lr), \
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->insGen, lr->insGen, __ATOMIC_RELEASE);
+#else // POF_SHT_VXLAN
+    poflr_ins_program_compile(&entry->prog, entry->ops, entry->instruction, \
+            POF_MIN(entry->instruction_num, POF_MAX_INSTRUCTION_NUM), lr);
+#endif // POF_SHT_VXLAN
+}
+
+/***********************************************************************
+ * Renew the instruction programs
+ * Form:     void poflr_ins_program_renew(struct pof_local_resource *lr)
+ * Input:    lr
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function should be called when a table, meter or
+ *           instruction block is added, and when one is deleted after
+ *           it is removed from lr but before it is freed. The new
+ *           generation stops the datapath using the old pointers, and
+ *           then all the programs are resolved again. The programs
+ *           not resolved, such as those of the entries being freed,
+ *           make the datapath find the objects by ID.
+ ***********************************************************************/
+void
+poflr_ins_program_renew(struct pof_local_resource *lr)
+{
+    struct tableInfo *table;
+    struct entryInfo *entry, *next;
+#ifdef POF_SHT_VXLAN
+    struct insBlockInfo *insBlock, *nextBlock;
+#endif // POF_SHT_VXLAN
+    uint32_t i;
+
+    __atomic_store_n(&lr->insGen, lr->insGen + 1, __ATOMIC_RELEASE);
+
+    programResolve(&lr->firstProg, lr);
+#ifdef POF_SHT_VXLAN
+    if(lr->insBlockMap){
+        HMAP_NODES_IN_STRUCT_TRAVERSE(insBlock, nextBlock, idNode, lr->insBlockMap){
+            programResolve(&insBlock->prog, lr);
+        }
+    }
+#endif // POF_SHT_VXLAN
+    for(i=0; i<=POFLR_TABLE_ID_MAX; i++){
+        if(!(table = lr->tables[i])){
+            continue;
+        }
+        HMAP_NODES_IN_STRUCT_TRAVERSE(entry, next, node, table->entryMap){
+#ifdef POF_SHT_VXLAN
+            poflr_ins_program_entry(entry, lr);
+#else // POF_SHT_VXLAN
+            programResolve(&entry->prog, lr);
+#endif // POF_SHT_VXLAN
+        }
+    }
+}
+
+/* Initialize the program going to the first table, which every packet
+ * starts with. */
+uint32_t
+poflr_init_ins_program(struct pof_local_resource *lr)
+{
+    struct insOp *op = &lr->firstOp;
+
+    memset(op, 0, sizeof *op);
+    op->type = POFIT_GOTO_TABLE;
+    op->code = POFLR_IC_GOTO_TABLE;
+    op->next = 1;
+    op->jump = POFLR_INS_OP_BAD;
+    opTableSet(op, POFDP_FIRST_TABLE_ID, 0, lr);
+
+    lr->firstProg.ops = op;
+    lr->firstProg.opNum = 1;
+    lr->insGen = 1;
+    programResolve(&lr->firstProg, lr);
+    return POF_OK;
+}
@@ -96,8 +96,8 @@ uint32_t poflr_reply_config(){
  * Output:   NONE
  * Return:   POF_OK or ERROR code
  * Discribe: This function will initialize the local table resource
- *           including the flow tables, group table, meter table and
- *           counter table.
+ *           including the flow tables, group table, meter table,
+ *           counter table and the first instruction program.
  ***********************************************************************/
 uint32_t poflr_init_table_resource(struct pof_local_resource * lr){
     pof_table_resource_desc *tbl_rsc_desc_ptr;
@@ -116,6 +116,9 @@ uint32_t poflr_init_table_resource(struct pof_local_resource * lr){
     ret = poflr_init_counter(lr);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
+    ret = poflr_init_ins_program(lr);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
     poflr_get_key_len(&key_len_ptr);
 
     /* Initialize table resource description of each type of table. */
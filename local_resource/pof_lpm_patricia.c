@@ -0,0 +1,334 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* Path-compressed trie. Every node holds the prefix of len bits, and the
+ * children split at the bit len. The bits skipped between a node and its
+ * child are checked when the lookup enters the child. */
+struct patNode {
+    uint32_t child[2];      /* Index of the node pool. 0 if none. */
+    uint16_t len;
+    struct entryInfo *entry;    /* The latest one of the same prefix. The
+                                 * former ones are chained by lpmNext. */
+};
+
+struct lpmPatricia {
+    struct patNode *nodes;  /* The node 0 is the root of len 0. */
+    uint8_t *prefixes;      /* The prefix of each node. */
+    uint32_t prefixSize;
+    uint32_t keyBytes;
+    uint32_t nodeMax;
+    uint32_t nodeNum;
+    struct rcuPool nodePool;    /* The nodes to reuse. */
+};
+
+#define PAT_PREFIX(pt,n)    ((pt)->prefixes + (size_t)(n) * (pt)->prefixSize)
+
+static inline uint32_t
+patBit(const uint8_t *p, uint32_t bit)
+{
+    return (p[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/* The 64 bits from the word of index w, with the first bit as the MSB.
+ * All the buffers are padded to the multiple of 8 bytes. */
+static inline uint64_t
+patWord(const uint8_t *p, uint32_t w)
+{
+    uint64_t word;
+    memcpy(&word, p + w * 8, 8);
+    return __builtin_bswap64(word);
+}
+
+/* Return the first bit in [from, to) where a and b differ, or to if none. */
+static inline uint32_t
+patMismatch(const uint8_t *a, const uint8_t *b, uint32_t from, uint32_t to)
+{
+    uint64_t diff;
+    uint32_t w;
+
+    if(from >= to){
+        return to;
+    }
+    for(w=from/64; w*64<to; w++){
+        diff = patWord(a, w) ^ patWord(b, w);
+        if(w == from/64 && from % 64){
+            diff &= ~0ULL >> (from % 64);
+        }
+        if(diff){
+            return POF_MIN(w * 64 + __builtin_clzll(diff), to);
+        }
+    }
+    return to;
+}
+
+static uint32_t
+patNodeAlloc(struct lpmPatricia *pt, const uint8_t *prefix, uint32_t len, \
+             struct entryInfo *entry)
+{
+    struct patNode *node;
+    uint8_t *p;
+    uint32_t n, i;
+
+    if(rcu_poolGet(&pt->nodePool, &n)){
+        /* Reused. */
+    }else if(pt->nodeNum < pt->nodeMax){
+        n = pt->nodeNum ++;
+    }else{
+        return 0;
+    }
+
+    node = &pt->nodes[n];
+    node->child[0] = node->child[1] = 0;
+    node->len = len;
+    node->entry = entry;
+    if(entry){
+        entry->lpmNext = NULL;
+    }
+    p = PAT_PREFIX(pt, n);
+    memset(p, 0, pt->prefixSize);
+    for(i=0; i<len/8; i++){
+        p[i] = prefix[i];
+    }
+    if(len % 8){
+        p[i] = prefix[i] & (uint8_t)(0xFF << (8 - len % 8));
+    }
+    return n;
+}
+
+/* The lookups may still stand on the node, so it is reused by the later
+ * inserts only after a grace period. */
+static void
+patNodeFree(struct lpmPatricia *pt, uint32_t n)
+{
+    rcu_poolRetire(&pt->nodePool, n);
+}
+
+/***********************************************************************
+ * Create the Patricia trie of the LPM table
+ * Form:     uint32_t poflr_patricia_create(struct tableInfo *table)
+ * Input:    table
+ * Output:   table->patricia
+ * Return:   POF_OK or Error code
+ * Discribe: This function allocates the node pool of the trie. Every
+ *           prefix adds one node and one split node at most, so the pool
+ *           has 2 * table->size nodes besides the root, and two more for
+ *           the new prefix of a modified entry.
+ ***********************************************************************/
+uint32_t
+poflr_patricia_create(struct tableInfo *table)
+{
+    struct lpmPatricia *pt;
+
+    POF_MALLOC_SAFE_RETURN(pt, 1, POF_ERROR);
+    table->patricia = pt;
+    pt->keyBytes = POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen);
+    pt->prefixSize = (pt->keyBytes + 7) / 8 * 8;
+    pt->nodeMax = 2 * (table->size + 1) + 1;
+    pt->nodeNum = 1;
+
+    if((pt->nodes = calloc(pt->nodeMax, sizeof *pt->nodes)) == NULL || \
+            (pt->prefixes = calloc(pt->nodeMax, pt->prefixSize)) == NULL || \
+            rcu_poolInit(&pt->nodePool, pt->nodeMax) != POF_OK){
+        poflr_patricia_destroy(table);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    return POF_OK;
+}
+
+void
+poflr_patricia_destroy(struct tableInfo *table)
+{
+    struct lpmPatricia *pt = table->patricia;
+
+    if(!pt){
+        return;
+    }
+    free(pt->nodes);
+    free(pt->prefixes);
+    rcu_poolDestroy(&pt->nodePool);
+    FREE(pt);
+    table->patricia = NULL;
+}
+
+/* Insert the prefix of depth bits. The same prefix inserted later
+ * overrides the former one. */
+uint32_t
+poflr_patricia_insert(struct entryInfo *entry, uint32_t depth, struct tableInfo *table)
+{
+    struct lpmPatricia *pt = table->patricia;
+    uint8_t prefix[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] = {0};
+    uint32_t n = 0, c, m, b, split, leaf, i;
+
+    for(i=0; i<pt->keyBytes; i++){
+        prefix[i] = entry->value[i] & entry->mask[i];
+    }
+
+    while(pt->nodes[n].len < depth){
+        b = patBit(prefix, pt->nodes[n].len);
+        if((c = pt->nodes[n].child[b]) == 0){
+            if((leaf = patNodeAlloc(pt, prefix, depth, entry)) == 0){
+                POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+            }
+            __atomic_store_n(&pt->nodes[n].child[b], leaf, __ATOMIC_RELEASE);
+            return POF_OK;
+        }
+
+        m = patMismatch(prefix, PAT_PREFIX(pt, c), pt->nodes[n].len, \
+                        POF_MIN(pt->nodes[c].len, depth));
+        if(m == pt->nodes[c].len){
+            n = c;
+            continue;
+        }
+
+        /* The prefix splits the edge to the child. */
+        if(m == depth){
+            if((split = patNodeAlloc(pt, prefix, depth, entry)) == 0){
+                POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+            }
+            pt->nodes[split].child[patBit(PAT_PREFIX(pt, c), depth)] = c;
+        }else{
+            if(rcu_poolAvailable(&pt->nodePool) + pt->nodeMax - pt->nodeNum < 2){
+                POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+            }
+            split = patNodeAlloc(pt, prefix, m, NULL);
+            leaf = patNodeAlloc(pt, prefix, depth, entry);
+            pt->nodes[split].child[patBit(PAT_PREFIX(pt, c), m)] = c;
+            pt->nodes[split].child[patBit(prefix, m)] = leaf;
+        }
+        __atomic_store_n(&pt->nodes[n].child[b], split, __ATOMIC_RELEASE);
+        return POF_OK;
+    }
+
+    entry->lpmNext = pt->nodes[n].entry;
+    __atomic_store_n(&pt->nodes[n].entry, entry, __ATOMIC_RELEASE);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Delete the prefix from the Patricia trie
+ * Form:     uint32_t poflr_patricia_delete(struct entryInfo *entry, uint32_t depth,
+ *                                          struct tableInfo *table)
+ * Input:    entry, prefix depth, table
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function clears the entry of the node of the prefix. If
+ *           another entry of the same prefix is chained after it, the
+ *           node takes it instead. The nodes left with no entry and
+ *           one child at most are removed from the trie.
+ ***********************************************************************/
+uint32_t
+poflr_patricia_delete(struct entryInfo *entry, uint32_t depth, struct tableInfo *table)
+{
+    struct lpmPatricia *pt = table->patricia;
+    struct entryInfo *tmp;
+    uint8_t prefix[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] = {0};
+    uint32_t path[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM * 8 + 1];
+    uint32_t pathNum = 0, n = 0, c, i, only;
+    struct patNode *cur, *parent;
+
+    for(i=0; i<pt->keyBytes; i++){
+        prefix[i] = entry->value[i] & entry->mask[i];
+    }
+
+    while(pt->nodes[n].len < depth){
+        path[pathNum ++] = n;
+        c = pt->nodes[n].child[patBit(prefix, pt->nodes[n].len)];
+        if(c == 0 || pt->nodes[c].len > depth || \
+                patMismatch(prefix, PAT_PREFIX(pt, c), pt->nodes[n].len, \
+                            pt->nodes[c].len) != pt->nodes[c].len){
+            return POF_OK;
+        }
+        n = c;
+    }
+    if(pt->nodes[n].entry != entry){
+        /* The former entry of the prefix is not looked up. Unchain it. */
+        for(tmp = pt->nodes[n].entry; tmp; tmp = tmp->lpmNext){
+            if(tmp->lpmNext == entry){
+                tmp->lpmNext = entry->lpmNext;
+                break;
+            }
+        }
+        return POF_OK;
+    }
+    __atomic_store_n(&pt->nodes[n].entry, entry->lpmNext, __ATOMIC_RELEASE);
+
+    /* Remove the nodes which do not split the prefixes any more. */
+    while(n && pathNum){
+        cur = &pt->nodes[n];
+        if(cur->entry || (cur->child[0] && cur->child[1])){
+            break;
+        }
+        only = cur->child[0] ? cur->child[0] : cur->child[1];
+        parent = &pt->nodes[path[-- pathNum]];
+        __atomic_store_n(&parent->child[parent->child[1] == n], only, __ATOMIC_RELEASE);
+        patNodeFree(pt, n);
+        if(only){
+            break;
+        }
+        n = path[pathNum];
+    }
+    return POF_OK;
+}
+
+/* Lookup the longest prefix matching the key. */
+struct entryInfo *
+poflr_patricia_lookup(const uint8_t *key, const struct tableInfo *table)
+{
+    const struct lpmPatricia *pt = table->patricia;
+    const struct patNode *node = &pt->nodes[0];
+    struct entryInfo *ret = __atomic_load_n(&node->entry, __ATOMIC_ACQUIRE), *entry;
+    uint8_t buf[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] POF_CACHE_ALIGNED;
+    uint32_t c;
+
+    /* Pad the key for the word loads. */
+    memcpy(buf, key, pt->keyBytes);
+    memset(buf + pt->keyBytes, 0, pt->prefixSize - pt->keyBytes);
+    key = buf;
+
+    while(node->len < table->keyLen){
+        c = __atomic_load_n(&node->child[patBit(key, node->len)], __ATOMIC_ACQUIRE);
+        /* The bit of node->len has chosen the child. Only the skipped
+         * bits after it are checked. */
+        if(c == 0 || patMismatch(key, PAT_PREFIX(pt, c), node->len + 1, \
+                                 pt->nodes[c].len) != pt->nodes[c].len){
+            break;
+        }
+        node = &pt->nodes[c];
+        if((entry = __atomic_load_n(&node->entry, __ATOMIC_ACQUIRE)) != NULL){
+            ret = entry;
+        }
+    }
+    return ret;
+}
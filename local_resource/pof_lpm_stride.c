@@ -0,0 +1,422 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* One slot of the stride tables. The slot refers either to the rule of
+ * the longest prefix covering it, or to the group of the next stride. */
+#define SLOT_VALID          (0x80000000)
+#define SLOT_EXT            (0x40000000)
+#define SLOT_DEPTH_SHIFT    (20)
+#define SLOT_DEPTH_MASK     (0x3FF)
+#define SLOT_VALUE_MASK     (0xFFFFF)
+#define SLOT_DEPTH(s)       (((s) >> SLOT_DEPTH_SHIFT) & SLOT_DEPTH_MASK)
+#define SLOT_VALUE(s)       ((s) & SLOT_VALUE_MASK)
+#define SLOT_RULE(rule,depth)   (SLOT_VALID | ((depth) << SLOT_DEPTH_SHIFT) | (rule))
+#define SLOT_GROUP(group)       (SLOT_EXT | (group))
+
+#define GROUP_SLOTS         (256)   /* The stride after the first is 8. */
+
+/* Multibit trie. The first stride is 24 bits for the keys up to 32 bits
+ * (DIR-24-8), and 16 bits for the longer keys (16-8-8-...). */
+struct lpmStride {
+    uint32_t *first;
+    uint32_t firstBits;
+
+    uint32_t **groups;
+    uint32_t groupNum;
+    uint32_t groupMax;
+    struct rcuPool groupPool;       /* The groups to reuse. */
+
+    struct entryInfo **rules;
+    uint32_t ruleMax;
+    struct rcuPool rulePool;
+
+    /* The rules hashed by prefix and depth, for the delete to find the
+     * covering prefix. Only the writer reads them. */
+    struct hmap *prefixMap;
+    struct hnode *ruleNodes;
+    uint32_t *depthRules;           /* Number of the rules of each depth. */
+};
+
+static uint32_t
+strideFirstIndex(const struct lpmStride *ls, const uint8_t *key)
+{
+    uint32_t i, index = 0;
+    for(i=0; i<ls->firstBits/8; i++){
+        index = (index << 8) | key[i];
+    }
+    return index;
+}
+
+static uint32_t
+strideGroupAlloc(struct lpmStride *ls, uint32_t slot)
+{
+    uint32_t group, i;
+
+    if(rcu_poolGet(&ls->groupPool, &group)){
+        /* Reused. */
+    }else if(ls->groupNum < ls->groupMax){
+        group = ls->groupNum;
+        if((ls->groups[group] = MALLOC(GROUP_SLOTS * sizeof(uint32_t))) == NULL){
+            POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+            return SLOT_VALUE_MASK;
+        }
+        ls->groupNum ++;
+    }else{
+        return SLOT_VALUE_MASK;
+    }
+
+    /* The new group inherits the rule of the slot it extends. */
+    for(i=0; i<GROUP_SLOTS; i++){
+        ls->groups[group][i] = slot;
+    }
+    return group;
+}
+
+/* The group is not freed, as the lookups may still walk it. It is only
+ * reused by the later inserts after a grace period. */
+static void
+strideGroupFree(struct lpmStride *ls, uint32_t group)
+{
+    rcu_poolRetire(&ls->groupPool, group);
+}
+
+/* Set the slots not covered by a longer prefix to the new slot. */
+static void
+strideRangeSet(struct lpmStride *ls, uint32_t *slots, uint32_t first, \
+               uint32_t count, uint32_t depth, uint32_t slot)
+{
+    uint32_t i, s;
+    for(i=first; i<first+count; i++){
+        s = slots[i];
+        if(s & SLOT_EXT){
+            strideRangeSet(ls, ls->groups[SLOT_VALUE(s)], 0, GROUP_SLOTS, depth, slot);
+        }else if(!(s & SLOT_VALID) || SLOT_DEPTH(s) <= depth){
+            __atomic_store_n(&slots[i], slot, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* Replace the slots of the deleted prefix with the covering prefix. */
+static void
+strideRangeReplace(struct lpmStride *ls, uint32_t *slots, uint32_t first, \
+                   uint32_t count, uint32_t depth, uint32_t slot)
+{
+    uint32_t i, s;
+    for(i=first; i<first+count; i++){
+        s = slots[i];
+        if(s & SLOT_EXT){
+            strideRangeReplace(ls, ls->groups[SLOT_VALUE(s)], 0, GROUP_SLOTS, depth, slot);
+        }else if((s & SLOT_VALID) && SLOT_DEPTH(s) == depth){
+            __atomic_store_n(&slots[i], slot, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* Fold the group back to its parent slot if all its slots are the same
+ * rule. */
+static void
+strideGroupFold(struct lpmStride *ls, uint32_t *parent)
+{
+    uint32_t group = SLOT_VALUE(*parent), *slots = ls->groups[group], i;
+
+    for(i=1; i<GROUP_SLOTS; i++){
+        if(slots[i] != slots[0]){
+            return;
+        }
+    }
+    if(slots[0] & SLOT_EXT){
+        return;
+    }
+    __atomic_store_n(parent, slots[0], __ATOMIC_RELEASE);
+    strideGroupFree(ls, group);
+}
+
+/* Walk to the slots of the prefix, creating the groups on the way if
+ * create. Return the slots of the last stride, and the path of the parent
+ * slots of the groups. */
+static uint32_t *
+strideWalk(struct lpmStride *ls, const uint8_t *prefix, uint32_t depth, bool create, \
+           uint32_t *first, uint32_t *count, uint32_t **path, uint32_t *pathNum)
+{
+    uint32_t *slots = ls->first, *slot, bits = ls->firstBits, byte = ls->firstBits / 8;
+    uint32_t group;
+
+    *first = strideFirstIndex(ls, prefix);
+    *pathNum = 0;
+    while(depth > bits){
+        slot = &slots[*first];
+        if(!(*slot & SLOT_EXT)){
+            if(!create){
+                return NULL;
+            }
+            if((group = strideGroupAlloc(ls, *slot)) == SLOT_VALUE_MASK){
+                return NULL;
+            }
+            __atomic_store_n(slot, SLOT_GROUP(group), __ATOMIC_RELEASE);
+        }
+        path[(*pathNum) ++] = slot;
+        slots = ls->groups[SLOT_VALUE(*slot)];
+        *first = prefix[byte ++];
+        bits += 8;
+    }
+    *count = 1 << (bits - depth);
+    return slots;
+}
+
+static hash_t
+strideHash(const uint8_t *prefix, uint32_t depth, uint16_t keyLen)
+{
+    return hmap_hashForBytes(prefix, POF_BITNUM_TO_BYTENUM_CEIL(keyLen)) ^ hmap_hashForUint32(depth);
+}
+
+/* Find the rule other than except with the prefix of depth bits. */
+static uint32_t
+strideRuleFind(const struct lpmStride *ls, const uint8_t *prefix, uint32_t depth, \
+               uint16_t keyLen, uint32_t except)
+{
+    const struct entryInfo *tmp;
+    struct hnode *node;
+    hash_t hash = strideHash(prefix, depth, keyLen);
+    uint32_t rule, i, d;
+
+    for(node = hmap_nodeGetWithHash(ls->prefixMap, hash); node; node = node->next){
+        if(node->hash != hash || (rule = node - ls->ruleNodes) == except){
+            continue;
+        }
+        tmp = ls->rules[rule];
+        for(i=0, d=0; i<POF_BITNUM_TO_BYTENUM_CEIL(keyLen); i++){
+            if((tmp->value[i] & tmp->mask[i]) != prefix[i]){
+                break;
+            }
+            d += __builtin_popcount(tmp->mask[i]);
+        }
+        if(i == POF_BITNUM_TO_BYTENUM_CEIL(keyLen) && d == depth){
+            return rule;
+        }
+    }
+    return SLOT_VALUE_MASK;
+}
+
+static uint32_t
+strideMaxStrides(const struct tableInfo *table, uint32_t firstBits)
+{
+    return (table->keyLen > firstBits) ? (table->keyLen - firstBits + 7) / 8 : 0;
+}
+
+static void
+stridePrefix(uint8_t *prefix, const struct entryInfo *entry, uint16_t keyLen)
+{
+    uint32_t i;
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(keyLen); i++){
+        prefix[i] = entry->value[i] & entry->mask[i];
+    }
+}
+
+/***********************************************************************
+ * Create the multibit trie of the LPM table
+ * Form:     uint32_t poflr_stride_create(struct tableInfo *table)
+ * Input:    table
+ * Output:   table->stride
+ * Return:   POF_OK or Error code
+ * Discribe: This function allocates the first stride table, and the
+ *           group list large enough for table->size prefixes of the key
+ *           length. The pages of the first stride table are not touched
+ *           until the prefixes are inserted. One more rule is kept for
+ *           the new prefix of a modified entry.
+ ***********************************************************************/
+uint32_t
+poflr_stride_create(struct tableInfo *table)
+{
+    struct lpmStride *ls;
+    uint32_t bits = (table->keyLen + 7) / 8 * 8, i;
+
+    POF_MALLOC_SAFE_RETURN(ls, 1, POF_ERROR);
+    table->stride = ls;
+    ls->firstBits = POF_MIN(bits, (table->keyLen <= 32) ? 24 : 16);
+    if(ls->firstBits == 0){
+        ls->firstBits = 8;
+    }
+    ls->groupMax = POF_MIN(table->size * strideMaxStrides(table, ls->firstBits), SLOT_VALUE_MASK);
+    ls->ruleMax = POF_MIN(table->size + 1, SLOT_VALUE_MASK);
+
+    if((ls->first = calloc((size_t)1 << ls->firstBits, sizeof(uint32_t))) == NULL || \
+            (ls->groupMax && (ls->groups = MALLOC(ls->groupMax * sizeof *ls->groups)) == NULL) || \
+            rcu_poolInit(&ls->groupPool, ls->groupMax) != POF_OK || \
+            (ls->rules = MALLOC(ls->ruleMax * sizeof *ls->rules)) == NULL || \
+            rcu_poolInit(&ls->rulePool, ls->ruleMax) != POF_OK || \
+            (ls->prefixMap = hmap_create(ls->ruleMax)) == NULL || \
+            (ls->ruleNodes = MALLOC(ls->ruleMax * sizeof *ls->ruleNodes)) == NULL || \
+            (ls->depthRules = calloc(bits + 1, sizeof *ls->depthRules)) == NULL){
+        poflr_stride_destroy(table);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    for(i=0; i<ls->ruleMax; i++){
+        rcu_poolPut(&ls->rulePool, ls->ruleMax - i - 1);
+    }
+    return POF_OK;
+}
+
+void
+poflr_stride_destroy(struct tableInfo *table)
+{
+    struct lpmStride *ls = table->stride;
+    uint32_t i;
+
+    if(!ls){
+        return;
+    }
+    free(ls->first);
+    for(i=0; i<ls->groupNum; i++){
+        FREE(ls->groups[i]);
+    }
+    if(ls->groups){
+        FREE(ls->groups);
+    }
+    rcu_poolDestroy(&ls->groupPool);
+    if(ls->rules){
+        FREE(ls->rules);
+    }
+    rcu_poolDestroy(&ls->rulePool);
+    if(ls->prefixMap){
+        hmap_destroy(ls->prefixMap);
+    }
+    if(ls->ruleNodes){
+        FREE(ls->ruleNodes);
+    }
+    free(ls->depthRules);
+    FREE(ls);
+    table->stride = NULL;
+}
+
+/* Insert the prefix of depth bits. The same prefix inserted later
+ * overrides the former one. */
+uint32_t
+poflr_stride_insert(struct entryInfo *entry, uint32_t depth, struct tableInfo *table)
+{
+    struct lpmStride *ls = table->stride;
+    uint8_t prefix[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] = {0};
+    uint32_t *slots, *path[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint32_t first, count, pathNum, rule;
+
+    if(depth > SLOT_DEPTH_MASK || rcu_poolAvailable(&ls->rulePool) == 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    stridePrefix(prefix, entry, table->keyLen);
+    if((slots = strideWalk(ls, prefix, depth, TRUE, &first, &count, path, &pathNum)) == NULL){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+
+    rcu_poolGet(&ls->rulePool, &rule);
+    ls->rules[rule] = entry;
+    entry->lpmRule = rule;
+    ls->ruleNodes[rule].hash = strideHash(prefix, depth, table->keyLen);
+    hmap_nodeInsert(ls->prefixMap, &ls->ruleNodes[rule]);
+    ls->depthRules[depth] ++;
+    strideRangeSet(ls, slots, first, count, depth, SLOT_RULE(rule, depth));
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Delete the prefix from the multibit trie
+ * Form:     uint32_t poflr_stride_delete(struct entryInfo *entry, uint32_t depth,
+ *                                        struct tableInfo *table)
+ * Input:    entry, prefix depth, table
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function finds the longest prefix left in the table
+ *           covering the deleted one, by looking up the prefix map with
+ *           the deleted prefix cut to each shorter depth, and replaces the slots of the
+ *           deleted prefix with it. The groups left with only one rule
+ *           are folded back to their parent slots. The rule of the
+ *           deleted prefix still refers to its entry, for the lookups
+ *           which have read the old slots, until it is reused after a
+ *           grace period.
+ ***********************************************************************/
+uint32_t
+poflr_stride_delete(struct entryInfo *entry, uint32_t depth, struct tableInfo *table)
+{
+    struct lpmStride *ls = table->stride;
+    uint8_t prefix[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] = {0};
+    uint8_t cut[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint32_t *slots, *path[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint32_t first, count, pathNum, slot = 0, d, cover, rule = entry->lpmRule;
+
+    if(rule >= ls->ruleMax || ls->rules[rule] != entry){
+        return POF_ERROR;
+    }
+    hmap_nodeDelete(ls->prefixMap, &ls->ruleNodes[rule]);
+    ls->depthRules[depth] --;
+
+    /* Find the longest prefix covering the deleted one. The bits from d
+     * on are cleared before looking up the depth d. */
+    stridePrefix(prefix, entry, table->keyLen);
+    memcpy(cut, prefix, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+    for(d=depth+1; d-- > 0; ){
+        if(d < depth){
+            cut[d / 8] &= ~(0x80 >> (d % 8));
+        }
+        if(ls->depthRules[d] && \
+                (cover = strideRuleFind(ls, cut, d, table->keyLen, rule)) != SLOT_VALUE_MASK){
+            slot = SLOT_RULE(cover, d);
+            break;
+        }
+    }
+
+    if((slots = strideWalk(ls, prefix, depth, FALSE, &first, &count, path, &pathNum)) != NULL){
+        strideRangeReplace(ls, slots, first, count, depth, slot);
+        while(pathNum){
+            strideGroupFold(ls, path[-- pathNum]);
+        }
+    }
+
+    /* The grace period of the rule starts only after no slot refers to
+     * it, so no lookup finds it reused. */
+    rcu_poolRetire(&ls->rulePool, rule);
+    return POF_OK;
+}
+
+/* Lookup the longest prefix matching the key. */
+struct entryInfo *
+poflr_stride_lookup(const uint8_t *key, const struct tableInfo *table)
+{
+    const struct lpmStride *ls = table->stride;
+    uint32_t slot, byte = ls->firstBits / 8;
+
+    slot = __atomic_load_n(&ls->first[strideFirstIndex(ls, key)], __ATOMIC_ACQUIRE);
+    while(slot & SLOT_EXT){
+        slot = __atomic_load_n(&ls->groups[SLOT_VALUE(slot)][key[byte ++]], __ATOMIC_ACQUIRE);
+    }
+    return (slot & SLOT_VALID) ? ls->rules[SLOT_VALUE(slot)] : NULL;
+}
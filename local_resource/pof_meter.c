@@ -31,6 +31,7 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -48,12 +49,15 @@ map_meterCreate()
     return meter;
 }
 
+/* The meter is freed after the datapath tasks which may still use the
+ * pointer resolved before the renewal. */
 static void
 map_meterDelete(struct meterInfo *meter, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->meterMap, &meter->idNode);
     lr->meterNum --;
-    FREE(meter);
+    poflr_ins_program_renew(lr);
+    rcu_free(meter);
 }
 
 static void
@@ -61,12 +65,13 @@ map_meterInsert(struct meterInfo *meter, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->meterMap, &meter->idNode);
     lr->meterNum ++;
+    poflr_ins_program_renew(lr);
 }
 
 static hash_t
 map_meterHashByID(uint32_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
 }
 
 /***********************************************************************
@@ -163,7 +168,7 @@ poflr_delete_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_reso
 uint32_t poflr_init_meter(struct pof_local_resource *lr){
 
     /* Initialize meter table. */
-    lr->meterMap = hmap_create(lr->meterNumMax);
+    lr->meterMap = hmap_createFixed(lr->meterNumMax);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->meterMap);
 
 	return POF_OK;
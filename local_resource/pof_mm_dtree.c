@@ -0,0 +1,543 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* A node of the decision tree. The inner node tests one bit of the key,
+ * and the leaf holds the rules reaching it in descending priority. */
+struct dtreeNode {
+    struct dtreeNode *child[2];     /* Both NULL for leaf. */
+    uint16_t bit;
+    uint32_t ruleNum;
+    struct entryInfo **rules;
+};
+
+/* The entries added after the snapshot of the published tree. */
+struct dtreeOverlay {
+    struct dtreeOverlay *next;      /* In the retired list. */
+    uint32_t size;
+    uint32_t num;
+    struct entryInfo *entries[0];
+};
+
+struct mmDtree {
+    struct tableInfo *table;
+
+    /* Published to the lookup by atomic pointer swap. */
+    struct dtreeNode *root;
+    struct dtreeOverlay *overlay;
+
+    /* All entries the classifier knows, including the deleted ones the
+     * published tree still refers to. Protected by the mutex. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct list *entries;           /* List with entryInfo.dtNode. */
+    uint32_t liveNum;
+    uint32_t gen;
+    uint32_t pubGen;                /* Snapshot of the published tree. */
+    bool dirty;
+    bool stop;
+    struct dtreeOverlay *retired;   /* Overlays replaced between rebuilds. */
+
+    task_t taskID;
+    uint32_t nodeNum;               /* Nodes of the tree in building. */
+};
+
+static bool
+dtreeBit(const uint8_t *bytes, uint16_t bit)
+{
+    return (bytes[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static bool
+dtreeMatch(const struct entryInfo *entry, const uint8_t *key, uint16_t len_b)
+{
+    uint32_t i;
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(len_b); i++){
+        if((entry->mask[i] & key[i]) != (entry->mask[i] & entry->value[i])){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int
+dtreePriorityCompare(const void *a, const void *b)
+{
+    const struct entryInfo *ea = *(struct entryInfo * const *)a;
+    const struct entryInfo *eb = *(struct entryInfo * const *)b;
+    return (int)eb->priority - (int)ea->priority;
+}
+
+static void
+dtreeNodeDestroy(struct dtreeNode *node)
+{
+    if(!node){
+        return;
+    }
+    dtreeNodeDestroy(node->child[0]);
+    dtreeNodeDestroy(node->child[1]);
+    if(node->rules){
+        FREE(node->rules);
+    }
+    FREE(node);
+}
+
+/* The callback of rcu_call() for the replaced tree. */
+static void
+dtreeTreeFree(void *arg)
+{
+    dtreeNodeDestroy(arg);
+}
+
+static struct dtreeNode *
+dtreeLeafCreate(struct entryInfo **rules, uint32_t num)
+{
+    struct dtreeNode *node;
+
+    POF_MALLOC_SAFE_RETURN(node, 1, NULL);
+    if(num){
+        if((node->rules = MALLOC(num * sizeof *rules)) == NULL){
+            FREE(node);
+            POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+            return NULL;
+        }
+        memcpy(node->rules, rules, num * sizeof *rules);
+    }
+    node->ruleNum = num;
+    return node;
+}
+
+/* Choose the bit which leaves the least rules in the larger child. The
+ * rules not caring the bit go to both children, so the bit is refused if
+ * it replicates too many rules. Return FALSE if no bit is good to split. */
+static bool
+dtreeBitChoose(struct entryInfo **rules, uint32_t num, const uint8_t *used, \
+               uint16_t keyLen, uint16_t *bit)
+{
+    uint32_t count[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM * 8][2];
+    uint32_t i, best = num, wild, c0, c1;
+    uint16_t b, y;
+    uint8_t m;
+
+    /* Count the rules caring each bit as 0 and 1. */
+    memset(count, 0, keyLen * sizeof count[0]);
+    for(i=0; i<num; i++){
+        for(y=0; y<POF_BITNUM_TO_BYTENUM_CEIL(keyLen); y++){
+            if((m = rules[i]->mask[y] & ~used[y]) == 0){
+                continue;
+            }
+            for(b=y*8; m; b++, m<<=1){
+                if(m & 0x80){
+                    count[b][dtreeBit(rules[i]->value, b)] ++;
+                }
+            }
+        }
+    }
+
+    for(b=0; b<keyLen; b++){
+        wild = num - count[b][0] - count[b][1];
+        c0 = count[b][0] + wild;
+        c1 = count[b][1] + wild;
+        if(POF_MAX(c0, c1) < best && \
+                (c0 + c1) * POFLR_DTREE_SPLIT_DIV <= num * POFLR_DTREE_SPLIT_MUL){
+            best = POF_MAX(c0, c1);
+            *bit = b;
+        }
+    }
+    return (best < num);
+}
+
+/* The first rule matches every key reaching the node if all its mask bits
+ * have been tested on the path. The rules behind it are only needed once
+ * it is deleted, so there is no use to split them. */
+static bool
+dtreeRuleCovers(const struct entryInfo *entry, const uint8_t *used, uint16_t keyLen)
+{
+    uint32_t i;
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(keyLen); i++){
+        if(entry->mask[i] & ~used[i]){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Build the tree of the rules in descending priority. used marks the bits
+ * tested on the path from the root. */
+static struct dtreeNode *
+dtreeBuild(struct mmDtree *dt, struct entryInfo **rules, uint32_t num, \
+           uint8_t *used, uint32_t depth)
+{
+    uint16_t keyLen = dt->table->keyLen, bit;
+    struct entryInfo **sub;
+    struct dtreeNode *node;
+    uint32_t i, j, k;
+
+    dt->nodeNum ++;
+    if(num <= POFLR_DTREE_LEAF_SIZE || dtreeRuleCovers(rules[0], used, keyLen) || \
+            depth >= POFLR_DTREE_DEPTH_MAX || \
+            dt->nodeNum >= POFLR_DTREE_NODE_MAX || \
+            !dtreeBitChoose(rules, num, used, keyLen, &bit)){
+        return dtreeLeafCreate(rules, num);
+    }
+
+    POF_MALLOC_SAFE_RETURN(node, 1, NULL);
+    if((sub = MALLOC(num * sizeof *sub)) == NULL){
+        FREE(node);
+        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        return NULL;
+    }
+    node->bit = bit;
+    used[bit >> 3] |= 0x80 >> (bit & 7);
+    for(k=0; k<2; k++){
+        /* The rules not caring the bit go to both children. */
+        for(i=0, j=0; i<num; i++){
+            if(!dtreeBit(rules[i]->mask, bit) || dtreeBit(rules[i]->value, bit) == k){
+                sub[j++] = rules[i];
+            }
+        }
+        if((node->child[k] = dtreeBuild(dt, sub, j, used, depth + 1)) == NULL){
+            break;
+        }
+    }
+    used[bit >> 3] &= ~(0x80 >> (bit & 7));
+    FREE(sub);
+
+    if(!node->child[0] || !node->child[1]){
+        dtreeNodeDestroy(node);
+        return NULL;
+    }
+    return node;
+}
+
+static struct dtreeOverlay *
+dtreeOverlayCreate(uint32_t size)
+{
+    struct dtreeOverlay *overlay;
+    POF_MALLOC_SAFE_RETURN_SIZE(overlay, 1, NULL, \
+            (sizeof *overlay + size * sizeof overlay->entries[0]));
+    overlay->size = size;
+    return overlay;
+}
+
+/* Copy the live entries inserted after the snapshot gen to a new overlay.
+ * Called with the mutex held. */
+static struct dtreeOverlay *
+dtreeOverlayRenew(const struct mmDtree *dt, uint32_t gen)
+{
+    struct dtreeOverlay *overlay;
+    struct entryInfo *entry, *next;
+
+    if((overlay = dtreeOverlayCreate(dt->table->size + 1)) == NULL){
+        return NULL;
+    }
+    LIST_NODES_IN_STRUCT_TRAVERSE(entry, next, dtNode, dt->entries){
+        if(entry->dtInsGen > gen && entry->dtDelGen == 0){
+            overlay->entries[overlay->num ++] = entry;
+        }
+    }
+    return overlay;
+}
+
+/* Build a new tree from the snapshot of the live entries, and publish it
+ * with the overlay of the entries inserted meanwhile. The old tree and
+ * overlays, and the dead entries only they refer to, are freed after a
+ * grace period, when no datapath task can still use them. */
+static uint32_t
+dtreeRebuild(struct mmDtree *dt)
+{
+    struct entryInfo **rules = NULL, *entry, *next, *dead = NULL;
+    struct dtreeOverlay *overlay, *oldOverlay, *retired;
+    struct dtreeNode *root, *oldRoot;
+    uint8_t used[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] = {0};
+    uint32_t gen, num = 0;
+
+    /* Snapshot. */
+    pthread_mutex_lock(&dt->mutex);
+    dt->dirty = FALSE;
+    gen = dt->gen ++;
+    if(dt->liveNum && (rules = MALLOC(dt->liveNum * sizeof *rules)) == NULL){
+        pthread_mutex_unlock(&dt->mutex);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    LIST_NODES_IN_STRUCT_TRAVERSE(entry, next, dtNode, dt->entries){
+        if(entry->dtDelGen == 0){
+            rules[num++] = entry;
+        }
+    }
+    pthread_mutex_unlock(&dt->mutex);
+
+    /* Build without the mutex, so the flow modifications go on. */
+    qsort(rules, num, sizeof *rules, dtreePriorityCompare);
+    dt->nodeNum = 0;
+    root = dtreeBuild(dt, rules, num, used, 0);
+    if(rules){
+        FREE(rules);
+    }
+    if(!root){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+
+    /* Publish. */
+    pthread_mutex_lock(&dt->mutex);
+    if((overlay = dtreeOverlayRenew(dt, gen)) == NULL){
+        pthread_mutex_unlock(&dt->mutex);
+        dtreeNodeDestroy(root);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    LIST_NODES_IN_STRUCT_TRAVERSE(entry, next, dtNode, dt->entries){
+        /* Deleted, and not in the new tree. */
+        if(entry->dtDelGen != 0 && (entry->dtDelGen <= gen || entry->dtInsGen > gen)){
+            list_nodeDelete(dt->entries, &entry->dtNode);
+            entry->dtNode.next = (struct listNode *)dead;
+            dead = entry;
+        }
+    }
+    oldRoot = dt->root;
+    oldOverlay = dt->overlay;
+    retired = dt->retired;
+    dt->retired = NULL;
+    __atomic_store_n(&dt->overlay, overlay, __ATOMIC_RELEASE);
+    __atomic_store_n(&dt->root, root, __ATOMIC_RELEASE);
+    dt->pubGen = gen;
+    pthread_mutex_unlock(&dt->mutex);
+
+    rcu_call(dtreeTreeFree, oldRoot);
+    rcu_free(oldOverlay);
+    while((overlay = retired) != NULL){
+        retired = overlay->next;
+        rcu_free(overlay);
+    }
+    while((entry = dead) != NULL){
+        dead = (struct entryInfo *)entry->dtNode.next;
+        rcu_free(entry);
+    }
+    return POF_OK;
+}
+
+static void *
+dtreeTask(struct mmDtree *dt)
+{
+    while(1){
+        pthread_mutex_lock(&dt->mutex);
+        while(!dt->dirty && !dt->stop){
+            pthread_cond_wait(&dt->cond, &dt->mutex);
+        }
+        pthread_mutex_unlock(&dt->mutex);
+        if(dt->stop){
+            break;
+        }
+
+        /* Wait for more flow modifications to rebuild for them once. */
+        usleep(POFLR_DTREE_REBUILD_DELAY_US);
+        dtreeRebuild(dt);
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ * Create the decision tree classifier of the MM table
+ * Form:     uint32_t poflr_dtree_create(struct tableInfo *table)
+ * Input:    table
+ * Output:   table->dtree
+ * Return:   POF_OK or Error code
+ * Discribe: This function creates an empty decision tree, and starts the
+ *           task to rebuild the tree after the flow modifications.
+ ***********************************************************************/
+uint32_t
+poflr_dtree_create(struct tableInfo *table)
+{
+    struct mmDtree *dt;
+    uint32_t ret;
+
+    POF_MALLOC_SAFE_RETURN(dt, 1, POF_ERROR);
+    dt->table = table;
+    dt->gen = 1;
+    dt->taskID = POF_INVALID_TASKID;
+    pthread_mutex_init(&dt->mutex, NULL);
+    pthread_cond_init(&dt->cond, NULL);
+    if((dt->entries = list_create()) == NULL || \
+            (dt->root = dtreeLeafCreate(NULL, 0)) == NULL || \
+            (dt->overlay = dtreeOverlayCreate(table->size + 1)) == NULL){
+        table->dtree = dt;
+        poflr_dtree_destroy(table);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    table->dtree = dt;
+
+    ret = pofbf_task_create(dt, (void *)dtreeTask, &dt->taskID);
+    if(ret != POF_OK){
+        poflr_dtree_destroy(table);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+    return POF_OK;
+}
+
+/* Stop the rebuild task, and free the classifier with the deleted entries
+ * it still holds. */
+void
+poflr_dtree_destroy(struct tableInfo *table)
+{
+    struct mmDtree *dt = table->dtree;
+    struct entryInfo *entry, *next;
+    struct dtreeOverlay *overlay;
+
+    if(!dt){
+        return;
+    }
+    if(dt->taskID != POF_INVALID_TASKID){
+        pthread_mutex_lock(&dt->mutex);
+        dt->stop = TRUE;
+        pthread_cond_signal(&dt->cond);
+        pthread_mutex_unlock(&dt->mutex);
+        pthread_join(dt->taskID, NULL);
+    }
+
+    if(dt->entries){
+        LIST_NODES_IN_STRUCT_TRAVERSE(entry, next, dtNode, dt->entries){
+            if(entry->dtDelGen != 0){
+                FREE(entry);
+            }
+        }
+        list_destroy(dt->entries);
+    }
+    dtreeNodeDestroy(dt->root);
+    if(dt->overlay){
+        FREE(dt->overlay);
+    }
+    while((overlay = dt->retired) != NULL){
+        dt->retired = overlay->next;
+        FREE(overlay);
+    }
+    pthread_cond_destroy(&dt->cond);
+    pthread_mutex_destroy(&dt->mutex);
+    FREE(dt);
+    table->dtree = NULL;
+}
+
+/* Add the entry to the overlay until the next rebuild. */
+uint32_t
+poflr_dtree_insert(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct mmDtree *dt = table->dtree;
+    struct dtreeOverlay *overlay;
+
+    pthread_mutex_lock(&dt->mutex);
+    overlay = dt->overlay;
+    if(overlay->num >= overlay->size){
+        /* Full of the entries deleted before the rebuild. Compact it to a
+         * new overlay, and leave the old one to the rebuild task. */
+        if((overlay = dtreeOverlayRenew(dt, dt->pubGen)) == NULL){
+            pthread_mutex_unlock(&dt->mutex);
+            return POF_ERROR;
+        }
+        dt->overlay->next = dt->retired;
+        dt->retired = dt->overlay;
+        __atomic_store_n(&dt->overlay, overlay, __ATOMIC_RELEASE);
+    }
+
+    entry->dtInsGen = dt->gen;
+    entry->dtDelGen = 0;
+    list_nodeInsertTail(dt->entries, &entry->dtNode);
+    dt->liveNum ++;
+    overlay->entries[overlay->num] = entry;
+    __atomic_store_n(&overlay->num, overlay->num + 1, __ATOMIC_RELEASE);
+
+    dt->dirty = TRUE;
+    pthread_cond_signal(&dt->cond);
+    pthread_mutex_unlock(&dt->mutex);
+    return POF_OK;
+}
+
+/* Mark the entry deleted. The entry is freed by the classifier once no
+ * published tree refers to it. */
+void
+poflr_dtree_delete(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct mmDtree *dt = table->dtree;
+
+    pthread_mutex_lock(&dt->mutex);
+    __atomic_store_n(&entry->dtDelGen, dt->gen, __ATOMIC_RELEASE);
+    dt->liveNum --;
+    dt->dirty = TRUE;
+    pthread_cond_signal(&dt->cond);
+    pthread_mutex_unlock(&dt->mutex);
+}
+
+/***********************************************************************
+ * Lookup the decision tree classifier of the MM table
+ * Form:     struct entryInfo *poflr_dtree_lookup(const uint8_t *key,
+ *                                                const struct tableInfo *table)
+ * Input:    key, table
+ * Output:   NONE
+ * Return:   The matched entry with the highest priority, or NULL
+ * Discribe: This function walks the tree to a leaf by the key bits, and
+ *           takes the first live entry matching in the leaf. Then the
+ *           entries in the overlay are checked for a higher priority.
+ ***********************************************************************/
+struct entryInfo *
+poflr_dtree_lookup(const uint8_t *key, const struct tableInfo *table)
+{
+    const struct mmDtree *dt = table->dtree;
+    const struct dtreeNode *node;
+    const struct dtreeOverlay *overlay;
+    struct entryInfo *entry, *ret = NULL;
+    uint32_t i, num;
+
+    node = __atomic_load_n(&dt->root, __ATOMIC_ACQUIRE);
+    overlay = __atomic_load_n(&dt->overlay, __ATOMIC_ACQUIRE);
+
+    while(node->child[0]){
+        node = node->child[dtreeBit(key, node->bit)];
+    }
+    for(i=0; i<node->ruleNum; i++){
+        entry = node->rules[i];
+        if(entry->dtDelGen == 0 && dtreeMatch(entry, key, table->keyLen)){
+            ret = entry;
+            break;
+        }
+    }
+
+    num = __atomic_load_n(&overlay->num, __ATOMIC_ACQUIRE);
+    for(i=0; i<num; i++){
+        entry = overlay->entries[i];
+        if(entry->dtDelGen == 0 && (!ret || ret->priority < entry->priority) && \
+                dtreeMatch(entry, key, table->keyLen)){
+            ret = entry;
+        }
+    }
+    return ret;
+}
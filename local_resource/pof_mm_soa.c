@@ -0,0 +1,390 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
+#include <string.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOA_X86
+#endif
+
+/* Compact layout of a MM table. The masked values and the masks of the
+ * entries are kept in two contiguous arrays in descending priority, one
+ * row of stride bytes for each entry. */
+struct soaRows {
+    uint8_t *values;
+    uint8_t *masks;
+    struct entryInfo **entries;
+    uint16_t *priorities;
+    uint32_t num;
+};
+
+/* The rows are never changed while the lookups may scan them. Each
+ * modification builds the new rows in the spare buffer and publishes
+ * it, and the old rows become the spare. The spare still scanned by the
+ * lookups is freed after a grace period instead of being waited for. */
+struct mmSoa {
+    struct soaRows *rows;       /* Scanned by the lookups. */
+    struct soaRows *spare;
+    uint64_t spareEpoch;        /* rcu_retire() when spare was unpublished. */
+    uint32_t size;
+    uint32_t stride;            /* Key bytes rounded up to POFLR_SOA_ALIGN. */
+    uint32_t (*scan)(const struct soaRows *, const uint8_t *key, uint32_t stride);
+};
+
+static bool
+soaRowMatchGeneric(const uint8_t *key, const uint8_t *value, const uint8_t *mask, uint32_t stride)
+{
+    uint64_t k, v, m;
+    uint32_t j;
+
+    for(j=0; j<stride; j+=sizeof k){
+        memcpy(&k, key + j, sizeof k);
+        memcpy(&v, value + j, sizeof v);
+        memcpy(&m, mask + j, sizeof m);
+        if((k & m) != v){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+#ifdef SOA_X86
+__attribute__((target("sse2"))) static inline bool
+soaRowMatchSse2(const uint8_t *key, const uint8_t *value, const uint8_t *mask, uint32_t stride)
+{
+    __m128i x;
+    uint32_t j;
+
+    for(j=0; j<stride; j+=16){
+        x = _mm_and_si128(_mm_load_si128((const __m128i *)(key + j)), \
+                          _mm_loadu_si128((const __m128i *)(mask + j)));
+        x = _mm_cmpeq_epi8(x, _mm_loadu_si128((const __m128i *)(value + j)));
+        if(_mm_movemask_epi8(x) != 0xFFFF){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+__attribute__((target("avx2"))) static inline bool
+soaRowMatchAvx2(const uint8_t *key, const uint8_t *value, const uint8_t *mask, uint32_t stride)
+{
+    __m256i x;
+    __m128i y;
+    uint32_t j;
+
+    for(j=0; j+32<=stride; j+=32){
+        x = _mm256_and_si256(_mm256_load_si256((const __m256i *)(key + j)), \
+                             _mm256_loadu_si256((const __m256i *)(mask + j)));
+        x = _mm256_xor_si256(x, _mm256_loadu_si256((const __m256i *)(value + j)));
+        if(!_mm256_testz_si256(x, x)){
+            return FALSE;
+        }
+    }
+    if(j < stride){
+        /* The last 16 bytes. */
+        y = _mm_and_si128(_mm_load_si128((const __m128i *)(key + j)), \
+                          _mm_loadu_si128((const __m128i *)(mask + j)));
+        y = _mm_xor_si128(y, _mm_loadu_si128((const __m128i *)(value + j)));
+        if(!_mm_testz_si128(y, y)){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+#endif // SOA_X86
+
+/* Return the index of the first row matching the key, or num. */
+#define SOA_SCAN(NAME)                                                          \
+            static uint32_t                                                     \
+            soaScan##NAME(const struct soaRows *rows, const uint8_t *key,       \
+                          uint32_t stride)                                      \
+            {                                                                   \
+                uint32_t i, offset;                                             \
+                for(i=0, offset=0; i<rows->num; i++, offset+=stride){           \
+                    if(soaRowMatch##NAME(key, rows->values + offset,            \
+                                         rows->masks + offset, stride)){        \
+                        break;                                                  \
+                    }                                                           \
+                }                                                               \
+                return i;                                                       \
+            }
+SOA_SCAN(Generic)
+#ifdef SOA_X86
+__attribute__((target("sse2"))) SOA_SCAN(Sse2)
+__attribute__((target("avx2"))) SOA_SCAN(Avx2)
+#endif // SOA_X86
+#undef SOA_SCAN
+
+static void
+soaRowsFree(void *arg)
+{
+    struct soaRows *rows = arg;
+
+    if(!rows){
+        return;
+    }
+    free(rows->values);
+    free(rows->masks);
+    if(rows->entries){
+        FREE(rows->entries);
+    }
+    if(rows->priorities){
+        FREE(rows->priorities);
+    }
+    FREE(rows);
+}
+
+static struct soaRows *
+soaRowsCreate(uint32_t size, uint32_t stride)
+{
+    struct soaRows *rows;
+
+    if((rows = MALLOC(sizeof *rows)) == NULL){
+        return NULL;
+    }
+    memset(rows, 0, sizeof *rows);
+    if(posix_memalign((void **)&rows->values, POF_CACHE_LINE_SIZE, size * stride) != 0){
+        rows->values = NULL;
+    }
+    if(posix_memalign((void **)&rows->masks, POF_CACHE_LINE_SIZE, size * stride) != 0){
+        rows->masks = NULL;
+    }
+    rows->entries = MALLOC(size * sizeof *rows->entries);
+    rows->priorities = MALLOC(size * sizeof *rows->priorities);
+    if(!rows->values || !rows->masks || !rows->entries || !rows->priorities){
+        soaRowsFree(rows);
+        return NULL;
+    }
+    return rows;
+}
+
+/* Copy n rows from the row srcRow of src to the row dstRow of dst. */
+static void
+soaRowsCopy(struct soaRows *dst, uint32_t dstRow, const struct soaRows *src, \
+            uint32_t srcRow, uint32_t n, uint32_t stride)
+{
+    memcpy(dst->values + dstRow * stride, src->values + srcRow * stride, n * stride);
+    memcpy(dst->masks + dstRow * stride, src->masks + srcRow * stride, n * stride);
+    memcpy(dst->entries + dstRow, src->entries + srcRow, n * sizeof *dst->entries);
+    memcpy(dst->priorities + dstRow, src->priorities + srcRow, n * sizeof *dst->priorities);
+}
+
+/* Copy the rows [from, to) of src but the row but to the row dstRow of
+ * dst. Return the number of the rows copied. */
+static uint32_t
+soaRowsCopyBut(struct soaRows *dst, uint32_t dstRow, const struct soaRows *src, \
+               uint32_t from, uint32_t to, uint32_t but, uint32_t stride)
+{
+    if(but < from || but >= to){
+        soaRowsCopy(dst, dstRow, src, from, to - from, stride);
+        return to - from;
+    }
+    soaRowsCopy(dst, dstRow, src, from, but - from, stride);
+    soaRowsCopy(dst, dstRow + but - from, src, but + 1, to - but - 1, stride);
+    return to - from - 1;
+}
+
+/* The spare rows to build. If the lookups may still scan the spare, it
+ * is freed after a grace period and new rows are built instead. Only if
+ * no memory is left, the grace period is waited for. */
+static struct soaRows *
+soaSpare(struct mmSoa *soa)
+{
+    struct soaRows *rows;
+
+    if(!rcu_passed(soa->spareEpoch)){
+        if((rows = soaRowsCreate(soa->size, soa->stride)) == NULL){
+            rcu_synchronize();
+            return soa->spare;
+        }
+        rcu_call(soaRowsFree, soa->spare);
+        soa->spare = rows;
+    }
+    return soa->spare;
+}
+
+/* Publish the spare rows, and keep the old ones as the spare. */
+static void
+soaPublish(struct mmSoa *soa)
+{
+    struct soaRows *old = soa->rows;
+
+    __atomic_store_n(&soa->rows, soa->spare, __ATOMIC_RELEASE);
+    soa->spare = old;
+    soa->spareEpoch = rcu_retire();
+}
+
+/***********************************************************************
+ * Create the compact layout of the MM table
+ * Form:     uint32_t poflr_soa_create(struct tableInfo *table)
+ * Input:    table
+ * Output:   table->soa
+ * Return:   POF_OK or Error code
+ * Discribe: This function allocates two buffers of the rows for all
+ *           table->size entries, and one more for the new row of a
+ *           modified entry. The flow mods allocate a new buffer only if
+ *           the spare one may still be scanned. The scan uses AVX2 or
+ *           SSE2 if the CPU supports.
+ ***********************************************************************/
+uint32_t
+poflr_soa_create(struct tableInfo *table)
+{
+    struct mmSoa *soa;
+    uint32_t stride;
+
+    stride = POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen);
+    stride = (stride + POFLR_SOA_ALIGN - 1) / POFLR_SOA_ALIGN * POFLR_SOA_ALIGN;
+    if(stride == 0){
+        stride = POFLR_SOA_ALIGN;
+    }
+
+    POF_MALLOC_SAFE_RETURN(soa, 1, POF_ERROR);
+    soa->size = table->size + 1;
+    soa->stride = stride;
+    soa->scan = soaScanGeneric;
+#ifdef SOA_X86
+    if(__builtin_cpu_supports("avx2")){
+        soa->scan = soaScanAvx2;
+    }else if(__builtin_cpu_supports("sse2")){
+        soa->scan = soaScanSse2;
+    }
+#endif // SOA_X86
+    table->soa = soa;
+
+    if((soa->rows = soaRowsCreate(soa->size, stride)) == NULL || \
+            (soa->spare = soaRowsCreate(soa->size, stride)) == NULL){
+        poflr_soa_destroy(table);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    return POF_OK;
+}
+
+void
+poflr_soa_destroy(struct tableInfo *table)
+{
+    struct mmSoa *soa = table->soa;
+
+    if(!soa){
+        return;
+    }
+    soaRowsFree(soa->rows);
+    soaRowsFree(soa->spare);
+    FREE(soa);
+    table->soa = NULL;
+}
+
+/* Insert the row of the entry behind the rows with higher or equal
+ * priority. The row of old, the entry replaced by a modify, is dropped
+ * in the same publish, so the later delete of old has nothing to do. */
+uint32_t
+poflr_soa_insert(struct entryInfo *entry, struct entryInfo *old, struct tableInfo *table)
+{
+    struct mmSoa *soa = table->soa;
+    const struct soaRows *rows = soa->rows;
+    struct soaRows *next;
+    uint32_t i, j, k, n, stride = soa->stride;
+    uint8_t *value, *mask;
+
+    for(k=0; k<rows->num && rows->entries[k] != old; k++){
+        continue;
+    }
+    if(k >= rows->num && rows->num >= soa->size){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    for(i=0; i<rows->num && rows->priorities[i] >= entry->priority; i++){
+        continue;
+    }
+
+    next = soaSpare(soa);
+    n = soaRowsCopyBut(next, 0, rows, 0, i, k, stride);
+    n += 1 + soaRowsCopyBut(next, n + 1, rows, i, rows->num, k, stride);
+    i = (k < i) ? i - 1 : i;
+
+    value = next->values + i * stride;
+    mask = next->masks + i * stride;
+    memset(value, 0, stride);
+    memset(mask, 0, stride);
+    for(j=0; j<POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen); j++){
+        mask[j] = entry->mask[j];
+        value[j] = entry->value[j] & entry->mask[j];
+    }
+    next->entries[i] = entry;
+    next->priorities[i] = entry->priority;
+    next->num = n;
+    soaPublish(soa);
+    return POF_OK;
+}
+
+void
+poflr_soa_delete(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct mmSoa *soa = table->soa;
+    const struct soaRows *rows = soa->rows;
+    struct soaRows *next;
+    uint32_t i, stride = soa->stride;
+
+    for(i=0; i<rows->num && rows->entries[i] != entry; i++){
+        continue;
+    }
+    if(i >= rows->num){
+        return;
+    }
+
+    next = soaSpare(soa);
+    next->num = soaRowsCopyBut(next, 0, rows, 0, rows->num, i, stride);
+    soaPublish(soa);
+}
+
+/***********************************************************************
+ * Lookup the compact layout of the MM table
+ * Form:     struct entryInfo *poflr_soa_lookup(const uint8_t *key,
+ *                                              const struct tableInfo *table)
+ * Input:    key, table
+ * Output:   NONE
+ * Return:   The matched entry with the highest priority, or NULL
+ * Discribe: This function compares the key with the rows in descending
+ *           priority, and stops at the first match.
+ ***********************************************************************/
+struct entryInfo *
+poflr_soa_lookup(const uint8_t *key, const struct tableInfo *table)
+{
+    const struct mmSoa *soa = table->soa;
+    const struct soaRows *rows = __atomic_load_n(&soa->rows, __ATOMIC_ACQUIRE);
+    uint8_t buf[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM] POF_CACHE_ALIGNED = {0};
+    uint32_t i;
+
+    memcpy(buf, key, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+    i = soa->scan(rows, buf, soa->stride);
+    return (i < rows->num) ? rows->entries[i] : NULL;
+}
@@ -34,6 +34,7 @@
 #include "../include/pof_hmap.h"
 #include "../include/pof_list.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_rcu.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -425,7 +426,7 @@ portNameInsert(const char *name, uint16_t slotID, struct list *list)
 static hash_t
 map_portHashByID(uint8_t id)
 {
-    return hmap_hashForLinear(id);
+    return hmap_hashForUint32(id);
 }
 
 static hash_t
@@ -434,12 +435,53 @@ map_portHashByName(const char *name)
     return hmap_hashForString(name);
 }
 
+/***********************************************************************
+ * Rebuild the flood port set of the slot.
+ * Form:     uint32_t poflr_flood_rebuild(struct pof_local_resource *lr)
+ * Input:    local resource
+ * Output:   lr->flood
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function collects the ports which a flood output is
+ *           replicated to, that is all ports except the port connecting
+ *           to the Controller and the ports whose config is 16. The
+ *           input port is skipped for each packet when flooding.
+ * NOTE:     The datapath may still be reading the replaced set, so it
+ *           is freed after a grace period.
+ ***********************************************************************/
+uint32_t
+poflr_flood_rebuild(struct pof_local_resource *lr)
+{
+    struct floodInfo *flood;
+    struct portInfo *port, *next;
+    uint16_t num = 0;
+
+    POF_MALLOC_SAFE_RETURN_SIZE(flood, 1, POF_ERROR, \
+            sizeof(*flood) + lr->portNum * sizeof(flood->ports[0]));
+
+    HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
+        if(port->pofIndex == pofsc_conn_desc.local_port_index || port->config == 16){
+            continue;
+        }
+        flood->ports[num].pofIndex = port->pofIndex;
+        /* -1 if the port is driven by another backend. */
+        flood->ports[num].fd = (port->backend == &pofdp_backend_raw) ? port->queue_fd[1] : -1;
+        flood->ports[num].sysIndex = port->sysIndex;
+        num ++;
+    }
+    flood->portNum = num;
+
+    /* Publish the new set only after it has been filled. */
+    rcu_free(__atomic_exchange_n(&lr->flood, flood, __ATOMIC_RELEASE));
+    return POF_OK;
+}
+
 static void
 map_portInsert(struct portInfo *port, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->portPofIndexMap, &port->pofIndexNode);
     hmap_nodeInsert(lr->portNameMap, &port->nameNode);
     lr->portNum ++;
+    poflr_flood_rebuild(lr);
 }
 
 /* Malloc memory for port information. should be free by map_portDelete(). */
@@ -451,13 +493,27 @@ map_portCreate()
     return port;
 }
 
+/* The datapath tasks may still output to the port through its backend,
+ * so the backend is closed together with the port after them. */
+static void
+map_portFree(void *arg)
+{
+    struct portInfo *port = arg;
+
+    if(port->backend != &pofdp_backend_raw){
+        pofdp_backend_close(port);
+    }
+    FREE(port);
+}
+
 static void
 map_portDelete(struct portInfo *port, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->portPofIndexMap, &port->pofIndexNode);
     hmap_nodeDelete(lr->portNameMap, &port->nameNode);
     lr->portNum --;
-    FREE(port);
+    poflr_flood_rebuild(lr);
+    rcu_call(map_portFree, port);
 }
 
 /* Check whether there is a port with the name in the system. */
@@ -518,7 +574,7 @@ poflr_del_port(const char *ethName, struct pof_local_resource *lr)
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Shut down the task which listen to the port. */
-	ret = pofbf_task_delete(&port->taskID);
+	ret = pofdp_delete_port_listen_task(port);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Remove the port, and free the memory. */
@@ -666,6 +722,7 @@ poflr_set_port(const char *name, struct portInfo *port, struct pof_local_resourc
     port->pofIndexNode.hash = map_portHashByID(portIndex);
 
     port->slotID = lr->slotID;
+    port->backend = &pofdp_backend_raw;
 
     portIndex ++;
 
@@ -751,6 +808,46 @@ poflr_add_port_no_report_no_task(const char *name, struct pof_local_resource *lr
     return POF_OK;
 }
 
+/* Create a port driven by a backend other than the raw socket, which
+ * does not exist in the system. No report or task. */
+static uint32_t
+poflr_add_port_backend(const struct pofdp_backend_assign *ba, struct pof_local_resource *lr)
+{
+    struct portInfo *port;
+    uint32_t ret;
+
+    if(poflr_get_port_with_name(ba->port, lr)){
+        POF_ERROR_CPRINT_FL("Add port Failed: Already have %s", ba->port);
+        return POF_ERROR;
+    }
+
+    port = map_portCreate();
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(port);
+    strncpy(port->name, ba->port, PORT_NAME_LEN-1);
+    strcpy(port->ip, "0.0.0.0");
+    port->pofIndex = portIndex;
+    port->pofState = POFPS_LIVE;
+    port->of_enable = POFE_DISABLE;
+    port->slotID = lr->slotID;
+    /* A locally administered address. */
+    port->hwaddr[0] = 0x02;
+    port->hwaddr[4] = lr->slotID;
+    port->hwaddr[5] = portIndex;
+    port->queue_fd[0] = port->queue_fd[1] = -1;
+    port->nameNode.hash = map_portHashByName(port->name);
+    port->pofIndexNode.hash = map_portHashByID(portIndex);
+
+    if((ret = pofdp_backend_open(port, ba->backend, ba->arg)) != POF_OK){
+        FREE(port);
+        return ret;
+    }
+    portIndex ++;
+    map_portInsert(port, lr);
+
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Driven by the %s backend!", port->name, ba->backend->name);
+    return POF_OK;
+}
+
 /* Only for command option when start the pofswitch.
  * Only add the port name to the namespace, no creation or report or task. */
 uint32_t
@@ -908,7 +1005,8 @@ uint32_t poflr_get_hwaddr_by_ipaddr(uint8_t *hwaddr, char *ipaddr_str, struct po
  * Return:   POF_OK or ERROR code
  * Discribe: This function will initialize the local physical net port
  *           infomation, including port name, port index, port MAC address
- *           and so on.
+ *           and so on. The ports driven by the other backends, such as
+ *           the pcap files, are created in the first slot too.
  ***********************************************************************/
 uint32_t 
 poflr_init_port(struct pof_local_resource *lr)
@@ -917,8 +1015,8 @@ poflr_init_port(struct pof_local_resource *lr)
     struct portName *portName, *next;
 
     /* Port map initialization. */
-    lr->portPofIndexMap = hmap_create(lr->portNumMax);
-    lr->portNameMap = hmap_create(lr->portNumMax);
+    lr->portPofIndexMap = hmap_createFixed(lr->portNumMax);
+    lr->portNameMap = hmap_createFixed(lr->portNumMax);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->portPofIndexMap);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->portNameMap);
 
@@ -937,6 +1035,14 @@ poflr_init_port(struct pof_local_resource *lr)
         POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
 
+    /* Create the ports driven by the other backends. */
+    if(lr->slotID == POF_SLOT_ID_BASE){
+        for(i=0; i<g_dp.backendPortNum; i++){
+            ret = poflr_add_port_backend(&g_dp.backendPorts[i], lr);
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        }
+    }
+
     return POF_OK;
 }
 
@@ -1032,6 +1138,10 @@ poflr_port_detect_old(struct pof_local_resource *lr)
 
     /* Traverse all ports. */
     HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
+        /* The ports of the other backends are not in the system. */
+        if(port->backend != &pofdp_backend_raw){
+            continue;
+        }
         /* Check whether the system still have the port. */
         if(checkPortNameInSys(port->name) != POF_OK){
             poflr_del_port(port->name, lr);
@@ -1044,6 +1154,7 @@ poflr_port_detect_old(struct pof_local_resource *lr)
         if(comparePorts(port, &tmp) != TRUE){
             /* If the port has been changed, update the port information and report to Controller. */
             updatePorts(port, &tmp);
+            poflr_flood_rebuild(lr);
             ret = poflr_port_report(POFPR_MODIFY, port);
             POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
         }
@@ -35,6 +35,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <ctype.h>
 
 char g_versionStr[POF_STRING_MAX_LEN - 1] = "";
 
@@ -124,6 +125,17 @@ struct pof_state g_states = {
 #else
     {"SHT VXLAN", "OFF"},
 #endif
+    {"RX RING","OFF"},
+    {"TX BATCH","ON"},
+    {"QDISC BYPASS","OFF"},
+    {"WORKERS","OFF"},
+    {"SCHED FIFO","OFF"},
+    {"FANOUT","OFF"},
+    {"MM ENGINE","LINEAR"},
+    {"LPM ENGINE","STRIDE"},
+    {"EM ENGINE","CUCKOO"},
+    {"FLOW CACHE","ON"},
+    {"INTERPRETER","THREADED"},
 };
 
 static uint32_t readConfigFile(FILE *fp, struct pof_datapath *dp);
@@ -150,6 +162,18 @@ uint32_t pofc_cmd_auto_clear = TRUE;
     CONFIG_CMD('v',"v","version",version,"Print the (v)ersion of POFSwitch.")                       \
     CONFIG_CMD('S',"S:","slot-num",slot_num,"Set the number of (s)lots. Default is 1.")             \
     CONFIG_CMD('m',"m","man-clear",man_clear,"(M)anually clear the resource when disconnect.")      \
+    CONFIG_CMD('R',"R:","rx-ring",rx_ring,"Receive packets through the mmap (R)X ring. Eg. -R all or -R eth0 -R eth1") \
+    CONFIG_CMD('Q',"Q","qdisc-bypass",qdisc_bypass,"Send packets bypassing the (Q)disc layer.")     \
+    CONFIG_CMD('w',"w:","workers",workers,"Poll all ports by a pool of (w)orker threads instead of one thread per port. Eg. -w 4") \
+    CONFIG_CMD('F',"F:","sched-fifo",sched_fifo,"Run the workers with SCHED_(F)IFO priority 1-99. Eg. -F 50") \
+    CONFIG_CMD('o',"o:","fanout",fanout,"Spread the packets of the port over several w(o)rkers. Eg. -o eth0,4") \
+    CONFIG_CMD('O',"O:","fanout-mode",fanout_mode,"Fan(O)ut mode: hash|cpu|ebpf|soft. Default is hash.") \
+    CONFIG_CMD('b',"b:","backend",backend,"Add a port driven by a (b)ackend: pcap-replay|pcap-record|loop. Eg. -b p0=pcap-replay:in.pcap,10 -b p1=pcap-record:out.pcap") \
+    CONFIG_CMD('M',"M:","mm-engine",mm_engine,"Lookup engine of (M)M tables: linear|tss|dtree|soa. Eg. -M tss or -M 3=tss for the MM table 3 only.") \
+    CONFIG_CMD('T',"T:","lpm-engine",lpm_engine,"Lookup engine of LPM (T)ables: tree|stride|patricia. Default is stride, and patricia for the keys wider than 64 bits.") \
+    CONFIG_CMD('E',"E:","em-engine",em_engine,"Lookup engine of (E)M tables: hmap|cuckoo. Default is cuckoo.") \
+    CONFIG_CMD('C',"C","no-flow-cache",no_flow_cache,"Look up every table without the flow (C)ache of the receive task.") \
+    CONFIG_CMD('I',"I","switch-interpreter",switch_interpreter,"Execute the instructions by the switch (I)nterpreter instead of the threaded one.") \
     CONFIG_CMD('t',"t","test",test,"(T)est.")
 
 #define OPT_ARG char *optarg, struct pof_datapath *dp
@@ -180,6 +204,289 @@ start_cmd_listen_port(OPT_ARG)
     return POF_OK;
 }
 
+static uint32_t
+start_cmd_rx_ring(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    if(strcmp(optarg, "all") == POF_OK){
+        dp->rxMode = POFDP_RX_RING;
+        strncpy(g_states.rxRing.cont, "ALL", POF_STRING_PAIR_MAX_LEN-1);
+        return POF_OK;
+    }
+    if(dp->rxRingPortNum >= POFDP_RX_RING_PORT_MAX){
+        return POF_ERROR;
+    }
+    strncpy(dp->rxRingPorts[dp->rxRingPortNum++], optarg, PORT_NAME_LEN-1);
+    if(dp->rxMode != POFDP_RX_RING){
+        strncpy(g_states.rxRing.cont, "CUSTOM", POF_STRING_PAIR_MAX_LEN-1);
+    }
+    return POF_OK;
+}
+
+static uint32_t
+start_cmd_qdisc_bypass(OPT_ARG)
+{
+    dp->txQdiscBypass = TRUE;
+    strncpy(g_states.qdiscBypass.cont, "ON", POF_STRING_PAIR_MAX_LEN-1);
+    return POF_OK;
+}
+
+static uint32_t
+start_cmd_no_flow_cache(OPT_ARG)
+{
+    dp->flowCache = FALSE;
+    strncpy(g_states.flowCache.cont, "OFF", POF_STRING_PAIR_MAX_LEN-1);
+    return POF_OK;
+}
+
+static uint32_t
+start_cmd_switch_interpreter(OPT_ARG)
+{
+    dp->threaded = FALSE;
+    strncpy(g_states.interpreter.cont, "SWITCH", POF_STRING_PAIR_MAX_LEN-1);
+    return POF_OK;
+}
+
+static uint32_t
+setWorkerNum(uint32_t num, struct pof_datapath *dp)
+{
+    if(num > POFDP_WORKER_MAX){
+        return POF_ERROR;
+    }
+    dp->workerNum = num;
+    if(num){
+        sprintf(g_states.workers.cont, "%u", num);
+    }else{
+        strncpy(g_states.workers.cont, "OFF", POF_STRING_PAIR_MAX_LEN-1);
+    }
+    return POF_OK;
+}
+
+static uint32_t
+setWorkerPriority(uint32_t priority, struct pof_datapath *dp)
+{
+    if(priority > 99){
+        return POF_ERROR;
+    }
+    dp->workerPriority = priority;
+    if(priority){
+        sprintf(g_states.schedFifo.cont, "%u", priority);
+    }else{
+        strncpy(g_states.schedFifo.cont, "OFF", POF_STRING_PAIR_MAX_LEN-1);
+    }
+    return POF_OK;
+}
+
+static const char *fanoutModeStr[] = {"HASH", "CPU", "EBPF", "SOFT"};
+
+/* "eth0,4" spreads the packets of the port eth0 over 4 fanout members. */
+static uint32_t
+setFanoutPort(char *str, struct pof_datapath *dp)
+{
+    char *arg[2] = {NULL, NULL};
+    uint32_t num;
+
+    pofbf_split_str(str, ",", arg, 2);
+    if(!arg[0] || !arg[1] || strlen(arg[0]) >= PORT_NAME_LEN || \
+            dp->fanoutPortNum >= POFDP_FANOUT_PORT_MAX){
+        return POF_ERROR;
+    }
+    if((num = atoi(arg[1])) == 0 || num > POFDP_WORKER_MAX){
+        return POF_ERROR;
+    }
+    strncpy(dp->fanoutPorts[dp->fanoutPortNum].port, arg[0], PORT_NAME_LEN-1);
+    dp->fanoutPorts[dp->fanoutPortNum].num = num;
+    dp->fanoutPortNum ++;
+    strncpy(g_states.fanout.cont, fanoutModeStr[dp->fanoutMode], POF_STRING_PAIR_MAX_LEN-1);
+    return POF_OK;
+}
+
+static uint32_t
+setFanoutMode(uint32_t mode, struct pof_datapath *dp)
+{
+    if(mode > POFDP_FANOUT_SOFT){
+        return POF_ERROR;
+    }
+    dp->fanoutMode = mode;
+    if(dp->fanoutPortNum){
+        strncpy(g_states.fanout.cont, fanoutModeStr[mode], POF_STRING_PAIR_MAX_LEN-1);
+    }
+    return POF_OK;
+}
+
+/* "p0=pcap-replay:in.pcap" adds the port p0 replaying in.pcap. */
+static uint32_t
+setBackendPort(char *str, struct pof_datapath *dp)
+{
+    struct pofdp_backend_assign *ba;
+    char *name, *arg;
+
+    if(dp->backendPortNum >= POFDP_BACKEND_PORT_MAX || (name = strchr(str, '=')) == NULL){
+        return POF_ERROR;
+    }
+    *name++ = '\0';
+    if((arg = strchr(name, ':')) != NULL){
+        *arg++ = '\0';
+    }
+
+    if(!str[0] || strlen(str) >= PORT_NAME_LEN || (arg && strlen(arg) >= POFDP_BACKEND_ARG_LEN)){
+        return POF_ERROR;
+    }
+
+    ba = &dp->backendPorts[dp->backendPortNum];
+    if((ba->backend = pofdp_backend_find(name)) == NULL || ba->backend == &pofdp_backend_raw){
+        return POF_ERROR;
+    }
+    strncpy(ba->port, str, PORT_NAME_LEN-1);
+    strncpy(ba->arg, arg ? arg : "", POFDP_BACKEND_ARG_LEN-1);
+    dp->backendPortNum ++;
+    return POF_OK;
+}
+
+static const char *mmEngineStr[POFLR_MM_ENGINE_NUM] = {"LINEAR", "TSS", "DTREE", "SOA"};
+
+/* "tss" sets the engine of all the MM tables, and "3=tss" sets the
+ * engine of the MM table 3 only. */
+static uint32_t
+setMmEngine(char *str)
+{
+    uint16_t id = POFLR_MM_ENGINE_ALL;
+    char *name;
+    uint32_t i;
+
+    if((name = strchr(str, '=')) != NULL){
+        *name++ = '\0';
+        id = atoi(str);
+    }else{
+        name = str;
+    }
+    for(i=0; i<POFLR_MM_ENGINE_NUM; i++){
+        if(strcasecmp(name, mmEngineStr[i]) != 0){
+            continue;
+        }
+        if(poflr_set_mm_engine(id, i) != POF_OK){
+            return POF_ERROR;
+        }
+        strncpy(g_states.mmEngine.cont, (id == POFLR_MM_ENGINE_ALL) ? mmEngineStr[i] : "PER TABLE", \
+                POF_STRING_PAIR_MAX_LEN-1);
+        return POF_OK;
+    }
+    return POF_ERROR;
+}
+
+static const char *lpmEngineStr[POFLR_LPM_ENGINE_NUM] = {"TREE", "STRIDE", "PATRICIA"};
+
+static uint32_t
+setLpmEngine(const char *str)
+{
+    uint32_t i;
+
+    for(i=0; i<POFLR_LPM_ENGINE_NUM; i++){
+        if(strcasecmp(str, lpmEngineStr[i]) == 0){
+            strncpy(g_states.lpmEngine.cont, lpmEngineStr[i], POF_STRING_PAIR_MAX_LEN-1);
+            return poflr_set_lpm_engine(i);
+        }
+    }
+    return POF_ERROR;
+}
+
+static const char *emEngineStr[POFLR_EM_ENGINE_NUM] = {"HMAP", "CUCKOO"};
+
+static uint32_t
+setEmEngine(const char *str)
+{
+    uint32_t i;
+
+    for(i=0; i<POFLR_EM_ENGINE_NUM; i++){
+        if(strcasecmp(str, emEngineStr[i]) == 0){
+            strncpy(g_states.emEngine.cont, emEngineStr[i], POF_STRING_PAIR_MAX_LEN-1);
+            return poflr_set_em_engine(i);
+        }
+    }
+    return POF_ERROR;
+}
+
+static uint32_t
+start_cmd_workers(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setWorkerNum(atoi(optarg), dp);
+}
+
+static uint32_t
+start_cmd_sched_fifo(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setWorkerPriority(atoi(optarg), dp);
+}
+
+static uint32_t
+start_cmd_fanout(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setFanoutPort(optarg, dp);
+}
+
+static uint32_t
+start_cmd_fanout_mode(OPT_ARG)
+{
+    uint32_t i;
+
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    for(i=0; i<=POFDP_FANOUT_SOFT; i++){
+        if(strcasecmp(optarg, fanoutModeStr[i]) == 0){
+            return setFanoutMode(i, dp);
+        }
+    }
+    return POF_ERROR;
+}
+
+static uint32_t
+start_cmd_backend(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setBackendPort(optarg, dp);
+}
+
+static uint32_t
+start_cmd_mm_engine(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setMmEngine(optarg);
+}
+
+static uint32_t
+start_cmd_lpm_engine(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setLpmEngine(optarg);
+}
+
+static uint32_t
+start_cmd_em_engine(OPT_ARG)
+{
+    if(optarg == NULL){
+        return POF_ERROR;
+    }
+    return setEmEngine(optarg);
+}
+
 static uint32_t
 start_cmd_device_id(OPT_ARG)
 {
@@ -430,6 +737,23 @@ enum pof_init_config_type{
 	POFICT_COUNTER_NUMBER   = 9,
 	POFICT_GROUP_NUMBER     = 10,
 	POFICT_DEVICE_PORT_NUMBER_MAX = 11,
+	POFICT_RX_RING          = 12,
+	POFICT_RX_RING_BLOCK_SIZE = 13,
+	POFICT_RX_RING_BLOCK_NUMBER = 14,
+	POFICT_TX_BATCH         = 15,
+	POFICT_TX_QDISC_BYPASS  = 16,
+	POFICT_WORKER_NUMBER    = 17,
+	POFICT_WORKER_CPUS      = 18,
+	POFICT_WORKER_PORT      = 19,
+	POFICT_WORKER_PRIORITY  = 20,
+	POFICT_FANOUT_PORT      = 21,
+	POFICT_FANOUT_MODE      = 22,
+	POFICT_PORT_BACKEND     = 23,
+	POFICT_MM_ENGINE        = 24,
+	POFICT_LPM_ENGINE       = 25,
+	POFICT_EM_ENGINE        = 26,
+	POFICT_FLOW_CACHE       = 27,
+	POFICT_THREADED         = 28,
 
 	POFICT_CONFIG_TYPE_MAX,
 };
@@ -439,7 +763,13 @@ char *config_type_str[POFICT_CONFIG_TYPE_MAX] = {
 	"MM_table_number", "LPM_table_number", "EM_table_number", "DT_table_number",
 	"Flow_table_size", "Flow_table_key_length", 
 	"Meter_number", "Counter_number", "Group_number", 
-	"Device_port_number_max"
+	"Device_port_number_max",
+	"Rx_ring", "Rx_ring_block_size", "Rx_ring_block_number",
+	"Tx_batch", "Tx_qdisc_bypass",
+	"Worker_number", "Worker_cpus", "Worker_port", "Worker_priority",
+	"Fanout_port", "Fanout_mode", "Port_backend",
+	"MM_engine", "LPM_engine", "EM_engine",
+	"Flow_cache", "Threaded_interpreter"
 };
 
 static uint8_t pofsic_get_config_type(char *str){
@@ -454,10 +784,35 @@ static uint8_t pofsic_get_config_type(char *str){
 	return 0xff;
 }
 
+/* A config value, long enough for "port=backend:arg". */
+#define CONFIG_VALUE_LEN (POF_STRING_MAX_LEN + POFDP_BACKEND_ARG_LEN)
+
+/* Read one word of the config file into buf of len bytes. Return 1 if
+ * read, 0 if the word does not fit in buf, or EOF. */
+static int
+readConfigWord(FILE *fp, char *buf, uint32_t len)
+{
+    char fmt[16];
+    int c;
+
+    snprintf(fmt, sizeof fmt, "%%%us", len - 1);
+    if(fscanf(fp, fmt, buf) != 1){
+        return EOF;
+    }
+    /* The word is cut if it goes on right behind the width. */
+    if((c = fgetc(fp)) != EOF){
+        ungetc(c, fp);
+        if(!isspace(c)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static uint32_t pofsic_get_config_data(FILE *fp, uint32_t *ret_p){
 	char str[POF_STRING_MAX_LEN];
 
-	if(fscanf(fp, "%s", str) != 1){
+	if(readConfigWord(fp, str, sizeof str) != 1){
 		*ret_p = POF_ERROR;
 		return POF_ERROR;
 	}else{
@@ -465,22 +820,76 @@ static uint32_t pofsic_get_config_data(FILE *fp, uint32_t *ret_p){
 	}
 }
 
+/* "Worker_cpus 2,3,4,5" runs worker 0 on CPU 2, worker 1 on CPU 3, ... */
+static uint32_t
+readWorkerCpus(char *str, struct pof_datapath *dp)
+{
+    char *cpus[POFDP_WORKER_MAX] = {NULL};
+    uint32_t i;
+
+    pofbf_split_str(str, ",", cpus, POFDP_WORKER_MAX);
+    for(i=0; i<POFDP_WORKER_MAX && cpus[i]; i++){
+        dp->workerCpus[i] = atoi(cpus[i]);
+    }
+    dp->workerCpuNum = i;
+    return POF_OK;
+}
+
+/* "Worker_port eth0,1" lets worker 1 poll the port eth0. */
+static uint32_t
+readWorkerPort(char *str, struct pof_datapath *dp)
+{
+    char *arg[2] = {NULL, NULL};
+
+    pofbf_split_str(str, ",", arg, 2);
+    if(!arg[0] || !arg[1] || strlen(arg[0]) >= PORT_NAME_LEN || \
+            dp->workerPortNum >= POFDP_WORKER_PORT_MAX){
+        return POF_ERROR;
+    }
+    strncpy(dp->workerPorts[dp->workerPortNum].port, arg[0], PORT_NAME_LEN-1);
+    dp->workerPorts[dp->workerPortNum].worker = atoi(arg[1]);
+    dp->workerPortNum ++;
+    return POF_OK;
+}
+
 static uint32_t
 readConfigFile(FILE *fp, struct pof_datapath *dp)
 {
 	uint32_t ret = POF_OK, data = 0;
     struct pof_param *param = &dp->param;
 	char     str[POF_STRING_MAX_LEN] = "\0";
-	char     ip_str[POF_STRING_MAX_LEN] = "\0";
+	char     ip_str[CONFIG_VALUE_LEN] = "\0";
 	uint8_t  config_type = 0;
-	while(fscanf(fp, "%s", str) == 1){
+	int      n;
+	while((n = readConfigWord(fp, str, sizeof str)) == 1){
 		config_type = pofsic_get_config_type(str);
 		if(config_type == POFICT_CONTROLLER_IP){
-			if(fscanf(fp, "%s", ip_str) != 1){
+			if(readConfigWord(fp, ip_str, POF_IP_ADDRESS_STRING_LEN) != 1){
 				ret = POF_ERROR;
 			}else{
 				pofsc_set_controller_ip(ip_str);
 			}
+		}else if(config_type == POFICT_WORKER_CPUS || config_type == POFICT_WORKER_PORT || \
+                config_type == POFICT_FANOUT_PORT || config_type == POFICT_PORT_BACKEND || \
+                config_type == POFICT_MM_ENGINE || config_type == POFICT_LPM_ENGINE || \
+                config_type == POFICT_EM_ENGINE){
+			if(readConfigWord(fp, ip_str, sizeof ip_str) != 1){
+				ret = POF_ERROR;
+			}else if(config_type == POFICT_WORKER_CPUS){
+				ret = readWorkerCpus(ip_str, dp);
+			}else if(config_type == POFICT_WORKER_PORT){
+				ret = readWorkerPort(ip_str, dp);
+			}else if(config_type == POFICT_FANOUT_PORT){
+				ret = setFanoutPort(ip_str, dp);
+			}else if(config_type == POFICT_MM_ENGINE){
+				ret = setMmEngine(ip_str);
+			}else if(config_type == POFICT_LPM_ENGINE){
+				ret = setLpmEngine(ip_str);
+			}else if(config_type == POFICT_EM_ENGINE){
+				ret = setEmEngine(ip_str);
+			}else{
+				ret = setBackendPort(ip_str, dp);
+			}
 		}else{
 			data = pofsic_get_config_data(fp, &ret);
 			switch(config_type){
@@ -517,6 +926,41 @@ readConfigFile(FILE *fp, struct pof_datapath *dp)
 				case POFICT_DEVICE_PORT_NUMBER_MAX:
                     param->portNumMax = data;
 					break;
+				case POFICT_RX_RING:
+                    dp->rxMode = data ? POFDP_RX_RING : POFDP_RX_RECVFROM;
+                    strncpy(g_states.rxRing.cont, data ? "ALL" : "OFF", POF_STRING_PAIR_MAX_LEN-1);
+					break;
+				case POFICT_RX_RING_BLOCK_SIZE:
+                    dp->rxRingBlockSize = data;
+					break;
+				case POFICT_RX_RING_BLOCK_NUMBER:
+                    dp->rxRingBlockNum = data;
+					break;
+				case POFICT_TX_BATCH:
+                    dp->txBatch = data ? TRUE : FALSE;
+                    strncpy(g_states.txBatch.cont, data ? "ON" : "OFF", POF_STRING_PAIR_MAX_LEN-1);
+					break;
+				case POFICT_TX_QDISC_BYPASS:
+                    dp->txQdiscBypass = data ? TRUE : FALSE;
+                    strncpy(g_states.qdiscBypass.cont, data ? "ON" : "OFF", POF_STRING_PAIR_MAX_LEN-1);
+					break;
+				case POFICT_WORKER_NUMBER:
+                    ret = setWorkerNum(data, dp);
+					break;
+				case POFICT_WORKER_PRIORITY:
+                    ret = setWorkerPriority(data, dp);
+					break;
+				case POFICT_FANOUT_MODE:
+                    ret = setFanoutMode(data, dp);
+					break;
+				case POFICT_FLOW_CACHE:
+                    dp->flowCache = data ? TRUE : FALSE;
+                    strncpy(g_states.flowCache.cont, data ? "ON" : "OFF", POF_STRING_PAIR_MAX_LEN-1);
+					break;
+				case POFICT_THREADED:
+                    dp->threaded = data ? TRUE : FALSE;
+                    strncpy(g_states.interpreter.cont, data ? "THREADED" : "SWITCH", POF_STRING_PAIR_MAX_LEN-1);
+					break;
 				default:
 					ret = POF_ERROR;
 					break;
@@ -528,6 +972,10 @@ readConfigFile(FILE *fp, struct pof_datapath *dp)
 			return ret;
 		}
 	}
+	if(n == 0){
+		POF_ERROR_CPRINT_FL("Can't load config file: Wrong config format.");
+		return POF_ERROR;
+	}
     return POF_OK;
 }
 
@@ -543,7 +991,13 @@ readConfigFile(FILE *fp, struct pof_datapath *dp)
  *			 "MM_table_number", "LPM_table_number", "EM_table_number", "DT_table_number",
  *			 "Flow_table_size", "Flow_table_key_length", 
  *			 "Meter_number", "Counter_number", "Group_number", 
- *			 "Device_port_number_max"
+ *			 "Device_port_number_max",
+ *			 "Rx_ring", "Rx_ring_block_size", "Rx_ring_block_number",
+ *			 "Tx_batch", "Tx_qdisc_bypass",
+ *			 "Worker_number", "Worker_cpus", "Worker_port", "Worker_priority",
+ *			 "Fanout_port", "Fanout_mode", "Port_backend",
+ *			 "MM_engine", "LPM_engine", "EM_engine",
+ *			 "Flow_cache", "Threaded_interpreter"
  ***********************************************************************/
 static uint32_t pof_set_init_config_by_file(struct pof_datapath *dp){
 	char     filename_relative[] = "./pofswitch_config.conf";
@@ -241,14 +241,16 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr, struct pof_datapath *dp){
          //take transfer from n to h
             pof_NtoH_transfer_packet_out(packet_out);
          //POF_DEBUG_CPRINT_OX_NO_ENTER(packet_out,sizeof(packet_out));
-         struct pofdp_packet dpp[1] = {0};
+         struct pofdp_packet dpp[1];
+         struct pofdp_mbuf mbuf[1];
          //POF_DEBUG_CPRINT(1,BLUE,"===============start memset\n");
-         memset(dpp, 0, sizeof *dpp);
+         pofdp_packet_init(dpp, mbuf, dp);
          //POF_DEBUG_CPRINT(1,BLUE,"===============memset success\n");
          //apply the packet_out to the pofdp_packet
-         dpp->packetBuf = dpp->buf;
+         dpp->packetBuf = &(mbuf->buf[POFDP_PACKET_PREBUF_LEN]);
+         dpp->packetBufLen = POFDP_PACKET_RAW_MAX_LEN;
          //POF_DEBUG_CPRINT(1,BLUE,"===============%d point packetbuf to memory success\n",packet_out->packetLen);
-         memcpy(dpp->buf,packet_out->data,packet_out->packetLen);
+         memcpy(dpp->packetBuf,packet_out->data,packet_out->packetLen);
          //POF_DEBUG_CPRINT(1,BLUE,"===============memcpy success\n");
          /* Store packet data, length, received port infomation into the message queue. */
          // dpp->output_port_id=packet_out->inPort;
@@ -256,7 +258,6 @@ uint32_t  pof_parse_msg_from_controller(char* msg_ptr, struct pof_datapath *dp){
          dpp->ori_len = packet_out->packetLen;
          dpp->left_len = dpp->ori_len;
          dpp->buf_offset = dpp->packetBuf;
-         dpp->dp = dp;
          dpp->act = (pof_action *)(packet_out->actionList);
          POF_DEBUG_CPRINT_0X_NO_ENTER(dpp->act,48*6);
          dpp->act_num =packet_out->actionNum;
@@ -299,6 +299,51 @@ cmd_meters(CMD_ARG)
     return SCTRL_OK;
 }
 
+static uint32_t
+cmdRecvHmap(int sockfd)
+{
+    struct responseHead resp[] = {0};
+    struct hmapStats stats[1];
+    uint32_t ret;
+
+    if( (ret = cmdRecv(sockfd, resp, sizeof(*resp))) != SCTRL_OK || \
+        (ret = cmdRecv(sockfd, stats, sizeof(*stats))) != SCTRL_OK ){
+        return ret;
+    }
+    resp->disc[POF_STRING_MAX_LEN - 1] = '\0';
+    cmdPrintHmapStats(resp->disc, stats);
+    return SCTRL_OK;
+}
+
+static uint32_t
+cmd_hmaps(CMD_ARG)
+{
+    struct command cmd[] = {
+        POFUC_hmaps, 0
+    };
+    struct responseHead resp[] = {0};
+    struct responseHead respSlots[] = {0};
+    uint32_t ret, i, j;
+
+    if( (ret = cmdSend(sockfd, cmd, cmdStr)) != SCTRL_OK || \
+        (ret = cmdRecvHmap(sockfd)) != SCTRL_OK || \
+        (ret = cmdRecv(sockfd, respSlots, sizeof(*respSlots))) != SCTRL_OK ){
+        return ret;
+    }
+
+    for(j=0; j<respSlots->count; j++){
+        if((ret = cmdRecv(sockfd, resp, sizeof(*resp))) != SCTRL_OK){
+            return ret;
+        }
+        for(i=0; i<resp->count; i++){
+            if((ret = cmdRecvHmap(sockfd)) != SCTRL_OK){
+                return ret;
+            }
+        }
+    }
+    return SCTRL_OK;
+}
+
 static uint32_t
 cmd_counters(CMD_ARG)
 {
@@ -425,6 +470,17 @@ cmd_test(CMD_ARG)
     return SCTRL_OK;
 }
 
+static uint32_t
+cmd_lpm_bench(CMD_ARG) {return SCTRL_OK;}
+static uint32_t
+cmd_hash_bench(CMD_ARG) {return SCTRL_OK;}
+
+static uint32_t
+cmd_bit_bench(CMD_ARG) {return SCTRL_OK;}
+
+static uint32_t
+cmd_ins_bench(CMD_ARG) {return SCTRL_OK;}
+
 static uint32_t
 cmd_clear_resource(CMD_ARG) {return SCTRL_OK;}
 
@@ -837,6 +837,10 @@ static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port, str
         //add by wenjian
         //give a value to pofsc_dev_conn_desc
         conn_desc_ptr->local_port_index=local_port_index;
+        /* The flood port sets exclude the port connecting to the Controller. */
+        HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
+            poflr_flood_rebuild(lr);
+        }
         /* Get the device id using the low 32bit of hardware address of local
          * port connecting to the Controller. */
         memcpy(&g_poflr_dev_id, hwaddr+2, POF_ETH_ALEN-2);
@@ -1102,6 +1106,8 @@ static uint32_t pofsc_destroy(struct pof_datapath *dp){
     HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
         poflr_ports_task_delete(lr);
     }
+    pofdp_worker_pool_destroy(dp);
+    pofdp_backend_close_all(dp);
 
     if(pofsc_send_q_id != POF_INVALID_QUEUEID){
         pofbf_queue_delete(&pofsc_send_q_id);
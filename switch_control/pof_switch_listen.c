@@ -228,6 +228,62 @@ listen_meters(LISTEN_ARG)
     return POF_OK;
 }
 
+/* Send the name of the hash map in a responseHead, then its stats. */
+static uint32_t
+listenHmapSend(int sockfd, const char *name, const struct hmap *map)
+{
+    struct responseHead resp[1] = {{0}};
+    struct hmapStats stats[1];
+
+    strncpy(resp->disc, name, POF_STRING_MAX_LEN - 1);
+    hmap_stats(map, stats);
+    if(send(sockfd, resp, sizeof(*resp), 0) <= 0 || \
+       send(sockfd, stats, sizeof(*stats), 0) <= 0){
+        return POF_ERROR;
+    }
+    return POF_OK;
+}
+
+static uint32_t
+listen_hmaps(LISTEN_ARG)
+{
+    struct tableInfo *table, *next;
+    struct pof_local_resource *lr, *lrNext;
+    char name[POF_STRING_MAX_LEN];
+    struct responseHead respSlots[1] = {
+        dp->slotNum, "slots"
+    };
+
+    if(listenHmapSend(sockfd, "slots", dp->slotMap) != POF_OK || \
+       send(sockfd, respSlots, sizeof(*respSlots), 0) <= 0){
+        return POF_ERROR;
+    }
+
+    HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
+        struct responseHead resp[1] = {
+            6 + lr->tableNum, "hmaps"
+        };
+
+        if(send(sockfd, resp, sizeof(*resp), 0) <= 0 || \
+           listenHmapSend(sockfd, "ports", lr->portPofIndexMap) != POF_OK || \
+           listenHmapSend(sockfd, "port names", lr->portNameMap) != POF_OK || \
+           listenHmapSend(sockfd, "tables", lr->tableIdMap) != POF_OK || \
+           listenHmapSend(sockfd, "groups", lr->groupMap) != POF_OK || \
+           listenHmapSend(sockfd, "meters", lr->meterMap) != POF_OK || \
+           listenHmapSend(sockfd, "counters", lr->counterMap) != POF_OK){
+            return POF_ERROR;
+        }
+
+        HMAP_NODES_IN_STRUCT_TRAVERSE(table, next, idNode, lr->tableIdMap){
+            snprintf(name, sizeof name, "table %d", table->id);
+            if(listenHmapSend(sockfd, name, table->entryMap) != POF_OK){
+                return POF_ERROR;
+            }
+        }
+    }
+    return POF_OK;
+}
+
 static uint32_t
 listen_counters(LISTEN_ARG)
 {
@@ -353,6 +409,17 @@ listen_delport(LISTEN_ARG)
 static uint32_t
 listen_test(LISTEN_ARG) {return POF_OK;}
 
+static uint32_t
+listen_lpm_bench(LISTEN_ARG) {return POF_OK;}
+static uint32_t
+listen_hash_bench(LISTEN_ARG) {return POF_OK;}
+
+static uint32_t
+listen_bit_bench(LISTEN_ARG) {return POF_OK;}
+
+static uint32_t
+listen_ins_bench(LISTEN_ARG) {return POF_OK;}
+
 static uint32_t
 listen_clear_resource(LISTEN_ARG) {return POF_OK;}
 